@@ -0,0 +1,119 @@
+#include "analysis.hpp"
+
+#include <string>
+#include <vector>
+
+#include "environment.hpp"
+
+// Extra cost of calling something other than a built-in procedure, e.g. a lambda
+const std::size_t CALL_COST = 16;
+
+// What the analysis knows about an expression
+struct Summary {
+	std::size_t cost;
+	bool pure;
+
+	// exp is a define of a pure expression, which a begin block can order by its dependencies
+	bool pureDefinition;
+};
+
+// Special forms that are not evaluated like a call of a procedure
+bool isSpecialFormNode(const Expression& exp) {
+	std::string op = exp.head().asSymbol();
+	return op == "begin" || op == "define" || op == "apply" || op == "map" || op == "reduce" ||
+		op == "fold" || op == "filter" || op == "sort-by" || op == "set-property" ||
+		op == "get-property" || op == "delay" || op == "force" || exp.isHeadListRoot() ||
+		exp.isHeadLambdaRoot();
+}
+
+// Cost and purity of exp itself, not counting its tail
+Summary summarizeNode(const Expression& exp) {
+
+	// definitions cannot shadow built-in procedures, so calling one is known to be cheap
+	static const Environment builtins;
+
+	std::string op = exp.head().asSymbol();
+	if (exp.isHeadLambdaRoot() || op == "delay") {
+
+		// the body is only evaluated when the lambda is called or the promise forced, in a scope
+		// of its own
+		return Summary{1, true, false};
+	} else if (op == "define" || op == "set-property" || op == "save-plot") {
+		return Summary{1, false, false};
+	} else if (op == "map" || op == "reduce" || op == "fold" || op == "filter" || op == "sort-by" ||
+		op == "continuous-plot" || op == "surface-plot" || op == "contour-plot") {
+		return Summary{PARALLEL_ARGUMENT_COST, true, false};
+	} else if (op == "apply" || op == "force") {
+		return Summary{CALL_COST, true, false};
+	} else if (exp.tailConstBegin() != exp.tailConstEnd() && !isSpecialFormNode(exp) &&
+		!builtins.is_proc(exp.head())) {
+		return Summary{CALL_COST, true, false};
+	}
+
+	return Summary{1, true, false};
+}
+
+Summary summarize(const Expression& exp) {
+	Summary result = summarizeNode(exp);
+	if (exp.isHeadLambdaRoot() || exp.head().asSymbol() == "delay") {
+		return result;
+	}
+
+	for (auto it = exp.tailConstBegin(); it != exp.tailConstEnd(); it++) {
+		Summary item = summarize(*it);
+		result.cost += item.cost;
+		result.pure = result.pure && item.pure;
+	}
+
+	return result;
+}
+
+// Summarize exp like summarize, marking exp and its subexpressions on the way
+Summary markNode(Expression& exp) {
+	Summary result = summarizeNode(exp);
+	if (exp.isHeadLambdaRoot() || exp.head().asSymbol() == "delay" ||
+		exp.tailConstBegin() == exp.tailConstEnd()) {
+		return result;
+	}
+
+	// the items of a begin block may also define symbols, evaluation follows their dependencies
+	bool begin = exp.head().asSymbol() == "begin";
+	bool pureTail = true;
+	bool independentTail = true;
+	std::size_t heavyItems = 0;
+	for (auto it = exp.tailBegin(); it != exp.tailEnd(); it++) {
+		Summary item = markNode(*it);
+		result.cost += item.cost;
+		result.pure = result.pure && item.pure;
+		pureTail = pureTail && item.pure;
+
+		bool independent = item.pure || (begin && item.pureDefinition);
+		independentTail = independentTail && independent;
+		if (independent && item.cost >= PARALLEL_ARGUMENT_COST) {
+			it->setEvalHints(it->evalHints() | Expression::HeavyHint);
+			heavyItems++;
+		}
+	}
+
+	result.pureDefinition = exp.head().asSymbol() == "define" && pureTail;
+
+	// only calls and lists evaluate their tail as independent arguments
+	bool call = exp.isHeadListRoot() || (exp.isHeadSymbol() && !isSpecialFormNode(exp));
+	if ((call || begin) && independentTail && heavyItems >= 2) {
+		exp.setEvalHints(exp.evalHints() | Expression::ParallelTailHint);
+	}
+
+	return result;
+}
+
+std::size_t estimateCost(const Expression& exp) {
+	return summarize(exp).cost;
+}
+
+bool isPure(const Expression& exp) {
+	return summarize(exp).pure;
+}
+
+void markParallelEvaluation(Expression& exp) {
+	markNode(exp);
+}
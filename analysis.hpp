@@ -0,0 +1,49 @@
+/*! \file analysis.hpp
+Purity and cost analysis of a parsed program.
+
+Arguments of a procedure call and elements of a list are evaluated in order by
+the tree walker. When they are pure (they cannot define or modify a symbol) the
+order is not observable, so arguments that are costly enough, e.g. two
+continuous-plots or maps over long lists, can be evaluated concurrently. The
+items of a begin block may also define symbols, they are evaluated concurrently
+as far as the symbols they use allow (see Expression::handle_begin). The
+analysis runs once after parsing and records its result as evaluation hints on
+the nodes of the AST (see Expression::EvalHint).
+ */
+#ifndef ANALYSIS_HPP
+#define ANALYSIS_HPP
+
+#include <cstddef>
+
+#include "expression.hpp"
+
+/// Estimated cost at or above which a pure argument is evaluated as a task of its own
+const std::size_t PARALLEL_ARGUMENT_COST = 1024;
+
+/*! Estimate the cost of evaluating an expression. Every node counts one, calls of
+	lambdas count more and map and the plots, which evaluate a lambda many times,
+	count PARALLEL_ARGUMENT_COST.
+	\param exp the expression
+	\return the estimated cost
+ */
+std::size_t estimateCost(const Expression& exp);
+
+/*! Determine if evaluating an expression can change the environment it is
+	evaluated in. Only define and set-property can, lambda bodies are evaluated in
+	a scope of their own and do not count. save-plot counts too, the files it
+	writes are written in order.
+	\param exp the expression
+	\return true if evaluating exp cannot change the environment
+ */
+bool isPure(const Expression& exp);
+
+/*! Mark the calls, lists and begin blocks of a program whose items can be
+	evaluated concurrently. A call or list is marked when its arguments are all
+	pure, a begin block when its items are all pure or define a symbol as a pure
+	expression. Either needs at least two items estimated to cost
+	PARALLEL_ARGUMENT_COST or more, those are marked heavy.
+	\param exp the program, modified in place
+ */
+void markParallelEvaluation(Expression& exp);
+
+#endif
@@ -0,0 +1,177 @@
+#include "catch.hpp"
+
+#include <chrono>
+#include <sstream>
+#include <string>
+
+#include "analysis.hpp"
+#include "interpreter.hpp"
+#include "parse.hpp"
+#include "semantic_error.hpp"
+
+Expression parseProgram(const std::string& program) {
+	std::istringstream iss(program);
+	Expression exp = parse(tokenize(iss));
+	REQUIRE(exp != Expression());
+	return exp;
+}
+
+Expression runProgram(const std::string& program) {
+	std::istringstream iss(program);
+	Interpreter interp;
+	REQUIRE(interp.parseStream(iss));
+	return interp.evaluate();
+}
+
+TEST_CASE("Test purity analysis", "[analysis]") {
+	REQUIRE(isPure(parseProgram("(+ 1 (* 2 x))")));
+	REQUIRE(isPure(parseProgram("(map (lambda (x) (begin (define y x) y)) (list 1 2))")));
+	REQUIRE(isPure(parseProgram("(f (g 1) (list a b))")));
+
+	REQUIRE(!isPure(parseProgram("(list (define a 1) 2)")));
+	REQUIRE(!isPure(parseProgram("(+ 1 (begin (define a 1) a))")));
+	REQUIRE(!isPure(parseProgram("(list (set-property \"a\" 1 x))")));
+}
+
+TEST_CASE("Test cost estimate", "[analysis]") {
+	REQUIRE(estimateCost(parseProgram("(+ 1 2)")) == 3);
+	REQUIRE(estimateCost(parseProgram("(f 1 2)")) > estimateCost(parseProgram("(+ 1 2)")));
+	REQUIRE(estimateCost(parseProgram("(map f (list 1 2))")) >= PARALLEL_ARGUMENT_COST);
+	REQUIRE(estimateCost(parseProgram("(continuous-plot f (list 0 1))")) >= PARALLEL_ARGUMENT_COST);
+}
+
+TEST_CASE("Test marking of parallel arguments", "[analysis]") {
+
+	// two heavy pure arguments
+	Expression exp = parseProgram("(list (map f (list 1 2)) (+ 1 2) (map g (list 3 4)))");
+	markParallelEvaluation(exp);
+	REQUIRE((exp.evalHints() & Expression::ParallelTailHint) != 0);
+	REQUIRE((exp.tailConstBegin()->evalHints() & Expression::HeavyHint) != 0);
+	REQUIRE(((exp.tailConstBegin() + 1)->evalHints() & Expression::HeavyHint) == 0);
+	REQUIRE(((exp.tailConstBegin() + 2)->evalHints() & Expression::HeavyHint) != 0);
+
+	// trivial arguments stay inline
+	exp = parseProgram("(+ (* 1 2) (f 3))");
+	markParallelEvaluation(exp);
+	REQUIRE(exp.evalHints() == 0);
+
+	// one heavy argument is not worth a task
+	exp = parseProgram("(list (map f (list 1 2)) 3)");
+	markParallelEvaluation(exp);
+	REQUIRE(exp.evalHints() == 0);
+
+	// an argument that defines a symbol orders its siblings
+	exp = parseProgram("(list (map f (list 1 2)) (begin (define a 1) (map f (list a))))");
+	markParallelEvaluation(exp);
+	REQUIRE(exp.evalHints() == 0);
+
+	// special forms other than list and begin do not evaluate their tail as arguments
+	exp = parseProgram("(set-property \"a\" (map f (list 1 2)) (map g (list 3 4)))");
+	markParallelEvaluation(exp);
+	REQUIRE(exp.evalHints() == 0);
+}
+
+TEST_CASE("Test parallel evaluation of arguments", "[analysis]") {
+	std::string define = "(begin (define f (lambda (x) (* x x))) (define n 100) ";
+
+	Expression result = runProgram(define +
+		"(list (map f (range 0 n 1)) (length (list 1 2)) (map (lambda (x) (- x)) (range 0 n 1))))");
+	REQUIRE(result.isHeadListRoot());
+	REQUIRE(std::distance(result.tailConstBegin(), result.tailConstEnd()) == 3);
+	REQUIRE(*(result.tailConstBegin() + 1) == Expression(Atom(2)));
+	REQUIRE(*(result.tailConstBegin()->tailConstBegin() + 10) == Expression(Atom(100)));
+	REQUIRE(*((result.tailConstBegin() + 2)->tailConstBegin() + 10) == Expression(Atom(-10)));
+
+	result = runProgram(define +
+		"(+ (apply + (map f (range 0 n 1))) (apply + (map f (range 0 n 1)))))");
+	REQUIRE(result == Expression(Atom(2 * 338350)));
+
+	// the error of the first failing argument is reported
+	try {
+		runProgram(define +
+			"(list (map f (range 0 n 1)) (map - (list \"a\")) (map (lambda (x) (f x x)) (list 1))))");
+		FAIL("expected a SemanticError");
+	} catch (const SemanticError& ex) {
+		REQUIRE(std::string(ex.what()) == "Error in call to negate: invalid argument.");
+	}
+}
+
+TEST_CASE("Test marking of begin blocks", "[analysis]") {
+	Expression exp = parseProgram(
+		"(begin (define f (lambda (x) x)) (define a (map f (list 1))) (define b (map f (list 2))))");
+	markParallelEvaluation(exp);
+	REQUIRE((exp.evalHints() & Expression::ParallelTailHint) != 0);
+
+	// a definition of an impure expression cannot be evaluated out of order
+	exp = parseProgram(
+		"(begin (define a (map f (list 1))) (define b (begin (define c 1) (map f (list c)))))");
+	markParallelEvaluation(exp);
+	REQUIRE(exp.evalHints() == 0);
+
+	// definitions outside a begin block are not independent arguments
+	exp = parseProgram("(list (define a (map f (list 1))) (define b (map f (list 2))))");
+	markParallelEvaluation(exp);
+	REQUIRE(exp.evalHints() == 0);
+}
+
+TEST_CASE("Test dependency ordered evaluation of begin blocks", "[analysis]") {
+
+	// f reads k where it is called, so the maps depend on k although f is defined first
+	Expression result = runProgram("(begin (define f (lambda (x) (* x k))) (define k 2) "
+		"(define a (map f (list 1 2 3))) (define b (map f (list 4))) (list a b))");
+	REQUIRE(result == runProgram("(list (list 2 4 6) (list 8))"));
+
+	// so does a lambda defined before the block
+	Interpreter outside;
+	std::istringstream lambda("(define g (lambda (x) (+ x k)))");
+	REQUIRE(outside.parseStream(lambda));
+	outside.evaluate();
+	std::istringstream block("(begin (define k 5) (define r1 (map g (list 1 2 3))) "
+		"(define r2 (map g (list 4 5 6))) (list r1 r2))");
+	REQUIRE(outside.parseStream(block));
+	REQUIRE(outside.evaluate() == runProgram("(list (list 6 7 8) (list 9 10 11))"));
+
+	// the definitions before the first failing item are kept, the later ones are not
+	Interpreter interp;
+	std::istringstream program("(begin (define f (lambda (x) x)) (define a (map f (list 1))) "
+		"(define b (map - (list \"x\"))) (define c (map f (list 2))))");
+	REQUIRE(interp.parseStream(program));
+	REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+
+	std::istringstream defined("(first a)");
+	REQUIRE(interp.parseStream(defined));
+	REQUIRE(interp.evaluate() == Expression(Atom(1)));
+
+	std::istringstream undefined("(c)");
+	REQUIRE(interp.parseStream(undefined));
+	REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+
+	// once an item has failed the later ones are cancelled, the error is raised without waiting
+	// for them
+	auto start = std::chrono::steady_clock::now();
+	REQUIRE_THROWS_AS(runProgram("(begin (define f (lambda (x) (+ x 1))) "
+		"(define a (map - (list \"x\"))) (define b (reduce + (map f (range 0 2000000 1)))) b)"),
+		SemanticError);
+	REQUIRE(std::chrono::steady_clock::now() - start < std::chrono::seconds(2));
+
+	// but the items before it still finish, and their definitions are kept
+	Interpreter slow;
+	std::istringstream slowProgram("(begin (define f (lambda (x) (+ x 1))) "
+		"(define a (reduce + (map f (range 0 20000 1)))) (define b (map - (list \"x\"))))");
+	REQUIRE(slow.parseStream(slowProgram));
+	REQUIRE_THROWS_AS(slow.evaluate(), SemanticError);
+
+	std::istringstream slowDefined("(+ a 0)");
+	REQUIRE(slow.parseStream(slowDefined));
+	REQUIRE(slow.evaluate() == Expression(200030001.));
+
+	// redefining a symbol fails like it does sequentially
+	try {
+		runProgram("(begin (define f (lambda (x) x)) (define a (map f (list 1))) "
+			"(define a (map f (list 2))))");
+		FAIL("expected a SemanticError");
+	} catch (const SemanticError& ex) {
+		REQUIRE(std::string(ex.what()) ==
+			"Error during evaluation: attempt to redefine a previously defined symbol");
+	}
+}
@@ -0,0 +1,108 @@
+#include "catch.hpp"
+
+#include <cmath>
+#include <sstream>
+#include <string>
+
+#include "environment.hpp"
+#include "parse.hpp"
+#include "semantic_error.hpp"
+#include "startup_image.hpp"
+
+// generated by add_plotscript_library from tests/aot_library.pls
+#include "aot_test_library.hpp"
+
+Expression evaluate(const std::string& program, Environment& env) {
+	std::istringstream iss(program);
+	TokenSequenceType tokens = tokenize(iss);
+	Expression exp = parse(tokens);
+	REQUIRE(exp != Expression());
+
+	return exp.eval(env);
+}
+
+TEST_CASE("Translated library matches the interpreter", "[aot]") {
+	Environment interpreted;
+	std::string error;
+	evaluateStartupFile(interpreted, AOT_TEST_LIBRARY, error);
+	REQUIRE(error == "");
+
+	Environment native;
+	register_aot_test_library(native);
+	REQUIRE(native.is_proc(Atom("hypot")));
+	REQUIRE(!interpreted.is_proc(Atom("hypot")));
+	REQUIRE(native.get_exp(Atom("half")) == interpreted.get_exp(Atom("half")));
+
+	// numbers without a C++ literal
+	REQUIRE(native.get_exp(Atom("huge")).head().asNumber() == HUGE_VAL);
+	REQUIRE(native.get_exp(Atom("negative-huge")).head().asNumber() == -HUGE_VAL);
+	REQUIRE(std::isnan(native.get_exp(Atom("undefined")).head().asNumber()));
+
+	std::vector<std::string> programs = {
+		"(square 3)",
+		"(square I)",
+		"(hypot 3 4)",
+		"(lerp 1 5 0.25)",
+		"(lerp I 1 0.5)",
+		"(poly -1.5)",
+		"(polar (+ 1 I))",
+		"(midpoint (list 0 0) (list 3 -4))",
+		"(label 1)",
+		"(map square (range 0 5 1))",
+		"(apply hypot (list 5 12))",
+	};
+
+	for (auto& program : programs) {
+		INFO(program);
+		REQUIRE(evaluate(program, native) == evaluate(program, interpreted));
+	}
+
+	INFO("the parameters outlive a lambda that grows the argument stack, called through first");
+	std::string wide = "(lambda (x) (max";
+	for (int i = 0; i < 50000; i++) {
+		wide += " x";
+	}
+
+	evaluate("(define wide " + wide + ")))", native);
+	REQUIRE(evaluate("(first-plus (map wide (range 1 2 1)) 10)", native) == Expression(11.));
+
+	INFO("errors are raised in the same places, operands are evaluated from the left");
+	std::vector<std::string> errors = {
+		"(square 1 2)",
+		"(hypot (list 1) 2)",
+		"(midpoint 1 2)",
+		"(sum-firsts 1 (list))",
+		"(sum-firsts (list) 1)",
+	};
+
+	auto errorOf = [](const std::string& program, Environment& env) {
+		try {
+			evaluate(program, env);
+		} catch (const SemanticError& ex) {
+			return std::string(ex.what());
+		}
+
+		FAIL("expected a SemanticError");
+		return std::string();
+	};
+
+	for (auto& program : errors) {
+		INFO(program);
+		REQUIRE(errorOf(program, native) == errorOf(program, interpreted));
+	}
+}
+
+TEST_CASE("Native procedures are layered and reset", "[aot]") {
+	Environment env;
+	register_aot_test_library(env);
+
+	REQUIRE_THROWS_AS(env.add_proc(Atom("square"), env.get_proc(Atom("+"))), SemanticError);
+	REQUIRE_THROWS_AS(env.add_exp(Atom("square"), Expression(1.0)), SemanticError);
+
+	Environment session(env.freeze());
+	REQUIRE(evaluate("(square 4)", session) == Expression(16.0));
+
+	env.reset();
+	REQUIRE(!env.is_known(Atom("square")));
+	REQUIRE(session.is_proc(Atom("square")));
+}
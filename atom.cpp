@@ -40,6 +40,10 @@ Atom::Atom(const std::string& value): Atom() {
 }
 
 void Atom::copy(const Atom& x) {
+	if (m_type == StringLiteralKind && x.m_type != StringLiteralKind) {
+		stringValue.~basic_string();
+	}
+
 	switch (x.m_type) {
 	case NoneKind:
 		m_type = NoneKind;
@@ -51,7 +55,8 @@ void Atom::copy(const Atom& x) {
 		setComplex(x.complexValue);
 		break;
 	case SymbolKind:
-		setSymbol(x.stringValue);
+		m_type = SymbolKind;
+		symbolValue = x.symbolValue;
 		break;
 	case StringLiteralKind:
 		setStringLiteral(x.stringValue);
@@ -73,8 +78,8 @@ Atom& Atom::operator=(const Atom& x) {
 
 Atom::~Atom() {
 
-	// we need to ensure the destructor of the symbol string is called
-	if (m_type == SymbolKind || m_type == StringLiteralKind) {
+	// we need to ensure the destructor of the string literal is called
+	if (m_type == StringLiteralKind) {
 		stringValue.~basic_string();
 	}
 }
@@ -123,19 +128,20 @@ void Atom::setComplex(complex value) {
 
 void Atom::setSymbol(const std::string& value) {
 
-	// we need to ensure the destructor of the symbol string is called
-	if (m_type == SymbolKind){
-		stringValue.~basic_string();
-	}
-
 	// Check if there are quotes (only) surrounding the value - this makes it a string literal
 	if (value.front() == '"' && value.find('"', 1) == value.length() - 1) {
 
 		// set as a string literal without the quotes
 		setStringLiteral(value.substr(1, value.find_last_of('"') - 1));
 	} else {
+
+		// we need to ensure the destructor of a string literal is called
+		if (m_type == StringLiteralKind) {
+			stringValue.~basic_string();
+		}
+
 		m_type = SymbolKind;
-		new (&stringValue) std::string(value);
+		symbolValue = internSymbol(value);
 	}
 }
 
@@ -168,7 +174,9 @@ std::string Atom::asSymbol(bool noQuotes) const noexcept {
 	std::string result;
 
 	// Just get the string value for symbol kinds and string literals with no quotes
-	if (m_type == SymbolKind || (m_type == StringLiteralKind && noQuotes)){
+	if (m_type == SymbolKind) {
+		return *symbolValue;
+	} else if (m_type == StringLiteralKind && noQuotes) {
 		return stringValue;
 	} else if (m_type == StringLiteralKind) {
 
@@ -179,6 +187,10 @@ std::string Atom::asSymbol(bool noQuotes) const noexcept {
 	return result;
 }
 
+Symbol Atom::symbol() const noexcept {
+	return (m_type == SymbolKind) ? symbolValue : nullptr;
+}
+
 bool Atom::operator==(const Atom& right) const noexcept {
 	if (m_type != right.m_type) {
 		return false;
@@ -205,7 +217,7 @@ bool Atom::operator==(const Atom& right) const noexcept {
 	case ComplexKind:
 		return complexValue == right.complexValue;
 	case SymbolKind:
-		return stringValue == right.stringValue;
+		return symbolValue == right.symbolValue;
 	case StringLiteralKind:
 		return stringValue == right.stringValue;
 	}
@@ -4,6 +4,7 @@ Defines the Atom type and associated functions.
 #ifndef ATOM_HPP
 #define ATOM_HPP
 
+#include "symbol_map.hpp"
 #include "token.hpp"
 
 // abstracts our complex number type
@@ -67,6 +68,9 @@ public:
 	/// value of Atom as a string, returns empty-string if not a Symbol
 	std::string asSymbol(bool noQuotes = false) const noexcept;
 
+	/// the interned Symbol of a Symbol Atom, nullptr for the other types
+	Symbol symbol() const noexcept;
+
 	/// equality comparison based on type and value
 	bool operator==(const Atom& right) const noexcept;
 
@@ -80,11 +84,14 @@ private:
 	Type m_type;
 
 	// values for the known types. Note the use of a union requires care
-	// when setting non POD values (see setSymbol)
+	// when setting non POD values (see setStringLiteral). Symbols are interned when
+	// the Atom is made, usually by the parser, so comparing and looking them up does
+	// not read their characters
 	union {
 		double numberValue;
 		std::string stringValue;
 		complex complexValue;
+		Symbol symbolValue;
 	};
 
 	// Helper function for copy construct and copy assignment
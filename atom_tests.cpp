@@ -85,6 +85,12 @@ TEST_CASE("Test constructors", "[atom]") {
 		REQUIRE(!a.isComplex());
 		REQUIRE(a.isSymbol());
 		REQUIRE(!a.isStringLiteral());
+
+		// the symbol is interned when the Atom is made, copies share it
+		REQUIRE(a.symbol() == internSymbol("hi"));
+		REQUIRE(Atom(a).symbol() == a.symbol());
+		REQUIRE(Atom("\"hi\"").symbol() == nullptr);
+		REQUIRE(Atom(1.0).symbol() == nullptr);
 	}
 
 	{
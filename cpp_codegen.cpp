@@ -0,0 +1,70 @@
+#include "cpp_codegen.hpp"
+
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+
+// Quote and escape a string as a C++ string literal
+std::string cppString(const std::string& str) {
+	std::string result = "\"";
+	for (char c : str) {
+		switch (c) {
+		case '"':
+			result += "\\\"";
+			break;
+		case '\\':
+			result += "\\\\";
+			break;
+		case '\n':
+			result += "\\n";
+			break;
+		case '\t':
+			result += "\\t";
+			break;
+		default:
+			result += c;
+		}
+	}
+
+	return result + "\"";
+}
+
+// Seventeen significant digits round-trip every finite double exactly, infinities and NaN
+// have no literal
+std::string cppDouble(double value) {
+	if (std::isnan(value)) {
+		return "std::numeric_limits<double>::quiet_NaN()";
+	} else if (std::isinf(value)) {
+		return std::string(value < 0 ? "-" : "") + "std::numeric_limits<double>::infinity()";
+	}
+
+	char buffer[32];
+	std::snprintf(buffer, sizeof(buffer), "%.17g", value);
+	return buffer;
+}
+
+// C++ expression constructing an Atom equal to atom
+std::string cppAtom(const Atom& atom) {
+	if (atom.isNumber()) {
+		return "Atom(" + cppDouble(atom.asNumber()) + ")";
+	} else if (atom.isComplex()) {
+		return "Atom(complex(" + cppDouble(atom.asComplex().real()) + ", " +
+			cppDouble(atom.asComplex().imag()) + "))";
+	} else if (atom.isSymbol() || atom.isStringLiteral()) {
+
+		// string literals keep their quotes, which is how the Atom constructor tells them apart
+		return "Atom(std::string(" + cppString(atom.asSymbol()) + "))";
+	}
+
+	return "Atom()";
+}
+
+// Symbol characters that are not valid in an identifier are replaced by an underscore
+std::string cppIdentifier(const std::string& symbol) {
+	std::string result;
+	for (char c : symbol) {
+		result += std::isalnum(static_cast<unsigned char>(c)) ? c : '_';
+	}
+
+	return result;
+}
@@ -0,0 +1,21 @@
+#ifndef CPP_CODEGEN_HPP
+#define CPP_CODEGEN_HPP
+// Helpers for the build tools that write plotscript values as C++ source
+
+#include <string>
+
+#include "atom.hpp"
+
+// Quote and escape a string as a C++ string literal
+std::string cppString(const std::string& str);
+
+// Write a double as a C++ literal that converts back to exactly the same value
+std::string cppDouble(double value);
+
+// C++ expression constructing an Atom equal to atom
+std::string cppAtom(const Atom& atom);
+
+// Turn a plotscript symbol into a valid C++ identifier, e.g. make-point becomes make_point
+std::string cppIdentifier(const std::string& symbol);
+
+#endif
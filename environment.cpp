@@ -1,143 +1,173 @@
 #include "environment.hpp"
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <cstdint>
+#include <functional>
 
 #include "environment.hpp"
+#include "parallel_sort.hpp"
 #include "semantic_error.hpp"
+#include "sequence.hpp"
 
 /***********************************************************************
 Helper Functions
 **********************************************************************/
 
 // predicate, the number of args is nargs
-bool nargs_equal(const std::vector<Expression>& args, unsigned nargs) {
+bool nargs_equal(Arguments args, unsigned nargs) {
 	return args.size() == nargs;
 }
 
+// the kinds of argument lists an arithmetic procedure can be called with
+enum NumericArguments {RealArguments, ComplexArguments, InvalidArguments};
+
+// Classify the arguments to an arithmetic procedure in a single pass. Calls where every argument
+// is a real number can then run plain double math, only calls with a complex argument pay for
+// complex arithmetic
+NumericArguments scanNumericArguments(Arguments args) {
+	NumericArguments kind = RealArguments;
+	for (auto& a : args) {
+		if (a.isHeadComplex()) {
+			kind = ComplexArguments;
+		} else if (!a.isHeadNumber()) {
+			return InvalidArguments;
+		}
+	}
+
+	return kind;
+}
+
 /***********************************************************************
 Each of the functions below have the signature that corresponds to the
 typedef'd Procedure function pointer.
 **********************************************************************/
 
 // the default procedure always returns an expresison of type None
-Expression default_proc(const std::vector<Expression>& args) {
+Expression default_proc(Arguments args) {
 
 	// make compiler happy we used this parameter
 	args.size();
 	return Expression();
 };
 
-Expression add(const std::vector<Expression>& args) {
+Expression add(Arguments args) {
+	switch (scanNumericArguments(args)) {
+	case RealArguments:
+		{
+			double result = 0;
+			for (auto& a : args) {
+				result += a.head().asNumber();
+			}
 
-	// check all aruments are numbers or complex, while adding
-	// I set the result to be complex and return the real value if no complex
-	// numbers were in the expressions
-	complex result = complex(0, 0);
-	bool isComplexProcedure = false;
+			return Expression(result);
+		}
+	case ComplexArguments:
+		{
+			// real arguments are still added as doubles so mixed sums round the same way
+			complex result = complex(0, 0);
+			for (auto& a : args) {
+				if (a.isHeadNumber()) {
+					result += a.head().asNumber();
+				} else {
+					result += a.head().asComplex();
+				}
+			}
 
-	for (auto& a : args) {
-		if (a.isHeadNumber()) {
-			result += a.head().asNumber();
-		} else if (a.isHeadComplex()) {
-			isComplexProcedure = true;
-			result += a.head().asComplex();
-		} else {
-			throw SemanticError("Error in call to add, argument not a (complex) number");
+			return Expression(result);
 		}
+	default:
+		throw SemanticError("Error in call to add, argument not a (complex) number");
 	}
-
-	return (isComplexProcedure) ? Expression(result) : Expression(result.real());
 };
 
-Expression mul(const std::vector<Expression>& args) {
+Expression mul(Arguments args) {
+	switch (scanNumericArguments(args)) {
+	case RealArguments:
+		{
+			double result = 1;
+			for (auto& a : args) {
+				result *= a.head().asNumber();
+			}
 
-	// The complex result needs to be initialized to (1, 0) for normal multiplication
-	// to occur. The complex number class will handle incorperating complex numbers.
-	complex result = complex(1, 0);
-	bool isComplexProcedure = false;
+			return Expression(result);
+		}
+	case ComplexArguments:
+		{
+			// The complex result needs to be initialized to (1, 0) for normal multiplication to occur.
+			// Real arguments scale the result instead of going through a full complex multiply
+			complex result = complex(1, 0);
+			for (auto& a : args) {
+				if (a.isHeadNumber()) {
+					result *= a.head().asNumber();
+				} else {
+					result *= a.head().asComplex();
+				}
+			}
 
-	for (auto& a : args) {
-		if (a.isHeadNumber()) {
-			result *= a.head().asNumber();
-		} else if (a.isHeadComplex()) {
-			isComplexProcedure = true;
-			result *= a.head().asComplex();
-		} else{
-			throw SemanticError("Error in call to mul, argument not a number");
+			return Expression(result);
 		}
+	default:
+		throw SemanticError("Error in call to mul, argument not a number");
 	}
-
-	return (isComplexProcedure) ? Expression(result) : Expression(result.real());
 };
 
-Expression subneg(const std::vector<Expression>& args) {
-	complex result;
-	bool isComplexProcedure = false;
+Expression subneg(Arguments args) {
 
 	// If there is just one argument, we want to return the negative of that number
 	if (nargs_equal(args, 1)) {
 		if (args[0].isHeadNumber()) {
-			result = -args[0].head().asNumber();
+			return Expression(-args[0].head().asNumber());
 		} else if(args[0].isHeadComplex()) {
-			isComplexProcedure = true;
-			result = -args[0].head().asComplex();
-		} else {
-			throw SemanticError("Error in call to negate: invalid argument.");
+			return Expression(-args[0].head().asComplex());
 		}
+
+		throw SemanticError("Error in call to negate: invalid argument.");
 	} else if (nargs_equal(args, 2)) {
 
 		// Either both are numbers, one or both are complex, or niether are numbers or complex
 		if (args[0].isHeadNumber() && args[1].isHeadNumber()) {
-			result = args[0].head().asNumber() - args[1].head().asNumber();
+			return Expression(args[0].head().asNumber() - args[1].head().asNumber());
 		} else if (args[0].isHeadComplex() || args[1].isHeadComplex()) {
-			isComplexProcedure = true;
 
 			// when either number is complex, we can retrieve the atom as complex
-			result = args[0].head().asComplex() - args[1].head().asComplex();
-		} else {
-			throw SemanticError("Error in call to subtraction: invalid argument.");
+			return Expression(args[0].head().asComplex() - args[1].head().asComplex());
 		}
-	} else {
-		throw SemanticError("Error in call to subtraction or negation: invalid number of arguments.");
+
+		throw SemanticError("Error in call to subtraction: invalid argument.");
 	}
 
-	return (isComplexProcedure) ? Expression(result) : Expression(result.real());
+	throw SemanticError("Error in call to subtraction or negation: invalid number of arguments.");
 };
 
-Expression div(const std::vector<Expression>& args) {
-	complex result;
-	bool isComplexProcedure = false;
+Expression div(Arguments args) {
 
 	// If there is just one argument, we want to return the inverse of that number
 	if (nargs_equal(args, 1)) {
 		if (args[0].isHeadNumber()) {
-			result = 1 / args[0].head().asNumber();
+			return Expression(1 / args[0].head().asNumber());
 		} else if(args[0].isHeadComplex()) {
-			isComplexProcedure = true;
-			result = complex(1, 0) / args[0].head().asComplex();
-		} else {
-			throw SemanticError("Error in call to division: invalid argument.");
+			return Expression(complex(1, 0) / args[0].head().asComplex());
 		}
+
+		throw SemanticError("Error in call to division: invalid argument.");
 	} else if (nargs_equal(args, 2)) {
 		if (args[0].isHeadNumber() && args[1].isHeadNumber()) {
-			result = args[0].head().asNumber() / args[1].head().asNumber();
+			return Expression(args[0].head().asNumber() / args[1].head().asNumber());
 		} else if (args[0].isHeadComplex() || args[1].isHeadComplex()) {
-			isComplexProcedure = true;
 
 			// When either argument is complex, this becomes a complex operation
-			result = args[0].head().asComplex() / args[1].head().asComplex();
-		} else {
-			throw SemanticError("Error in call to division: invalid argument.");
+			return Expression(args[0].head().asComplex() / args[1].head().asComplex());
 		}
-	} else {
-		throw SemanticError("Error in call to division: invalid number of arguments.");
+
+		throw SemanticError("Error in call to division: invalid argument.");
 	}
 
-	return (isComplexProcedure) ? Expression(result) : Expression(result.real());
+	throw SemanticError("Error in call to division: invalid number of arguments.");
 };
 
-Expression sqrt(const std::vector<Expression>& args) {
+Expression sqrt(Arguments args) {
 	complex result;
 	bool isComplexProcedure = false;
 
@@ -162,7 +192,7 @@ Expression sqrt(const std::vector<Expression>& args) {
 	return (isComplexProcedure) ? Expression(result) : Expression(result.real());
 }
 
-Expression pow(const std::vector<Expression>& args) {
+Expression pow(Arguments args) {
 	complex result;
 	bool isComplexProcedure = false;
 
@@ -184,7 +214,7 @@ Expression pow(const std::vector<Expression>& args) {
 	return (isComplexProcedure) ? Expression(result) : Expression(result.real());
 }
 
-Expression ln(const std::vector<Expression>& args) {
+Expression ln(Arguments args) {
 	double result = 0;
 
 	// ln takes one argument
@@ -210,7 +240,7 @@ Expression ln(const std::vector<Expression>& args) {
 	return Expression(result);
 }
 
-Expression sin(const std::vector<Expression>& args) {
+Expression sin(Arguments args) {
 	double result = 0;
 
 	// sin takes one argument
@@ -227,7 +257,7 @@ Expression sin(const std::vector<Expression>& args) {
 	return Expression(result);
 }
 
-Expression cos(const std::vector<Expression>& args) {
+Expression cos(Arguments args) {
 	double result = 0;
 
 	// cos takes one argument
@@ -244,7 +274,7 @@ Expression cos(const std::vector<Expression>& args) {
 	return Expression(result);
 }
 
-Expression tan(const std::vector<Expression>& args) {
+Expression tan(Arguments args) {
 	double result = 0;
 
 	// tan takes one argument
@@ -261,7 +291,7 @@ Expression tan(const std::vector<Expression>& args) {
 	return Expression(result);
 }
 
-Expression real(const std::vector<Expression>& args) {
+Expression real(Arguments args) {
 	double result = 0;
 
 	if (nargs_equal(args, 1)) {
@@ -277,7 +307,7 @@ Expression real(const std::vector<Expression>& args) {
 	return Expression(result);
 }
 
-Expression imag(const std::vector<Expression>& args) {
+Expression imag(Arguments args) {
 	double result = 0;
 
 	if (nargs_equal(args, 1)) {
@@ -293,7 +323,7 @@ Expression imag(const std::vector<Expression>& args) {
 	return Expression(result);
 }
 
-Expression mag(const std::vector<Expression>& args) {
+Expression mag(Arguments args) {
 	double result = 0;
 
 	if (nargs_equal(args, 1)) {
@@ -309,7 +339,7 @@ Expression mag(const std::vector<Expression>& args) {
 	return Expression(result);
 }
 
-Expression arg(const std::vector<Expression>& args) {
+Expression arg(Arguments args) {
 	double result = 0;
 
 	if (nargs_equal(args, 1)) {
@@ -325,7 +355,7 @@ Expression arg(const std::vector<Expression>& args) {
 	return Expression(result);
 }
 
-Expression conj(const std::vector<Expression>& args) {
+Expression conj(Arguments args) {
 	complex result = 0;
 
 	if (nargs_equal(args, 1)) {
@@ -341,10 +371,73 @@ Expression conj(const std::vector<Expression>& args) {
 	return Expression(result);
 }
 
+// min and max of real numbers, taking any number of arguments like add and mul
+Expression min(Arguments args) {
+	if (args.empty()) {
+		throw SemanticError("Error in call to min: invalid number of arguments.");
+	} else if (scanNumericArguments(args) != RealArguments) {
+		throw SemanticError("Error in call to min: invalid argument.");
+	}
+
+	double result = args[0].head().asNumber();
+	for (auto& a : args) {
+		result = std::min(result, a.head().asNumber());
+	}
+
+	return Expression(result);
+}
+
+Expression max(Arguments args) {
+	if (args.empty()) {
+		throw SemanticError("Error in call to max: invalid number of arguments.");
+	} else if (scanNumericArguments(args) != RealArguments) {
+		throw SemanticError("Error in call to max: invalid argument.");
+	}
+
+	double result = args[0].head().asNumber();
+	for (auto& a : args) {
+		result = std::max(result, a.head().asNumber());
+	}
+
+	return Expression(result);
+}
+
+// Comparisons of two real numbers, returning 1 if they hold and 0 otherwise, e.g. for the
+// predicate of filter
+template<typename Compare>
+Expression compareNumbers(Arguments args, const std::string& name, Compare compare) {
+	if (!nargs_equal(args, 2)) {
+		throw SemanticError("Error in call to " + name + ": invalid number of arguments.");
+	} else if (!args[0].isHeadNumber() || !args[1].isHeadNumber()) {
+		throw SemanticError("Error in call to " + name + ": invalid argument.");
+	}
+
+	return Expression(compare(args[0].head().asNumber(), args[1].head().asNumber()) ? 1. : 0.);
+}
+
+Expression less(Arguments args) {
+	return compareNumbers(args, "<", std::less<double>());
+}
+
+Expression greater(Arguments args) {
+	return compareNumbers(args, ">", std::greater<double>());
+}
+
+Expression equal(Arguments args) {
+	return compareNumbers(args, "=", std::equal_to<double>());
+}
+
 // ******** List related functions ********
-Expression first(const std::vector<Expression>& args) {
+Expression first(Arguments args) {
 	if (nargs_equal(args, 1)) {
-		if (args[0].isHeadListRoot()) {
+		if (args[0].isHeadSequence()) {
+			Expression element;
+			if (elementCursor(args[0])->next(element)) {
+				return element;
+			}
+
+			throw SemanticError("Error: argument to first is an empty list");
+		} else if (args[0].isHeadListRoot()) {
 			if (args[0].tailConstBegin() != args[0].tailConstEnd()) {
 				return Expression(*args[0].tailConstBegin());
 			}
@@ -361,9 +454,20 @@ Expression first(const std::vector<Expression>& args) {
 	throw SemanticError("Error: more than one argument in call to first");
 }
 
-Expression rest(const std::vector<Expression>& args) {
+Expression rest(Arguments args) {
 	if (nargs_equal(args, 1)) {
-		if (args[0].isHeadListRoot()) {
+		if (args[0].isHeadSequence()) {
+
+			// reading the first element may call a lambda, which can grow the argument stack args
+			// points into, so the sequence is copied out of it first
+			Expression seq = args[0];
+			Expression element;
+			if (elementCursor(seq)->next(element)) {
+				return makeDrop(seq, 1);
+			}
+
+			throw SemanticError("Error: argument to rest is an empty list");
+		} else if (args[0].isHeadListRoot()) {
 			std::vector<Expression>::const_iterator cbegin = args[0].tailConstBegin();
 			std::vector<Expression>::const_iterator cend = args[0].tailConstEnd();
 			if (cbegin != cend) {
@@ -383,9 +487,14 @@ Expression rest(const std::vector<Expression>& args) {
 	throw SemanticError("Error: more than one argument in call to rest");
 }
 
-Expression length(const std::vector<Expression>& args) {
+Expression length(Arguments args) {
 	if (nargs_equal(args, 1)) {
-		if (args[0].isHeadListRoot()) {
+
+		// the elements of a sequence are counted without storing them, a map is as long as the
+		// sequence it maps
+		if (args[0].isHeadSequence()) {
+			return Expression(static_cast<double>(elementCount(args[0])));
+		} else if (args[0].isHeadListRoot()) {
 			std::vector<Expression>::const_iterator cbegin = args[0].tailConstBegin();
 			std::vector<Expression>::const_iterator cend = args[0].tailConstEnd();
 			return Expression(std::distance(cbegin, cend));
@@ -399,15 +508,19 @@ Expression length(const std::vector<Expression>& args) {
 	throw SemanticError("Error: more than one argument in call to length");
 }
 
-Expression append(const std::vector<Expression>& args) {
+Expression append(Arguments args) {
 	if (nargs_equal(args, 2)) {
-		if (args[0].isHeadListRoot()) {
-			std::vector<Expression>::const_iterator cbegin = args[0].tailConstBegin();
-			std::vector<Expression>::const_iterator cend = args[0].tailConstEnd();
+
+		// like rest, the element is copied out of args before forcing the list can call a lambda
+		Expression element = args[1];
+		Expression list = forceSequence(args[0]);
+		if (list.isHeadListRoot()) {
+			std::vector<Expression>::const_iterator cbegin = list.tailConstBegin();
+			std::vector<Expression>::const_iterator cend = list.tailConstEnd();
 
 			// Copy the list and add the second argument to the new list
 			std::vector<Expression> result(cbegin, cend);
-			result.push_back(args[1]);
+			result.push_back(element);
 			return Expression(result);
 		}
 
@@ -419,9 +532,13 @@ Expression append(const std::vector<Expression>& args) {
 	throw SemanticError("Error: wrong number of arguments for append which takes two arguments");
 }
 
-Expression join(const std::vector<Expression>& args) {
+Expression join(Arguments args) {
 	if (nargs_equal(args, 2)) {
-		if (args[0].isHeadListRoot() && args[1].isHeadListRoot()) {
+		bool sequences = args[0].isHeadSequence() || args[1].isHeadSequence();
+		if (sequences && (args[0].isHeadListRoot() || args[0].isHeadSequence()) &&
+			(args[1].isHeadListRoot() || args[1].isHeadSequence())) {
+			return makeJoin(args[0], args[1]);
+		} else if (args[0].isHeadListRoot() && args[1].isHeadListRoot()) {
 
 			// Iterators for first list
 			std::vector<Expression>::const_iterator cbegin1 = args[0].tailConstBegin();
@@ -450,7 +567,7 @@ Expression join(const std::vector<Expression>& args) {
 	throw SemanticError("Error: wrong number of arguments for join which takes two arguments");
 }
 
-Expression range(const std::vector<Expression>& args) {
+Expression range(Arguments args) {
 	if (nargs_equal(args, 3)) {
 		if (args[0].isHeadNumber() && args[1].isHeadNumber() && args[2].isHeadNumber()) {
 			if (args[1].head().asNumber() > args[0].head().asNumber()) {
@@ -459,16 +576,8 @@ Expression range(const std::vector<Expression>& args) {
 					double end = args[1].head().asNumber();
 					double step = args[2].head().asNumber();
 
-					// pre-allocate memory into the results vector
-					std::vector<Expression> result;
-					result.reserve(((end - begin) / step));
-
-					// Actually perform the count and save to result
-					for (double i = begin; i <= end; i = i + step) {
-						result.push_back(Expression(i));
-					}
-
-					return Expression(result);
+					// the numbers are produced when they are read
+					return makeRange(begin, end, step);
 				}
 
 				// The step argument is not positive
@@ -487,165 +596,453 @@ Expression range(const std::vector<Expression>& args) {
 	throw SemanticError("Error: wrong number of arguments for range which takes three arguments");
 }
 
-const double PI = std::atan2(0, -1);
-const double EXP = std::exp(1);
-const complex I = complex(0, 1);
+// Helper for take and drop, which take a list or sequence and a count
+std::size_t countArgument(Arguments args, const std::string& name) {
+	if (!nargs_equal(args, 2)) {
+		throw SemanticError("Error: wrong number of arguments for " + name +
+			" which takes two arguments");
+	} else if (!args[0].isHeadListRoot() && !args[0].isHeadSequence()) {
+		throw SemanticError("Error: first argument to " + name + " is not a list");
+	}
+
+	double count = args[1].isHeadNumber() ? args[1].head().asNumber() : -1;
+	if (count < 0 || count != std::floor(count)) {
+		throw SemanticError("Error: second argument to " + name + " is not a non-negative integer");
+	}
 
-Environment::Environment() {
-	reset();
+	return static_cast<std::size_t>(count);
 }
 
-bool Environment::is_known(const Atom& sym) const {
-	if (!sym.isSymbol()) {
-		return false;
+// The first elements of a list, or a sequence of the first elements of a sequence
+Expression take(Arguments args) {
+	std::size_t count = countArgument(args, "take");
+	if (args[0].isHeadSequence()) {
+		return makeTake(args[0], count);
 	}
 
-	return envmap.find(sym.asSymbol()) != envmap.end();
+	auto begin = args[0].tailConstBegin();
+	auto end = args[0].tailConstEnd();
+	std::size_t size = std::distance(begin, end);
+	return Expression(std::vector<Expression>(begin, begin + std::min(count, size)));
 }
 
-bool Environment::is_exp(const Atom& sym) const {
-	if(!sym.isSymbol()) {
-		return false;
+// A list without its first elements, or a sequence of the later elements of a sequence
+Expression drop(Arguments args) {
+	std::size_t count = countArgument(args, "drop");
+	if (args[0].isHeadSequence()) {
+		return makeDrop(args[0], count);
 	}
 
-	auto result = envmap.find(sym.asSymbol());
-	return (result != envmap.end()) && (result->second.type == ExpressionType);
+	auto begin = args[0].tailConstBegin();
+	auto end = args[0].tailConstEnd();
+	std::size_t size = std::distance(begin, end);
+	return Expression(std::vector<Expression>(begin + std::min(count, size), end));
 }
 
-Expression Environment::get_exp(const Atom& sym) const {
-	Expression exp;
+// The numbers of a list or sequence in ascending order, NaN last. They are sorted as a packed array
+// of doubles, in parallel for long lists
+Expression sort(Arguments args) {
+	if (!nargs_equal(args, 1)) {
+		throw SemanticError("Error: wrong number of arguments for sort which takes one argument");
+	}
+
+	Expression list = forceSequence(args[0]);
+	if (!list.isHeadListRoot()) {
+		throw SemanticError("Error: argument to sort is not a list");
+	}
 
-	if (sym.isSymbol()) {
-		auto result = envmap.find(sym.asSymbol());
-		if (result != envmap.end() && result->second.type == ExpressionType) {
-			exp = result->second.exp;
+	std::vector<double> numbers;
+	numbers.reserve(std::distance(list.tailConstBegin(), list.tailConstEnd()));
+	for (auto it = list.tailConstBegin(); it != list.tailConstEnd(); it++) {
+		if (!it->isHeadNumber()) {
+			throw SemanticError("Error: argument to sort is not a list of real numbers");
 		}
+
+		numbers.push_back(it->head().asNumber());
 	}
 
-	return exp;
+	parallelStableSort(numbers, numberBefore);
+
+	std::vector<Expression> result;
+	result.reserve(numbers.size());
+	for (double number : numbers) {
+		result.push_back(Expression(number));
+	}
+
+	return Expression(result);
 }
 
-Expression* Environment::get_exp_ptr(const Atom& sym) {
-	if (sym.isSymbol()) {
-		auto result = envmap.find(sym.asSymbol());
-		if (result != envmap.end() && result->second.type == ExpressionType) {
-			return &result->second.exp;
-		}
+/***********************************************************************
+Built-in table
+
+The built-in procedures and constants are stored in a constant table. A
+perfect hash for their names is found at compile time: the seed is searched
+until every name lands in its own slot of BUILTIN_SLOTS, so a lookup is one
+hash of the name and one string comparison. Adding a builtin only requires a
+new row in builtins, the compiler finds a new seed if needed.
+**********************************************************************/
+
+// the kind of value a built-in symbol maps to
+enum BuiltinKind {BuiltinProcedure, BuiltinNumber, BuiltinComplex};
+
+struct Builtin {
+	const char* name;
+	BuiltinKind kind;
+	Procedure proc; // used when kind is BuiltinProcedure
+	double real, imag; // used when kind is BuiltinNumber or BuiltinComplex
+};
+
+constexpr Builtin builtins[] = {
+
+	// Built-In value of pi, atan2(0, -1)
+	{"pi", BuiltinNumber, nullptr, 3.141592653589793, 0},
+
+	// Built_In value of euler's number, exp(1)
+	{"e", BuiltinNumber, nullptr, 2.718281828459045, 0},
+
+	// Built_In value of the imaginary number
+	{"I", BuiltinComplex, nullptr, 0, 1},
+
+	{"+", BuiltinProcedure, add, 0, 0},
+	{"-", BuiltinProcedure, subneg, 0, 0},
+	{"*", BuiltinProcedure, mul, 0, 0},
+	{"/", BuiltinProcedure, div, 0, 0},
+	{"sqrt", BuiltinProcedure, sqrt, 0, 0},
+	{"^", BuiltinProcedure, pow, 0, 0},
+	{"ln", BuiltinProcedure, ln, 0, 0},
+	{"sin", BuiltinProcedure, sin, 0, 0},
+	{"cos", BuiltinProcedure, cos, 0, 0},
+	{"tan", BuiltinProcedure, tan, 0, 0},
+	{"real", BuiltinProcedure, real, 0, 0},
+	{"imag", BuiltinProcedure, imag, 0, 0},
+	{"mag", BuiltinProcedure, mag, 0, 0},
+	{"arg", BuiltinProcedure, arg, 0, 0},
+	{"conj", BuiltinProcedure, conj, 0, 0},
+	{"min", BuiltinProcedure, min, 0, 0},
+	{"max", BuiltinProcedure, max, 0, 0},
+	{"<", BuiltinProcedure, less, 0, 0},
+	{">", BuiltinProcedure, greater, 0, 0},
+	{"=", BuiltinProcedure, equal, 0, 0},
+	{"first", BuiltinProcedure, first, 0, 0},
+	{"rest", BuiltinProcedure, rest, 0, 0},
+	{"length", BuiltinProcedure, length, 0, 0},
+	{"append", BuiltinProcedure, append, 0, 0},
+	{"join", BuiltinProcedure, join, 0, 0},
+	{"range", BuiltinProcedure, range, 0, 0},
+	{"take", BuiltinProcedure, take, 0, 0},
+	{"drop", BuiltinProcedure, drop, 0, 0},
+	{"sort", BuiltinProcedure, sort, 0, 0}
+};
+
+constexpr std::size_t NUM_BUILTINS = sizeof(builtins) / sizeof(builtins[0]);
+constexpr std::size_t BUILTIN_SLOTS = 256;
+static_assert(NUM_BUILTINS < 255, "slot table entries are stored in an unsigned char");
+
+// FNV-1a over the name, with the seed mixed into the offset basis
+constexpr std::uint32_t FNV_PRIME = 16777619u;
+constexpr std::uint32_t FNV_OFFSET = 2166136261u;
+
+constexpr std::uint32_t hashName(const char* s, std::uint32_t h) {
+	return (*s == '\0') ? h :
+		hashName(s + 1, (h ^ static_cast<unsigned char>(*s)) * FNV_PRIME);
+}
+
+constexpr std::size_t slotFromHash(std::uint32_t h) {
+	return (h ^ (h >> 16)) & (BUILTIN_SLOTS - 1);
+}
+
+constexpr std::size_t slotOf(const char* name, std::uint32_t seed) {
+	return slotFromHash(hashName(name, FNV_OFFSET ^ (seed * 0x9E3779B9u)));
+}
+
+// true if builtin i does not share a slot with any builtin from j on
+constexpr bool slotUnique(std::size_t i, std::size_t j, std::uint32_t seed) {
+	return (j == NUM_BUILTINS) ? true :
+		(slotOf(builtins[i].name, seed) != slotOf(builtins[j].name, seed) &&
+			slotUnique(i, j + 1, seed));
+}
+
+constexpr bool isPerfectSeed(std::uint32_t seed, std::size_t i = 0) {
+	return (i == NUM_BUILTINS) ? true :
+		(slotUnique(i, i + 1, seed) && isPerfectSeed(seed, i + 1));
+}
+
+constexpr std::uint32_t findPerfectSeed(std::uint32_t seed = 0) {
+	return isPerfectSeed(seed) ? seed : findPerfectSeed(seed + 1);
+}
+
+constexpr std::uint32_t BUILTIN_SEED = findPerfectSeed();
+
+// index + 1 of the builtin hashing to slot, or 0 for an empty slot
+constexpr unsigned char builtinInSlot(std::size_t slot, std::size_t i = 0) {
+	return (i == NUM_BUILTINS) ? 0 :
+		(slotOf(builtins[i].name, BUILTIN_SEED) == slot) ? static_cast<unsigned char>(i + 1) :
+		builtinInSlot(slot, i + 1);
+}
+
+// C++11 has no std::index_sequence, this is enough to expand the slot table
+template<std::size_t... I> struct IndexSequence {};
+template<std::size_t N, std::size_t... I>
+struct MakeIndexSequence: MakeIndexSequence<N - 1, N - 1, I...> {};
+template<std::size_t... I>
+struct MakeIndexSequence<0, I...>: IndexSequence<I...> {};
+
+struct SlotTable {
+	unsigned char slots[BUILTIN_SLOTS];
+};
+
+template<std::size_t... I>
+constexpr SlotTable makeSlotTable(IndexSequence<I...>) {
+	return {{builtinInSlot(I)...}};
+}
+
+constexpr SlotTable builtinSlots = makeSlotTable(MakeIndexSequence<BUILTIN_SLOTS>());
+
+// Return the builtin named by sym or nullptr
+const Builtin* findBuiltin(const Atom& sym) {
+	if (!sym.isSymbol()) {
+		return nullptr;
+	}
+
+	std::string name = sym.asSymbol();
+	std::uint32_t h = FNV_OFFSET ^ (BUILTIN_SEED * 0x9E3779B9u);
+	for (char c : name) {
+		h = (h ^ static_cast<unsigned char>(c)) * FNV_PRIME;
+	}
+
+	unsigned char entry = builtinSlots.slots[slotFromHash(h)];
+	if (entry != 0 && name == builtins[entry - 1].name) {
+		return &builtins[entry - 1];
 	}
 
-	// if the expression isn't found in the map, then return a null pointer
 	return nullptr;
 }
 
-void Environment::add_exp(const Atom& sym, const Expression& exp, bool overwrite) {
-	if (!sym.isSymbol()) {
-		throw SemanticError("Attempt to add non-symbol to environment");
+// The Expressions for the built-in constants, created once and shared by every Environment
+const Expression& builtinConstant(const Builtin& builtin) {
+	static const std::vector<Expression> constants = [] {
+		std::vector<Expression> result(NUM_BUILTINS);
+		for (std::size_t i = 0; i < NUM_BUILTINS; i++) {
+			if (builtins[i].kind == BuiltinNumber) {
+				result[i] = Expression(builtins[i].real);
+			} else if (builtins[i].kind == BuiltinComplex) {
+				result[i] = Expression(complex(builtins[i].real, builtins[i].imag));
+			}
+		}
+
+		return result;
+	}();
+
+	return constants[&builtin - builtins];
+}
+
+Environment::Environment() {}
+
+Environment::Environment(std::shared_ptr<const Environment> base):
+	m_parent(base.get()), m_base(base) {}
+
+Environment Environment::makeScope(const Environment& parent) {
+	Environment scope;
+	scope.m_parent = &parent;
+	scope.m_base = parent.m_base;
+	return scope;
+}
+
+std::shared_ptr<const Environment> Environment::freeze() const {
+	std::shared_ptr<const Environment> cached = std::atomic_load(&m_frozen);
+	if (cached) {
+		return cached;
 	}
 
-	// error if overwriting symbol map unless overwrite flag is true
-	if (!overwrite && envmap.find(sym.asSymbol()) != envmap.end()) {
-		throw SemanticError("Attempt to overwrite symbol in environemnt");
+	std::shared_ptr<Environment> frozen = std::make_shared<Environment>(m_base);
+
+	// Flatten every layer above the base, outermost first so inner definitions win
+	std::vector<const Environment*> layers;
+	for (const Environment* env = this; env != nullptr && env != m_base.get(); env = env->m_parent) {
+		layers.push_back(env);
 	}
 
-	envmap[sym.asSymbol()] = EnvResult(ExpressionType, exp);
+	for (auto it = layers.rbegin(); it != layers.rend(); it++) {
+		(*it)->definitions.forEach([&frozen](Symbol sym, const Expression& exp) {
+			frozen->definitions.assign(sym, exp);
+		});
+		(*it)->procedures.forEach([&frozen](Symbol sym, Procedure proc) {
+			frozen->procedures.assign(sym, proc);
+		});
+	}
+
+	std::atomic_store(&m_frozen, std::shared_ptr<const Environment>(frozen));
+	return frozen;
 }
 
-bool Environment::is_proc(const Atom& sym) const {
+// Symbols defined during execution shadow the builtins, lambda arguments are added with
+// overwrite and may share a name with a built-in constant. Layers are searched from the top down
+const Expression* Environment::find_definition(const Atom& sym) const {
 	if (!sym.isSymbol()) {
-		return false;
+		return nullptr;
 	}
 
-	auto result = envmap.find(sym.asSymbol());
-	return (result != envmap.end()) && (result->second.type == ProcedureType);
+	Symbol key = sym.symbol();
+	for (const Environment* env = this; env != nullptr; env = env->m_parent) {
+		const Expression* exp = env->definitions.find(key);
+		if (exp != nullptr) {
+			return exp;
+		}
+	}
+
+	return nullptr;
 }
 
-Procedure Environment::get_proc(const Atom& sym) const {
-	if (sym.isSymbol()) {
-		auto result = envmap.find(sym.asSymbol());
-		if (result != envmap.end() && result->second.type == ProcedureType) {
-			return result->second.proc;
+const Procedure* Environment::find_procedure(const Atom& sym) const {
+	if (!sym.isSymbol()) {
+		return nullptr;
+	}
+
+	Symbol key = sym.symbol();
+	for (const Environment* env = this; env != nullptr; env = env->m_parent) {
+		const Procedure* proc = env->procedures.find(key);
+		if (proc != nullptr) {
+			return proc;
 		}
 	}
 
-	return default_proc;
+	return nullptr;
 }
 
-/*
-Reset the environment to the default state. First remove all entries and
-then re-add the default ones.
- */
-void Environment::reset() {
-	envmap.clear();
+bool Environment::is_known(const Atom& sym) const {
+	return find_definition(sym) != nullptr || find_procedure(sym) != nullptr ||
+		findBuiltin(sym) != nullptr;
+}
 
-	// Built-In value of pi
-	envmap.emplace("pi", EnvResult(ExpressionType, Expression(PI)));
+bool Environment::is_exp(const Atom& sym) const {
+	return find_exp(sym) != nullptr;
+}
 
-	// Built_In value of euler's number
-	envmap.emplace("e", EnvResult(ExpressionType, Expression(EXP)));
+const Expression* Environment::find_exp(const Atom& sym) const {
+	const Expression* definition = find_definition(sym);
+	if (definition != nullptr) {
+		return definition;
+	}
 
-	// Built_In value of the imaginary number
-	envmap.emplace("I", EnvResult(ExpressionType, Expression(I)));
+	const Builtin* builtin = findBuiltin(sym);
+	if (builtin != nullptr && builtin->kind != BuiltinProcedure) {
+		return &builtinConstant(*builtin);
+	}
 
-	// Procedure: add;
-	envmap.emplace("+", EnvResult(ProcedureType, add));
+	return nullptr;
+}
 
-	// Procedure: subneg;
-	envmap.emplace("-", EnvResult(ProcedureType, subneg));
+const Expression& Environment::get_exp_ref(const Atom& sym) const {
+	static const Expression none;
 
-	// Procedure: mul;
-	envmap.emplace("*", EnvResult(ProcedureType, mul));
+	const Expression* exp = find_exp(sym);
+	return (exp != nullptr) ? *exp : none;
+}
+
+Expression Environment::get_exp(const Atom& sym) const {
+	return get_exp_ref(sym);
+}
+
+Expression* Environment::get_exp_ptr(const Atom& sym) {
+	if (!sym.isSymbol()) {
+		return nullptr;
+	}
+
+	// the caller may modify the result
+	m_frozen.reset();
 
-	// Procedure: div;
-	envmap.emplace("/", EnvResult(ProcedureType, div));
+	Symbol key = sym.symbol();
+	Expression* local = definitions.find(key);
+	if (local != nullptr) {
+		return local;
+	}
 
-	// Procedure: sqrt
-	envmap.emplace("sqrt", EnvResult(ProcedureType, sqrt));
+	// Expressions from lower layers and built-in constants are shared, the caller may modify the
+	// result so this layer gets its own copy
+	const Expression* shared = find_exp(sym);
+	if (shared != nullptr) {
+		return &definitions.assign(key, *shared);
+	}
 
-	// Procedure: pow
-	envmap.emplace("^", EnvResult(ProcedureType, pow));
+	// if the expression isn't found in the map, then return a null pointer
+	return nullptr;
+}
 
-	// Procedure: ln
-	envmap.emplace("ln", EnvResult(ProcedureType, ln));
+void Environment::add_exp(const Atom& sym, const Expression& exp, bool overwrite) {
+	if (!sym.isSymbol()) {
+		throw SemanticError("Attempt to add non-symbol to environment");
+	}
 
-	// Procedure: sin
-	envmap.emplace("sin", EnvResult(ProcedureType, sin));
+	// error if overwriting symbol map unless overwrite flag is true
+	if (!overwrite && is_known(sym)) {
+		throw SemanticError("Attempt to overwrite symbol in environemnt");
+	}
 
-	// Procedure: cos
-	envmap.emplace("cos", EnvResult(ProcedureType, cos));
+	// lambdas made outside of the lambda special form, e.g. by the startup image, are profiled
+	// when they are bound to a name
+	Expression& bound = definitions.assign(sym.symbol(), exp);
+	bound.profileCalls();
+	m_frozen.reset();
+}
 
-	// Procedure: tan
-	envmap.emplace("tan", EnvResult(ProcedureType, tan));
+void Environment::add_proc(const Atom& sym, Procedure proc) {
+	if (!sym.isSymbol()) {
+		throw SemanticError("Attempt to add non-symbol to environment");
+	}
 
-	// Procedure: real
-	envmap.emplace("real", EnvResult(ProcedureType, real));
+	if (is_known(sym)) {
+		throw SemanticError("Attempt to overwrite symbol in environemnt");
+	}
 
-	// Procedure: imag
-	envmap.emplace("imag", EnvResult(ProcedureType, imag));
+	procedures.assign(sym.symbol(), proc);
+	m_frozen.reset();
+}
 
-	// Procedure: mag
-	envmap.emplace("mag", EnvResult(ProcedureType, mag));
+bool Environment::is_proc(const Atom& sym) const {
+	if (find_definition(sym) != nullptr) {
+		return false;
+	}
 
-	// Procedure: arg
-	envmap.emplace("arg", EnvResult(ProcedureType, arg));
+	if (find_procedure(sym) != nullptr) {
+		return true;
+	}
 
-	// Procedure: conj
-	envmap.emplace("conj", EnvResult(ProcedureType, conj));
+	const Builtin* builtin = findBuiltin(sym);
+	return builtin != nullptr && builtin->kind == BuiltinProcedure;
+}
 
-	// Procedure: first
-	envmap.emplace("first", EnvResult(ProcedureType, first));
+Procedure Environment::get_proc(const Atom& sym) const {
+	if (find_definition(sym) == nullptr) {
+		const Procedure* proc = find_procedure(sym);
+		if (proc != nullptr) {
+			return *proc;
+		}
 
-	// Procedure: rest
-	envmap.emplace("rest", EnvResult(ProcedureType, rest));
+		const Builtin* builtin = findBuiltin(sym);
+		if (builtin != nullptr && builtin->kind == BuiltinProcedure) {
+			return builtin->proc;
+		}
+	}
 
-	// Procedure: length
-	envmap.emplace("length", EnvResult(ProcedureType, length));
+	return default_proc;
+}
 
-	// Procedure: append
-	envmap.emplace("append", EnvResult(ProcedureType, append));
+std::vector<std::string> Environment::get_symbols() const {
+	std::vector<std::string> symbols;
+	symbols.reserve(definitions.size());
+	definitions.forEach([&symbols](Symbol sym, const Expression&) {
+		symbols.push_back(*sym);
+	});
 
-	// Procedure: join
-	envmap.emplace("join", EnvResult(ProcedureType, join));
+	return symbols;
+}
 
-	// Procedure: range
-	envmap.emplace("range", EnvResult(ProcedureType, range));
+/*
+Reset the environment to the default state. The builtins and the base are
+not stored in this layer, so this only has to drop its definitions.
+ */
+void Environment::reset() {
+	definitions.clear();
+	procedures.clear();
+	m_frozen.reset();
 }
@@ -11,17 +11,21 @@ needed.
 #define ENVIRONMENT_HPP
 
 // system includes
-#include <map>
+#include <memory>
 
 // module includes
 #include "atom.hpp"
 #include "expression.hpp"
+#include "symbol_map.hpp"
 
 /*! \typedef Procedure
-\brief A Procedure is a C++ function pointer taking a vector of
+\brief A Procedure is a C++ function pointer taking a view of evaluated
 			 Expressions as arguments and returning an Expression.
+
+The arguments are not owned by the procedure, so the caller can pass them from
+wherever they already live without building a new vector for every call.
 */
-typedef Expression (*Procedure)(const std::vector<Expression>& args);
+typedef Expression (*Procedure)(Arguments args);
 
 /*! \class Environment
 \brief A class representing the interpreter environment.
@@ -36,6 +40,13 @@ return you can obtain
 the mapped-to value using get_exp or get_proc.
 
 To add an symbol to expression mapping use the add_exp member function.
+
+An Environment can be layered over another one. Lookups that miss in the
+environment continue in the one below it, while definitions and modifications
+only ever touch the top layer. A frozen base (see freeze) can be shared by any
+number of interpreters, each with its own thin layer of definitions on top, and
+lambda calls evaluate their body in a scope layered over the caller's
+environment instead of a full copy of it.
  */
 class Environment {
 public:
@@ -44,6 +55,24 @@ public:
 	 * definitions. */
 	Environment();
 
+	/*! Construct an environment layered over a frozen, shareable base.
+		\param base the environment to continue lookups in. reset() returns to this state
+	 */
+	explicit Environment(std::shared_ptr<const Environment> base);
+
+	/*! Create a scope layered over parent, e.g. for evaluating the body of a lambda.
+		\param parent the environment to continue lookups in, it must outlive the scope
+		\return the new, empty scope
+	 */
+	static Environment makeScope(const Environment& parent);
+
+	/*! Freeze the current state of the environment into an immutable base that can be shared
+		between environments (and threads). The result is kept until this layer is modified, so
+		freezing the same scope again is free.
+		\return the frozen environment
+	 */
+	std::shared_ptr<const Environment> freeze() const;
+
 	/*! Determine if a symbol is known to the environment.
 		\param sym the sumbol to lookup
 		\return true if the symbol has been defined in the environment
@@ -63,6 +92,20 @@ public:
 	*/
 	Expression get_exp(const Atom& sym) const;
 
+	/*! Get a const-reference to the Expression the argument symbol maps to, without copying it.
+		\param sym the symbol to lookup
+		\return the expression the symbol maps to or an Expression of NoneType. The reference is
+		valid until the environment is modified
+	*/
+	const Expression& get_exp_ref(const Atom& sym) const;
+
+	/*! Find the Expression the argument symbol maps to, without copying it.
+		\param sym the symbol to lookup
+		\return a pointer to the expression the symbol maps to or nullptr if the symbol is not
+		defined as an expression. The pointer is valid until the environment is modified
+	*/
+	const Expression* find_exp(const Atom& sym) const;
+
 	/*! Get a pointer to the Expression the argument symbol maps to.
 		\param sym the symbol to lookup
 		\return a pointer expression the symbol maps to or an Expression of NoneType
@@ -75,6 +118,14 @@ public:
 	 */
 	void add_exp(const Atom& sym, const Expression& exp, bool overwrite = false);
 
+	/*! Add a mapping from sym to a native procedure, e.g. a plotscript library compiled to C++.
+		The procedure is called like a built-in one.
+		\param sym the symbol to add
+		\param proc the procedure the symbol should map to
+		\throws SemanticError if the symbol is already known
+	 */
+	void add_proc(const Atom& sym, Procedure proc);
+
 	/*! Determine if a symbol has been defined as a procedure
 		\param sym the symbol to lookup
 		\return true if thr symbol maps to a procedure
@@ -90,27 +141,41 @@ public:
 	*/
 	Procedure get_proc(const Atom& sym) const;
 
-	/*! Reset the environment to its default state. */
+	/*! List the symbols mapped to expressions in this layer (not the builtins or the base) in
+		the order they were first defined.
+		\return the defined symbols
+	 */
+	std::vector<std::string> get_symbols() const;
+
+	/*! Reset the environment to its default state. Only the definitions made in this layer are
+	 * removed, so this does not depend on the size of the base. */
 	void reset();
 
 private:
 
-	// Environment is a mapping from symbols to expressions or procedures
-	enum EnvResultType {ExpressionType, ProcedureType};
+	// return a pointer to the definition of sym made during execution, or nullptr
+	const Expression* find_definition(const Atom& sym) const;
+
+	// return a pointer to the native procedure added for sym, or nullptr
+	const Procedure* find_procedure(const Atom& sym) const;
+
+	// The environment lookups continue in, or nullptr. For an environment built over a frozen base
+	// this is the base itself and m_base keeps it alive, scopes share their parent's base
+	const Environment* m_parent = nullptr;
+	std::shared_ptr<const Environment> m_base;
 
-	struct EnvResult {
-		EnvResultType type;
-		Expression exp; // used when type is ExpressionType
-		Procedure proc; // used when type is ProcedureType
+	// Built-in procedures and constants live in a table generated at compile time and shared by
+	// every Environment. Only symbols defined during execution in this layer are stored per
+	// instance, which keeps construction and reset nearly free
+	SymbolMap<Expression> definitions;
 
-		// constructors for use in container emplace
-		EnvResult() {};
-		EnvResult(EnvResultType t, Expression e): type(t), exp(e) {};
-		EnvResult(EnvResultType t, Procedure p): type(t), proc(p) {};
-	};
+	// Native procedures added with add_proc, layered like the definitions
+	SymbolMap<Procedure> procedures;
 
-	// the environment map
-	std::map<std::string, EnvResult> envmap;
+	// The last result of freeze, dropped whenever this layer is modified. Parents are never
+	// modified while a scope over them is alive, so this layer's own changes are enough.
+	// Accessed with the atomic shared_ptr functions, several threads may freeze one scope
+	mutable std::shared_ptr<const Environment> m_frozen;
 };
 
 #endif
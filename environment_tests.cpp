@@ -41,6 +41,27 @@ TEST_CASE("Test get expression", "[environment]") {
 	REQUIRE(env.get_exp(Atom("hi")) == Expression());
 }
 
+TEST_CASE("Test reference lookups", "[environment]") {
+	Environment env;
+
+	std::vector<Expression> items(100000, Expression(1.0));
+	env.add_exp(Atom("big"), Expression(items));
+
+	// references point at the stored definition rather than a copy
+	const Expression& ref = env.get_exp_ref(Atom("big"));
+	REQUIRE(&ref == env.find_exp(Atom("big")));
+	REQUIRE(&ref == &env.get_exp_ref(Atom("big")));
+
+	// copies made from the reference share the elements
+	Expression copy = env.get_exp(Atom("big"));
+	REQUIRE(&*copy.tailConstBegin() == &*ref.tailConstBegin());
+
+	REQUIRE(env.find_exp(Atom("undefined")) == nullptr);
+	REQUIRE(env.get_exp_ref(Atom("undefined")) == Expression());
+	REQUIRE(env.find_exp(Atom("+")) == nullptr);
+	REQUIRE(*env.find_exp(Atom("pi")) == Expression(std::atan2(0, -1)));
+}
+
 TEST_CASE("Test add expression", "[environment]") {
 	Environment env;
 
@@ -77,6 +98,29 @@ TEST_CASE("Test get built-in procedure", "[environment]") {
 	REQUIRE(padd(args) == Expression(3.0));
 }
 
+TEST_CASE("Test procedure argument views", "[environment]") {
+	Environment env;
+
+	Procedure padd = env.get_proc(Atom("+"));
+	Procedure pmul = env.get_proc(Atom("*"));
+
+	INFO("pointer and count view")
+	Expression storage[] = {Expression(1.0), Expression(2.0), Expression(3.0)};
+	REQUIRE(padd(Arguments(storage, 3)) == Expression(6.0));
+	REQUIRE(pmul(Arguments(storage + 1, 2)) == Expression(6.0));
+
+	INFO("single element view")
+	Procedure pneg = env.get_proc(Atom("-"));
+	REQUIRE(pneg(Arguments(storage, 1)) == Expression(-1.0));
+
+	INFO("view of a list tail")
+	Expression list(std::vector<Expression>{Expression(4.0), Expression(5.0)});
+	REQUIRE(padd(Arguments(list.tailConstBegin(), list.tailConstEnd())) == Expression(9.0));
+
+	INFO("empty view")
+	REQUIRE(padd(Arguments()) == Expression(0.0));
+}
+
 TEST_CASE("Test reset", "[environment]") {
 	Environment env;
 
@@ -94,6 +138,115 @@ TEST_CASE("Test reset", "[environment]") {
 	REQUIRE(env.get_exp(Atom("hi")) == Expression());
 }
 
+TEST_CASE("Test built-in table lookups", "[environment]") {
+	Environment env;
+
+	INFO("every built-in procedure resolves to itself")
+	std::vector<std::string> procs = {"+", "-", "*", "/", "sqrt", "^", "ln", "sin", "cos", "tan",
+		"real", "imag", "mag", "arg", "conj", "min", "max", "first", "rest", "length", "append",
+		"join", "range"};
+	for (auto& name : procs) {
+		INFO(name);
+		REQUIRE(env.is_proc(Atom(name)));
+		REQUIRE(!env.is_exp(Atom(name)));
+		REQUIRE(env.get_proc(Atom(name)) != env.get_proc(Atom("notaproc")));
+	}
+
+	INFO("names close to a builtin are not builtins")
+	REQUIRE(!env.is_known(Atom("sqr")));
+	REQUIRE(!env.is_known(Atom("sqrtt")));
+	REQUIRE(!env.is_known(Atom("p")));
+
+	INFO("constants")
+	REQUIRE(env.get_exp(Atom("e")) == Expression(std::exp(1)));
+	REQUIRE(env.get_exp(Atom("I")) == Expression(complex(0, 1)));
+}
+
+TEST_CASE("Test definitions shadow built-in constants", "[environment]") {
+	Environment env;
+
+	REQUIRE_THROWS_AS(env.add_exp(Atom("pi"), Expression(3.0)), SemanticError);
+
+	// lambda arguments are added with overwrite and may reuse a constant's name
+	env.add_exp(Atom("pi"), Expression(3.0), true);
+	REQUIRE(env.get_exp(Atom("pi")) == Expression(3.0));
+
+	// modifying a constant through a pointer does not affect other environments
+	Expression* e = env.get_exp_ptr(Atom("e"));
+	REQUIRE(e != nullptr);
+	e->setProperty("note", Expression(1.0));
+	REQUIRE(env.get_exp(Atom("e")).getProperty("note") == Expression(1.0));
+	REQUIRE(Environment().get_exp(Atom("e")).getProperty("note") == Expression());
+
+	env.reset();
+	REQUIRE(env.get_exp(Atom("pi")) == Expression(std::atan2(0, -1)));
+	REQUIRE(env.get_exp(Atom("e")).getProperty("note") == Expression());
+}
+
+TEST_CASE("Test environments layered over a frozen base", "[environment]") {
+	Environment startup;
+	startup.add_exp(Atom("size"), Expression(2.0));
+	std::shared_ptr<const Environment> base = startup.freeze();
+
+	Environment session1(base);
+	Environment session2(base);
+	REQUIRE(session1.get_exp(Atom("size")) == Expression(2.0));
+	REQUIRE(session1.is_proc(Atom("+")));
+
+	INFO("base definitions cannot be redefined, only overwritten in the session")
+	REQUIRE_THROWS_AS(session1.add_exp(Atom("size"), Expression(3.0)), SemanticError);
+	session1.add_exp(Atom("size"), Expression(3.0), true);
+	REQUIRE(session1.get_exp(Atom("size")) == Expression(3.0));
+	REQUIRE(session2.get_exp(Atom("size")) == Expression(2.0));
+	REQUIRE(base->get_exp(Atom("size")) == Expression(2.0));
+
+	INFO("modifying through a pointer copies into the session")
+	session2.get_exp_ptr(Atom("size"))->setProperty("note", Expression(1.0));
+	REQUIRE(session2.get_exp(Atom("size")).getProperty("note") == Expression(1.0));
+	REQUIRE(base->get_exp(Atom("size")).getProperty("note") == Expression());
+
+	INFO("reset returns to the base")
+	session1.add_exp(Atom("extra"), Expression(4.0));
+	session1.reset();
+	REQUIRE(session1.get_exp(Atom("size")) == Expression(2.0));
+	REQUIRE(!session1.is_known(Atom("extra")));
+
+	INFO("the base outlives the environment it was frozen from")
+	startup.reset();
+	REQUIRE(!startup.is_known(Atom("size")));
+	REQUIRE(session1.get_exp(Atom("size")) == Expression(2.0));
+}
+
+TEST_CASE("Test scopes", "[environment]") {
+	Environment env;
+	env.add_exp(Atom("a"), Expression(1.0));
+	env.add_exp(Atom("b"), Expression(2.0));
+
+	Environment scope = Environment::makeScope(env);
+	scope.add_exp(Atom("a"), Expression(10.0), true);
+	scope.add_exp(Atom("c"), Expression(3.0));
+	REQUIRE(scope.get_exp(Atom("a")) == Expression(10.0));
+	REQUIRE(scope.get_exp(Atom("b")) == Expression(2.0));
+	REQUIRE(env.get_exp(Atom("a")) == Expression(1.0));
+	REQUIRE(!env.is_known(Atom("c")));
+
+	INFO("freezing a scope flattens it with its parents")
+	std::shared_ptr<const Environment> frozen = scope.freeze();
+	REQUIRE(frozen->get_exp(Atom("a")) == Expression(10.0));
+	REQUIRE(frozen->get_exp(Atom("b")) == Expression(2.0));
+	REQUIRE(frozen->get_exp(Atom("c")) == Expression(3.0));
+
+	INFO("freezing again reuses the snapshot until the scope is modified")
+	REQUIRE(scope.freeze() == frozen);
+	scope.add_exp(Atom("d"), Expression(4.0));
+	std::shared_ptr<const Environment> refrozen = scope.freeze();
+	REQUIRE(refrozen != frozen);
+	REQUIRE(refrozen->get_exp(Atom("d")) == Expression(4.0));
+	REQUIRE(frozen->get_exp(Atom("d")) == Expression());
+	*scope.get_exp_ptr(Atom("d")) = Expression(5.0);
+	REQUIRE(scope.freeze()->get_exp(Atom("d")) == Expression(5.0));
+}
+
 TEST_CASE("Test semeantic errors", "[environment]") {
 	Environment env;
 
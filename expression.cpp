@@ -3,54 +3,74 @@
 #include <sstream>
 #include <iomanip>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <condition_variable>
+#include <deque>
 #include <limits>
+#include <map>
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <unordered_set>
 
 #include "environment.hpp"
 #include "semantic_error.hpp"
 
 #include "interrupt_flag.hpp"
+#include "lambda_compiler.hpp"
+#include "parallel_sort.hpp"
+#include "plot_cache.hpp"
+#include "plot_data.hpp"
+#include "plot_export.hpp"
+#include "promise.hpp"
+#include "sequence.hpp"
+#include "thread_pool.hpp"
 std::atomic<bool> interrupt_flag;
 
-Expression::Expression() {}
-
-Expression::Expression(const std::vector<Expression>& a): m_head(ListRoot), m_tail(a) {}
+// The items of a tail and the call profile of the lambda it belongs to. A copy made for writing
+// starts without a profile, since the profile describes the body it was made for
+struct Expression::Tail {
+	Tail() {}
+	explicit Tail(const std::vector<Expression>& a): items(a) {}
+	Tail(const Tail& other): items(other.items) {}
+	~Tail() { delete profile.load(std::memory_order_relaxed); }
 
-Expression::Expression(const Atom& a): m_head(a) {}
+	std::vector<Expression> items;
+	std::atomic<LambdaProfile*> profile{nullptr};
+};
 
-// recursive copy
-Expression::Expression(const Expression& a) {
-	m_head = a.m_head;
-	m_tail = a.m_tail;
+Expression::Expression() {}
 
-	// Deep copy the map from "a" and create a new unique pointer from it
-	if (a.m_props.get() != nullptr) {
-		m_props = std::unique_ptr<PropertyMap>(new PropertyMap(*a.m_props));
+Expression::Expression(const std::vector<Expression>& a): m_head(ListRoot) {
+	if (!a.empty()) {
+		m_tail = std::make_shared<Tail>(a);
+		for (auto& element : m_tail->items) {
+			if (element.isHeadSequence()) {
+				element = forceSequence(element);
+			}
+		}
 	}
 }
 
-Expression& Expression::operator=(const Expression& a) {
-
-	// prevent self-assignment
-	if (this != &a) {
-		m_head = a.m_head;
-
-		m_tail.clear();
-		m_tail = a.m_tail;
-
-		// Clear out the contents of this property map if it exists. This needs to happen regardless
-		// of the state of the right hand side's property map
-		if (m_props != nullptr) {
-			m_props->clear();
-		}
-
-		if (a.m_props.get() != nullptr) {
-			m_props = std::unique_ptr<PropertyMap>(new PropertyMap(*a.m_props));
-		}
-	}
+Expression Expression::fromSequence(std::shared_ptr<const Sequence> seq) {
+	Expression exp(SequenceRoot);
+	exp.m_seq = seq;
+	return exp;
+}
 
-	return *this;
+Expression Expression::fromPromise(std::shared_ptr<const Promise> promise) {
+	Expression exp(PromiseRoot);
+	exp.m_promise = promise;
+	return exp;
 }
 
+Expression::Expression(const Atom& a): m_head(a) {}
+
 Atom& Expression::head() {
 	return m_head;
 }
@@ -83,15 +103,37 @@ bool Expression::isHeadLambdaRoot() const noexcept {
 	return m_head == LambdaRoot;
 }
 
+bool Expression::isHeadSequence() const noexcept {
+	return m_seq.get() != nullptr;
+}
+
+const Sequence* Expression::sequence() const noexcept {
+	return m_seq.get();
+}
+
+bool Expression::isHeadPromise() const noexcept {
+	return m_promise.get() != nullptr;
+}
+
+const Promise* Expression::promise() const noexcept {
+	return m_promise.get();
+}
+
 void Expression::setProperty(const std::string& key, const Expression& value) {
+	if (isHeadSequence()) {
+		*this = forceSequence(*this);
+	}
 
-	// Construct a new property list if one doesn't already exist
+	// Construct a new property list if one doesn't already exist, or copy it if it is shared with
+	// another expression
 	if (m_props.get() == nullptr) {
-		m_props = std::unique_ptr<PropertyMap>(new PropertyMap);
+		m_props = std::make_shared<PropertyMap>();
+	} else if (m_props.use_count() > 1) {
+		m_props = std::make_shared<PropertyMap>(*m_props);
 	}
 
 	// Add the key and the expression to the map
-	(*m_props)[key] = value;
+	(*m_props)[key] = forceSequence(value);
 }
 
 Expression Expression::getProperty(const std::string& property) const {
@@ -100,7 +142,7 @@ Expression Expression::getProperty(const std::string& property) const {
 
 		// if it was found, return the value
 		if (it != m_props->cend()) {
-			return it->second;
+			return forcePromise(it->second);
 		}
 	}
 
@@ -108,30 +150,442 @@ Expression Expression::getProperty(const std::string& property) const {
 	return Expression();
 }
 
+// A lambda bound to a name may share its tail with copies read by other threads, so the profile
+// is published with a compare and swap and the loser's profile is discarded
+void Expression::profileCalls() {
+	if (!isHeadLambdaRoot() || profile() != nullptr) {
+		return;
+	}
+
+	std::unique_ptr<LambdaProfile> profile(new LambdaProfile());
+	LambdaProfile* expected = nullptr;
+	if (m_tail->profile.compare_exchange_strong(expected, profile.get(),
+		std::memory_order_acq_rel)) {
+		profile.release();
+	}
+}
+
+LambdaProfile* Expression::profile() const noexcept {
+	return (m_tail.get() != nullptr) ? m_tail->profile.load(std::memory_order_acquire) : nullptr;
+}
+
+unsigned Expression::evalHints() const noexcept {
+	return m_hints;
+}
+
+void Expression::setEvalHints(unsigned hints) noexcept {
+	m_hints = static_cast<unsigned char>(hints);
+}
+
+std::vector<std::string> Expression::getPropertyKeys() const {
+	std::vector<std::string> keys;
+	if (m_props.get() != nullptr) {
+		for (auto& prop : *m_props) {
+			keys.push_back(prop.first);
+		}
+
+		std::sort(keys.begin(), keys.end());
+	}
+
+	return keys;
+}
+
+const std::vector<Expression>& Expression::tailItems() const noexcept {
+	static const std::vector<Expression> emptyTail;
+	return (m_tail.get() != nullptr) ? m_tail->items : emptyTail;
+}
+
+// NOTE: the use count is only a safe test for sharing because an Expression itself is never
+// modified by one thread while another thread reads it. Copies in other threads keep the count
+// above one, so they are never written through.
+std::vector<Expression>& Expression::mutableTail() {
+	if (m_tail.get() == nullptr) {
+		m_tail = std::make_shared<Tail>();
+	} else if (m_tail.use_count() > 1) {
+		m_tail = std::make_shared<Tail>(*m_tail);
+	} else {
+		delete m_tail->profile.exchange(nullptr, std::memory_order_relaxed);
+	}
+
+	return m_tail->items;
+}
+
 void Expression::append(const Atom& a) {
-	m_tail.emplace_back(a);
+	mutableTail().emplace_back(a);
 }
 
 Expression* Expression::tail() {
 	Expression* ptr = nullptr;
 
-	if (m_tail.size() > 0) {
-		ptr = &m_tail.back();
+	if (!tailItems().empty()) {
+		ptr = &mutableTail().back();
 	}
 
 	return ptr;
 }
 
+Expression::IteratorType Expression::tailBegin() {
+	return mutableTail().begin();
+}
+
+Expression::IteratorType Expression::tailEnd() {
+	return mutableTail().end();
+}
+
 Expression::ConstIteratorType Expression::tailConstBegin() const noexcept {
-	return m_tail.cbegin();
+	return tailItems().cbegin();
 }
 
 Expression::ConstIteratorType Expression::tailConstEnd() const noexcept {
-	return m_tail.cend();
+	return tailItems().cend();
+}
+
+// Evaluated procedure arguments are staged on a per-thread stack that keeps its capacity between
+// calls, so calling a built-in procedure does not allocate once the stack has grown to the depth
+// of the program. A view into the stack is only valid until something else is pushed onto it,
+// anything that goes on to evaluate more expressions must bind or copy its arguments first.
+thread_local std::vector<Expression> argumentStack;
+
+// RAII helper that owns the top of the argument stack for the duration of a procedure call. The
+// stack is truncated back to where the frame started even if evaluation throws
+class ArgumentFrame {
+public:
+	ArgumentFrame(): m_base(argumentStack.size()) {}
+	~ArgumentFrame() {
+		argumentStack.erase(argumentStack.begin() + m_base, argumentStack.end());
+	}
+
+	void push(const Expression& exp) {
+		argumentStack.push_back(exp);
+	}
+
+	// Only valid until the next push on the argument stack
+	Arguments arguments() const {
+		return Arguments(argumentStack.data() + m_base, argumentStack.size() - m_base);
+	}
+
+private:
+	std::size_t m_base;
+};
+
+// Evaluate the items of a tail marked with ParallelTailHint, in order. The items marked heavy are
+// evaluated concurrently on the shared thread pool, each in a scope of its own so a wrong analysis
+// cannot race on env, and the others inline. The analysis only marks tails of pure items, so the
+// order of evaluation is not observable. If evaluation fails, the error of the first failing item
+// is rethrown, the same error sequential evaluation would report
+std::vector<Expression> evalParallel(const std::vector<Expression>& items, Environment& env) {
+	std::vector<Expression> results(items.size());
+	std::vector<std::size_t> heavy;
+	std::size_t firstFailure = items.size();
+	std::exception_ptr error;
+	for (std::size_t i = 0; i < items.size(); i++) {
+		if (items[i].evalHints() & Expression::HeavyHint) {
+			heavy.push_back(i);
+		} else if (i < firstFailure) {
+			try {
+				results[i] = items[i].eval(env);
+			} catch (...) {
+				firstFailure = i;
+				error = std::current_exception();
+			}
+		}
+	}
+
+	std::mutex errorMutex;
+	const Environment& parent = env;
+	ThreadPool::shared().parallelFor(heavy.size(), 1, [&](std::size_t begin, std::size_t end) {
+		for (std::size_t i = begin; i < end; i++) {
+			std::size_t index = heavy[i];
+			{
+				std::lock_guard<std::mutex> lock(errorMutex);
+				if (index > firstFailure) {
+					continue;
+				}
+			}
+
+			try {
+				Environment scope = Environment::makeScope(parent);
+				results[index] = items[index].eval(scope);
+			} catch (...) {
+				std::lock_guard<std::mutex> lock(errorMutex);
+				if (index < firstFailure) {
+					firstFailure = index;
+					error = std::current_exception();
+				}
+			}
+		}
+	});
+
+	if (error) {
+		std::rethrow_exception(error);
+	}
+
+	return results;
+}
+
+// Add the symbols appearing anywhere in exp to symbols, including lambda bodies, which see the
+// definitions of their caller
+void collectSymbols(const Expression& exp, std::unordered_set<std::string>& symbols) {
+	if (exp.isHeadSymbol()) {
+		symbols.insert(exp.head().asSymbol());
+	}
+
+	for (auto it = exp.tailConstBegin(); it != exp.tailConstEnd(); it++) {
+		collectSymbols(*it, symbols);
+	}
+}
+
+// The evaluation of a begin block marked with ParallelTailHint, shared with the tasks queued for
+// its items since they may only run after the block has finished
+struct BeginGraph {
+	BeginGraph(const std::vector<Expression>& items, Environment& env):
+		items(items), env(env), defines(items.size()), dependencies(items.size()),
+		successors(items.size()), results(items.size()), errors(items.size()),
+		cancellation(std::make_shared<Cancellation>(ThreadPool::currentCancellation())),
+		waiting(items.size()), finished(items.size()), remaining(items.size()),
+		firstFailure(items.size()) {}
+
+	const std::vector<Expression>& items;
+	Environment& env;
+
+	// the symbol each item defines, if any, and the earlier items whose definitions it may read
+	std::vector<std::string> defines;
+	std::vector<std::vector<std::size_t>> dependencies;
+	std::vector<std::vector<std::size_t>> successors;
+
+	// the value of each item or the error evaluating it. An item whose dependency failed is not
+	// evaluated and gets the same error
+	std::vector<Expression> results;
+	std::vector<std::exception_ptr> errors;
+
+	// the computation the items run as, cancelled once an item has failed and every item before
+	// it has finished, which leaves only items whose results are discarded
+	std::shared_ptr<Cancellation> cancellation;
+
+	// guards the members below and is signalled when they change
+	std::mutex mutex;
+	std::condition_variable changed;
+
+	// the items whose dependencies have finished and that no thread has started yet
+	std::deque<std::size_t> ready;
+
+	// the number of dependencies of each item that have not finished
+	std::vector<std::size_t> waiting;
+
+	std::vector<bool> finished;
+	std::size_t remaining;
+
+	// the first item in order that failed, or the number of items. Later items are not started
+	std::size_t firstFailure;
+};
+
+// Helper function to tell whether a value defined outside a begin block may read symbols when it is
+// called or forced, which then resolve to the definitions of the block
+bool mayReadSymbols(const Expression& exp) {
+	if (exp.isHeadLambdaRoot() || exp.isHeadSequence() || exp.isHeadPromise()) {
+		return true;
+	}
+
+	for (auto it = exp.tailConstBegin(); it != exp.tailConstEnd(); it++) {
+		if (mayReadSymbols(*it)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// Build the def-use graph of a begin block. An item depends on the last earlier definition of each
+// symbol it uses, and on the dependencies of those definitions: with dynamic scope, calling a
+// lambda reads the symbols of its body where it is called. The body of a lambda defined before the
+// block is not known here, so an item using one depends on every earlier definition
+void buildBeginGraph(BeginGraph& graph) {
+	std::size_t count = graph.items.size();
+	std::vector<std::unordered_set<std::string>> uses(count);
+	std::unordered_map<std::string, std::size_t> lastDefinition;
+	for (std::size_t i = 0; i < count; i++) {
+		const Expression& item = graph.items[i];
+		collectSymbols(item, uses[i]);
+
+		std::vector<bool> depends(i, false);
+		std::vector<std::string> work(uses[i].begin(), uses[i].end());
+		std::unordered_set<std::string> visited(uses[i]);
+		while (!work.empty()) {
+			Atom sym(work.back());
+			auto definition = lastDefinition.find(work.back());
+			work.pop_back();
+			if (definition == lastDefinition.end()) {
+				if (graph.env.is_exp(sym) && mayReadSymbols(graph.env.get_exp_ref(sym))) {
+					depends.assign(i, true);
+					break;
+				}
+
+				continue;
+			} else if (depends[definition->second]) {
+				continue;
+			}
+
+			depends[definition->second] = true;
+			for (auto& sym : uses[definition->second]) {
+				if (visited.insert(sym).second) {
+					work.push_back(sym);
+				}
+			}
+		}
+
+		for (std::size_t j = 0; j < i; j++) {
+			if (depends[j]) {
+				graph.dependencies[i].push_back(j);
+				graph.successors[j].push_back(i);
+			}
+		}
+
+		graph.waiting[i] = graph.dependencies[i].size();
+		if (item.head().asSymbol() == "define") {
+			graph.defines[i] = item.tailConstBegin()->head().asSymbol();
+			lastDefinition[graph.defines[i]] = i;
+		}
+	}
+}
+
+void runReadyBeginItem(const std::shared_ptr<BeginGraph>& graph);
+
+// Evaluate item i of a begin block in a scope holding the definitions it depends on, then make
+// the items that were only waiting for it ready
+void runBeginItem(const std::shared_ptr<BeginGraph>& graph, std::size_t i) {
+	bool skipped;
+	{
+		std::lock_guard<std::mutex> lock(graph->mutex);
+		skipped = i > graph->firstFailure;
+	}
+
+	for (std::size_t j : graph->dependencies[i]) {
+		if (!skipped && graph->errors[j]) {
+			graph->errors[i] = graph->errors[j];
+			break;
+		}
+	}
+
+	if (!skipped && !graph->errors[i]) {
+		try {
+			Environment scope = Environment::makeScope(graph->env);
+			for (std::size_t j : graph->dependencies[i]) {
+				if (!graph->defines[j].empty()) {
+					scope.add_exp(Atom(graph->defines[j]), graph->results[j], true);
+				}
+			}
+
+			graph->results[i] = graph->items[i].eval(scope);
+		} catch (...) {
+			graph->errors[i] = std::current_exception();
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(graph->mutex);
+	graph->finished[i] = true;
+	graph->remaining--;
+	if (graph->errors[i] && i < graph->firstFailure) {
+		graph->firstFailure = i;
+	}
+
+	for (std::size_t successor : graph->successors[i]) {
+		if (--graph->waiting[successor] == 0) {
+			graph->ready.push_back(successor);
+			ThreadPool::shared().push([graph]() {
+				runReadyBeginItem(graph);
+			});
+		}
+	}
+
+	if (graph->firstFailure < graph->items.size() && !graph->cancellation->isCancelled()) {
+		auto end = graph->finished.begin() + graph->firstFailure;
+		if (std::find(graph->finished.begin(), end, false) == end) {
+			graph->cancellation->cancel();
+		}
+	}
+
+	graph->changed.notify_all();
+}
+
+// Run the oldest ready item of a begin block, if there still is one. A task is queued for every
+// item that becomes ready, but the block may have run the item itself
+void runReadyBeginItem(const std::shared_ptr<BeginGraph>& graph) {
+	std::size_t i;
+	{
+		std::lock_guard<std::mutex> lock(graph->mutex);
+		if (graph->ready.empty()) {
+			return;
+		}
+
+		i = graph->ready.front();
+		graph->ready.pop_front();
+	}
+
+	runBeginItem(graph, i);
+}
+
+// Evaluate the items of a begin block marked with ParallelTailHint. The analysis only marks blocks
+// whose items are pure apart from defining a symbol, so each item is evaluated as soon as the
+// definitions it uses are, on the shared thread pool. The definitions are then added to env in
+// order up to the first failing item, whose error is rethrown, so env and the result are the same
+// as after sequential evaluation. The block runs ready items itself while it waits, but none of
+// the other tasks queued on the pool
+Expression evalBeginGraph(const std::vector<Expression>& items, Environment& env) {
+	std::shared_ptr<BeginGraph> graph = std::make_shared<BeginGraph>(items, env);
+	buildBeginGraph(*graph);
+
+	// the items, and the tasks queued for them, run as the computation of the block. An interrupt
+	// seen by one item cancels the others
+	ThreadPool::CancellationScope cancellation(graph->cancellation);
+	std::unique_lock<std::mutex> lock(graph->mutex);
+	for (std::size_t i = 0; i < items.size(); i++) {
+		if (graph->dependencies[i].empty()) {
+			graph->ready.push_back(i);
+			ThreadPool::shared().push([graph]() {
+				runReadyBeginItem(graph);
+			});
+		}
+	}
+
+	while (graph->remaining > 0) {
+		if (graph->ready.empty()) {
+			graph->changed.wait(lock);
+			continue;
+		}
+
+		std::size_t i = graph->ready.front();
+		graph->ready.pop_front();
+		lock.unlock();
+		runBeginItem(graph, i);
+		lock.lock();
+	}
+
+	lock.unlock();
+	for (std::size_t i = 0; i < items.size(); i++) {
+		if (graph->errors[i]) {
+			std::rethrow_exception(graph->errors[i]);
+		} else if (!graph->defines[i].empty()) {
+			env.add_exp(Atom(graph->defines[i]), graph->results[i]);
+		}
+	}
+
+	return graph->results.back();
 }
 
-Expression apply_lambda(const Expression& lambda, const std::vector<Expression>& args,
-	Environment env) {
+Expression apply_lambda(const Expression& lambda, Arguments args, const Environment& parent) {
+
+	// Lambdas called often enough run in their compiled form
+	LambdaProfile* profile = lambda.profile();
+	if (profile != nullptr) {
+		const CompiledLambda* code = profile->enter(lambda);
+		if (code != nullptr) {
+			return runCompiledLambda(*code, args, parent);
+		}
+	}
+
+	// The body is evaluated in a scope layered over the caller's environment, so the arguments
+	// shadow existing definitions without copying the environment
+	Environment env = Environment::makeScope(parent);
 
 	// Reference the arguments and expression of the lambda function. Only the expression needs
 	// to be copied
@@ -145,8 +599,9 @@ Expression apply_lambda(const Expression& lambda, const std::vector<Expression>&
 	// Make sure the number of argumentes between the lambda function and the passed in args match
 	if (std::distance(lBegin, lEnd) == std::distance(args.cbegin(), args.cend())) {
 
-		// loop through each argument and add it to the copied environment with the lambda arguments
-		// as the symbols
+		// loop through each argument and add it to the lambda scope with the lambda arguments
+		// as the symbols. This has to happen before the body is evaluated, the arguments may be a
+		// view into the argument stack
 		auto ut = args.cbegin();
 		for (auto lt = lBegin; lt != lEnd; lt++, ut++) {
 
@@ -163,10 +618,11 @@ Expression apply_lambda(const Expression& lambda, const std::vector<Expression>&
 }
 
 // Forward declare the plot functions for apply
-Expression discretePlot(const std::vector<Expression>& args);
-Expression continuousPlot(const std::vector<Expression>& args, const Environment& env);
+Expression discretePlot(Arguments args);
+Expression continuousPlot(Arguments args, const Environment& env);
+Expression surfacePlot(Arguments args, const Environment& env, bool contour);
 
-Expression apply(const Atom & op, const std::vector<Expression>& args, const Environment& env) {
+Expression apply(const Atom & op, Arguments args, const Environment& env) {
 
 	// head must be a symbol
 	if (!op.isSymbol()) {
@@ -177,15 +633,54 @@ Expression apply(const Atom & op, const std::vector<Expression>& args, const Env
 	if (!env.is_proc(op)) {
 
 		// check if there is a lambda function in the environment
-		Expression lambda = env.get_exp(op);
+		const Expression& lambda = env.get_exp_ref(op);
 		if (lambda.isHeadLambdaRoot()) {
 			return apply_lambda(lambda, args, env);
 
 			// Check if it is one of the plot commands
 		} else if (op.asSymbol() == "discrete-plot") {
-			return discretePlot(args);
+
+			// Forcing a lazy map evaluates its lambda, which may grow the argument stack the view
+			// points into, so the plot commands copy their arguments before forcing any of them
+			std::vector<Expression> plotArgs(args.begin(), args.end());
+			for (auto& arg : plotArgs) {
+				arg = forceSequence(arg);
+			}
+
+			return discretePlot(plotArgs);
 		} else if (op.asSymbol() == "continuous-plot") {
-			return continuousPlot(args, env);
+
+			// continuous-plot also evaluates its lambda many times, with its own copy of the
+			// arguments
+			std::vector<Expression> plotArgs(args.begin(), args.end());
+			for (auto& arg : plotArgs) {
+				arg = forceSequence(arg);
+			}
+
+			return continuousPlot(plotArgs, env);
+		} else if (op.asSymbol() == "surface-plot" || op.asSymbol() == "contour-plot") {
+
+			// like continuous-plot, the lambda is evaluated many times
+			std::vector<Expression> plotArgs(args.begin(), args.end());
+			for (auto& arg : plotArgs) {
+				arg = forceSequence(arg);
+			}
+
+			return surfacePlot(plotArgs, env, op.asSymbol() == "contour-plot");
+		} else if (op.asSymbol() == "save-plot") {
+
+			// the plot is not forced, a plot still in its typed form is written from it
+			if (args.size() != 2) {
+				throw SemanticError("Error: wrong number of arguments for save-plot which takes two "
+					"arguments");
+			} else if (!args[1].isHeadStringLiteral()) {
+				throw SemanticError("Error: second argument to save-plot should be a file name");
+			}
+
+			// writing a plot forces the promises among its options, so it is copied out of the view
+			Expression plot = args[0];
+			savePlot(plot, args[1].head().asSymbol(true));
+			return Expression();
 		} else {
 			throw SemanticError("Error during evaluation: symbol does not name a procedure");
 		}
@@ -198,12 +693,14 @@ Expression apply(const Atom & op, const std::vector<Expression>& args, const Env
 	return proc(args);
 }
 
-Expression Expression::handle_lookup(const Atom& head, const Environment& env) {
+Expression Expression::handle_lookup(const Atom& head, const Environment& env) const {
 
-	// if symbol is in env return value
+	// if symbol is in env return value. The bound expression shares its tail with the returned
+	// copy, so reading a large definition does not copy it
 	if (head.isSymbol()) {
-		if(env.is_exp(head)) {
-			return env.get_exp(head);
+		const Expression* exp = env.find_exp(head);
+		if (exp != nullptr) {
+			return *exp;
 		} else {
 			throw SemanticError("Error during evaluation: unknown symbol");
 		}
@@ -214,15 +711,19 @@ Expression Expression::handle_lookup(const Atom& head, const Environment& env) {
 	}
 }
 
-Expression Expression::handle_begin(Environment& env) {
-	if (m_tail.size() == 0) {
+Expression Expression::handle_begin(Environment& env) const {
+	if (tailItems().size() == 0) {
 		throw SemanticError("Error during evaluation: zero arguments to begin");
 	}
 
+	if (m_hints & ParallelTailHint) {
+		return evalBeginGraph(tailItems(), env);
+	}
+
 	// evaluate each arg from tail, return the last
 	Expression result;
-	for (Expression::IteratorType it = m_tail.begin(); it != m_tail.end(); ++it) {
-		result = it->eval(env);
+	for (auto& exp : tailItems()) {
+		result = exp.eval(env);
 	}
 
 	return result;
@@ -234,62 +735,75 @@ bool Expression::isSpecialForm(const Atom& head) const {
 		s == "begin" ||
 		s == "apply" ||
 		s == "map" ||
+		s == "reduce" ||
+		s == "fold" ||
+		s == "filter" ||
+		s == "sort-by" ||
 		head == ListRoot ||
 		head == LambdaRoot ||
 		s == "set-property" ||
 		s == "get-property" ||
+		s == "delay" ||
+		s == "force" ||
 		s == "discrete-plot" ||
-		s == "continuous-plot";
+		s == "continuous-plot" ||
+		s == "surface-plot" ||
+		s == "contour-plot" ||
+		s == "save-plot";
 }
 
-Expression Expression::handle_define(Environment& env) {
+Expression Expression::handle_define(Environment& env) const {
 
 	// tail must have size 2 or error
-	if (m_tail.size() != 2) {
+	if (tailItems().size() != 2) {
 		throw SemanticError("Error during evaluation: invalid number of arguments to define");
 	}
 
 	// tail[0] must be symbol
-	if (!m_tail[0].isHeadSymbol()) {
+	if (!tailItems()[0].isHeadSymbol()) {
 		throw SemanticError("Error during evaluation: first argument to define not symbol");
 	}
 
 	// but tail[0] must not be a special-form or procedure
-	if (isSpecialForm(m_tail[0].head())) {
+	if (isSpecialForm(tailItems()[0].head())) {
 		throw SemanticError("Error during evaluation: attempt to redefine a special-form");
 	}
 
-	if (env.is_proc(m_tail[0].head())) {
+	if (env.is_proc(tailItems()[0].head())) {
 		throw SemanticError("Error during evaluation: attempt to redefine a built-in procedure");
 	}
 
 	// eval tail[1]
-	Expression result = m_tail[1].eval(env);
+	Expression result = tailItems()[1].eval(env);
 
-	if (env.is_exp(m_tail[0].head())) {
+	if (env.is_exp(tailItems()[0].head())) {
 		throw SemanticError("Error during evaluation: attempt to redefine a previously defined "
 			"symbol");
 	}
 
 	//and add to env
-	env.add_exp(m_tail[0].head(), result);
+	env.add_exp(tailItems()[0].head(), result);
 
 	return result;
 }
 
-Expression Expression::handle_list(Environment& env) {
+Expression Expression::handle_list(Environment& env) const {
+	if (m_hints & ParallelTailHint) {
+		return Expression(evalParallel(tailItems(), env));
+	}
+
 	std::vector<Expression> result;
-	for (auto& a : m_tail) {
+	for (auto& a : tailItems()) {
 		result.push_back(a.eval(env));
 	}
 
 	return Expression(result);
 }
 
-Expression Expression::handle_lambda(Environment& env) {
+Expression Expression::handle_lambda(Environment& env) const {
 
 	// Lambda needs a list of arguments and an expression to evaluate those arguments in
-	if (m_tail.size() != 2) {
+	if (tailItems().size() != 2) {
 		throw SemanticError("Error during evaluation: invalid number of arguments to lambda");
 	}
 
@@ -299,13 +813,14 @@ Expression Expression::handle_lambda(Environment& env) {
 	// Reference the first element of the tail as the function arguments. The second expression
 	// in the tail is the expression related to the lambda function itself. It gets
 	// evaluated at run time
-	Expression& lambdaArgs = lambda.m_tail[0];
+	Expression& lambdaArgs = lambda.mutableTail()[0];
 
 	// Start evaluating the possible arguments for the lambda function. Start by moving the head to
 	// the tail of the lambdaArgs expression
-	lambdaArgs.m_tail.insert(lambdaArgs.tailConstBegin(), lambdaArgs.head());
+	std::vector<Expression>& argsTail = lambdaArgs.mutableTail();
+	argsTail.insert(argsTail.begin(), Expression(lambdaArgs.head()));
 	lambdaArgs.m_head = ListRoot;
-	for (Expression& arg : lambdaArgs.m_tail) {
+	for (const Expression& arg : argsTail) {
 
 		// Need to ensure each argument is a symbol type expression that does not point to a procedure
 		if (arg.isHeadSymbol()) {
@@ -326,31 +841,48 @@ Expression Expression::handle_lambda(Environment& env) {
 	// After processing the user's lambda function, the copied expression will contain the
 	// lambda function's information. We just need to set the head to a lambda type
 	lambda.m_head = LambdaRoot;
+	lambda.profileCalls();
 	return lambda;
 }
 
-Expression Expression::handle_apply(Environment& env) {
+// Resolve the procedure argument of apply or map. A symbol bound to a lambda is referenced in
+// place, anything else is evaluated into storage. The result is only a lambda if it has a
+// lambda head
+const Expression& resolveProcedure(const Expression& proc, Environment& env, Expression& storage) {
+	if (proc.tailConstBegin() == proc.tailConstEnd()) {
+		const Expression* bound = env.find_exp(proc.head());
+		if (bound != nullptr) {
+			return *bound;
+		}
+	}
+
+	storage = proc.eval(env);
+	return storage;
+}
+
+Expression Expression::handle_apply(Environment& env) const {
 
 	// The first expression is a procedure, and the second is the list of expressions
-	if (m_tail.size() == 2) {
+	if (tailItems().size() == 2) {
 
 		// pre-evaluate the second expression to create a list
-		Expression list = m_tail[1].eval(env);
+		Expression list = forceSequence(tailItems()[1].eval(env));
 		if (!list.isHeadListRoot()) {
 			throw SemanticError("Error: second argument to apply not a list");
 		}
 
-		// create the list
-		std::vector<Expression> applyArgs(list.tailConstBegin(), list.tailConstEnd());
+		// view the list elements as the arguments
+		Arguments applyArgs(list.tailConstBegin(), list.tailConstEnd());
 
 		// to be a valid procedure, the expression should be JUST the procedure symbol
-		Expression& proc = m_tail[0];
-		if (proc.m_tail.empty() && env.is_proc(proc.head())) {
+		const Expression& proc = tailItems()[0];
+		if (proc.tailItems().empty() && env.is_proc(proc.head())) {
 			return env.get_proc(proc.head())(applyArgs);
 
 		// If the procedure is a pre-defined or anonymous lambda function
 		} else {
-			Expression lambda = proc.eval(env);
+			Expression storage;
+			const Expression& lambda = resolveProcedure(proc, env, storage);
 
 			// If we have a lambda function, evaluate the with that function
 			if (lambda.isHeadLambdaRoot()) {
@@ -364,163 +896,757 @@ Expression Expression::handle_apply(Environment& env) {
 	throw SemanticError("Error: wrong number of arguments to apply which takes two arguments");
 }
 
-Expression Expression::handle_map(Environment& env) {
-
-		// The first expression is a procedure, and the second is the list of expressions
-		if (m_tail.size() == 2) {
-
-			// pre-evaluate the second expression to create a list
-			Expression list = m_tail[1].eval(env);
-			if (!list.isHeadListRoot()) {
-				throw SemanticError("Error: second argument to map not a list");
-			}
-
-			// create the list
-			std::vector<Expression> mapList(list.tailConstBegin(), list.tailConstEnd());
-
-			// to be a valid procedure, the expression should be JUST the procedure symbol
-			Expression& proc = m_tail[0];
-			if (proc.m_tail.empty() && env.is_proc(proc.head())) {
-				for (Expression& a : mapList) {
-					a = env.get_proc(proc.head())(std::vector<Expression>{a});
-				}
-
-				return Expression(mapList);
-
-			// The procedure could be a pre-defined lambda or anonymous lambda
-			} else {
-				Expression lambda = proc.eval(env);
-
-				// If we have a lambda function, evaluate the map with that function
-				if (lambda.isHeadLambdaRoot()) {
-					for (Expression& a : mapList) {
-						a = apply_lambda(lambda, std::vector<Expression>{a}, env);
-					}
-
-					return Expression(mapList);
+// Call f(i) for every i in [0, count), in ranges of grain indices spread across the shared thread
+// pool. If calls fail, the error of the first failing index is rethrown, the same error a
+// sequential loop would report. Indices after a known failure are skipped
+template<typename F>
+void forEachIndexParallel(std::size_t count, std::size_t grain, F f) {
+	std::atomic<std::size_t> firstFailure(count);
+	std::exception_ptr error;
+	std::mutex errorMutex;
+
+	ThreadPool::shared().parallelFor(count, grain, [&](std::size_t begin, std::size_t end) {
+		for (std::size_t i = begin; i < end && i < firstFailure.load(); i++) {
+			try {
+				f(i);
+			} catch (...) {
+				std::lock_guard<std::mutex> lock(errorMutex);
+				if (i < firstFailure.load()) {
+					firstFailure.store(i);
+					error = std::current_exception();
 				}
 			}
-
-			throw SemanticError("Error: first argument to map not a procedure");
 		}
+	});
 
-		throw SemanticError("Error: wrong number of arguments to map which takes two arguments");
+	if (error) {
+		std::rethrow_exception(error);
+	}
 }
 
-Expression Expression::handle_setProperty(Environment& env) {
-	if (m_tail.size() == 3) {
-		if (m_tail[0].isHeadStringLiteral()) {
+// Lists shorter than this are mapped on the calling thread
+const std::size_t PARALLEL_MAP_MIN = 64;
 
-			// If the expression already lives in the environment, we can modify it directly. Note, that
-			// if the expression found is a lambda function with arguments, we only want to set a
-			// property to its returned expression. Otherwise, if the lambda has no arguments, we can
-			// set a property to the function itself
-			Expression* expPtr = env.get_exp_ptr(m_tail[2].head());
-			if (expPtr != nullptr && (!expPtr->isHeadLambdaRoot() ||
-				(expPtr->isHeadLambdaRoot() && m_tail[2].m_tail.size() == 0))) {
-				expPtr->setProperty(m_tail[0].head().asSymbol(true), m_tail[1].eval(env));
-				return *expPtr;
-			} else {
+// The number of indices per range for a parallel loop over count independent calls, about four
+// ranges per thread so uneven calls balance
+std::size_t parallelGrain(std::size_t count) {
+	return std::max<std::size_t>(1, count / (4 * (ThreadPool::shared().size() + 1)));
+}
 
-				// grab the evaluated expression to apply the property to
-				Expression exp = m_tail[2].eval(env);
-				exp.setProperty(m_tail[0].head().asSymbol(true), m_tail[1].eval(env));
-				return exp;
-			}
+// Build the list of f(element) for every element of list, in order. Procedures only see their
+// arguments and lambda bodies run in a scope of their own, so the calls are independent and long
+// lists are split across the shared thread pool
+template<typename F>
+Expression mapElements(const Expression& list, F f) {
+	std::size_t count = std::distance(list.tailConstBegin(), list.tailConstEnd());
+	if (count < PARALLEL_MAP_MIN) {
+		std::vector<Expression> results;
+		results.reserve(count);
+		for (auto it = list.tailConstBegin(); it != list.tailConstEnd(); it++) {
+			results.push_back(f(*it));
 		}
 
-		throw SemanticError("Error: first argument to set-property not a string literal");
+		return Expression(results);
 	}
 
-	throw SemanticError("Error: wrong number of arguments to set-property which takes three "
-		"arguments");
+	const Expression* elements = &*list.tailConstBegin();
+	std::vector<Expression> results(count);
+	forEachIndexParallel(count, parallelGrain(count), [&](std::size_t i) {
+		results[i] = f(elements[i]);
+	});
+
+	return Expression(results);
 }
 
-Expression Expression::handle_getProperty(Environment& env) {
-	if (m_tail.size() == 2) {
-		if (m_tail[0].isHeadStringLiteral()) {
+// Lists shorter than this are mapped one call at a time, packing them does not pay and the calls
+// let the lambda be promoted to its compiled form
+const std::size_t ARRAY_MAP_MIN = 32;
+
+// Map a lambda over a list of real numbers with the array form of the lambda (see
+// lambda_compiler.hpp). return false if it has none or the list holds anything else, the list is
+// then mapped one call at a time
+bool mapNumbers(const Expression& lambda, const Expression& list, const Environment& env,
+	Expression& result) {
+	std::size_t count = std::distance(list.tailConstBegin(), list.tailConstEnd());
+	if (count < ARRAY_MAP_MIN) {
+		return false;
+	}
 
-			// Get the expression from the environment or just evaluate it
-			Expression exp = m_tail[1].eval(env);
-			return exp.getProperty(m_tail[0].head().asSymbol(true));
+	std::vector<double> xs;
+	xs.reserve(count);
+	for (auto it = list.tailConstBegin(); it != list.tailConstEnd(); it++) {
+		if (!it->isHeadNumber()) {
+			return false;
 		}
 
-		throw SemanticError("Error: first argument to get-property not a string literal");
+		xs.push_back(it->head().asNumber());
 	}
 
-	throw SemanticError("Error: wrong number of arguments to get-property which takes two "
-		"arguments");
-}
-
-// this is a simple recursive version. the iterative version is more
-// difficult with the ast data structure used (no parent pointer).
-// this limits the practical depth of our AST
-Expression Expression::eval(Environment& env) {
+	std::vector<double> ys;
+	if (!evalLambdaArray(lambda, xs, ys, env)) {
+		return false;
+	}
 
-	// check for interrupt signal
-	if (interrupt_flag.load()) {
-		interrupt_flag.store(false);
-		env.reset();
-		throw SemanticError("Error: interpreter kernel interrupted");
+	std::vector<Expression> results;
+	results.reserve(count);
+	for (double y : ys) {
+		results.push_back(Expression(y));
 	}
 
-	if (m_head.asSymbol() == "begin") {
+	result = Expression(results);
+	return true;
+}
 
-		// handle begin special-form
-		return handle_begin(env);
-	} else if (m_head.asSymbol() == "define") {
+// The elements of a map over a sequence kept for later reads, past these they are computed again
+// every time, so streaming a long map runs in bounded memory
+const std::size_t MAP_MEMO_MAX = 1 << 16;
 
-		// handle define special-form
-		return handle_define(env);
-	} else if (m_head.asSymbol() == "apply") {
+// A map over a sequence. Its elements are computed when they are read and the first ones are
+// remembered, so reading a defined map again, or walking it with first and rest, calls f once per
+// element. Forcing it maps the forced source like map does a list
+class MapSequence: public Sequence {
+public:
+	typedef std::function<Expression(const Expression&)> Function;
 
-		// handle apply special-form
-		return handle_apply(env);
-	} else if (m_head.asSymbol() == "map") {
+	MapSequence(const Expression& source, Function f):
+		m_source(source), m_f(f), m_memo(std::make_shared<Memo>()) {}
 
-		// handle map special-form
-		return handle_map(env);
-	} else if (isHeadListRoot()) {
+	// f calls lambda in scope, so forcing may use the array form of the lambda
+	MapSequence(const Expression& source, Function f, const Expression& lambda,
+		std::shared_ptr<const Environment> scope):
+		m_source(source), m_f(f), m_lambda(lambda), m_scope(scope),
+		m_memo(std::make_shared<Memo>()) {}
 
-		// handle list special-form
-		return handle_list(env);
-	} else if (isHeadLambdaRoot()) {
+	std::unique_ptr<SequenceCursor> cursor() const {
+		return std::unique_ptr<SequenceCursor>(new Cursor(m_source, m_f, m_memo));
+	}
 
-		// handle lambda special-form
-		return handle_lambda(env);
-	} else if (m_head.asSymbol() == "set-property") {
+	std::size_t length() const {
+		return elementCount(m_source);
+	}
 
-		// handle set-property special-form
-		return handle_setProperty(env);
-	} else if (m_head.asSymbol() == "get-property") {
+	// the elements the cursors already produced are reused, only the rest of the source is mapped
+	Expression toList() const {
+		std::vector<Expression> elements;
+		{
+			std::lock_guard<std::mutex> lock(m_memo->mutex);
+			elements = m_memo->elements;
+		}
 
-		// handle get-property special-form
-		return handle_getProperty(env);
-	} else if (m_tail.empty()) {
-		return handle_lookup(m_head, env);
-	} else {
+		Expression list = forceSequence(m_source);
+		if (!elements.empty()) {
+			std::size_t count = std::distance(list.tailConstBegin(), list.tailConstEnd());
+			elements.resize(std::min(elements.size(), count));
+			list = Expression(std::vector<Expression>(list.tailConstBegin() + elements.size(),
+				list.tailConstEnd()));
+		}
 
-		// else attempt to treat as procedure
-		std::vector<Expression> results;
-		for (Expression::IteratorType it = m_tail.begin(); it != m_tail.end(); ++it) {
-			results.push_back(it->eval(env));
+		Expression result;
+		if (!m_scope || !mapNumbers(m_lambda, list, *m_scope, result)) {
+			result = mapElements(list, m_f);
 		}
 
-		return apply(m_head, results, env);
-	}
-}
+		if (elements.empty()) {
+			return result;
+		}
 
-Expression Expression::evalLambda(const std::vector<Expression>& input,
-		const Environment& env) const {
-	if (isHeadLambdaRoot()) {
-		return apply_lambda(*this, input, env);
+		elements.insert(elements.end(), result.tailConstBegin(), result.tailConstEnd());
+		return Expression(elements);
 	}
 
-	return Expression();
-}
-
+private:
+
+	// the elements produced so far, shared by the cursors. f is called without holding the
+	// mutex, so it may read the map itself or wait for tasks that do
+	struct Memo {
+		std::mutex mutex;
+		std::vector<Expression> elements;
+	};
+
+	Expression m_source;
+	Function m_f;
+	Expression m_lambda;
+	std::shared_ptr<const Environment> m_scope;
+	std::shared_ptr<Memo> m_memo;
+
+	class Cursor: public SequenceCursor {
+	public:
+		Cursor(const Expression& source, Function f, std::shared_ptr<Memo> memo):
+			m_source(elementCursor(source)), m_f(f), m_memo(memo), m_index(0), m_skip(0) {}
+
+	protected:
+		bool advance(Expression& value) {
+			{
+				std::lock_guard<std::mutex> lock(m_memo->mutex);
+				if (m_index < m_memo->elements.size()) {
+					value = m_memo->elements[m_index++];
+					m_skip++;
+					return true;
+				}
+			}
+
+			// the source is only read past the elements taken from the memo when one is missing
+			Expression element;
+			for (; m_skip > 0; m_skip--) {
+				if (!m_source->next(element)) {
+					return false;
+				}
+			}
+
+			if (!m_source->next(element)) {
+				return false;
+			}
+
+			value = m_f(element);
+			std::lock_guard<std::mutex> lock(m_memo->mutex);
+			if (m_index == m_memo->elements.size() && m_index < MAP_MEMO_MAX) {
+				m_memo->elements.push_back(value);
+			}
+
+			m_index++;
+			return true;
+		}
+
+	private:
+		std::unique_ptr<SequenceCursor> m_source;
+		Function m_f;
+		std::shared_ptr<Memo> m_memo;
+		std::size_t m_index;
+
+		// the elements of the source to pass over before reading the next one
+		std::size_t m_skip;
+	};
+};
+
+Expression Expression::handle_map(Environment& env) const {
+
+		// The first expression is a procedure, and the second is the list of expressions
+		if (tailItems().size() == 2) {
+
+			// pre-evaluate the second expression to create a list
+			Expression list = tailItems()[1].eval(env);
+			if (!list.isHeadListRoot() && !list.isHeadSequence()) {
+				throw SemanticError("Error: second argument to map not a list");
+			}
+
+			// to be a valid procedure, the expression should be JUST the procedure symbol. Each
+			// element is passed by reference
+			const Expression& proc = tailItems()[0];
+			if (proc.tailItems().empty() && env.is_proc(proc.head())) {
+				Procedure procedure = env.get_proc(proc.head());
+				auto f = [procedure](const Expression& element) {
+					return procedure(Arguments(&element, 1));
+				};
+
+				if (list.isHeadSequence()) {
+					return Expression::fromSequence(std::make_shared<MapSequence>(list, f));
+				}
+
+				return mapElements(list, f);
+
+			// The procedure could be a pre-defined lambda or anonymous lambda
+			} else {
+				Expression storage;
+				const Expression& lambda = resolveProcedure(proc, env, storage);
+
+				// If we have a lambda function, evaluate the map with that function. A map over a
+				// sequence is evaluated later, in a copy of the environment as it is now
+				if (lambda.isHeadLambdaRoot() && list.isHeadSequence()) {
+					std::shared_ptr<const Environment> scope = env.freeze();
+					Expression function(lambda);
+					return Expression::fromSequence(std::make_shared<MapSequence>(list,
+						[function, scope](const Expression& element) {
+							return apply_lambda(function, Arguments(&element, 1), *scope);
+						}, function, scope));
+				} else if (lambda.isHeadLambdaRoot()) {
+
+					// elementwise arithmetic over numbers is evaluated over all of them at once
+					Expression result;
+					if (mapNumbers(lambda, list, env, result)) {
+						return result;
+					}
+
+					const Environment& scope = env;
+					return mapElements(list, [&lambda, &scope](const Expression& element) {
+						return apply_lambda(lambda, Arguments(&element, 1), scope);
+					});
+				}
+			}
+
+			throw SemanticError("Error: first argument to map not a procedure");
+		}
+
+		throw SemanticError("Error: wrong number of arguments to map which takes two arguments");
+}
+
+// Built-in procedures taking any number of arguments whose result does not depend on how the
+// arguments are grouped, so a reduction with them can be split into independent parts
+bool isAssociativeBuiltin(const Atom& op) {
+	std::string s = op.asSymbol();
+	return s == "+" || s == "*" || s == "min" || s == "max";
+}
+
+// Elements combined by one call of an associative built-in procedure. The results of the chunks
+// are combined by a final call, so the grouping does not depend on the number of threads
+const std::size_t REDUCE_CHUNK = 1024;
+
+// Combine init, if not null, and the elements of a list or sequence with an associative built-in
+// procedure. The chunks of a list are combined in parallel, a sequence is read one chunk at a
+// time so it is reduced in constant memory. A lone element is kept as it is, like reduce does with
+// any other procedure
+Expression reduceAssociative(Procedure proc, const Expression* init, const Expression& items) {
+	std::vector<Expression> partials;
+	if (init != nullptr) {
+		partials.push_back(*init);
+	}
+
+	if (items.isHeadSequence()) {
+		std::unique_ptr<SequenceCursor> cursor = elementCursor(items);
+		std::vector<Expression> chunk;
+		Expression element;
+		bool more = true;
+		while (more) {
+			chunk.clear();
+			while (chunk.size() < REDUCE_CHUNK && (more = cursor->next(element))) {
+				chunk.push_back(element);
+			}
+
+			if (chunk.size() == 1) {
+				partials.push_back(chunk[0]);
+			} else if (!chunk.empty()) {
+				partials.push_back(proc(Arguments(chunk)));
+			}
+		}
+	} else {
+		std::size_t count = std::distance(items.tailConstBegin(), items.tailConstEnd());
+		std::size_t chunks = (count + REDUCE_CHUNK - 1) / REDUCE_CHUNK;
+		std::size_t first = partials.size();
+		partials.resize(first + chunks);
+
+		const Expression* elements = (count == 0) ? nullptr : &*items.tailConstBegin();
+		forEachIndexParallel(chunks, 1, [&](std::size_t i) {
+			std::size_t begin = i * REDUCE_CHUNK;
+			std::size_t size = std::min(REDUCE_CHUNK, count - begin);
+			partials[first + i] = (size == 1) ? elements[begin] :
+				proc(Arguments(elements + begin, size));
+		});
+	}
+
+	if (partials.empty()) {
+		throw SemanticError("Error: reduce of an empty list");
+	}
+
+	return (partials.size() == 1) ? partials[0] : proc(Arguments(partials));
+}
+
+// Combine acc and the elements of a list or sequence from the left, with one call of
+// combine(acc, element) per element
+template<typename F>
+Expression foldElements(Expression acc, SequenceCursor& cursor, F combine) {
+	Expression element;
+	while (cursor.next(element)) {
+		acc = combine(acc, element);
+	}
+
+	return acc;
+}
+
+// Reduce items with the procedure argument proc of the special form named form, starting from
+// init if it is not null or from the first element
+Expression reduceElements(const Expression& proc, const Expression* init, const Expression& items,
+	Environment& env, const std::string& form) {
+	if (!items.isHeadListRoot() && !items.isHeadSequence()) {
+		throw SemanticError("Error: " + std::string(init == nullptr ? "second" : "third") +
+			" argument to " + form + " not a list");
+	}
+
+	// a built-in procedure is given as just its symbol, like for map
+	Procedure procedure = nullptr;
+	Expression storage;
+	const Expression* lambda = nullptr;
+	if (proc.tailConstBegin() == proc.tailConstEnd() && env.is_proc(proc.head())) {
+		procedure = env.get_proc(proc.head());
+		if (isAssociativeBuiltin(proc.head())) {
+			return reduceAssociative(procedure, init, items);
+		}
+	} else {
+		lambda = &resolveProcedure(proc, env, storage);
+		if (!lambda->isHeadLambdaRoot()) {
+			throw SemanticError("Error: first argument to " + form + " not a procedure");
+		}
+	}
+
+	std::unique_ptr<SequenceCursor> cursor = elementCursor(items);
+	Expression acc;
+	if (init != nullptr) {
+		acc = *init;
+	} else if (!cursor->next(acc)) {
+		throw SemanticError("Error: reduce of an empty list");
+	}
+
+	const Environment& scope = env;
+	return foldElements(acc, *cursor, [procedure, lambda, &scope](const Expression& left,
+		const Expression& right) {
+		Expression args[2] = {left, right};
+		return (lambda != nullptr) ? apply_lambda(*lambda, Arguments(args, 2), scope) :
+			procedure(Arguments(args, 2));
+	});
+}
+
+Expression Expression::handle_reduce(Environment& env) const {
+	if (tailItems().size() == 2) {
+		Expression items = tailItems()[1].eval(env);
+		return reduceElements(tailItems()[0], nullptr, items, env, "reduce");
+	}
+
+	throw SemanticError("Error: wrong number of arguments to reduce which takes two arguments");
+}
+
+Expression Expression::handle_fold(Environment& env) const {
+	if (tailItems().size() == 3) {
+		Expression init = tailItems()[1].eval(env);
+		Expression items = tailItems()[2].eval(env);
+		return reduceElements(tailItems()[0], &init, items, env, "fold");
+	}
+
+	throw SemanticError("Error: wrong number of arguments to fold which takes three arguments");
+}
+
+// A one argument procedure given to filter or sort-by, called on an element
+typedef std::function<Expression(const Expression&)> ElementFunction;
+
+// Resolve the procedure argument proc of the special form named form, a built-in procedure symbol
+// or a lambda. A lambda is called in env, or in a copy of env as it is now if the function is
+// called later by a lazy sequence
+ElementFunction elementFunction(const Expression& proc, Environment& env, bool lazy,
+	const std::string& form) {
+	if (proc.tailConstBegin() == proc.tailConstEnd() && env.is_proc(proc.head())) {
+		Procedure procedure = env.get_proc(proc.head());
+		return [procedure](const Expression& element) {
+			return procedure(Arguments(&element, 1));
+		};
+	}
+
+	Expression storage;
+	Expression function = resolveProcedure(proc, env, storage);
+	if (!function.isHeadLambdaRoot()) {
+		throw SemanticError("Error: first argument to " + form + " not a procedure");
+	} else if (lazy) {
+		std::shared_ptr<const Environment> scope = env.freeze();
+		return [function, scope](const Expression& element) {
+			return apply_lambda(function, Arguments(&element, 1), *scope);
+		};
+	}
+
+	const Environment* scope = &env;
+	return [function, scope](const Expression& element) {
+		return apply_lambda(function, Arguments(&element, 1), *scope);
+	};
+}
+
+// Return true if the result of the predicate of filter holds, any number but 0 does
+bool predicateHolds(const Expression& result) {
+	if (!result.isHeadNumber()) {
+		throw SemanticError("Error: predicate of filter did not return a real number");
+	}
+
+	return result.head().asNumber() != 0;
+}
+
+// Build the list of the elements of list for which pred holds, in order. Long lists are tested
+// on the shared thread pool like map
+Expression filterElements(const Expression& list, const ElementFunction& pred) {
+	std::size_t count = std::distance(list.tailConstBegin(), list.tailConstEnd());
+	const Expression* elements = (count == 0) ? nullptr : &*list.tailConstBegin();
+	std::vector<char> keep(count);
+	if (count < PARALLEL_MAP_MIN) {
+		for (std::size_t i = 0; i < count; i++) {
+			keep[i] = predicateHolds(pred(elements[i]));
+		}
+	} else {
+		forEachIndexParallel(count, parallelGrain(count), [&](std::size_t i) {
+			keep[i] = predicateHolds(pred(elements[i]));
+		});
+	}
+
+	std::vector<Expression> results;
+	for (std::size_t i = 0; i < count; i++) {
+		if (keep[i]) {
+			results.push_back(elements[i]);
+		}
+	}
+
+	return Expression(results);
+}
+
+// A filter of a sequence. Its elements are tested when they are read, forcing it filters the
+// forced source like filter does a list
+class FilterSequence: public Sequence {
+public:
+	FilterSequence(const Expression& source, ElementFunction pred): m_source(source), m_pred(pred) {}
+
+	std::unique_ptr<SequenceCursor> cursor() const {
+		return std::unique_ptr<SequenceCursor>(new Cursor(m_source, m_pred));
+	}
+
+	Expression toList() const {
+		return filterElements(forceSequence(m_source), m_pred);
+	}
+
+private:
+	Expression m_source;
+	ElementFunction m_pred;
+
+	class Cursor: public SequenceCursor {
+	public:
+		Cursor(const Expression& source, ElementFunction pred):
+			m_source(elementCursor(source)), m_pred(pred) {}
+
+	protected:
+		bool advance(Expression& value) {
+			while (m_source->next(value)) {
+				if (predicateHolds(m_pred(value))) {
+					return true;
+				}
+			}
+
+			return false;
+		}
+
+	private:
+		std::unique_ptr<SequenceCursor> m_source;
+		ElementFunction m_pred;
+	};
+};
+
+Expression Expression::handle_filter(Environment& env) const {
+	if (tailItems().size() == 2) {
+		Expression list = tailItems()[1].eval(env);
+		if (!list.isHeadListRoot() && !list.isHeadSequence()) {
+			throw SemanticError("Error: second argument to filter not a list");
+		}
+
+		// a filter of a sequence is lazy like a map of one
+		ElementFunction pred = elementFunction(tailItems()[0], env, list.isHeadSequence(), "filter");
+		if (list.isHeadSequence()) {
+			return Expression::fromSequence(std::make_shared<FilterSequence>(list, pred));
+		}
+
+		return filterElements(list, pred);
+	}
+
+	throw SemanticError("Error: wrong number of arguments to filter which takes two arguments");
+}
+
+// The elements of a list ordered by the real number keys computed for them, NaN last, which keep
+// their order when equal. The keys are computed once per element, like map, and sorted in parallel
+Expression Expression::handle_sortBy(Environment& env) const {
+	if (tailItems().size() == 2) {
+		Expression list = forceSequence(tailItems()[1].eval(env));
+		if (!list.isHeadListRoot()) {
+			throw SemanticError("Error: second argument to sort-by not a list");
+		}
+
+		ElementFunction key = elementFunction(tailItems()[0], env, false, "sort-by");
+		Expression keys = mapElements(list, [&key](const Expression& element) {
+			Expression value = key(element);
+			if (!value.isHeadNumber()) {
+				throw SemanticError("Error: key of sort-by is not a real number");
+			}
+
+			return value;
+		});
+
+		std::vector<std::pair<double, std::size_t>> order;
+		for (auto it = keys.tailConstBegin(); it != keys.tailConstEnd(); it++) {
+			order.push_back({it->head().asNumber(), order.size()});
+		}
+
+		parallelStableSort(order, [](const std::pair<double, std::size_t>& a,
+			const std::pair<double, std::size_t>& b) {
+			return numberBefore(a.first, b.first);
+		});
+
+		std::vector<Expression> results;
+		results.reserve(order.size());
+		for (auto& item : order) {
+			results.push_back(*(list.tailConstBegin() + item.second));
+		}
+
+		return Expression(results);
+	}
+
+	throw SemanticError("Error: wrong number of arguments to sort-by which takes two arguments");
+}
+
+Expression Expression::handle_setProperty(Environment& env) const {
+	if (tailItems().size() == 3) {
+		if (tailItems()[0].isHeadStringLiteral()) {
+
+			// If the expression already lives in the environment, we can modify it directly. Note, that
+			// if the expression found is a lambda function with arguments, we only want to set a
+			// property to its returned expression. Otherwise, if the lambda has no arguments, we can
+			// set a property to the function itself
+			Expression* expPtr = env.get_exp_ptr(tailItems()[2].head());
+			if (expPtr != nullptr && (!expPtr->isHeadLambdaRoot() ||
+				(expPtr->isHeadLambdaRoot() && tailItems()[2].tailItems().size() == 0))) {
+				expPtr->setProperty(tailItems()[0].head().asSymbol(true), tailItems()[1].eval(env));
+				return *expPtr;
+			} else {
+
+				// grab the evaluated expression to apply the property to
+				Expression exp = tailItems()[2].eval(env);
+				exp.setProperty(tailItems()[0].head().asSymbol(true), tailItems()[1].eval(env));
+				return exp;
+			}
+		}
+
+		throw SemanticError("Error: first argument to set-property not a string literal");
+	}
+
+	throw SemanticError("Error: wrong number of arguments to set-property which takes three "
+		"arguments");
+}
+
+Expression Expression::handle_getProperty(Environment& env) const {
+	if (tailItems().size() == 2) {
+		if (tailItems()[0].isHeadStringLiteral()) {
+
+			// Get the expression from the environment or just evaluate it
+			Expression exp = tailItems()[1].eval(env);
+			return exp.getProperty(tailItems()[0].head().asSymbol(true));
+		}
+
+		throw SemanticError("Error: first argument to get-property not a string literal");
+	}
+
+	throw SemanticError("Error: wrong number of arguments to get-property which takes two "
+		"arguments");
+}
+
+Expression Expression::handle_delay(Environment& env) const {
+	if (tailItems().size() == 1) {
+
+		// the expression is evaluated when forced, in a copy of the environment as it is now
+		return makePromise(tailItems()[0], env);
+	}
+
+	throw SemanticError("Error: wrong number of arguments to delay which takes one argument");
+}
+
+Expression Expression::handle_force(Environment& env) const {
+	if (tailItems().size() == 1) {
+
+		// forcing anything but a promise returns it unchanged
+		return forcePromise(tailItems()[0].eval(env));
+	}
+
+	throw SemanticError("Error: wrong number of arguments to force which takes one argument");
+}
+
+// this is a simple recursive version. the iterative version is more
+// difficult with the ast data structure used (no parent pointer).
+// this limits the practical depth of our AST
+Expression Expression::eval(Environment& env) const {
+
+	// check for interrupt signal. In a parallel evaluation the first task to see it cancels the
+	// others, which stop here as if they had seen it too
+	if (interrupt_flag.load() || ThreadPool::isCancelled()) {
+		if (interrupt_flag.exchange(false)) {
+			ThreadPool::cancelCurrent();
+		}
+		env.reset();
+		throw SemanticError("Error: interpreter kernel interrupted");
+	}
+
+	if (m_head.asSymbol() == "begin") {
+
+		// handle begin special-form
+		return handle_begin(env);
+	} else if (m_head.asSymbol() == "define") {
+
+		// handle define special-form
+		return handle_define(env);
+	} else if (m_head.asSymbol() == "apply") {
+
+		// handle apply special-form
+		return handle_apply(env);
+	} else if (m_head.asSymbol() == "map") {
+
+		// handle map special-form
+		return handle_map(env);
+	} else if (m_head.asSymbol() == "reduce") {
+
+		// handle reduce special-form
+		return handle_reduce(env);
+	} else if (m_head.asSymbol() == "fold") {
+
+		// handle fold special-form
+		return handle_fold(env);
+	} else if (m_head.asSymbol() == "filter") {
+
+		// handle filter special-form
+		return handle_filter(env);
+	} else if (m_head.asSymbol() == "sort-by") {
+
+		// handle sort-by special-form
+		return handle_sortBy(env);
+	} else if (isHeadListRoot()) {
+
+		// handle list special-form
+		return handle_list(env);
+	} else if (isHeadLambdaRoot()) {
+
+		// handle lambda special-form
+		return handle_lambda(env);
+	} else if (m_head.asSymbol() == "set-property") {
+
+		// handle set-property special-form
+		return handle_setProperty(env);
+	} else if (m_head.asSymbol() == "get-property") {
+
+		// handle get-property special-form
+		return handle_getProperty(env);
+	} else if (m_head.asSymbol() == "delay") {
+
+		// handle delay special-form
+		return handle_delay(env);
+	} else if (m_head.asSymbol() == "force") {
+
+		// handle force special-form
+		return handle_force(env);
+	} else if (tailItems().empty()) {
+		return handle_lookup(m_head, env);
+	} else {
+
+		// else attempt to treat as procedure, staging the evaluated arguments on the argument stack
+		ArgumentFrame frame;
+		if (m_hints & ParallelTailHint) {
+			for (auto& value : evalParallel(tailItems(), env)) {
+				frame.push(value);
+			}
+		} else {
+			for (auto& exp : tailItems()) {
+				frame.push(exp.eval(env));
+			}
+		}
+
+		return apply(m_head, frame.arguments(), env);
+	}
+}
+
+Expression Expression::evalLambda(Arguments input, const Environment& env) const {
+	if (isHeadLambdaRoot()) {
+		return apply_lambda(*this, input, env);
+	}
+
+	return Expression();
+}
+
 std::ostream& operator<<(std::ostream& out, const Expression& exp) {
-	if (exp.head().isNone()) {
+	if (exp.isHeadSequence()) {
+		return out << forceSequence(exp);
+	} else if (exp.head().isNone()) {
 		out << "NONE";
 		return out;
 	}
@@ -549,13 +1675,36 @@ std::ostream& operator<<(std::ostream& out, const Expression& exp) {
 }
 
 bool Expression::operator==(const Expression& exp) const noexcept {
+
+	// a promise is only equal to itself
+	if (isHeadPromise() || exp.isHeadPromise()) {
+		return m_promise == exp.m_promise;
+	}
+
+	// sequences compare by their elements, a sequence whose elements cannot be computed is not
+	// equal to anything
+	if (isHeadSequence() || exp.isHeadSequence()) {
+		try {
+			return forceSequence(*this) == forceSequence(exp);
+		} catch (...) {
+			return false;
+		}
+	}
+
 	bool result = (m_head == exp.m_head);
 
-	result = result && (m_tail.size() == exp.m_tail.size());
+	// expressions sharing a tail have equal tails
+	if (!result || m_tail == exp.m_tail) {
+		return result;
+	}
+
+	const std::vector<Expression>& left = tailItems();
+	const std::vector<Expression>& right = exp.tailItems();
+	result = result && (left.size() == right.size());
 
 	if (result) {
-		for (auto lefte = m_tail.begin(), righte = exp.m_tail.begin();
-			lefte != m_tail.end() && righte != exp.m_tail.end();
+		for (auto lefte = left.begin(), righte = right.begin();
+			lefte != left.end() && righte != right.end();
 			++lefte, ++righte) {
 
 			result = result && (*lefte == *righte);
@@ -582,6 +1731,12 @@ const double PI = std::atan2(0, -1);
 #define PLOT_M 50
 #define PLOT_LINE_ANG_MIN 175
 #define PLOT_SPLIT_MAX 10
+#define PLOT_RESOLUTION 1000
+#define PLOT_DENSITY_RESOLUTION 200
+#define PLOT_SURFACE_RESOLUTION 64
+#define PLOT_CONTOUR_RESOLUTION 24
+#define PLOT_CONTOUR_REFINEMENT 2
+#define PLOT_CONTOUR_LEVELS 10
 
 // convenience struct to hold the bounds values and stem abscissa starting value
 typedef struct _Bounds {
@@ -626,33 +1781,19 @@ typedef struct _Line {
 	}
 } Line;
 
-// Helper function to create a plotscript point object
-Expression makePointExpression(Point p, double size = 0) {
-
-	// NOTE: Ordinate values are negated because of Qt's coordinate system
-	Expression point({Expression(p.x), Expression(-p.y)});
-	point.setProperty("object-name", Expression(Atom("\"point\"")));
-	point.setProperty("size", Expression(size));
-	return point;
+// Helper functions to add plotscript point, line and text objects to a plot
+// NOTE: Ordinate values are negated because of Qt's coordinate system
+void addPoint(PlotData& plot, Point p, double size = 0) {
+	plot.addPoint(p.x, -p.y, size);
 }
 
-// Helper function to create a plotscript line object
-Expression makeLineExpression(Line l) {
-	Expression line({makePointExpression({l.x1, l.y1}), makePointExpression({l.x2, l.y2})});
-	line.setProperty("object-name", Expression(Atom("\"line\"")));
-	line.setProperty("thickness", Expression(0));
-	return line;
+void addLine(PlotData& plot, Line l) {
+	plot.addLine(l.x1, -l.y1, l.x2, -l.y2, 0);
 }
 
-// Helper function to create a plotscript text object
-Expression makeTextExpression(const std::string& text, Point point, double scale = 1,
+void addText(PlotData& plot, const std::string& text, Point point, double scale = 1,
 	double rotation = 0) {
-	Expression textExp(Atom('"' + text + '"'));
-	textExp.setProperty("object-name", Expression(Atom("\"text\"")));
-	textExp.setProperty("position", makePointExpression(point));
-	textExp.setProperty("text-scale", Expression(scale));
-	textExp.setProperty("text-rotation", Expression(rotation));
-	return textExp;
+	plot.addText(text, point.x, -point.y, scale, rotation);
 }
 
 // Helper function to get a key-value pair from the plot options
@@ -669,7 +1810,8 @@ std::pair<const Expression&, const Expression&> getOptionKeyValue(const Expressi
 		}
 	}
 
-	return {Expression(), Expression()};
+	static const Expression none;
+	return {none, none};
 }
 
 // convenience struct to house the possible plot options
@@ -679,28 +1821,26 @@ typedef struct _PlotOptions {
 } PlotOptions;
 
 // Helper function to apply plot options
-void applyPlotOptions(std::vector<Expression>& plotData, const PlotOptions& options,
-	const Bounds& scaled) {
+void applyPlotOptions(PlotData& plot, const PlotOptions& options, const Bounds& scaled) {
 	if (options.title != std::string()) {
-		plotData.push_back(makeTextExpression(options.title,
-			{scaled.AL + (PLOT_N / 2), scaled.OU + PLOT_A}, options.textScale));
+		addText(plot, options.title, {scaled.AL + (PLOT_N / 2), scaled.OU + PLOT_A},
+			options.textScale);
 	}
 
 	if (options.abscissaLabel != std::string()) {
-		plotData.push_back(makeTextExpression(options.abscissaLabel,
-			{scaled.AL + (PLOT_N / 2), scaled.OL - PLOT_A}, options.textScale));
+		addText(plot, options.abscissaLabel, {scaled.AL + (PLOT_N / 2), scaled.OL - PLOT_A},
+			options.textScale);
 	}
 
 	if (options.ordinateLabel != std::string()) {
-		plotData.push_back(makeTextExpression(options.ordinateLabel,
-			{scaled.AL - PLOT_B, scaled.OL + (PLOT_N / 2)}, options.textScale, -PI / 2));
+		addText(plot, options.ordinateLabel,
+			{scaled.AL - PLOT_B, scaled.OL + (PLOT_N / 2)}, options.textScale, -PI / 2);
 	}
 }
 
 // Helper function to handle any possible options for plots (title, axis labels, etc.)
 // it returns the text scale if it was set (1 if it was not set)
-double handlePlotOptions(std::vector<Expression>& plotData, const Expression& options,
-	const Bounds& scaled) {
+double handlePlotOptions(PlotData& plot, const Expression& options, const Bounds& scaled) {
 
 	// the options expression should be a list
 	if (options.isHeadListRoot()) {
@@ -713,34 +1853,41 @@ double handlePlotOptions(std::vector<Expression>& plotData, const Expression& op
 		for (auto it = optionsBegin; it != optionsEnd; it++) {
 			std::pair<const Expression&, const Expression&> option = getOptionKeyValue(*it);
 
+			// a delayed value is only computed for the options that are used
+			const std::string key = option.first.head().asSymbol(true);
+
 			// If there is a title,
-			if (option.first.head().asSymbol(true) == "title") {
-				if (option.second.isHeadStringLiteral()) {
-					plotOptions.title = option.second.head().asSymbol(true);
+			if (key == "title") {
+				Expression value = forcePromise(option.second);
+				if (value.isHeadStringLiteral()) {
+					plotOptions.title = value.head().asSymbol(true);
 				}
 
 				// If there is an abscissa label,
-			} else if (option.first.head().asSymbol(true) == "abscissa-label") {
-				if (option.second.isHeadStringLiteral()) {
-					plotOptions.abscissaLabel = option.second.head().asSymbol(true);
+			} else if (key == "abscissa-label") {
+				Expression value = forcePromise(option.second);
+				if (value.isHeadStringLiteral()) {
+					plotOptions.abscissaLabel = value.head().asSymbol(true);
 				}
 
 				// If there is an ordinate label,
-			} else if (option.first.head().asSymbol(true) == "ordinate-label") {
-				if (option.second.isHeadStringLiteral()) {
-					plotOptions.ordinateLabel = option.second.head().asSymbol(true);
+			} else if (key == "ordinate-label") {
+				Expression value = forcePromise(option.second);
+				if (value.isHeadStringLiteral()) {
+					plotOptions.ordinateLabel = value.head().asSymbol(true);
 				}
 
 				// If there is a text-scale option,
-			} else if (option.first.head().asSymbol(true) == "text-scale") {
-				if (option.second.isHeadNumber()) {
-					plotOptions.textScale = option.second.head().asNumber();
+			} else if (key == "text-scale") {
+				Expression value = forcePromise(option.second);
+				if (value.isHeadNumber()) {
+					plotOptions.textScale = value.head().asNumber();
 				}
 			}
 		}
 
 		// After all options have been evaluated, apply them and return the text scale
-		applyPlotOptions(plotData, plotOptions, scaled);
+		applyPlotOptions(plot, plotOptions, scaled);
 		return plotOptions.textScale;
 	}
 
@@ -767,8 +1914,8 @@ Point getPointValues(const Expression& point) {
 	throw SemanticError("Error: not a valid point for plot");
 }
 
-// returns a bounds object (AL, AU, OL, and OU) based off a list of points
-Bounds getBoundsFromList(const Expression& data) {
+// returns a bounds object (AL, AU, OL, and OU) based off a list of points, and the points
+Bounds getBoundsFromList(const Expression& data, std::vector<Point>& points) {
 
 	// data should be a list expression when this function is called
 	auto dataBegin = data.tailConstBegin();
@@ -783,11 +1930,13 @@ Bounds getBoundsFromList(const Expression& data) {
 	Point firstPoint = getPointValues(*dataBegin);
 	double AL = firstPoint.x, AU = AL,
 		OL = firstPoint.y, OU = OL;
+	points.assign(1, firstPoint);
 
 	// Traverse through the list of points to find the minima and maxima
 	// I increment dataBegin before assigning it to "it" because we already got the first point
 	for (auto it = dataBegin + 1; it != dataEnd; it++) {
 		Point p = getPointValues(*it);
+		points.push_back(p);
 
 		// update the bound values
 		if (AL > p.x) {
@@ -806,13 +1955,13 @@ Bounds getBoundsFromList(const Expression& data) {
 	return {AL, AU, OL, OU};
 }
 
-// Helper function that adds the abscissa and ordinate axes to a vector of expressions. Also
+// Helper function that adds the abscissa and ordinate axes to a plot. Also
 // returns the starting point for stem plot lines
-double addPlotAxes(std::vector<Expression>& plotData, const Bounds& scaled) {
+double addPlotAxes(PlotData& plot, const Bounds& scaled) {
 
 	// Adding the ordinate axis
 	if (0 > scaled.AL && 0 < scaled.AU) {
-		plotData.push_back(makeLineExpression({0, 0, scaled.OL, scaled.OU}));
+		addLine(plot, {0, 0, scaled.OL, scaled.OU});
 	}
 
 	// In the cases where the abscissa axis does not need to be created, we still need a reference
@@ -824,23 +1973,22 @@ double addPlotAxes(std::vector<Expression>& plotData, const Bounds& scaled) {
 	} else {
 
 		// If the axis is in the plot, then we need to create another axis line
-		plotData.push_back(makeLineExpression({scaled.AL, scaled.AU, 0, 0}));
+		addLine(plot, {scaled.AL, scaled.AU, 0, 0});
 	}
 
 	return 0;
 }
 
-void addPlotEdges(std::vector<Expression>& plotData, const Bounds& scaled) {
+void addPlotEdges(PlotData& plot, const Bounds& scaled) {
 
 	// Data bounding box edges (top, bottom, left, right)
-	plotData.push_back(makeLineExpression({scaled.AL, scaled.AU, scaled.OU, scaled.OU}));
-	plotData.push_back(makeLineExpression({scaled.AL, scaled.AU, scaled.OL, scaled.OL}));
-	plotData.push_back(makeLineExpression({scaled.AL, scaled.AL, scaled.OU, scaled.OL}));
-	plotData.push_back(makeLineExpression({scaled.AU, scaled.AU, scaled.OU, scaled.OL}));
+	addLine(plot, {scaled.AL, scaled.AU, scaled.OU, scaled.OU});
+	addLine(plot, {scaled.AL, scaled.AU, scaled.OL, scaled.OL});
+	addLine(plot, {scaled.AL, scaled.AL, scaled.OU, scaled.OL});
+	addLine(plot, {scaled.AU, scaled.AU, scaled.OU, scaled.OL});
 }
 
-void addPlotTickLabels(std::vector<Expression>& plotData, const Bounds& bounds,
-	double textScale) {
+void addPlotTickLabels(PlotData& plot, const Bounds& bounds, double textScale) {
 	Bounds scaled = bounds.scaleForGraphics();
 
 	std::stringstream ss;
@@ -848,40 +1996,255 @@ void addPlotTickLabels(std::vector<Expression>& plotData, const Bounds& bounds,
 
 	// Tick labels (AL, AU, OL, OU)
 	ss << bounds.AL;
-	plotData.push_back(makeTextExpression(ss.str(), {scaled.AL, scaled.OL - PLOT_C}, textScale));
+	addText(plot, ss.str(), {scaled.AL, scaled.OL - PLOT_C}, textScale);
 
 	ss.str(std::string());
 	ss << bounds.AU;
-	plotData.push_back(makeTextExpression(ss.str(), {scaled.AU, scaled.OL - PLOT_C}, textScale));
+	addText(plot, ss.str(), {scaled.AU, scaled.OL - PLOT_C}, textScale);
 
 	ss.str(std::string());
 	ss << bounds.OL;
-	plotData.push_back(makeTextExpression(ss.str(), {scaled.AL - PLOT_D, scaled.OL}, textScale));
+	addText(plot, ss.str(), {scaled.AL - PLOT_D, scaled.OL}, textScale);
 
 	ss.str(std::string());
 	ss << bounds.OU;
-	plotData.push_back(makeTextExpression(ss.str(), {scaled.AL - PLOT_D, scaled.OU}, textScale));
+	addText(plot, ss.str(), {scaled.AL - PLOT_D, scaled.OU}, textScale);
 }
 
-void addScaledDiscreteData(const Expression& data, std::vector<Expression>& plotData,
-	const Bounds& bounds, double stemRoot) {
-	double absScale = bounds.calcAbsScale();
-	double ordScale = bounds.calcOrdScale();
+// Helper function to convert a non-negative number given as an option to a count, the largest
+// count for numbers too large for one. Converting them to std::size_t is undefined
+std::size_t optionCount(double value) {
+	const double limit = std::ldexp(1., std::numeric_limits<std::size_t>::digits);
+	return (value >= limit) ? std::numeric_limits<std::size_t>::max() :
+		static_cast<std::size_t>(value);
+}
 
-	auto dataBegin = data.tailConstBegin();
-	auto dataEnd = data.tailConstEnd();
-	for (auto it = dataBegin; it != dataEnd; it++) {
-		Point p = getPointValues(*it).scaleForGraphics(absScale, ordScale);
+// Options of a discrete plot that reduce a long series to about the resolution it is shown at
+typedef struct _DecimationOptions {
 
-		// Create the scaled point expression and add it to the plot data
-		plotData.push_back(makePointExpression(p, PLOT_P / 2));
-		plotData.push_back(makeLineExpression({p.x, p.x, stemRoot, p.y}));
-	}
-}
+	// "lttb", "min-max", "density", or empty to plot every point
+	std::string method;
 
-Expression discretePlot(const std::vector<Expression>& args) {
+	// the points kept by lttb, the columns of min-max which keeps up to two points in each, or the
+	// cells of each side of the density grid
+	std::size_t resolution = 0;
+} DecimationOptions;
 
-	// Discrete plots can take one or two arguments (options are, optional)
+// Helper function to read the decimation options of a discrete plot. Like the other plot options,
+// unknown methods and values of the wrong type are ignored
+DecimationOptions getDecimationOptions(const Expression& options) {
+	DecimationOptions decimation;
+	if (!options.isHeadListRoot()) {
+		return decimation;
+	}
+
+	for (auto it = options.tailConstBegin(); it != options.tailConstEnd(); it++) {
+		std::pair<const Expression&, const Expression&> option = getOptionKeyValue(*it);
+		const std::string key = option.first.head().asSymbol(true);
+		if (key == "decimation") {
+			Expression value = forcePromise(option.second);
+			std::string method = value.head().asSymbol(true);
+			if (value.isHeadStringLiteral() &&
+				(method == "lttb" || method == "min-max" || method == "density")) {
+				decimation.method = method;
+			}
+		} else if (key == "resolution") {
+			Expression value = forcePromise(option.second);
+			if (value.isHeadNumber() && value.head().asNumber() >= 3) {
+				decimation.resolution = optionCount(value.head().asNumber());
+			}
+		}
+	}
+
+	if (decimation.resolution == 0) {
+		decimation.resolution = (decimation.method == "density") ? PLOT_DENSITY_RESOLUTION :
+			PLOT_RESOLUTION;
+	} else if (decimation.method == "density") {
+
+		// the density grid holds resolution * resolution counts, it is capped like the grid of a
+		// surface plot
+		decimation.resolution = std::min<std::size_t>(decimation.resolution, PLOT_RESOLUTION);
+	}
+
+	return decimation;
+}
+
+// Largest triangle three buckets: keep the first and last points, and split the others in order
+// into count - 2 buckets. From each bucket keep the point making the largest triangle with the
+// point kept from the bucket before and the average of the bucket after, so the shape of the
+// series is kept with few points
+std::vector<Point> decimateLTTB(const std::vector<Point>& points, std::size_t count) {
+	if (points.size() <= count) {
+		return points;
+	}
+
+	std::vector<Point> kept;
+	kept.reserve(count);
+	kept.push_back(points.front());
+
+	double bucketSize = static_cast<double>(points.size() - 2) / (count - 2);
+	std::size_t previous = 0;
+	for (std::size_t b = 0; b < count - 2; b++) {
+		std::size_t begin = static_cast<std::size_t>(b * bucketSize) + 1;
+		std::size_t end = static_cast<std::size_t>((b + 1) * bucketSize) + 1;
+
+		// the average of the next bucket, or the last point after the last bucket
+		std::size_t nextEnd = std::min(static_cast<std::size_t>((b + 2) * bucketSize) + 1,
+			points.size() - 1);
+		Point average = points.back();
+		if (end < nextEnd) {
+			average = {0, 0};
+			for (std::size_t i = end; i < nextEnd; i++) {
+				average.x += points[i].x;
+				average.y += points[i].y;
+			}
+
+			average.x /= (nextEnd - end);
+			average.y /= (nextEnd - end);
+		}
+
+		// twice the area of the triangle, its sign does not matter
+		const Point& a = points[previous];
+		std::size_t best = begin;
+		double bestArea = -1;
+		for (std::size_t i = begin; i < end; i++) {
+			double area = std::fabs((a.x - average.x) * (points[i].y - a.y) -
+				(a.x - points[i].x) * (average.y - a.y));
+			if (area > bestArea) {
+				bestArea = area;
+				best = i;
+			}
+		}
+
+		kept.push_back(points[best]);
+		previous = best;
+	}
+
+	kept.push_back(points.back());
+	return kept;
+}
+
+// Split the abscissas into columns and keep the lowest and highest point of each column, in the
+// order of the series. Every extreme of the ordinates is kept whatever the order of the points
+std::vector<Point> decimateMinMax(const std::vector<Point>& points, const Bounds& bounds,
+	std::size_t columns) {
+	// the same as points.size() <= 2 * columns, which may overflow
+	if ((points.size() + 1) / 2 <= columns) {
+		return points;
+	}
+
+	const std::size_t none = points.size();
+	std::vector<std::size_t> lowest(columns, none), highest(columns, none);
+	double width = bounds.AU - bounds.AL;
+	for (std::size_t i = 0; i < points.size(); i++) {
+		std::size_t column = (width > 0) ?
+			std::min(static_cast<std::size_t>((points[i].x - bounds.AL) / width * columns),
+				columns - 1) : 0;
+		if (lowest[column] == none || points[i].y < points[lowest[column]].y) {
+			lowest[column] = i;
+		}
+
+		if (highest[column] == none || points[i].y > points[highest[column]].y) {
+			highest[column] = i;
+		}
+	}
+
+	std::vector<bool> keep(points.size(), false);
+	for (std::size_t c = 0; c < columns; c++) {
+		if (lowest[c] != none) {
+			keep[lowest[c]] = true;
+			keep[highest[c]] = true;
+		}
+	}
+
+	std::vector<Point> kept;
+	for (std::size_t i = 0; i < points.size(); i++) {
+		if (keep[i]) {
+			kept.push_back(points[i]);
+		}
+	}
+
+	return kept;
+}
+
+// Reduce the points of a discrete plot as the options ask, the bounds are those of every point
+std::vector<Point> decimatePoints(const std::vector<Point>& points, const Bounds& bounds,
+	const DecimationOptions& options) {
+	if (options.method == "lttb") {
+		return decimateLTTB(points, options.resolution);
+	} else if (options.method == "min-max") {
+		return decimateMinMax(points, bounds, options.resolution);
+	}
+
+	return points;
+}
+
+// Count the points in each cell of a grid of cells by cells over the bounds, row by row from the
+// top. Ranges of points are counted into grids of their own on the shared thread pool, which are
+// then summed, so the counts do not depend on how the points were split
+std::vector<std::uint32_t> binPoints(const std::vector<Point>& points, const Bounds& bounds,
+	std::size_t cells) {
+	std::vector<std::uint32_t> counts(cells * cells, 0);
+	std::mutex countsMutex;
+	double width = bounds.AU - bounds.AL;
+	double height = bounds.OU - bounds.OL;
+
+	// each range fills a grid, so ranges are at least as long as the grid
+	std::size_t grain = std::max(parallelGrain(points.size()), counts.size());
+	ThreadPool::shared().parallelFor(points.size(), grain, [&](std::size_t begin, std::size_t end) {
+		std::vector<std::uint32_t> local(counts.size(), 0);
+		for (std::size_t i = begin; i < end; i++) {
+			std::size_t column = (width > 0) ?
+				std::min(static_cast<std::size_t>((points[i].x - bounds.AL) / width * cells),
+					cells - 1) : 0;
+			std::size_t row = (height > 0) ?
+				std::min(static_cast<std::size_t>((bounds.OU - points[i].y) / height * cells),
+					cells - 1) : 0;
+			local[row * cells + column]++;
+		}
+
+		std::lock_guard<std::mutex> lock(countsMutex);
+		for (std::size_t c = 0; c < counts.size(); c++) {
+			counts[c] += local[c];
+		}
+	});
+
+	return counts;
+}
+
+// Add an image of columns by rows values over the area of the data
+void addImage(PlotData& plot, const Bounds& bounds, std::size_t columns, std::size_t rows,
+	std::vector<double> values, bool logarithmic) {
+	Bounds scaled = bounds.scaleForGraphics();
+	plot.addImage(scaled.AL, -scaled.OU, scaled.AU - scaled.AL, scaled.OU - scaled.OL, columns,
+		rows, std::move(values), logarithmic);
+}
+
+// Draw the points as a single image of their density, so drawing it costs the same however many
+// points there are. Counts are shaded on a log scale so sparse cells stay visible
+void addDensityImage(const std::vector<Point>& points, PlotData& plot, const Bounds& bounds,
+	std::size_t cells) {
+	std::vector<std::uint32_t> counts = binPoints(points, bounds, cells);
+	addImage(plot, bounds, cells, cells, std::vector<double>(counts.begin(), counts.end()), true);
+}
+
+void addScaledDiscreteData(const std::vector<Point>& points, PlotData& plot, const Bounds& bounds,
+	double stemRoot) {
+	double absScale = bounds.calcAbsScale();
+	double ordScale = bounds.calcOrdScale();
+
+	for (const Point& point : points) {
+		Point p = point.scaleForGraphics(absScale, ordScale);
+
+		// Create the scaled point expression and add it to the plot data
+		addPoint(plot, p, PLOT_P / 2);
+		addLine(plot, {p.x, p.x, stemRoot, p.y});
+	}
+}
+
+Expression discretePlot(Arguments args) {
+
+	// Discrete plots can take one or two arguments (options are, optional)
 	bool justData = args.size() == 1;
 	bool dataAndOptions = args.size() == 2;
 
@@ -890,16 +2253,29 @@ Expression discretePlot(const std::vector<Expression>& args) {
 
 		// The data should be a list. Start processing the plot data
 		if (data.isHeadListRoot()) {
-			Bounds bounds = getBoundsFromList(data);
+			std::vector<Point> points;
+			Bounds bounds = getBoundsFromList(data, points);
 			Bounds scaledBounds = bounds.scaleForGraphics();
-			std::vector<Expression> plotData;
+			std::shared_ptr<PlotData> plot = std::make_shared<PlotData>();
+
+			// A long series is reduced before its primitives are made, the bounds are exact
+			DecimationOptions decimation;
+			if (dataAndOptions) {
+				decimation = getDecimationOptions(args[1]);
+				points = decimatePoints(points, bounds, decimation);
+			}
 
 			// We need a value to start stem lines from
-			double stemRoot = addPlotAxes(plotData, scaledBounds);
+			double stemRoot = addPlotAxes(*plot, scaledBounds);
 
-			// for each point in the list of data points, scale and create the line and point objects
-			addScaledDiscreteData(data, plotData, bounds, stemRoot);
-			addPlotEdges(plotData, scaledBounds);
+			// for each point in the list of data points, scale and create the line and point
+			// objects, or a single image of their density
+			if (decimation.method == "density") {
+				addDensityImage(points, *plot, bounds, decimation.resolution);
+			} else {
+				addScaledDiscreteData(points, *plot, bounds, stemRoot);
+			}
+			addPlotEdges(*plot, scaledBounds);
 
 			// Retreive the options if there were any and apply them (i.e. create the text labels)
 			double textScale = 1;
@@ -907,13 +2283,13 @@ Expression discretePlot(const std::vector<Expression>& args) {
 
 				// Create the title, abscissa label, ordinate label text objects if they were set and get
 				// the text scale
-				textScale = handlePlotOptions(plotData, args[1], scaledBounds);
+				textScale = handlePlotOptions(*plot, args[1], scaledBounds);
 			}
 
-			addPlotTickLabels(plotData, bounds, textScale);
+			addPlotTickLabels(*plot, bounds, textScale);
 
 			// if no options exist, just return the plot data
-			return Expression(plotData);
+			return makePlot(plot);
 		}
 
 		// Both arguements should be a list
@@ -934,10 +2310,97 @@ void updateOrdinateBounds(Bounds& bounds, double o) {
 	}
 }
 
+// Evaluates the lambda of a continuous plot. Abscissas the plot is about to need are sampled
+// ahead, concurrently, and looked up when the plot asks for them in order, so the plot is the
+// same as evaluating them one at a time. Each evaluation runs in a scope of its own, like map
+class ContinuousSampler {
+public:
+	ContinuousSampler(const Expression& lambda, const Environment& env): m_lambda(lambda), m_env(env) {}
+
+	// Evaluate the lambda at every abscissa of xs on the shared thread pool. An error is kept
+	// until the abscissa is asked for, since the plot may never need it
+	void prefetch(const std::vector<double>& xs) {
+
+		// a lambda of elementwise arithmetic is evaluated at all of them at once
+		std::vector<double> ys;
+		if (evalLambdaArray(m_lambda, xs, ys, m_env)) {
+			for (std::size_t i = 0; i < xs.size(); i++) {
+				m_samples[key(xs[i])].value = Expression(ys[i]);
+			}
+
+			return;
+		}
+
+		std::vector<Sample> samples(xs.size());
+		std::atomic<bool> interrupted(false);
+		ThreadPool::shared().parallelFor(xs.size(), 1, [&](std::size_t begin, std::size_t end) {
+			for (std::size_t i = begin; i < end; i++) {
+				try {
+					samples[i].value = evaluate(xs[i]);
+				} catch (...) {
+					samples[i].error = std::current_exception();
+					if (ThreadPool::isCancelled()) {
+						interrupted.store(true);
+					}
+				}
+			}
+		});
+
+		// an interrupt seen by a sample stops the plot even if the sample is not needed
+		if (interrupted.load()) {
+			throw SemanticError("Error: interpreter kernel interrupted");
+		}
+
+		for (std::size_t i = 0; i < xs.size(); i++) {
+			m_samples[key(xs[i])] = samples[i];
+		}
+	}
+
+	// return the result of the lambda at x, sampled ahead or evaluated now
+	Expression value(double x) const {
+		auto it = m_samples.find(key(x));
+		if (it == m_samples.end()) {
+			return evaluate(x);
+		} else if (it->second.error) {
+			std::rethrow_exception(it->second.error);
+		}
+
+		return it->second.value;
+	}
+
+	// forget the samples taken ahead
+	void clear() {
+		m_samples.clear();
+	}
+
+private:
+	struct Sample {
+		Expression value;
+		std::exception_ptr error;
+	};
+
+	const Expression& m_lambda;
+	const Environment& m_env;
+
+	// keyed by the bits of the abscissa, 0 and -0 are different arguments
+	std::unordered_map<std::uint64_t, Sample> m_samples;
+
+	Expression evaluate(double x) const {
+		Expression input(x);
+		return m_lambda.evalLambda(Arguments(&input, 1), m_env);
+	}
+
+	static std::uint64_t key(double x) {
+		std::uint64_t bits;
+		std::memcpy(&bits, &x, sizeof(bits));
+		return bits;
+	}
+};
+
 // Helper function to get the point at the evaluated lambda and update the bounds
-void stepContinuous(const Expression& lambda, const Environment& env, double toEval, Point& p,
-	Bounds& bounds, bool init = false) {
-	Expression lambdaResultExp = lambda.evalLambda({Expression(toEval)}, env);
+void stepContinuous(const ContinuousSampler& sampler, double toEval, Point& p, Bounds& bounds,
+	bool init = false) {
+	Expression lambdaResultExp = sampler.value(toEval);
 
 	// if the result is a valid number, then we can make it the next point
 	if (lambdaResultExp.isHeadNumber()) {
@@ -972,89 +2435,245 @@ double angleAdjacent(const Line& l1, const Line& l2) {
 	return std::acos(dotP / (magA * magB)) * (180 / PI);
 }
 
-void smoothContinuousPlot(const Expression& lambda, const Environment& env,
-	std::vector<Line>& lines, Bounds& bounds, std::size_t iteration = 0) {
+// Options of a continuous plot that trade the accuracy of its curve for the number of samples
+typedef struct _SmoothingOptions {
 
-	// We need to work through the whole plot and split lines that have an angle smaller than 175
-	// We do nothing if we already hit 10 iterations
-	if (iteration < PLOT_SPLIT_MAX) {
-		bool alreadySmooth = true;
-		for (std::size_t i = 0; i < lines.size() - 1; i++) {
+	// adjacent lines meeting at a smaller angle, in degrees, are split
+	double minAngle = PLOT_LINE_ANG_MIN;
 
-			// Check the angle between the current line and the next
-			Line l1 = lines[i];
-			Line l2 = lines[i + 1];
-			if (std::isgreater(PLOT_LINE_ANG_MIN, angleAdjacent(l1, l2))) {
-				alreadySmooth = false;
+	// the most samples the plot takes, though the first PLOT_M are always taken
+	std::size_t sampleBudget = std::numeric_limits<std::size_t>::max();
+} SmoothingOptions;
+
+// Helper function to read the options of a continuous plot that control its smoothing. Options
+// of the wrong type are ignored, like the other plot options
+SmoothingOptions getSmoothingOptions(const Expression& options) {
+	SmoothingOptions smoothing;
+	if (!options.isHeadListRoot()) {
+		return smoothing;
+	}
+
+	for (auto it = options.tailConstBegin(); it != options.tailConstEnd(); it++) {
+		std::pair<const Expression&, const Expression&> option = getOptionKeyValue(*it);
+		const std::string key = option.first.head().asSymbol(true);
+
+		// the tolerance is how far from straight a corner may be, in degrees, by default
+		// 180 - PLOT_LINE_ANG_MIN
+		if (key == "angle-tolerance") {
+			Expression value = forcePromise(option.second);
+			if (value.isHeadNumber() && value.head().asNumber() >= 0 &&
+				value.head().asNumber() <= 180) {
+				smoothing.minAngle = 180 - value.head().asNumber();
+			}
+		} else if (key == "sample-budget") {
+			Expression value = forcePromise(option.second);
+			if (value.isHeadNumber() && value.head().asNumber() >= 0) {
+				smoothing.sampleBudget = optionCount(value.head().asNumber());
+			}
+		}
+	}
+
+	return smoothing;
+}
+
+// The abscissas a smoothing pass is likely to evaluate: the midpoints of both lines of every pair
+// of adjacent lines the pass checks whose angle is too sharp at the start of the pass, and the
+// middle of the second half of the later line, which is split next if its angle with the
+// following line is too sharp as well
+std::vector<double> splitCandidates(const std::vector<Line>& lines, const std::vector<char>& fresh,
+	double minAngle) {
+	std::vector<double> xs;
+	std::size_t last = lines.size();
+	for (std::size_t i = 0; i + 1 < lines.size(); i++) {
+		if ((fresh[i] || fresh[i + 1]) &&
+			std::isgreater(minAngle, angleAdjacent(lines[i], lines[i + 1]))) {
+			if (last != i) {
+				xs.push_back((lines[i].x1 + lines[i].x2) / 2);
+			}
+
+			double mid = (lines[i + 1].x1 + lines[i + 1].x2) / 2;
+			xs.push_back(mid);
+			xs.push_back((mid + lines[i + 1].x2) / 2);
+			last = i + 1;
+		}
+	}
+
+	return xs;
+}
+
+// Split the lines of a continuous plot that meet at too sharp an angle, in at most PLOT_SPLIT_MAX
+// passes. Each pass scans the lines once, writing them out in order: a sharp pair is replaced by
+// the two halves of each line, and the scan goes on from the later half of the second one. A pass
+// only checks the pairs that hold a line made by the previous pass, the others were checked and
+// smooth then and the same lines still are, and the passes stop once one splits nothing. samples
+// is the number taken so far, each split takes two more
+void smoothContinuousPlot(ContinuousSampler& sampler, std::vector<Line>& lines, Bounds& bounds,
+	const SmoothingOptions& options, std::size_t samples) {
+
+	// every line is unchecked at first
+	std::vector<char> fresh(lines.size(), 1);
+	std::vector<Line> smoothed;
+	std::vector<char> smoothedFresh;
+
+	for (std::size_t pass = 0; pass < PLOT_SPLIT_MAX && lines.size() > 1; pass++) {
+
+		// the midpoints the pass will probably need are evaluated together first, the pass then
+		// runs in order and evaluates the few it needs besides
+		std::size_t remaining = (options.sampleBudget > samples) ?
+			options.sampleBudget - samples : 0;
+		std::vector<double> xs = splitCandidates(lines, fresh, options.minAngle);
+		if (xs.size() > remaining) {
+			xs.resize(remaining);
+		}
+
+		sampler.prefetch(xs);
+
+		smoothed.clear();
+		smoothedFresh.clear();
+		smoothed.reserve(lines.size() * 2);
+		smoothedFresh.reserve(lines.size() * 2);
+
+		// l1 is the line the scan is at, made by this pass or the one before if check is set
+		bool split = false;
+		Line l1 = lines[0];
+		bool l1Made = false;
+		bool check = fresh[0];
+		for (std::size_t i = 1; i < lines.size(); i++) {
+			const Line& l2 = lines[i];
+			if ((check || fresh[i]) && samples + 2 <= options.sampleBudget &&
+				std::isgreater(options.minAngle, angleAdjacent(l1, l2))) {
+				split = true;
 
-				// If the angle is less than the minimum, remove the two current lines, add in the split
-				// lines, then advance to the next unevaluated line
 				double firstMidx = (l1.x1 + l1.x2) / 2;
-				double firstMidy = lambda.evalLambda({Expression(firstMidx)}, env).head().asNumber();
+				double firstMidy = sampler.value(firstMidx).head().asNumber();
 				double secondMidx = (l2.x1 + l2.x2) / 2;
-				double secondMidy = lambda.evalLambda({Expression(secondMidx)}, env).head().asNumber();
-
-				// NOTE: It's important to increment the index appropriately to keep the lines in order.
-				Line new1 = {l1.x1, firstMidx, l1.y1, firstMidy};
-				Line new2 = {firstMidx, l1.x2, firstMidy, l1.y2};
-				Line new3 = {l2.x1, secondMidx, l2.y1, secondMidy};
-				Line new4 = {secondMidx, l2.x2, secondMidy, l2.y2};
+				double secondMidy = sampler.value(secondMidx).head().asNumber();
+				samples += 2;
 
 				updateOrdinateBounds(bounds, firstMidy);
 				updateOrdinateBounds(bounds, secondMidy);
 
-				// erase the old lines
-				lines.erase(lines.begin() + i, lines.begin() + i + 2);
+				smoothed.push_back({l1.x1, firstMidx, l1.y1, firstMidy});
+				smoothed.push_back({firstMidx, l1.x2, firstMidy, l1.y2});
+				smoothed.push_back({l2.x1, secondMidx, l2.y1, secondMidy});
+				smoothedFresh.insert(smoothedFresh.end(), 3, 1);
 
-				// insert the new ones in reverse order (insert pushes everything forward)
-				lines.insert(lines.begin() + i, new4);
-				lines.insert(lines.begin() + i, new3);
-				lines.insert(lines.begin() + i, new2);
-				lines.insert(lines.begin() + i, new1);
-				i += 2;
+				// the later half of the second line is checked with the line after it
+				l1 = {secondMidx, l2.x2, secondMidy, l2.y2};
+				l1Made = true;
+				check = true;
+			} else {
+				smoothed.push_back(l1);
+				smoothedFresh.push_back(l1Made);
+				l1 = l2;
+				l1Made = false;
+				check = fresh[i];
 			}
 		}
 
-		if (!alreadySmooth) {
-			smoothContinuousPlot(lambda, env, lines, bounds, iteration + 1);
+		smoothed.push_back(l1);
+		smoothedFresh.push_back(l1Made);
+
+		lines.swap(smoothed);
+		fresh.swap(smoothedFresh);
+		sampler.clear();
+		if (!split) {
+			break;
 		}
 	}
 }
 
-void addScaledContinuousData(const Expression& lambda, const Environment& env, Bounds& bounds,
-	std::vector<Expression>& plotData) {
+// Sample the lambda of a continuous plot over the abscissa bounds and smooth it, the ordinate
+// bounds are set to those of the curve
+std::vector<Line> sampleContinuousData(const Expression& lambda, const Environment& env,
+	Bounds& bounds, const SmoothingOptions& options) {
 	double incValue = (bounds.AU - bounds.AL) / PLOT_M;
 	std::vector<Line> lines;
 
+	// The abscissas are evaluated together, then read in order
+	ContinuousSampler sampler(lambda, env);
+	std::vector<double> xs = {bounds.AL};
+	for (double i = 1; i < PLOT_M - 1; i++) {
+		xs.push_back(bounds.AL + (incValue * i));
+	}
+
+	xs.push_back(bounds.AU);
+	sampler.prefetch(xs);
+
 	// Prime the loop
 	Point prev, next;
-	stepContinuous(lambda, env, bounds.AL, prev, bounds, true);
-	for (double i = 1; i < PLOT_M - 1; i++) {
+	stepContinuous(sampler, xs.front(), prev, bounds, true);
+	for (std::size_t i = 1; i < xs.size(); i++) {
 
-		// create lines from i to i + 1
-		stepContinuous(lambda, env, bounds.AL + (incValue * i), next, bounds);
+		// create lines from i - 1 to i
+		stepContinuous(sampler, xs[i], next, bounds);
 
 		// add the line to the list
 		lines.push_back({prev.x, next.x, prev.y, next.y});
 		prev = next;
 	}
 
-	// calculate the final value
-	stepContinuous(lambda, env, bounds.AU, next, bounds);
-	lines.push_back({prev.x, next.x, prev.y, next.y});
-
 	// Smooth the plot
-	smoothContinuousPlot(lambda, env, lines, bounds);
+	sampler.clear();
+	smoothContinuousPlot(sampler, lines, bounds, options, xs.size());
+	return lines;
+}
+
+// The lines of a curve join end to end, so the curve is kept as the points they join
+SampledCurve toCurve(const std::vector<Line>& lines, const Bounds& bounds) {
+	SampledCurve curve;
+	curve.x.push_back(lines.front().x1);
+	curve.y.push_back(lines.front().y1);
+	for (const Line& line : lines) {
+		curve.x.push_back(line.x2);
+		curve.y.push_back(line.y2);
+	}
+
+	curve.lowest = bounds.OL;
+	curve.highest = bounds.OU;
+	return curve;
+}
+
+std::vector<Line> fromCurve(const SampledCurve& curve, Bounds& bounds) {
+	std::vector<Line> lines;
+	lines.reserve(curve.x.size() - 1);
+	for (std::size_t i = 1; i < curve.x.size(); i++) {
+		lines.push_back({curve.x[i - 1], curve.x[i], curve.y[i - 1], curve.y[i]});
+	}
+
+	bounds.OL = curve.lowest;
+	bounds.OU = curve.highest;
+	return lines;
+}
+
+// Add the lines of a continuous plot. A curve sampled before with the same lambda, abscissa bounds
+// and smoothing options is taken from the shared plot cache instead of being sampled again. Lambdas
+// looking up definitions are sampled every time without touching the cache
+void addScaledContinuousData(const Expression& lambda, const Environment& env, Bounds& bounds,
+	const SmoothingOptions& options, PlotData& plot) {
+	std::vector<Line> lines;
+	if (isCacheableLambda(lambda)) {
+		CurveKey key{lambda, bounds.AL, bounds.AU, options.minAngle, options.sampleBudget};
+		SampledCurve curve;
+		if (PlotCache::shared().find(key, curve)) {
+			lines = fromCurve(curve, bounds);
+		} else {
+			lines = sampleContinuousData(lambda, env, bounds, options);
+			PlotCache::shared().insert(key, toCurve(lines, bounds));
+		}
+	} else {
+		lines = sampleContinuousData(lambda, env, bounds, options);
+	}
 
 	// Iterate through each line, scale it, and add it to the plot
 	double absScaleFactor = bounds.calcAbsScale();
 	double ordScaleFactor = bounds.calcOrdScale();
 	for (auto& line : lines) {
-		plotData.push_back(makeLineExpression(line.scaleForGraphics(absScaleFactor, ordScaleFactor)));
+		addLine(plot, line.scaleForGraphics(absScaleFactor, ordScaleFactor));
 	}
 }
 
-Expression continuousPlot(const std::vector<Expression>& args, const Environment& env) {
+Expression continuousPlot(Arguments args, const Environment& env) {
 
 	// Continuous plots can take two or three arguments (options are, optional)
 	bool justData = args.size() == 2;
@@ -1065,7 +2684,7 @@ Expression continuousPlot(const std::vector<Expression>& args, const Environment
 
 		// Validate the arguments. Start processing the plot data
 		if (lambda.isHeadLambdaRoot()) {
-			std::vector<Expression> plotData;
+			std::shared_ptr<PlotData> plot = std::make_shared<PlotData>();
 
 			// We can grab the bounds as a point since we expect a list of two values
 			Bounds bounds;
@@ -1073,21 +2692,27 @@ Expression continuousPlot(const std::vector<Expression>& args, const Environment
 			bounds.AL = abscissaBounds.x;
 			bounds.AU = abscissaBounds.y;
 
-			// Create the plot (addScaledContinuousData will update the bounds)
-			addScaledContinuousData(lambda, env, bounds, plotData);
+			// Create the plot (addScaledContinuousData will update the bounds). The options that
+			// control the smoothing are needed before sampling, the others once the plot is done
+			SmoothingOptions smoothing;
+			if (dataAndOptions) {
+				smoothing = getSmoothingOptions(args[2]);
+			}
+
+			addScaledContinuousData(lambda, env, bounds, smoothing, *plot);
 
 			Bounds scaledBounds = bounds.scaleForGraphics();
-			addPlotAxes(plotData, scaledBounds);
-			addPlotEdges(plotData, scaledBounds);
+			addPlotAxes(*plot, scaledBounds);
+			addPlotEdges(*plot, scaledBounds);
 
 			// Retreive the options if there were any and apply them (i.e. create the text labels)
 			double textScale = 1;
 			if (dataAndOptions) {
-				textScale = handlePlotOptions(plotData, args[2], scaledBounds);
+				textScale = handlePlotOptions(*plot, args[2], scaledBounds);
 			}
 
-			addPlotTickLabels(plotData, bounds, textScale);
-			return Expression(plotData);
+			addPlotTickLabels(*plot, bounds, textScale);
+			return makePlot(plot);
 		}
 
 		throw SemanticError("Error: first argument to continuous-plot should be a lambda function");
@@ -1097,3 +2722,409 @@ Expression continuousPlot(const std::vector<Expression>& args, const Environment
 	throw SemanticError("Error: wrong number of arguments for continuous-plot which "
 		"takes two or three arguments");
 }
+
+// Evaluates the lambda of a surface or contour plot at points of the plane. The points are
+// evaluated together in ranges spread across the shared thread pool, a tile of the grid each, and
+// each evaluation runs in a scope of its own like map. A point is only evaluated once
+class SurfaceSampler {
+public:
+	SurfaceSampler(const Expression& lambda, const Environment& env):
+		m_lambda(lambda), m_env(env) {}
+
+	// Evaluate the lambda at every point not yet sampled. If evaluations fail, the error of the
+	// first failing point is thrown
+	void sample(const std::vector<Point>& points) {
+		std::vector<Point> fresh;
+		for (const Point& p : points) {
+			if (m_values.insert({key(p), 0}).second) {
+				fresh.push_back(p);
+			}
+		}
+
+		std::vector<double> values(fresh.size());
+		forEachIndexParallel(fresh.size(), parallelGrain(fresh.size()), [&](std::size_t i) {
+			Expression input[2] = {Expression(fresh[i].x), Expression(fresh[i].y)};
+			Expression result = m_lambda.evalLambda(Arguments(input, 2), m_env);
+			if (!result.isHeadNumber()) {
+				throw SemanticError("Error: invalid function for surface plot");
+			}
+
+			values[i] = result.head().asNumber();
+		});
+
+		for (std::size_t i = 0; i < fresh.size(); i++) {
+			m_values[key(fresh[i])] = values[i];
+		}
+	}
+
+	// return the value of the lambda at a point sampled before
+	double value(const Point& p) const {
+		return m_values.at(key(p));
+	}
+
+private:
+	const Expression& m_lambda;
+	const Environment& m_env;
+
+	// keyed by the bits of the coordinates
+	std::map<std::pair<std::uint64_t, std::uint64_t>, double> m_values;
+
+	static std::pair<std::uint64_t, std::uint64_t> key(const Point& p) {
+		std::uint64_t x, y;
+		std::memcpy(&x, &p.x, sizeof(x));
+		std::memcpy(&y, &p.y, sizeof(y));
+		return {x, y};
+	}
+};
+
+// Options of surface and contour plots
+typedef struct _SurfaceOptions {
+
+	// the cells of each side of the grid, 0 for the default of the plot
+	std::size_t resolution = 0;
+
+	// the times a contour plot halves the cells a contour crosses
+	std::size_t refinement = PLOT_CONTOUR_REFINEMENT;
+
+	// the values a contour plot draws, or empty for levels evenly spaced between the lowest and
+	// highest value on the grid
+	std::vector<double> levels;
+	std::size_t levelCount = PLOT_CONTOUR_LEVELS;
+} SurfaceOptions;
+
+// Helper function to read the options of a surface or contour plot. Options of the wrong type are
+// ignored, like the other plot options
+SurfaceOptions getSurfaceOptions(const Expression& options) {
+	SurfaceOptions surface;
+	if (!options.isHeadListRoot()) {
+		return surface;
+	}
+
+	for (auto it = options.tailConstBegin(); it != options.tailConstEnd(); it++) {
+		std::pair<const Expression&, const Expression&> option = getOptionKeyValue(*it);
+		const std::string key = option.first.head().asSymbol(true);
+		if (key == "resolution") {
+			Expression value = forcePromise(option.second);
+			if (value.isHeadNumber() && value.head().asNumber() >= 1 &&
+				value.head().asNumber() <= PLOT_RESOLUTION) {
+				surface.resolution = static_cast<std::size_t>(value.head().asNumber());
+			}
+		} else if (key == "refinement") {
+			Expression value = forcePromise(option.second);
+			if (value.isHeadNumber() && value.head().asNumber() >= 0 &&
+				value.head().asNumber() <= PLOT_SPLIT_MAX) {
+				surface.refinement = static_cast<std::size_t>(value.head().asNumber());
+			}
+		} else if (key == "levels") {
+
+			// either the number of levels or the levels themselves
+			Expression value = forceSequence(forcePromise(option.second));
+			if (value.isHeadNumber() && value.head().asNumber() >= 1) {
+				surface.levelCount = static_cast<std::size_t>(std::min(value.head().asNumber(),
+					static_cast<double>(PLOT_RESOLUTION)));
+				surface.levels.clear();
+			} else if (value.isHeadListRoot() && value.tailConstBegin() != value.tailConstEnd() &&
+				std::all_of(value.tailConstBegin(), value.tailConstEnd(),
+					[](const Expression& e) { return e.isHeadNumber(); })) {
+				surface.levels.clear();
+				for (auto level = value.tailConstBegin(); level != value.tailConstEnd(); level++) {
+					surface.levels.push_back(level->head().asNumber());
+				}
+			}
+		}
+	}
+
+	return surface;
+}
+
+// Helper function to read the bounds of a surface or contour plot, two lists of two numbers
+Bounds getSurfaceBounds(const Expression& abscissa, const Expression& ordinate) {
+	Point abscissaBounds = getPointValues(abscissa);
+	Point ordinateBounds = getPointValues(ordinate);
+	if (!(abscissaBounds.x < abscissaBounds.y) || !(ordinateBounds.x < ordinateBounds.y)) {
+		throw SemanticError("Error: empty bounds for surface plot");
+	}
+
+	return {abscissaBounds.x, abscissaBounds.y, ordinateBounds.x, ordinateBounds.y};
+}
+
+// Draw the lambda as an image of cells by cells, each shaded by the value at its center
+void addSurfaceImage(SurfaceSampler& sampler, PlotData& plot, const Bounds& bounds,
+	std::size_t cells) {
+	double width = (bounds.AU - bounds.AL) / cells;
+	double height = (bounds.OU - bounds.OL) / cells;
+
+	// row by row from the top, so each range of the pool is a band of rows
+	std::vector<Point> centers;
+	centers.reserve(cells * cells);
+	for (std::size_t r = 0; r < cells; r++) {
+		for (std::size_t c = 0; c < cells; c++) {
+			centers.push_back({bounds.AL + (c + 0.5) * width, bounds.OU - (r + 0.5) * height});
+		}
+	}
+
+	sampler.sample(centers);
+
+	std::vector<double> values;
+	values.reserve(centers.size());
+	for (const Point& p : centers) {
+		values.push_back(sampler.value(p));
+	}
+
+	addImage(plot, bounds, cells, cells, std::move(values), false);
+}
+
+// A cell of a contour plot, from (x0, y0) at the bottom left to (x1, y1) at the top right
+typedef struct _Cell {
+	double x0, y0, x1, y1;
+
+	// the corners counterclockwise from the bottom left
+	std::vector<Point> corners() const {
+		return {{x0, y0}, {x1, y0}, {x1, y1}, {x0, y1}};
+	}
+
+	// the middles of the sides counterclockwise from the bottom, and the center
+	std::vector<Point> middles() const {
+		double xm = (x0 + x1) / 2;
+		double ym = (y0 + y1) / 2;
+		return {{xm, y0}, {x1, ym}, {xm, y1}, {x0, ym}, {xm, ym}};
+	}
+} Cell;
+
+// Helper function to tell whether a level crosses a cell, its corners not all on one side
+bool crossesCell(const double (&values)[4], const std::vector<double>& levels) {
+	auto range = std::minmax_element(values, values + 4);
+	return std::any_of(levels.begin(), levels.end(), [&](double level) {
+		return *range.first < level && level <= *range.second;
+	});
+}
+
+// Helper function to find where the value is level between two points, interpolating linearly
+// from the bottom left one so both cells sharing the side find exactly the same point
+Point levelCrossing(Point a, double va, Point b, double vb, double level) {
+	if (b.x < a.x || (b.x == a.x && b.y < a.y)) {
+		std::swap(a, b);
+		std::swap(va, vb);
+	}
+
+	double t = (level - va) / (vb - va);
+	return {a.x + t * (b.x - a.x), a.y + t * (b.y - a.y)};
+}
+
+// Marching squares: add the lines along which the value is level across a cell, interpolating
+// linearly between the points of its boundary. These are its corners and the corners of smaller
+// neighbours on its sides, counterclockwise from the bottom left. The boundary is crossed an even
+// number of times, when more than twice the arcs between crossings on the other side of the
+// center are cut off and those on its side are joined through it
+void addContourLines(const std::vector<Point>& boundary, const std::vector<double>& values,
+	double center, double level, std::vector<Line>& lines) {
+	std::vector<Point> crossings;
+	std::vector<bool> arcsAbove;
+	for (std::size_t i = 0; i < boundary.size(); i++) {
+		std::size_t j = (i + 1) % boundary.size();
+		if ((values[i] >= level) != (values[j] >= level)) {
+			crossings.push_back(levelCrossing(boundary[i], values[i], boundary[j], values[j],
+				level));
+			arcsAbove.push_back(values[j] >= level);
+		}
+	}
+
+	// the arc from each crossing to the next is cut off by joining them, two are joined either way
+	std::size_t first = (crossings.size() > 2 && arcsAbove[0] == (center >= level)) ? 1 : 0;
+	for (std::size_t k = first; k + 1 < crossings.size() + first; k += 2) {
+		const Point& a = crossings[k];
+		const Point& b = crossings[(k + 1) % crossings.size()];
+		lines.push_back({a.x, b.x, a.y, b.y});
+	}
+}
+
+// Draw the lines along which the lambda takes each level. The grid is refined where a level
+// crosses a cell: each pass halves those cells, evaluating the new points together, so the
+// contours are followed closely without sampling the whole plane finely. A cell next to smaller
+// ones is bounded by all of their corners on its sides, so both see a contour cross their common
+// side at the same points and the contours are drawn without gaps
+void addContourData(SurfaceSampler& sampler, PlotData& plot, const Bounds& bounds,
+	const SurfaceOptions& options) {
+	std::size_t cells = (options.resolution != 0) ? options.resolution : PLOT_CONTOUR_RESOLUTION;
+	double width = (bounds.AU - bounds.AL) / cells;
+	double height = (bounds.OU - bounds.OL) / cells;
+
+	std::vector<Cell> grid;
+	std::vector<Point> points;
+	for (std::size_t r = 0; r < cells; r++) {
+		for (std::size_t c = 0; c < cells; c++) {
+			grid.push_back({bounds.AL + c * width, bounds.OL + r * height,
+				bounds.AL + (c + 1) * width, bounds.OL + (r + 1) * height});
+			std::vector<Point> corners = grid.back().corners();
+			points.insert(points.end(), corners.begin(), corners.end());
+		}
+	}
+
+	sampler.sample(points);
+
+	auto cornerValues = [&](const Cell& cell, double (&values)[4]) {
+		std::vector<Point> corners = cell.corners();
+		for (std::size_t i = 0; i < 4; i++) {
+			values[i] = sampler.value(corners[i]);
+		}
+	};
+
+	// the levels are spread over the values of the grid unless given
+	std::vector<double> levels = options.levels;
+	if (levels.empty()) {
+		double lowest = std::numeric_limits<double>::infinity();
+		double highest = -lowest;
+		for (const Point& p : points) {
+			lowest = std::min(lowest, sampler.value(p));
+			highest = std::max(highest, sampler.value(p));
+		}
+
+		for (std::size_t i = 1; i <= options.levelCount; i++) {
+			levels.push_back(lowest + (highest - lowest) * i / (options.levelCount + 1));
+		}
+	}
+
+	double values[4];
+	std::vector<Cell> done;
+	for (std::size_t pass = 0; pass < options.refinement && !grid.empty(); pass++) {
+		std::vector<Cell> crossed;
+		points.clear();
+		for (const Cell& cell : grid) {
+			cornerValues(cell, values);
+			if (crossesCell(values, levels)) {
+				crossed.push_back(cell);
+				std::vector<Point> middles = cell.middles();
+				points.insert(points.end(), middles.begin(), middles.end());
+			} else {
+				done.push_back(cell);
+			}
+		}
+
+		sampler.sample(points);
+
+		// each crossed cell becomes its four quarters
+		grid.clear();
+		for (const Cell& cell : crossed) {
+			double xm = (cell.x0 + cell.x1) / 2;
+			double ym = (cell.y0 + cell.y1) / 2;
+			grid.push_back({cell.x0, cell.y0, xm, ym});
+			grid.push_back({xm, cell.y0, cell.x1, ym});
+			grid.push_back({xm, ym, cell.x1, cell.y1});
+			grid.push_back({cell.x0, ym, xm, cell.y1});
+		}
+	}
+
+	done.insert(done.end(), grid.begin(), grid.end());
+
+	// The corners of the cells along each horizontal and vertical line. Halving a side always
+	// computes its middle from the same ends, so corners shared by cells compare equal
+	std::map<double, std::set<double>> rows, columns;
+	for (const Cell& cell : done) {
+		for (const Point& p : cell.corners()) {
+			rows[p.y].insert(p.x);
+			columns[p.x].insert(p.y);
+		}
+	}
+
+	// the corners on a line strictly between lo and hi, in increasing order
+	auto between = [](const std::set<double>& line, double lo, double hi) {
+		return std::vector<double>(line.upper_bound(lo), line.lower_bound(hi));
+	};
+
+	std::vector<Line> lines;
+	std::vector<Point> boundary;
+	std::vector<double> boundaryValues;
+	for (const Cell& cell : done) {
+		std::vector<double> bottom = between(rows[cell.y0], cell.x0, cell.x1);
+		std::vector<double> right = between(columns[cell.x1], cell.y0, cell.y1);
+		std::vector<double> top = between(rows[cell.y1], cell.x0, cell.x1);
+		std::vector<double> left = between(columns[cell.x0], cell.y0, cell.y1);
+
+		boundary.clear();
+		boundary.push_back({cell.x0, cell.y0});
+		for (auto x = bottom.begin(); x != bottom.end(); x++) {
+			boundary.push_back({*x, cell.y0});
+		}
+
+		boundary.push_back({cell.x1, cell.y0});
+		for (auto y = right.begin(); y != right.end(); y++) {
+			boundary.push_back({cell.x1, *y});
+		}
+
+		boundary.push_back({cell.x1, cell.y1});
+		for (auto x = top.rbegin(); x != top.rend(); x++) {
+			boundary.push_back({*x, cell.y1});
+		}
+
+		boundary.push_back({cell.x0, cell.y1});
+		for (auto y = left.rbegin(); y != left.rend(); y++) {
+			boundary.push_back({cell.x0, *y});
+		}
+
+		boundaryValues.clear();
+		for (const Point& p : boundary) {
+			boundaryValues.push_back(sampler.value(p));
+		}
+
+		cornerValues(cell, values);
+		double center = (values[0] + values[1] + values[2] + values[3]) / 4;
+		for (double level : levels) {
+			addContourLines(boundary, boundaryValues, center, level, lines);
+		}
+	}
+
+	double absScaleFactor = bounds.calcAbsScale();
+	double ordScaleFactor = bounds.calcOrdScale();
+	for (auto& line : lines) {
+		addLine(plot, line.scaleForGraphics(absScaleFactor, ordScaleFactor));
+	}
+}
+
+// Surface and contour plots take a lambda of two arguments, the abscissa bounds and the ordinate
+// bounds, and optionally options
+Expression surfacePlot(Arguments args, const Environment& env, bool contour) {
+	const std::string name = contour ? "contour-plot" : "surface-plot";
+	bool justData = args.size() == 3;
+	bool dataAndOptions = args.size() == 4;
+
+	if (justData || dataAndOptions) {
+		const Expression& lambda = args[0];
+		if (lambda.isHeadLambdaRoot() &&
+			std::distance(lambda.tailConstBegin()->tailConstBegin(),
+				lambda.tailConstBegin()->tailConstEnd()) == 2) {
+			std::shared_ptr<PlotData> plot = std::make_shared<PlotData>();
+			Bounds bounds = getSurfaceBounds(args[1], args[2]);
+			Bounds scaledBounds = bounds.scaleForGraphics();
+
+			SurfaceOptions surface;
+			if (dataAndOptions) {
+				surface = getSurfaceOptions(args[3]);
+			}
+
+			SurfaceSampler sampler(lambda, env);
+			if (contour) {
+				addContourData(sampler, *plot, bounds, surface);
+			} else {
+				addSurfaceImage(sampler, *plot, bounds,
+					(surface.resolution != 0) ? surface.resolution : PLOT_SURFACE_RESOLUTION);
+			}
+
+			addPlotAxes(*plot, scaledBounds);
+			addPlotEdges(*plot, scaledBounds);
+
+			double textScale = 1;
+			if (dataAndOptions) {
+				textScale = handlePlotOptions(*plot, args[3], scaledBounds);
+			}
+
+			addPlotTickLabels(*plot, bounds, textScale);
+			return makePlot(plot);
+		}
+
+		throw SemanticError("Error: first argument to " + name +
+			" should be a lambda function of two arguments");
+	}
+
+	throw SemanticError("Error: wrong number of arguments for " + name +
+		" which takes three or four arguments");
+}
@@ -12,8 +12,12 @@ Defines the Expression type and assiciated functions.
 #include "token.hpp"
 #include "atom.hpp"
 
-// forward declare Environment
+// forward declare Environment, Arguments, LambdaProfile, Sequence and Promise
 class Environment;
+class Arguments;
+class LambdaProfile;
+class Sequence;
+class Promise;
 
 /*! \class Expression
 \brief An expression is a tree of Atoms.
@@ -23,24 +27,50 @@ list of expressions called the tail.
  */
 class Expression {
 public:
+	typedef std::vector<Expression>::iterator IteratorType;
 	typedef std::vector<Expression>::const_iterator ConstIteratorType;
 
+	/// Hints for evaluating an expression, set by markParallelEvaluation (see analysis.hpp)
+	enum EvalHint {
+
+		/// the tail items may be evaluated concurrently, for a call or list the ones marked
+		/// HeavyHint, for a begin block all of them in the order of their dependencies
+		ParallelTailHint = 1,
+
+		/// the expression is pure, or a pure definition in a begin block, and costly enough to be
+		/// evaluated as a task of its own
+		HeavyHint = 2
+	};
+
 	/// Default construct and Expression, whose type in NoneType
 	Expression();
 
-	/// Constructor for an list of expressions.
+	/// Constructor for an list of expressions. Sequences among them are forced into lists
 	Expression(const std::vector<Expression>& a);
 
+	/// return a lazy sequence (see sequence.hpp)
+	static Expression fromSequence(std::shared_ptr<const Sequence> seq);
+
+	/// return a promise made by delay (see promise.hpp)
+	static Expression fromPromise(std::shared_ptr<const Promise> promise);
+
 	/*! Construct an Expression with given Atom as head an empty tail
 		\param atom the atom to make the head
 	*/
 	Expression(const Atom& a);
 
-	/// deep-copy construct an expression (recursive)
-	Expression(const Expression& a);
+	/// copy construct an expression. The tail and properties are shared with a until either
+	/// expression is modified, so copying is O(1) regardless of the size of the tree
+	Expression(const Expression& a) = default;
 
-	/// deep-copy assign an expression	(recursive)
-	Expression& operator=(const Expression& a);
+	/// move construct an expression
+	Expression(Expression&& a) noexcept = default;
+
+	/// copy assign an expression, sharing the tail and properties like the copy constructor
+	Expression& operator=(const Expression& a) = default;
+
+	/// move assign an expression
+	Expression& operator=(Expression&& a) noexcept = default;
 
 	/// return a reference to the head Atom
 	Atom& head();
@@ -54,6 +84,12 @@ public:
 	/// return a pointer to the last expression in the tail, or nullptr
 	Expression* tail();
 
+	/// return an iterator to the beginning of tail, first copying it if it is shared
+	IteratorType tailBegin();
+
+	/// return an iterator to the tail end, first copying it if it is shared
+	IteratorType tailEnd();
+
 	/// return a const-iterator to the beginning of tail
 	ConstIteratorType tailConstBegin() const noexcept;
 
@@ -78,18 +114,48 @@ public:
 	/// convienience member to determine if head atom is the root of a lambda expression
 	bool isHeadLambdaRoot() const noexcept;
 
-	/// Creates a new property for this expression with key and value
+	/// convienience member to determine if the expression is a lazy sequence
+	bool isHeadSequence() const noexcept;
+
+	/// return the lazy sequence of the expression, or nullptr if it is not one
+	const Sequence* sequence() const noexcept;
+
+	/// convienience member to determine if the expression is a promise
+	bool isHeadPromise() const noexcept;
+
+	/// return the promise of the expression, or nullptr if it is not one
+	const Promise* promise() const noexcept;
+
+	/// Creates a new property for this expression with key and value. A sequence is forced into a
+	/// list first, and so is value
 	void setProperty(const std::string& key, const Expression& value);
 
-	/// return the value of a certain property of the expression. If no such property exists,
-	/// an empty expression is returned
+	/// return the value of a certain property of the expression, forcing it if it is a promise.
+	/// If no such property exists, an empty expression is returned
 	Expression getProperty(const std::string& property) const;
 
+	/// return the keys of every property of the expression, sorted
+	std::vector<std::string> getPropertyKeys() const;
+
 	/// Evaluate expression using a post-order traversal (recursive)
-	Expression eval(Environment& env);
+	Expression eval(Environment& env) const;
 
 	/// Evaluate a lambda function with a certain input expression
-	Expression evalLambda(const std::vector<Expression>& input, const Environment& env) const;
+	Expression evalLambda(Arguments input, const Environment& env) const;
+
+	/// Start counting the calls of this lambda so it can be promoted to a compiled form (see
+	/// lambda_compiler.hpp). Copies share the profile until their tail is modified. Does nothing
+	/// for other expressions or if the lambda is already profiled
+	void profileCalls();
+
+	/// return the call profile of this lambda, or nullptr if it is not profiled
+	LambdaProfile* profile() const noexcept;
+
+	/// return the evaluation hints of this expression, a combination of EvalHint values
+	unsigned evalHints() const noexcept;
+
+	/// set the evaluation hints of this expression. They are kept by copies
+	void setEvalHints(unsigned hints) noexcept;
 
 	/// equality comparison for two expressions (recursive)
 	bool operator==(const Expression& exp) const noexcept;
@@ -100,34 +166,109 @@ private:
 	Atom m_head;
 
 	// the tail list is expressed as a vector for access efficiency
-	// and cache coherence, at the cost of wasted memory.
-	std::vector<Expression> m_tail;
+	// and cache coherence, at the cost of wasted memory. It is shared between copies of the
+	// expression and copied on write, an empty tail is a null pointer. The call profile of a
+	// lambda is kept with its tail, so copies share it and other expressions pay nothing for it
+	struct Tail;
+	std::shared_ptr<Tail> m_tail;
 
 	// Map of properties linked to this expression. I used a pointer here because not every
-	// expression will make use of this property list
+	// expression will make use of this property list. Shared and copied on write like the tail
 	typedef std::unordered_map<std::string, Expression> PropertyMap;
-	std::unique_ptr<PropertyMap> m_props;
+	std::shared_ptr<PropertyMap> m_props;
 
-	// convenience typedef
-	typedef std::vector<Expression>::iterator IteratorType;
+	// The elements of a lazy sequence, whose head is SequenceRoot
+	std::shared_ptr<const Sequence> m_seq;
+
+	// The delayed value of a promise, whose head is PromiseRoot
+	std::shared_ptr<const Promise> m_promise;
+
+	// EvalHint values, ignored by comparison
+	unsigned char m_hints = 0;
+
+	// return the tail for reading
+	const std::vector<Expression>& tailItems() const noexcept;
+
+	// return the tail for modification, first copying it if another expression shares it
+	std::vector<Expression>& mutableTail();
 
 	// Macros for the heads of special types of expressions.
 	#define ListRoot Atom("list")
 	#define LambdaRoot Atom("lambda")
+	#define SequenceRoot Atom("sequence")
+	#define PromiseRoot Atom("promise")
 
 	// internal helper method to determin if an Atom is a special form (list, begin, define, etc.)
 	bool isSpecialForm(const Atom& head) const;
 
 	// internal helper methods
-	Expression handle_lookup(const Atom& head, const Environment& env);
-	Expression handle_define(Environment& env);
-	Expression handle_begin(Environment& env);
-	Expression handle_list(Environment& env);
-	Expression handle_lambda(Environment& env);
-	Expression handle_apply(Environment& env);
-	Expression handle_map(Environment& env);
-	Expression handle_setProperty(Environment& env);
-	Expression handle_getProperty(Environment& env);
+	Expression handle_lookup(const Atom& head, const Environment& env) const;
+	Expression handle_define(Environment& env) const;
+	Expression handle_begin(Environment& env) const;
+	Expression handle_list(Environment& env) const;
+	Expression handle_lambda(Environment& env) const;
+	Expression handle_apply(Environment& env) const;
+	Expression handle_map(Environment& env) const;
+	Expression handle_reduce(Environment& env) const;
+	Expression handle_fold(Environment& env) const;
+	Expression handle_filter(Environment& env) const;
+	Expression handle_sortBy(Environment& env) const;
+	Expression handle_setProperty(Environment& env) const;
+	Expression handle_getProperty(Environment& env) const;
+	Expression handle_delay(Environment& env) const;
+	Expression handle_force(Environment& env) const;
+};
+
+/*! \class Arguments
+\brief A non-owning view of a contiguous run of evaluated Expressions.
+
+Procedures receive their arguments through this view, so the caller decides where the
+arguments are stored (a vector, the evaluator's argument stack, a single list element)
+instead of copying them into a new vector for every call. The viewed Expressions must
+outlive the view.
+ */
+class Arguments {
+public:
+	typedef const Expression* ConstIteratorType;
+
+	/// Construct an empty view
+	Arguments() noexcept: m_data(nullptr), m_count(0) {}
+
+	/// Construct a view of count Expressions starting at data
+	Arguments(const Expression* data, std::size_t count) noexcept: m_data(data), m_count(count) {}
+
+	/// Construct a view of every Expression in a vector
+	Arguments(const std::vector<Expression>& args) noexcept:
+		m_data(args.data()), m_count(args.size()) {}
+
+	/// Construct a view of the Expressions between two tail iterators
+	Arguments(Expression::ConstIteratorType begin, Expression::ConstIteratorType end) noexcept:
+		m_data(begin == end ? nullptr : &*begin), m_count(end - begin) {}
+
+	/// return the number of arguments in the view
+	std::size_t size() const noexcept { return m_count; }
+
+	/// return true if there are no arguments in the view
+	bool empty() const noexcept { return m_count == 0; }
+
+	/// return a const-reference to the argument at index i (unchecked)
+	const Expression& operator[](std::size_t i) const noexcept { return m_data[i]; }
+
+	/// return a const-iterator to the first argument
+	ConstIteratorType begin() const noexcept { return m_data; }
+
+	/// return a const-iterator past the last argument
+	ConstIteratorType end() const noexcept { return m_data + m_count; }
+
+	/// return a const-iterator to the first argument
+	ConstIteratorType cbegin() const noexcept { return m_data; }
+
+	/// return a const-iterator past the last argument
+	ConstIteratorType cend() const noexcept { return m_data + m_count; }
+
+private:
+	const Expression* m_data;
+	std::size_t m_count;
 };
 
 /// Render expression to output stream
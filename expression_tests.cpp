@@ -69,3 +69,25 @@ TEST_CASE("Test string literal expression", "[expression]") {
 	REQUIRE(!exp.isHeadListRoot());
 	REQUIRE(!exp.isHeadLambdaRoot());
 }
+
+TEST_CASE("Test copies share their tail until modified", "[expression]") {
+	Expression list(std::vector<Expression>{Expression(1), Expression(2)});
+	list.setProperty("name", Expression(Atom("\"list\"")));
+
+	Expression copy(list);
+	REQUIRE(copy == list);
+	REQUIRE(&*copy.tailConstBegin() == &*list.tailConstBegin());
+
+	// modifying the copy leaves the original alone
+	copy.append(Atom(3.0));
+	copy.setProperty("name", Expression(Atom("\"copy\"")));
+	REQUIRE(std::distance(list.tailConstBegin(), list.tailConstEnd()) == 2);
+	REQUIRE(std::distance(copy.tailConstBegin(), copy.tailConstEnd()) == 3);
+	REQUIRE(list.getProperty("name") == Expression(Atom("\"list\"")));
+	REQUIRE(copy.getProperty("name") == Expression(Atom("\"copy\"")));
+
+	// assignment shares in the same way
+	Expression assigned;
+	assigned = list;
+	REQUIRE(&*assigned.tailConstBegin() == &*list.tailConstBegin());
+}
@@ -6,18 +6,37 @@
 // module includes
 #include "token.hpp"
 #include "parse.hpp"
+#include "analysis.hpp"
 #include "expression.hpp"
 #include "environment.hpp"
+#include "plot_data.hpp"
 #include "semantic_error.hpp"
+#include "sequence.hpp"
+
+Interpreter::Interpreter() {}
+
+Interpreter::Interpreter(std::shared_ptr<const Environment> base): env(base) {}
 
 bool Interpreter::parseStream(std::istream& expression) noexcept {
 	TokenSequenceType tokens = tokenize(expression);
 
 	ast = parse(tokens);
+	markParallelEvaluation(ast);
 
 	return (ast != Expression());
 };
 
 Expression Interpreter::evaluate() {
-	return ast.eval(env);
+
+	// the result is shown, so a lazy sequence is forced into a list
+	return forceSequence(ast.eval(env));
+}
+
+Expression Interpreter::evaluateForDisplay() {
+	Expression result = ast.eval(env);
+	if (plotData(result)) {
+		return result;
+	}
+
+	return forceSequence(result);
 }
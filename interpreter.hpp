@@ -18,13 +18,22 @@ It maintains an environment during evaluation.
 /*! \class Interpreter
 \brief Class to parse and evaluate an expression (program)
 
-Interpreter has an Environment, which starts at a default.
+Interpreter has an Environment, which starts at a default or at a shared base.
 The parse method builds an internal AST.
 The eval method updates Environment and returns last result.
 */
 class Interpreter {
 public:
 
+	/// Construct an interpreter with the default environment
+	Interpreter();
+
+	/*! Construct an interpreter whose environment is layered over a frozen base. Only
+		definitions made by this interpreter are stored in it, the base is shared.
+		\param base the frozen environment to start from
+	 */
+	explicit Interpreter(std::shared_ptr<const Environment> base);
+
 	/*! Parse into an internal Expression from a stream
 		\param expression the raw text stream repreenting the candidate expression
 		\return true on successful parsing
@@ -37,6 +46,13 @@ public:
 	 */
 	Expression evaluate();
 
+	/*! Evaluate like evaluate, except that a plot is left in its typed form (see plot_data.hpp)
+		for a renderer to draw, instead of being forced into a list of its primitives.
+		\return the Expression resulting from the evaluation in the current environment
+		\throws SemanticError when a semantic error is encountered
+	 */
+	Expression evaluateForDisplay();
+
 private:
 
 	// the environment
@@ -1,9 +1,12 @@
 #include "catch.hpp"
 
+#include <algorithm>
+#include <cmath>
 #include <string>
 #include <sstream>
 #include <fstream>
 #include <iostream>
+#include <map>
 
 #include "semantic_error.hpp"
 #include "interpreter.hpp"
@@ -31,6 +34,17 @@ Expression run(const std::string& program, bool runSemantic = false) {
 	return result;
 }
 
+// A lambda returning its argument through a call with many arguments, which grows the argument
+// stack the arguments of the calling procedure may be viewed in
+std::string wideIdentity() {
+	std::string call = "(lambda (x) (max";
+	for (int i = 0; i < 50000; i++) {
+		call += " x";
+	}
+
+	return call + "))";
+}
+
 TEST_CASE("Test Interpreter parser with expected input", "[interpreter]") {
 	std::string program = "(begin (define r 10) (* pi (* r r)))";
 
@@ -782,6 +796,15 @@ TEST_CASE("Testing list specific functions (rest)", "[Interpreter]") {
 		REQUIRE(result == Expression(expected));
 	}
 
+	{
+		INFO("the rest of a lazy map whose lambda grows the argument stack");
+		Expression result = run("(begin (define wide " + wideIdentity() + ") "
+			"(rest (map wide (range 1 3 1))))");
+
+		std::vector<Expression> expected = {Expression(2), Expression(3)};
+		REQUIRE(result == Expression(expected));
+	}
+
 	{
 		INFO("Should throw semantic error for:");
 		std::vector<std::string> programs = {
@@ -878,6 +901,15 @@ TEST_CASE("Testing list specific functions (append)", "[Interpreter]") {
 		REQUIRE(result == Expression(expected));
 	}
 
+	{
+		INFO("appending to a lazy map whose lambda grows the argument stack");
+		Expression result = run("(begin (define wide " + wideIdentity() + ") "
+			"(append (map wide (range 1 2 1)) 3))");
+
+		std::vector<Expression> expected = {Expression(1), Expression(2), Expression(3)};
+		REQUIRE(result == Expression(expected));
+	}
+
 	{
 		INFO("Should throw semantic error for:");
 		std::vector<std::string> programs = {
@@ -1099,6 +1131,188 @@ TEST_CASE("Testing functional procedure (map)", "[interpreter]") {
 	}
 }
 
+TEST_CASE("Testing map over long lists", "[interpreter]") {
+
+	// long lists are mapped on the thread pool, the results keep their order
+	Expression result = run("(map (lambda (x) (* x x)) (range 0 999 1))");
+	REQUIRE(std::distance(result.tailConstBegin(), result.tailConstEnd()) == 1000);
+	double i = 0;
+	for (auto it = result.tailConstBegin(); it != result.tailConstEnd(); it++, i++) {
+		REQUIRE(*it == Expression(i * i));
+	}
+
+	REQUIRE(run("(map sqrt (range 0 999 1))") ==
+		run("(begin (define f (lambda (x) (sqrt x))) (map f (range 0 999 1)))"));
+
+	{
+		INFO("the error of the first failing element is reported");
+
+		// element 300 fails with an invalid argument, element 700 with the wrong number of arguments
+		std::string items;
+		for (int n = 0; n < 1000; n++) {
+			if (n == 300) {
+				items += " (list \"a\" 1)";
+			} else if (n == 700) {
+				items += " (list 1 2 3)";
+			} else {
+				items += " (list 1 2)";
+			}
+		}
+
+		std::string program = "(map (lambda (x) (apply - x)) (list" + items + "))";
+		std::istringstream iss(program);
+		Interpreter interp;
+		REQUIRE(interp.parseStream(iss));
+		for (int attempt = 0; attempt < 10; attempt++) {
+			try {
+				interp.evaluate();
+				FAIL("expected an error");
+			} catch (const SemanticError& ex) {
+				REQUIRE(std::string(ex.what()) == "Error in call to subtraction: invalid argument.");
+			}
+		}
+	}
+}
+
+TEST_CASE("Testing functional procedures (reduce and fold)", "[interpreter]") {
+
+	REQUIRE(run("(reduce + (list 1 2 3))") == Expression(6.));
+	REQUIRE(run("(reduce max (list 3 9 2))") == Expression(9.));
+	REQUIRE(run("(reduce min (list 3 9 2))") == Expression(2.));
+
+	// other procedures combine the elements from the left
+	REQUIRE(run("(reduce - (list 10 1 2))") == Expression(7.));
+	REQUIRE(run("(reduce (lambda (a b) (- a b)) (list 10 1 2))") == Expression(7.));
+	REQUIRE(run("(begin (define f (lambda (a b) (/ a b))) (reduce f (list 8 2 2)))") ==
+		Expression(2.));
+	REQUIRE(run("(reduce - (list 4))") == Expression(4.));
+
+	// a lone element is the result whatever the procedure
+	REQUIRE(run("(reduce + (list \"a\"))") == run("(reduce - (list \"a\"))"));
+	REQUIRE(run("(reduce max (map (lambda (x) (* x I)) (take (range 1 2 1) 1)))") ==
+		Expression(complex(0, 1)));
+
+	REQUIRE(run("(fold - 10 (list 1 2))") == Expression(7.));
+	REQUIRE(run("(fold + 5 (list))") == Expression(5.));
+	REQUIRE(run("(fold * 2 (list 3 I))") == Expression(complex(0, 6)));
+	REQUIRE(run("(fold (lambda (acc x) (append acc x)) (list) (list 1 2))") ==
+		Expression(std::vector<Expression>{Expression(1.), Expression(2.)}));
+
+	{
+		INFO("Should throw semantic error for:");
+		std::vector<std::string> programs = {
+			"(reduce)",
+			"(reduce +)",
+			"(reduce + (list))",
+			"(reduce + 1)",
+			"(reduce 1 (list 1 2))",
+			"(reduce + (list 1 \"a\"))",
+			"(reduce + (append (range 1 1024 1) \"a\"))",
+			"(reduce (lambda (a) a) (list 1 2))",
+			"(fold + (list 1))",
+			"(fold + 0 1)",
+			"(fold e 0 (list 1))",
+			"(min)",
+			"(max 1 I)"
+		};
+
+		for (auto s : programs) {
+			INFO(s);
+			run(s, true);
+		}
+	}
+}
+
+TEST_CASE("Testing reduce over long lists", "[interpreter]") {
+
+	// chunks of long lists are reduced on the thread pool, sequences are read a chunk at a time
+	REQUIRE(run("(reduce + (append (range 1 99999 1) 100000))") == Expression(5000050000.));
+	REQUIRE(run("(reduce + (range 1 100000 1))") == Expression(5000050000.));
+	REQUIRE(run("(fold + 1 (range 1 100000 1))") == Expression(5000050001.));
+	REQUIRE(run("(reduce max (append (range 1 99999 1) -1))") == Expression(99999.));
+	REQUIRE(run("(reduce (lambda (a b) (+ a b)) (range 1 100000 1))") == Expression(5000050000.));
+
+	// the grouping is fixed, lists and sequences round the same whatever the number of threads
+	REQUIRE(run("(reduce + (append (range 0 10 1e-4) 0))") == run("(reduce + (range 0 10 1e-4))"));
+}
+
+TEST_CASE("Testing comparison procedures", "[interpreter]") {
+
+	REQUIRE(run("(< 1 2)") == Expression(1.));
+	REQUIRE(run("(< 2 1)") == Expression(0.));
+	REQUIRE(run("(> 2 1)") == Expression(1.));
+	REQUIRE(run("(= 2 2)") == Expression(1.));
+	REQUIRE(run("(= 2 3)") == Expression(0.));
+
+	std::vector<std::string> programs = {"(<)", "(< 1)", "(> 1 2 3)", "(= 1 I)", "(< \"a\" 1)"};
+	for (auto s : programs) {
+		INFO(s);
+		run(s, true);
+	}
+}
+
+TEST_CASE("Testing filter, sort and sort-by", "[interpreter]") {
+
+	REQUIRE(run("(filter (lambda (x) (> x 2)) (list 1 3 2 4))") == run("(list 3 4)"));
+	REQUIRE(run("(begin (define small (lambda (x) (< x 3))) (filter small (list 1 3 2 4)))") ==
+		run("(list 1 2)"));
+	REQUIRE(run("(filter - (list 0 1 0 2))") == run("(list 1 2)"));
+	REQUIRE(run("(filter (lambda (x) 0) (list 1 2))") == run("(list)"));
+
+	REQUIRE(run("(sort (list 3 -1 2 2.5))") == run("(list -1 2 2.5 3)"));
+	REQUIRE(run("(sort (list))") == run("(list)"));
+	REQUIRE(run("(sort (map - (range 1 3 1)))") == run("(list -3 -2 -1)"));
+
+	// NaN is not ordered by <, it goes last
+	Expression sorted = run("(sort (list 3 (/ 0 0) 1 2))");
+	std::vector<Expression> numbers(sorted.tailConstBegin(), sorted.tailConstEnd() - 1);
+	REQUIRE(Expression(numbers) == run("(list 1 2 3)"));
+	REQUIRE(std::isnan((sorted.tailConstEnd() - 1)->head().asNumber()));
+	REQUIRE(run("(sort-by (lambda (x) (/ x x)) (list 0 1 2))") == run("(list 1 2 0)"));
+
+	// equal keys keep their order
+	REQUIRE(run("(sort-by first (list (list 2 \"a\") (list 1 \"b\") (list 2 \"c\") "
+		"(list 0 \"d\")))") ==
+		run("(list (list 0 \"d\") (list 1 \"b\") (list 2 \"a\") (list 2 \"c\"))"));
+	REQUIRE(run("(sort-by (lambda (x) (- x)) (list 1 3 2))") == run("(list 3 2 1)"));
+
+	{
+		INFO("long lists are filtered and sorted in parallel");
+		Expression result = run("(filter (lambda (x) (> x 4999.5)) (range 0 9999 1))");
+		REQUIRE(result == run("(range 5000 9999 1)"));
+
+		result = run("(sort (map (lambda (x) (- 9999 x)) (range 0 9999 1)))");
+		REQUIRE(result == run("(range 0 9999 1)"));
+
+		result = run("(sort-by (lambda (x) (- x)) (range 0 9999 1))");
+		REQUIRE(result == run("(map (lambda (x) (- 9999 x)) (range 0 9999 1))"));
+	}
+
+	{
+		INFO("Should throw semantic error for:");
+		std::vector<std::string> programs = {
+			"(filter)",
+			"(filter -)",
+			"(filter - 1)",
+			"(filter 1 (list 1))",
+			"(filter (lambda (x) (list x)) (list 1))",
+			"(sort)",
+			"(sort 1)",
+			"(sort (list 1 I))",
+			"(sort (list 1) (list 2))",
+			"(sort-by first)",
+			"(sort-by first 1)",
+			"(sort-by e (list 1))",
+			"(sort-by (lambda (x) I) (list 1))"
+		};
+
+		for (auto s : programs) {
+			INFO(s);
+			run(s, true);
+		}
+	}
+}
+
 TEST_CASE("Test a medium-sized expression", "[interpreter]") {
 
 	{
@@ -1200,6 +1414,40 @@ TEST_CASE("Test non-trivial arithmetic procedures with complex numbers", "[inter
 		Expression result = run(program);
 		REQUIRE(result == Expression(complex(-7, 2.05)));
 	}
+
+	{ // a complex argument anywhere in the call keeps the result complex
+		std::vector<std::string> programs = {"(+ 1 2 (- I I))", "(* 2 (/ I I))", "(- 2 (* 0 I))"};
+
+		for (auto s : programs) {
+			INFO(s);
+			Expression result = run(s);
+			REQUIRE(result.isHeadComplex());
+		}
+	}
+
+	{ // calls with only real arguments produce real numbers
+		std::vector<std::string> programs = {"(+ 1 2 3)", "(* 2 3 4)", "(- 2 3)", "(/ 2 3)"};
+
+		for (auto s : programs) {
+			INFO(s);
+			Expression result = run(s);
+			REQUIRE(result.isHeadNumber());
+		}
+	}
+
+	{
+		INFO("Should throw semantic error for:");
+		std::vector<std::string> programs = {
+			"(+ I \"eggs\")",
+			"(* I (list))",
+			"(+ 1 I (list 1))"
+		};
+
+		for (auto s : programs) {
+			INFO(s);
+			run(s, true);
+		}
+	}
 }
 
 TEST_CASE("Test procedures (square root)", "[interpreter]") {
@@ -1650,6 +1898,22 @@ TEST_CASE("Simple discrete plot tests", "[interpreter]") {
 	}
 }
 
+TEST_CASE("Plot arguments outlive the lambdas of lazy maps among them", "[interpreter]") {
+	const std::string define = "(begin (define wide " + wideIdentity() + ") ";
+
+	Expression discrete = run(define + "(discrete-plot (map (lambda (x) (list x (wide x))) "
+		"(range 1 2 1)) (list (list \"title\" \"T\"))))");
+	REQUIRE(std::distance(discrete.tailConstBegin(), discrete.tailConstEnd()) > 2);
+
+	Expression continuous = run(define + "(continuous-plot (lambda (x) x) "
+		"(map wide (range -1 1 2)) (list (list \"title\" \"T\"))))");
+	REQUIRE(std::distance(continuous.tailConstBegin(), continuous.tailConstEnd()) > 2);
+
+	Expression surface = run(define + "(surface-plot (lambda (x y) (+ x y)) "
+		"(map wide (range -1 1 2)) (list -1 1) (list (list \"resolution\" 4))))");
+	REQUIRE(std::distance(surface.tailConstBegin(), surface.tailConstEnd()) == 1 + 6 + 4);
+}
+
 TEST_CASE("Simple continuous plot tests", "[interpreter]") {
 
 	{ // Testing continuous plot, verify list length
@@ -1682,6 +1946,191 @@ TEST_CASE("Simple continuous plot tests", "[interpreter]") {
 	}
 }
 
+TEST_CASE("Testing continuous plots of expensive lambdas", "[interpreter]") {
+
+	// the samples are evaluated concurrently, the plot is the same as sampling them in order
+	Expression cheap = run("(continuous-plot (lambda (x) (sin (* 3 x))) (list -2 2))");
+	Expression expensive = run("(continuous-plot (lambda (x) (+ (sin (* 3 x)) "
+		"(reduce + (map (lambda (k) (* k 0)) (range 1 200 1))))) (list -2 2))");
+	REQUIRE(cheap == expensive);
+
+	// the error of the first sample in order is reported
+	std::istringstream iss("(continuous-plot (lambda (x) (list x)) (list 0 1))");
+	Interpreter interp;
+	REQUIRE(interp.parseStream(iss));
+	try {
+		interp.evaluate();
+		FAIL("expected an error");
+	} catch (const SemanticError& ex) {
+		REQUIRE(std::string(ex.what()) == "Error: invalid function for continuous plot");
+	}
+}
+
+TEST_CASE("Testing maps of elementwise lambdas", "[interpreter]") {
+
+	// long lists of numbers are mapped with the array form of the lambda, the same as one call at a
+	// time
+	std::string square = "(lambda (x) (- (* x x) (sqrt (+ 1 x))))";
+	Expression packed = run("(map " + square + " (range 0 999 1))");
+	Expression called = run("(map (lambda (x) (begin (- (* x x) (sqrt (+ 1 x))))) "
+		"(range 0 999 1))");
+	REQUIRE(packed == called);
+	REQUIRE(std::distance(packed.tailConstBegin(), packed.tailConstEnd()) == 1000);
+
+	INFO("an argument outside the domain of the array form is called like the others");
+	Expression negative = run("(map " + square + " (map - (range 0 999 1)))");
+	REQUIRE(negative.tailConstBegin()->head().asNumber() == -1);
+	REQUIRE((negative.tailConstBegin() + 2)->isHeadComplex());
+}
+
+TEST_CASE("Testing the smoothing options of continuous plots", "[interpreter]") {
+	const std::string plot = "(continuous-plot (lambda (x) (sin (* 3 x))) (list -2 2)";
+	Expression smooth = run(plot + ")");
+	Expression straight = run(plot + " (list (list \"angle-tolerance\" 180)))");
+	Expression unsampled = run(plot + " (list (list \"sample-budget\" 0)))");
+	Expression budgeted = run(plot + " (list (list \"sample-budget\" 60)))");
+
+	// no corner is split, so the plot has the PLOT_M - 1 lines of its first samples
+	REQUIRE(straight == unsampled);
+
+	// budgets too large to count are unlimited
+	REQUIRE(run(plot + " (list (list \"sample-budget\" 1e30)))") == smooth);
+	REQUIRE(run(plot + " (list (list \"sample-budget\" (/ 1 0))))") == smooth);
+	std::size_t size = std::distance(straight.tailConstBegin(), straight.tailConstEnd());
+	REQUIRE(std::distance(smooth.tailConstBegin(), smooth.tailConstEnd()) > size);
+
+	// each split takes two samples and adds two lines, the lines stay in order and joined
+	REQUIRE(std::distance(budgeted.tailConstBegin(), budgeted.tailConstEnd()) == size + 10);
+	auto line = budgeted.tailConstBegin();
+	for (std::size_t i = 0; i + 1 < 59; i++, line++) {
+		REQUIRE(*std::prev(line->tailConstEnd()) == *std::next(line)->tailConstBegin());
+		REQUIRE(std::prev(line->tailConstEnd())->tailConstBegin()->head().asNumber() >
+			line->tailConstBegin()->tailConstBegin()->head().asNumber());
+	}
+}
+
+TEST_CASE("Testing decimation of discrete plots", "[interpreter]") {
+
+	// a noisy series of 5000 points with its extremes in the middle
+	const std::string data = "(map (lambda (x) (list x (+ (sin x) (* 3 (= x 2500))))) "
+		"(range 0 4999 1))";
+	Expression full = run("(discrete-plot " + data + ")");
+	Expression lttb = run("(discrete-plot " + data + " (list (list \"decimation\" \"lttb\") "
+		"(list \"resolution\" 100)))");
+	Expression minMax = run("(discrete-plot " + data + " (list (list \"decimation\" \"min-max\") "
+		"(list \"resolution\" 50)))");
+
+	// the plots hold the abscissa axis and the edges (5 lines), a point and a stem per point kept,
+	// then the tick labels. The bounds are those of every point
+	std::size_t fullSize = std::distance(full.tailConstBegin(), full.tailConstEnd());
+	REQUIRE(fullSize == 5 + 2 * 5000 + 4);
+	REQUIRE(std::distance(lttb.tailConstBegin(), lttb.tailConstEnd()) == 5 + 2 * 100 + 4);
+	std::size_t minMaxSize = std::distance(minMax.tailConstBegin(), minMax.tailConstEnd());
+	REQUIRE(minMaxSize <= 5 + 2 * 100 + 4);
+	REQUIRE(minMaxSize > 5 + 2 * 50 + 4);
+
+	for (std::size_t i = 1; i <= 4; i++) {
+		REQUIRE(*(full.tailConstEnd() - i) == *(lttb.tailConstEnd() - i));
+		REQUIRE(*(full.tailConstEnd() - i) == *(minMax.tailConstEnd() - i));
+	}
+
+	// the spike is kept by both
+	auto hasPoint = [](const Expression& plot, const Expression& point) {
+		return std::find(plot.tailConstBegin(), plot.tailConstEnd(), point) != plot.tailConstEnd();
+	};
+
+	auto spike = std::find_if(full.tailConstBegin(), full.tailConstEnd(), [](const Expression& e) {
+		return e.getProperty("object-name") == Expression(Atom("\"point\"")) &&
+			std::prev(e.tailConstEnd())->head().asNumber() < -9;
+	});
+	REQUIRE(spike != full.tailConstEnd());
+	REQUIRE(hasPoint(lttb, *spike));
+	REQUIRE(hasPoint(minMax, *spike));
+
+	// a resolution too large to count keeps every point
+	REQUIRE(run("(discrete-plot " + data + " (list (list \"decimation\" \"lttb\") "
+		"(list \"resolution\" 1e30)))") == full);
+	REQUIRE(run("(discrete-plot " + data + " (list (list \"decimation\" \"min-max\") "
+		"(list \"resolution\" (^ 2 63))))") == full);
+
+	INFO("an unknown method plots every point");
+	Expression unknown = run("(discrete-plot " + data + " (list (list \"decimation\" \"mean\")))");
+	REQUIRE(unknown == full);
+}
+
+TEST_CASE("Testing surface and contour plots", "[interpreter]") {
+	Expression surface = run("(surface-plot (lambda (x y) (+ x y)) (list -1 1) (list -1 1) "
+		"(list (list \"resolution\" 4)))");
+
+	// the image, both axes, the edges and the tick labels
+	REQUIRE(std::distance(surface.tailConstBegin(), surface.tailConstEnd()) == 1 + 6 + 4);
+	const Expression& image = *surface.tailConstBegin();
+	REQUIRE(image.getProperty("object-name") == Expression(Atom("\"image\"")));
+	REQUIRE(std::distance(image.tailConstBegin(), image.tailConstEnd()) == 4);
+
+	// each cell holds the value at its center, the rows from the top
+	const Expression& top = *image.tailConstBegin();
+	const Expression& bottom = *std::prev(image.tailConstEnd());
+	REQUIRE(*top.tailConstBegin() == Expression(0.));
+	REQUIRE(*std::prev(top.tailConstEnd()) == Expression(1.5));
+	REQUIRE(*bottom.tailConstBegin() == Expression(-1.5));
+
+	// a circle of radius 0.5, drawn 10 times larger in the plot
+	const std::string circle = "(contour-plot (lambda (x y) (+ (* x x) (* y y))) (list -1 1) "
+		"(list -1 1) (list (list \"levels\" (list 0.25))";
+	Expression coarse = run(circle + " (list \"refinement\" 0)))");
+	Expression fine = run(circle + "))");
+	std::size_t coarseLines = std::distance(coarse.tailConstBegin(), coarse.tailConstEnd()) - 10;
+	std::size_t fineLines = std::distance(fine.tailConstBegin(), fine.tailConstEnd()) - 10;
+	REQUIRE(coarseLines > 4);
+	REQUIRE(fineLines > 2 * coarseLines);
+
+	auto radius = [](const Expression& point) {
+		return std::hypot(point.tailConstBegin()->head().asNumber(),
+			std::prev(point.tailConstEnd())->head().asNumber());
+	};
+
+	auto line = fine.tailConstBegin();
+	for (std::size_t i = 0; i < fineLines; i++, line++) {
+		REQUIRE(line->getProperty("object-name") == Expression(Atom("\"line\"")));
+		REQUIRE(radius(*line->tailConstBegin()) == Approx(5).epsilon(0.01));
+		REQUIRE(radius(*std::prev(line->tailConstEnd())) == Approx(5).epsilon(0.01));
+	}
+
+	// the circle is closed, next to refined cells too: every end is shared by exactly two lines
+	std::map<std::pair<double, double>, std::size_t> ends;
+	line = fine.tailConstBegin();
+	for (std::size_t i = 0; i < fineLines; i++, line++) {
+		for (auto point = line->tailConstBegin(); point != line->tailConstEnd(); point++) {
+			ends[{point->tailConstBegin()->head().asNumber(),
+				std::prev(point->tailConstEnd())->head().asNumber()}]++;
+		}
+	}
+
+	REQUIRE(ends.size() == fineLines);
+	REQUIRE(std::all_of(ends.begin(), ends.end(),
+		[](const std::pair<const std::pair<double, double>, std::size_t>& end) {
+			return end.second == 2;
+		}));
+
+	INFO("the levels default to 10 across the values of the grid");
+	Expression levels = run("(contour-plot (lambda (x y) x) (list 0 1) (list 0 1))");
+	REQUIRE(std::distance(levels.tailConstBegin(), levels.tailConstEnd()) > 10 * 24);
+
+	std::vector<std::string> programs = {
+		"(surface-plot (lambda (x) x) (list 0 1) (list 0 1))",
+		"(contour-plot (lambda (x y) x) (list 1 1) (list 0 1))",
+		"(surface-plot (lambda (x y) \"a\") (list 0 1) (list 0 1))",
+		"(contour-plot (lambda (x y) x) (list 0 1))",
+		"(define surface-plot 1)"
+	};
+
+	for (auto s : programs) {
+		INFO(s);
+		run(s, true);
+	}
+}
+
 TEST_CASE("Test some semantically invalid expresions", "[interpreter]") {
 	std::vector<std::string> programs = {
 		"(@ none)", // so such procedure
@@ -0,0 +1,745 @@
+#include "lambda_compiler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "environment.hpp"
+#include "semantic_error.hpp"
+#include "interrupt_flag.hpp"
+#include "thread_pool.hpp"
+
+// Defined in expression.cpp, calls go through it whenever the compiled form cannot resolve the
+// procedure itself
+Expression apply(const Atom& op, Arguments args, const Environment& env);
+
+std::size_t initialThreshold() {
+	const char* value = std::getenv("PLOTSCRIPT_PROMOTION_THRESHOLD");
+	return (value != nullptr) ? std::strtoul(value, nullptr, 10) : 16;
+}
+
+std::atomic<std::size_t>& promotionThreshold() {
+	static std::atomic<std::size_t> threshold(initialThreshold());
+	return threshold;
+}
+
+std::atomic<std::size_t> promotedCount(0);
+std::atomic<std::size_t> unsupportedCount(0);
+
+// The state of one call of a compiled lambda. The scope holding the arguments by name is only
+// built when the body calls something that may look them up (a lambda or a plot)
+class Frame {
+public:
+	Frame(const CompiledLambda& lambda, Arguments args, const Environment& env):
+		m_lambda(lambda), m_args(args), m_env(env) {}
+
+	const Expression& arg(std::size_t i) const {
+		return m_args[i];
+	}
+
+	const Environment& env() const {
+		return m_env;
+	}
+
+	const Environment& scope() const;
+
+private:
+	const CompiledLambda& m_lambda;
+	Arguments m_args;
+	const Environment& m_env;
+	mutable std::unique_ptr<Environment> m_scope;
+};
+
+// A node of the compiled body
+class Node {
+public:
+	virtual ~Node() {}
+	virtual Expression eval(const Frame& frame) const = 0;
+};
+
+typedef std::vector<std::unique_ptr<Node>> Nodes;
+
+class CompiledLambda {
+public:
+	CompiledLambda(const std::vector<Atom>& params, std::unique_ptr<Node> body):
+		m_params(params), m_body(std::move(body)) {}
+
+	const std::vector<Atom>& params() const {
+		return m_params;
+	}
+
+	const Node& body() const {
+		return *m_body;
+	}
+
+private:
+	std::vector<Atom> m_params;
+	std::unique_ptr<Node> m_body;
+};
+
+const Environment& Frame::scope() const {
+	if (m_scope.get() == nullptr) {
+		m_scope.reset(new Environment(Environment::makeScope(m_env)));
+		for (std::size_t i = 0; i < m_lambda.params().size(); i++) {
+			m_scope->add_exp(m_lambda.params()[i], m_args[i], true);
+		}
+	}
+
+	return *m_scope;
+}
+
+// Arguments of up to this many values are evaluated into a buffer on the stack
+const std::size_t INLINE_ARGUMENTS = 4;
+
+// Evaluate nodes and pass the values to call as an Arguments view
+template<typename F>
+Expression withArguments(const Nodes& nodes, const Frame& frame, F call) {
+	if (nodes.size() <= INLINE_ARGUMENTS) {
+		Expression values[INLINE_ARGUMENTS];
+		for (std::size_t i = 0; i < nodes.size(); i++) {
+			values[i] = nodes[i]->eval(frame);
+		}
+
+		return call(Arguments(values, nodes.size()));
+	}
+
+	std::vector<Expression> values;
+	values.reserve(nodes.size());
+	for (auto& node : nodes) {
+		values.push_back(node->eval(frame));
+	}
+
+	return call(Arguments(values));
+}
+
+class ConstantNode: public Node {
+public:
+	explicit ConstantNode(const Atom& value): m_value(value) {}
+
+	Expression eval(const Frame&) const {
+		return m_value;
+	}
+
+private:
+	Expression m_value;
+};
+
+class ArgumentNode: public Node {
+public:
+	explicit ArgumentNode(std::size_t index): m_index(index) {}
+
+	Expression eval(const Frame& frame) const {
+		return frame.arg(m_index);
+	}
+
+private:
+	std::size_t m_index;
+};
+
+// A free symbol, looked up in the caller's environment like the tree walker does
+class LookupNode: public Node {
+public:
+	explicit LookupNode(const Atom& sym): m_sym(sym) {}
+
+	Expression eval(const Frame& frame) const {
+		const Expression* exp = frame.env().find_exp(m_sym);
+		if (exp == nullptr) {
+			throw SemanticError("Error during evaluation: unknown symbol");
+		}
+
+		return *exp;
+	}
+
+private:
+	Atom m_sym;
+};
+
+class ListNode: public Node {
+public:
+	explicit ListNode(Nodes items): m_items(std::move(items)) {}
+
+	Expression eval(const Frame& frame) const {
+		std::vector<Expression> result;
+		result.reserve(m_items.size());
+		for (auto& item : m_items) {
+			result.push_back(item->eval(frame));
+		}
+
+		return Expression(result);
+	}
+
+private:
+	Nodes m_items;
+};
+
+// A call of a built-in procedure. Definitions cannot shadow built-in procedures (define and
+// lambda arguments refuse their names), so the procedure is resolved once when compiling
+class BuiltinCallNode: public Node {
+public:
+	BuiltinCallNode(Procedure proc, Nodes args): m_proc(proc), m_args(std::move(args)) {}
+
+	Expression eval(const Frame& frame) const {
+		Procedure proc = m_proc;
+		return withArguments(m_args, frame, [proc](Arguments args) {
+			return proc(args);
+		});
+	}
+
+private:
+	Procedure m_proc;
+	Nodes m_args;
+};
+
+// Any other call, e.g. of a lambda, is applied in a scope holding the arguments by name, since
+// the callee may refer to them
+class CallNode: public Node {
+public:
+	CallNode(const Atom& op, Nodes args): m_op(op), m_args(std::move(args)) {}
+
+	Expression eval(const Frame& frame) const {
+		const Atom& op = m_op;
+		return withArguments(m_args, frame, [&op, &frame](Arguments args) {
+			return apply(op, args, frame.scope());
+		});
+	}
+
+private:
+	Atom m_op;
+	Nodes m_args;
+};
+
+// Compile an expression of a lambda body, returns nullptr if it uses an unsupported construct
+class Compiler {
+public:
+	explicit Compiler(const std::vector<Atom>& params): m_params(params) {}
+
+	std::unique_ptr<Node> compile(const Expression& exp) {
+		const Atom& head = exp.head();
+
+		// special forms other than list change the environment or evaluate their arguments
+		// lazily, they are left to the tree walker
+		std::string op = head.asSymbol();
+		if (op == "begin" || op == "define" || op == "apply" || op == "map" || op == "reduce" ||
+			op == "fold" || op == "filter" || op == "sort-by" || exp.isHeadLambdaRoot() ||
+			op == "set-property" || op == "get-property" || op == "delay" || op == "force") {
+			return nullptr;
+		}
+
+		if (exp.tailConstBegin() == exp.tailConstEnd() && !exp.isHeadListRoot()) {
+			return compileTerminal(head);
+		}
+
+		Nodes args;
+		for (auto it = exp.tailConstBegin(); it != exp.tailConstEnd(); it++) {
+			std::unique_ptr<Node> arg = compile(*it);
+			if (arg.get() == nullptr) {
+				return nullptr;
+			}
+
+			args.push_back(std::move(arg));
+		}
+
+		if (exp.isHeadListRoot()) {
+			return std::unique_ptr<Node>(new ListNode(std::move(args)));
+		} else if (paramIndex(head) < m_params.size()) {
+
+			// calling an argument needs its value in the environment
+			return nullptr;
+		} else if (m_builtins.is_proc(head)) {
+			return std::unique_ptr<Node>(new BuiltinCallNode(m_builtins.get_proc(head),
+				std::move(args)));
+		}
+
+		return std::unique_ptr<Node>(new CallNode(head, std::move(args)));
+	}
+
+private:
+	const std::vector<Atom>& m_params;
+	Environment m_builtins;
+
+	std::size_t paramIndex(const Atom& sym) const {
+		for (std::size_t i = 0; i < m_params.size(); i++) {
+			if (m_params[i] == sym) {
+				return i;
+			}
+		}
+
+		return m_params.size();
+	}
+
+	std::unique_ptr<Node> compileTerminal(const Atom& head) {
+		if (head.isNumber() || head.isComplex() || head.isStringLiteral()) {
+			return std::unique_ptr<Node>(new ConstantNode(head));
+		} else if (!head.isSymbol()) {
+			return nullptr;
+		}
+
+		std::size_t index = paramIndex(head);
+		if (index < m_params.size()) {
+			return std::unique_ptr<Node>(new ArgumentNode(index));
+		}
+
+		return std::unique_ptr<Node>(new LookupNode(head));
+	}
+};
+
+std::unique_ptr<CompiledLambda> compileLambda(const Expression& lambda) {
+	const Expression& lambdaArgs = *lambda.tailConstBegin();
+	const Expression& body = *std::prev(lambda.tailConstEnd());
+
+	std::vector<Atom> params;
+	for (auto it = lambdaArgs.tailConstBegin(); it != lambdaArgs.tailConstEnd(); it++) {
+		params.push_back(it->head());
+	}
+
+	std::unique_ptr<Node> node = Compiler(params).compile(body);
+	if (node.get() == nullptr) {
+		return nullptr;
+	}
+
+	return std::unique_ptr<CompiledLambda>(new CompiledLambda(params, std::move(node)));
+}
+
+// Arguments of an array form are evaluated in blocks of this many, so the operands of every
+// operation of the body stay in cache
+const std::size_t ARRAY_BLOCK = 256;
+
+// A node of the array form of a body, its values at a block of arguments
+class ArrayNode {
+public:
+	virtual ~ArrayNode() {}
+
+	// write the values at the n arguments xs to out, return false if one needs the general
+	// evaluation
+	virtual bool eval(const double* xs, std::size_t n, double* out,
+		const Environment& env) const = 0;
+};
+
+typedef std::vector<std::unique_ptr<ArrayNode>> ArrayNodes;
+
+// Numbers are stored in Atoms, which make values within epsilon of zero zero. The general
+// evaluation stores the argument and the result of every call, so the array form does too
+void truncateToZero(double* values, std::size_t n) {
+	for (std::size_t i = 0; i < n; i++) {
+		if (std::fabs(values[i]) <= std::numeric_limits<double>::epsilon()) {
+			values[i] = 0;
+		}
+	}
+}
+
+class ArrayConstantNode: public ArrayNode {
+public:
+	explicit ArrayConstantNode(double value): m_value(value) {}
+
+	bool eval(const double*, std::size_t n, double* out, const Environment&) const {
+		std::fill(out, out + n, m_value);
+		return true;
+	}
+
+private:
+	double m_value;
+};
+
+class ArrayArgumentNode: public ArrayNode {
+public:
+	bool eval(const double* xs, std::size_t n, double* out, const Environment&) const {
+		std::copy(xs, xs + n, out);
+		truncateToZero(out, n);
+		return true;
+	}
+};
+
+// A free symbol, which must be bound to a real number in the caller's environment
+class ArrayLookupNode: public ArrayNode {
+public:
+	explicit ArrayLookupNode(const Atom& sym): m_sym(sym) {}
+
+	bool eval(const double*, std::size_t n, double* out, const Environment& env) const {
+		const Expression* exp = env.find_exp(m_sym);
+		if (exp == nullptr || !exp->isHeadNumber()) {
+			return false;
+		}
+
+		std::fill(out, out + n, exp->head().asNumber());
+		return true;
+	}
+
+private:
+	Atom m_sym;
+};
+
+// The elementwise operations, each the same arithmetic as the built-in procedure on real numbers.
+// Operations whose result is only real for some arguments accept the others through inDomain
+struct RealDomain {
+	static bool inDomain(double) { return true; }
+};
+
+struct NonNegativeDomain {
+	static bool inDomain(double x) { return x >= 0; }
+};
+
+struct NegateOp: RealDomain { static double apply(double x) { return -x; } };
+struct InverseOp: RealDomain { static double apply(double x) { return 1 / x; } };
+struct SinOp: RealDomain { static double apply(double x) { return std::sin(x); } };
+struct CosOp: RealDomain { static double apply(double x) { return std::cos(x); } };
+struct TanOp: RealDomain { static double apply(double x) { return std::tan(x); } };
+struct SqrtOp: NonNegativeDomain { static double apply(double x) { return std::sqrt(x); } };
+struct LnOp: NonNegativeDomain { static double apply(double x) { return std::log(x); } };
+
+struct AddOp { static double apply(double a, double b) { return a + b; } };
+struct MulOp { static double apply(double a, double b) { return a * b; } };
+struct SubOp { static double apply(double a, double b) { return a - b; } };
+struct DivOp { static double apply(double a, double b) { return a / b; } };
+struct PowOp { static double apply(double a, double b) { return std::pow(a, b); } };
+struct MinOp { static double apply(double a, double b) { return std::min(a, b); } };
+struct MaxOp { static double apply(double a, double b) { return std::max(a, b); } };
+struct LessOp { static double apply(double a, double b) { return (a < b) ? 1. : 0.; } };
+struct GreaterOp { static double apply(double a, double b) { return (a > b) ? 1. : 0.; } };
+struct EqualOp { static double apply(double a, double b) { return (a == b) ? 1. : 0.; } };
+
+template<typename Op>
+class ArrayUnaryNode: public ArrayNode {
+public:
+	explicit ArrayUnaryNode(std::unique_ptr<ArrayNode> arg): m_arg(std::move(arg)) {}
+
+	bool eval(const double* xs, std::size_t n, double* out, const Environment& env) const {
+		if (!m_arg->eval(xs, n, out, env)) {
+			return false;
+		}
+
+		for (std::size_t i = 0; i < n; i++) {
+			if (!Op::inDomain(out[i])) {
+				return false;
+			}
+		}
+
+		for (std::size_t i = 0; i < n; i++) {
+			out[i] = Op::apply(out[i]);
+		}
+
+		truncateToZero(out, n);
+		return true;
+	}
+
+private:
+	std::unique_ptr<ArrayNode> m_arg;
+};
+
+// Combine the arguments from the left, starting from the value of the first argument or, for +
+// and *, from their identity like the built-in procedures do
+template<typename Op>
+class ArrayFoldNode: public ArrayNode {
+public:
+	ArrayFoldNode(ArrayNodes args, bool fromIdentity, double identity):
+		m_args(std::move(args)), m_fromIdentity(fromIdentity), m_identity(identity) {}
+
+	bool eval(const double* xs, std::size_t n, double* out, const Environment& env) const {
+		double operand[ARRAY_BLOCK];
+		std::size_t first = 0;
+		if (m_fromIdentity) {
+			std::fill(out, out + n, m_identity);
+		} else if (!m_args[0]->eval(xs, n, out, env)) {
+			return false;
+		} else {
+			first = 1;
+		}
+
+		for (std::size_t k = first; k < m_args.size(); k++) {
+			if (!m_args[k]->eval(xs, n, operand, env)) {
+				return false;
+			}
+
+			for (std::size_t i = 0; i < n; i++) {
+				out[i] = Op::apply(out[i], operand[i]);
+			}
+		}
+
+		truncateToZero(out, n);
+		return true;
+	}
+
+private:
+	ArrayNodes m_args;
+	bool m_fromIdentity;
+	double m_identity;
+};
+
+class ArrayLambda {
+public:
+	explicit ArrayLambda(std::unique_ptr<ArrayNode> body): m_body(std::move(body)) {}
+
+	const ArrayNode& body() const {
+		return *m_body;
+	}
+
+private:
+	std::unique_ptr<ArrayNode> m_body;
+};
+
+// Compile the body of a lambda of one argument into its array form, returns nullptr if it uses
+// anything but numbers, symbols and calls of the elementwise built-in procedures. Like for the
+// compiled form, the built-in procedures cannot be shadowed so they are resolved by name
+class ArrayCompiler {
+public:
+	explicit ArrayCompiler(const Atom& param): m_param(param) {}
+
+	std::unique_ptr<ArrayNode> compile(const Expression& exp) const {
+		const Atom& head = exp.head();
+		if (exp.tailConstBegin() == exp.tailConstEnd() && !exp.isHeadListRoot()) {
+			if (head.isNumber()) {
+				return std::unique_ptr<ArrayNode>(new ArrayConstantNode(head.asNumber()));
+			} else if (head == m_param) {
+				return std::unique_ptr<ArrayNode>(new ArrayArgumentNode());
+			} else if (head.isSymbol()) {
+				return std::unique_ptr<ArrayNode>(new ArrayLookupNode(head));
+			}
+
+			return nullptr;
+		} else if (!head.isSymbol() || exp.isHeadListRoot() || exp.isHeadLambdaRoot()) {
+			return nullptr;
+		}
+
+		ArrayNodes args;
+		for (auto it = exp.tailConstBegin(); it != exp.tailConstEnd(); it++) {
+			std::unique_ptr<ArrayNode> arg = compile(*it);
+			if (arg.get() == nullptr) {
+				return nullptr;
+			}
+
+			args.push_back(std::move(arg));
+		}
+
+		return compileCall(head.asSymbol(), std::move(args));
+	}
+
+private:
+	Atom m_param;
+
+	template<typename Op>
+	static std::unique_ptr<ArrayNode> unary(ArrayNodes& args) {
+		return std::unique_ptr<ArrayNode>(new ArrayUnaryNode<Op>(std::move(args[0])));
+	}
+
+	template<typename Op>
+	static std::unique_ptr<ArrayNode> fold(ArrayNodes& args, bool fromIdentity = false,
+		double identity = 0) {
+		return std::unique_ptr<ArrayNode>(new ArrayFoldNode<Op>(std::move(args), fromIdentity,
+			identity));
+	}
+
+	// calls with the wrong number of arguments are left to the general evaluation, which reports
+	// the error
+	static std::unique_ptr<ArrayNode> compileCall(const std::string& op, ArrayNodes args) {
+		std::size_t n = args.size();
+		if (op == "+" && n >= 1) {
+			return fold<AddOp>(args, true, 0);
+		} else if (op == "*" && n >= 1) {
+			return fold<MulOp>(args, true, 1);
+		} else if (op == "-" && n == 1) {
+			return unary<NegateOp>(args);
+		} else if (op == "-" && n == 2) {
+			return fold<SubOp>(args);
+		} else if (op == "/" && n == 1) {
+			return unary<InverseOp>(args);
+		} else if (op == "/" && n == 2) {
+			return fold<DivOp>(args);
+		} else if (op == "^" && n == 2) {
+			return fold<PowOp>(args);
+		} else if (op == "min" && n >= 1) {
+			return fold<MinOp>(args);
+		} else if (op == "max" && n >= 1) {
+			return fold<MaxOp>(args);
+		} else if (op == "<" && n == 2) {
+			return fold<LessOp>(args);
+		} else if (op == ">" && n == 2) {
+			return fold<GreaterOp>(args);
+		} else if (op == "=" && n == 2) {
+			return fold<EqualOp>(args);
+		} else if (n != 1) {
+			return nullptr;
+		} else if (op == "sqrt") {
+			return unary<SqrtOp>(args);
+		} else if (op == "ln") {
+			return unary<LnOp>(args);
+		} else if (op == "sin") {
+			return unary<SinOp>(args);
+		} else if (op == "cos") {
+			return unary<CosOp>(args);
+		} else if (op == "tan") {
+			return unary<TanOp>(args);
+		}
+
+		return nullptr;
+	}
+};
+
+std::unique_ptr<ArrayLambda> compileArrayLambda(const Expression& lambda) {
+	const Expression& lambdaArgs = *lambda.tailConstBegin();
+	const Expression& body = *std::prev(lambda.tailConstEnd());
+
+	// a body that is just a symbol returns its value as it is, properties included
+	if (std::distance(lambdaArgs.tailConstBegin(), lambdaArgs.tailConstEnd()) != 1 ||
+		(body.tailConstBegin() == body.tailConstEnd() && body.isHeadSymbol())) {
+		return nullptr;
+	}
+
+	const Atom& param = lambdaArgs.tailConstBegin()->head();
+	std::unique_ptr<ArrayNode> node = ArrayCompiler(param).compile(body);
+	if (node.get() == nullptr) {
+		return nullptr;
+	}
+
+	return std::unique_ptr<ArrayLambda>(new ArrayLambda(std::move(node)));
+}
+
+LambdaProfile::LambdaProfile(): m_calls(0), m_state(Interpreted) {}
+
+LambdaProfile::~LambdaProfile() {}
+
+std::size_t LambdaProfile::calls() const noexcept {
+	return m_calls.load(std::memory_order_relaxed);
+}
+
+bool LambdaProfile::isCompiled() const noexcept {
+	return m_state.load(std::memory_order_acquire) == Compiled;
+}
+
+bool LambdaProfile::isUnsupported() const noexcept {
+	return m_state.load(std::memory_order_relaxed) == Unsupported;
+}
+
+// Only the call that takes the state from Interpreted to Compiling compiles the lambda, calls made
+// meanwhile on other threads keep using the tree walker
+const CompiledLambda* LambdaProfile::enter(const Expression& lambda) {
+	int state = m_state.load(std::memory_order_acquire);
+	if (state == Compiled) {
+		return m_code.get();
+	} else if (state != Interpreted) {
+		return nullptr;
+	}
+
+	std::size_t threshold = promotionThreshold().load(std::memory_order_relaxed);
+	std::size_t calls = m_calls.fetch_add(1, std::memory_order_relaxed) + 1;
+	if (threshold == 0 || calls < threshold ||
+		!m_state.compare_exchange_strong(state, Compiling, std::memory_order_acquire)) {
+		return nullptr;
+	}
+
+	m_code = compileLambda(lambda);
+	if (m_code.get() == nullptr) {
+		unsupportedCount.fetch_add(1, std::memory_order_relaxed);
+		m_state.store(Unsupported, std::memory_order_release);
+		return nullptr;
+	}
+
+	promotedCount.fetch_add(1, std::memory_order_relaxed);
+	m_state.store(Compiled, std::memory_order_release);
+	return m_code.get();
+}
+
+const ArrayLambda* LambdaProfile::arrayForm(const Expression& lambda) {
+	std::call_once(m_arrayCompiled, [this, &lambda]() {
+		m_array = compileArrayLambda(lambda);
+	});
+
+	return m_array.get();
+}
+
+Expression runCompiledLambda(const CompiledLambda& code, Arguments args, const Environment& env) {
+
+	// the tree walker checks for an interrupt on every expression, once per call is enough to
+	// stop a long computation made of many calls
+	if (interrupt_flag.load() || ThreadPool::isCancelled()) {
+		if (interrupt_flag.exchange(false)) {
+			ThreadPool::cancelCurrent();
+		}
+		throw SemanticError("Error: interpreter kernel interrupted");
+	}
+
+	if (args.size() != code.params().size()) {
+		throw SemanticError("Error during evaluation: incorrect number of arguments to "
+			"lambda function");
+	}
+
+	// The arguments may be a view into the evaluator's argument stack, which calls made by the body
+	// can grow and move. The body reads them throughout, so they are copied first
+	if (args.size() <= INLINE_ARGUMENTS) {
+		Expression values[INLINE_ARGUMENTS];
+		std::copy(args.begin(), args.end(), values);
+		return code.body().eval(Frame(code, Arguments(values, args.size()), env));
+	}
+
+	std::vector<Expression> values(args.begin(), args.end());
+	return code.body().eval(Frame(code, Arguments(values), env));
+}
+
+// The blocks of a long array are evaluated on the shared thread pool, the nodes only read the
+// environment
+bool evalLambdaArray(const Expression& lambda, const std::vector<double>& xs,
+	std::vector<double>& ys, const Environment& env) {
+	if (!lambda.isHeadLambdaRoot()) {
+		return false;
+	}
+
+	// a lambda made without a profile, e.g. by a test, is compiled for this call only
+	std::unique_ptr<ArrayLambda> unprofiled;
+	const ArrayLambda* code = nullptr;
+	if (lambda.profile() != nullptr) {
+		code = lambda.profile()->arrayForm(lambda);
+	} else {
+		unprofiled = compileArrayLambda(lambda);
+		code = unprofiled.get();
+	}
+
+	if (code == nullptr) {
+		return false;
+	}
+
+	ys.resize(xs.size());
+	std::size_t blocks = (xs.size() + ARRAY_BLOCK - 1) / ARRAY_BLOCK;
+	std::atomic<bool> general(false);
+	std::atomic<bool> interrupted(false);
+	ThreadPool::shared().parallelFor(blocks, 1, [&](std::size_t begin, std::size_t end) {
+		for (std::size_t b = begin; b < end && !general.load() && !interrupted.load(); b++) {
+			if (interrupt_flag.load() || ThreadPool::isCancelled()) {
+				interrupted.store(true);
+				break;
+			}
+
+			std::size_t first = b * ARRAY_BLOCK;
+			std::size_t n = std::min(ARRAY_BLOCK, xs.size() - first);
+			if (!code->body().eval(xs.data() + first, n, ys.data() + first, env)) {
+				general.store(true);
+			}
+		}
+	});
+
+	if (interrupted.load()) {
+		if (interrupt_flag.exchange(false)) {
+			ThreadPool::cancelCurrent();
+		}
+		throw SemanticError("Error: interpreter kernel interrupted");
+	}
+
+	return !general.load();
+}
+
+void setPromotionThreshold(std::size_t calls) {
+	promotionThreshold().store(calls);
+}
+
+PromotionStats promotionStats() {
+	PromotionStats stats;
+	stats.threshold = promotionThreshold().load();
+	stats.promoted = promotedCount.load();
+	stats.unsupported = unsupportedCount.load();
+	return stats;
+}
+
+void resetPromotionStats() {
+	promotedCount.store(0);
+	unsupportedCount.store(0);
+}
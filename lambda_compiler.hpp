@@ -0,0 +1,126 @@
+/*! \file lambda_compiler.hpp
+Tiered execution of lambda functions.
+
+Every lambda starts out evaluated by the tree walker in Expression::eval. Its
+LambdaProfile counts the calls, and once the count reaches the promotion threshold
+the body is compiled into a tree of pre-resolved nodes (arguments bound to
+their position, built-in procedures resolved, no special-form dispatch and no
+scope unless the body calls something that may need one). Bodies using a
+construct the compiler does not support stay with the tree walker.
+
+A lambda of one argument whose body is elementwise arithmetic on real numbers
+also has an array form, used by map and continuous-plot to evaluate it at many
+numbers at once: each operation of the body runs as one loop over a block of
+packed doubles instead of once per call.
+ */
+#ifndef LAMBDA_COMPILER_HPP
+#define LAMBDA_COMPILER_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "expression.hpp"
+
+// the compiled and array forms of a lambda, defined in lambda_compiler.cpp
+class CompiledLambda;
+class ArrayLambda;
+
+/*! \class LambdaProfile
+\brief The call count and compiled form of a lambda, shared by all copies of it.
+ */
+class LambdaProfile {
+public:
+	LambdaProfile();
+	~LambdaProfile();
+
+	// Not copyable
+	LambdaProfile(const LambdaProfile&) = delete;
+	LambdaProfile& operator=(const LambdaProfile&) = delete;
+
+	/// return the number of calls counted, calls stop being counted once the lambda is promoted
+	std::size_t calls() const noexcept;
+
+	/// return true if the lambda has been promoted to its compiled form
+	bool isCompiled() const noexcept;
+
+	/// return true if the lambda was due for promotion but uses an unsupported construct
+	bool isUnsupported() const noexcept;
+
+	/*! Count a call of lambda, compiling it when the count reaches the promotion threshold.
+		\param lambda the lambda this profile belongs to
+		\return the compiled form to run, or nullptr to use the tree walker
+	 */
+	const CompiledLambda* enter(const Expression& lambda);
+
+	/*! return the array form of lambda, compiled on the first call, or nullptr if its body is not
+		elementwise arithmetic. Calls are not counted
+		\param lambda the lambda this profile belongs to
+	 */
+	const ArrayLambda* arrayForm(const Expression& lambda);
+
+private:
+	enum State {Interpreted, Compiling, Compiled, Unsupported};
+
+	std::atomic<std::size_t> m_calls;
+	std::atomic<int> m_state;
+
+	// written once before the state becomes Compiled
+	std::unique_ptr<CompiledLambda> m_code;
+
+	std::once_flag m_arrayCompiled;
+	std::unique_ptr<ArrayLambda> m_array;
+};
+
+/*! Run the compiled form of a lambda.
+	\param code the compiled lambda
+	\param args the arguments of the call
+	\param env the environment of the caller
+	\return the result, the same as evaluating the lambda with the tree walker
+	\throws SemanticError when a semantic error is encountered
+ */
+Expression runCompiledLambda(const CompiledLambda& code, Arguments args, const Environment& env);
+
+/*! Evaluate a lambda of one argument at many real numbers at once, using its array form. The body
+	may use numbers, the argument, symbols bound to real numbers and calls of + - * / ^ sqrt ln sin
+	cos tan min max < > and =.
+	\param lambda the lambda
+	\param xs the arguments
+	\param ys set to the results, the same as calling the lambda at each argument
+	\param env the environment of the caller
+	\return false if the lambda has no array form or an argument needs the general evaluation (e.g.
+		the square root of a negative number is complex), the lambda is then to be called at each
+		argument. ys is unspecified
+	\throws SemanticError on an interrupt
+ */
+bool evalLambdaArray(const Expression& lambda, const std::vector<double>& xs,
+	std::vector<double>& ys, const Environment& env);
+
+/// Statistics for tuning the promotion threshold
+struct PromotionStats {
+
+	/// number of calls after which a lambda is promoted, 0 if promotion is disabled
+	std::size_t threshold;
+
+	/// number of lambdas promoted to their compiled form
+	std::size_t promoted;
+
+	/// number of lambdas due for promotion that stayed with the tree walker
+	std::size_t unsupported;
+};
+
+/*! Set the number of calls after which a lambda is promoted. The default is 16, or the value of
+	the PLOTSCRIPT_PROMOTION_THRESHOLD environment variable.
+	\param calls the threshold, 0 disables promotion
+ */
+void setPromotionThreshold(std::size_t calls);
+
+/// return the promotion statistics of the process
+PromotionStats promotionStats();
+
+/// reset the promotion counts of the process, the threshold is kept
+void resetPromotionStats();
+
+#endif
@@ -0,0 +1,169 @@
+#include "catch.hpp"
+
+#include <cstring>
+#include <sstream>
+#include <string>
+
+#include "environment.hpp"
+#include "interpreter.hpp"
+#include "lambda_compiler.hpp"
+#include "semantic_error.hpp"
+
+Expression runWithThreshold(const std::string& program, std::size_t threshold) {
+	setPromotionThreshold(threshold);
+
+	std::istringstream iss(program);
+	Interpreter interp;
+	REQUIRE(interp.parseStream(iss));
+
+	Expression result;
+	try {
+		result = interp.evaluate();
+	} catch (...) {
+		setPromotionThreshold(16);
+		throw;
+	}
+
+	setPromotionThreshold(16);
+	return result;
+}
+
+TEST_CASE("Promoted lambdas match the tree walker", "[lambda_compiler]") {
+	std::vector<std::string> programs = {
+		"(begin (define f (lambda (x) (+ (* x x) (/ 1 (+ 2 x))))) (map f (range 0 20 1)))",
+		"(begin (define f (lambda (x y) (list y x (^ x I)))) (apply f (list 2 3)) (apply f (list 4 5)))",
+		"(begin (define k 3) (define f (lambda (x) (* k x))) (map f (range 0 5 1)))",
+
+		// dynamic scope: g sees the argument of f
+		"(begin (define g (lambda (y) (+ x y))) (define f (lambda (x) (g 1))) (map f (range 0 5 1)))",
+
+		// unsupported constructs stay with the tree walker
+		"(begin (define f (lambda (x) (begin (define y 2) (* x y)))) (map f (range 0 5 1)))",
+		"(begin (define f (lambda (x) (get-property \"a\" x))) (map f (range 0 5 1)))",
+	};
+
+	for (auto& program : programs) {
+		INFO(program);
+		REQUIRE(runWithThreshold(program, 1) == runWithThreshold(program, 0));
+	}
+
+	INFO("errors match");
+	std::vector<std::string> errors = {
+		"(begin (define f (lambda (x) (+ x unknown))) (map f (range 0 5 1)))",
+		"(begin (define f (lambda (x) (first x))) (map f (range 0 5 1)))",
+		"(begin (define f (lambda (x y) (+ x y))) (map f (range 0 5 1)))",
+	};
+
+	for (auto& program : errors) {
+		INFO(program);
+		REQUIRE_THROWS_AS(runWithThreshold(program, 1), SemanticError);
+		REQUIRE_THROWS_AS(runWithThreshold(program, 0), SemanticError);
+	}
+}
+
+TEST_CASE("Promotion statistics", "[lambda_compiler]") {
+	resetPromotionStats();
+	runWithThreshold("(begin (define f (lambda (x) (+ x 1))) (map f (range 0 10 1)))", 4);
+	REQUIRE(promotionStats().promoted == 1);
+	REQUIRE(promotionStats().unsupported == 0);
+
+	runWithThreshold("(begin (define f (lambda (x) (begin x))) (map f (range 0 10 1)))", 4);
+	REQUIRE(promotionStats().promoted == 1);
+	REQUIRE(promotionStats().unsupported == 1);
+
+	INFO("lambdas below the threshold are not promoted");
+	runWithThreshold("(begin (define f (lambda (x) (+ x 1))) (map f (range 0 2 1)))", 4);
+	REQUIRE(promotionStats().promoted == 1);
+	REQUIRE(promotionStats().threshold == 16);
+
+	INFO("promotion can be disabled");
+	runWithThreshold("(begin (define f (lambda (x) (+ x 1))) (map f (range 0 10 1)))", 0);
+	REQUIRE(promotionStats().promoted == 1);
+	resetPromotionStats();
+}
+
+TEST_CASE("Copies of a lambda share its profile", "[lambda_compiler]") {
+	Expression lambda(Atom("lambda"));
+	REQUIRE(lambda.profile() == nullptr);
+
+	lambda.append(Atom("list"));
+	lambda.tail()->append(Atom("x"));
+	lambda.append(Atom("x"));
+	Expression earlier(lambda);
+	lambda.profileCalls();
+	REQUIRE(lambda.profile() != nullptr);
+
+	Expression copy(lambda);
+	REQUIRE(copy.profile() == lambda.profile());
+	REQUIRE(earlier.profile() == lambda.profile());
+
+	INFO("modifying the body drops the profile");
+	copy.append(Atom(1.0));
+	REQUIRE(copy.profile() == nullptr);
+
+	INFO("other expressions are not profiled");
+	Expression number(Atom(1.0));
+	number.profileCalls();
+	REQUIRE(number.profile() == nullptr);
+}
+
+TEST_CASE("Array forms match calling the lambda", "[lambda_compiler]") {
+	Environment env;
+	env.add_exp(Atom("k"), Expression(3.));
+
+	std::vector<double> xs = {-2.5, -1, -0., 0., 1e-17, 0.5, 1, 2, 3.75, 1e300};
+	std::vector<std::string> lambdas = {
+		"(lambda (x) (+ (* x x) (/ 1 (+ 2 x))))",
+		"(lambda (x) (- (sin x) (* (cos (* k x)) (tan x))))",
+		"(lambda (x) (+ x))",
+		"(lambda (x) (- (+ x 1e-17) x))",
+		"(lambda (x) (- x))",
+		"(lambda (x) (/ x))",
+		"(lambda (x) (^ x 0.5))",
+		"(lambda (x) (min x 1 (max x -1)))",
+		"(lambda (x) (+ (< x 0) (> x 1) (= x 2)))",
+		"(lambda (x) (* pi x))",
+		"(lambda (e) (* e 2))",
+		"(lambda (x) 4)",
+	};
+
+	for (auto& program : lambdas) {
+		INFO(program);
+		std::istringstream iss(program);
+		Interpreter interp;
+		REQUIRE(interp.parseStream(iss));
+		Expression lambda = interp.evaluate();
+
+		std::vector<double> ys;
+		REQUIRE(evalLambdaArray(lambda, xs, ys, env));
+		REQUIRE(ys.size() == xs.size());
+		for (std::size_t i = 0; i < xs.size(); i++) {
+			Expression input(xs[i]);
+			double y = lambda.evalLambda(Arguments(&input, 1), env).head().asNumber();
+			REQUIRE(std::memcmp(&y, &ys[i], sizeof(y)) == 0);
+		}
+	}
+
+	INFO("anything else is called at each argument");
+	std::vector<std::string> general = {
+		"(lambda (x) (sqrt x))", // complex for negative arguments
+		"(lambda (x) (ln x))", // an error for negative arguments
+		"(lambda (x) (list x))",
+		"(lambda (x) (+ x I))",
+		"(lambda (x) (+ x unknown))",
+		"(lambda (x) x)",
+		"(lambda (x y) (+ x y))",
+		"(lambda (x) (apply + (list x)))",
+	};
+
+	for (auto& program : general) {
+		INFO(program);
+		std::istringstream iss(program);
+		Interpreter interp;
+		REQUIRE(interp.parseStream(iss));
+		Expression lambda = interp.evaluate();
+
+		std::vector<double> ys;
+		REQUIRE_FALSE(evalLambdaArray(lambda, xs, ys, env));
+	}
+}
@@ -66,6 +66,8 @@ void NotebookApp::checkOutput() {
 		// Output the message
 		if (msg.type == ErrorType) {
 			output->error(QString::fromStdString(msg.err));
+		} else if (msg.type == ExpressionType && msg.plot) {
+			output->processPlot(*msg.plot);
 		} else if (msg.type == ExpressionType) {
 			output->processExpression(msg.exp);
 		}
@@ -1,5 +1,9 @@
 #include "output_widget.hpp"
 
+#include <QGraphicsPixmapItem>
+#include <QImage>
+#include <QPixmap>
+
 #include <cmath>
 const double PI = std::atan2(0, -1);
 
@@ -115,24 +119,12 @@ void OutputWidget::handleTextGraphic(const Expression& exp) {
 			// Get the optional scale property
 			Expression scaleExp = exp.getProperty("text-scale");
 			double scale = scaleExp.head().asNumber();
-			if (scale < 1) {
-				scale = 1;
-			}
 
 			// Get the optional rotation property
 			Expression rotExp = exp.getProperty("text-rotation");
 			double rot = rotExp.isHeadNumber() ? rotExp.head().asNumber() : 0;
 
-			// Create the text and update its position
-			auto text = addText(QString::fromStdString(str));
-
-			// Create the formatted text
-			qreal x = posRect.left() - (text->boundingRect().width() / 2);
-			qreal y = posRect.top() - (text->boundingRect().height() / 2);
-			text->setPos(x, y);
-			text->setTransformOriginPoint(text->boundingRect().center());
-			text->setRotation(rot * (180 / PI));
-			text->setScale(scale);
+			placeText(QString::fromStdString(str), posRect.left(), posRect.top(), scale, rot);
 			return;
 		}
 
@@ -142,6 +134,91 @@ void OutputWidget::handleTextGraphic(const Expression& exp) {
 	throw SemanticError("Error: invalid text object");
 }
 
+void OutputWidget::placeText(const QString& str, qreal x, qreal y, double scale,
+	double rotation) {
+	if (scale < 1) {
+		scale = 1;
+	}
+
+	// Create the text and update its position
+	auto text = addText(str);
+
+	// Create the formatted text
+	text->setPos(x - (text->boundingRect().width() / 2), y - (text->boundingRect().height() / 2));
+	text->setTransformOriginPoint(text->boundingRect().center());
+	text->setRotation(rotation * (180 / PI));
+	text->setScale(scale);
+}
+
+void OutputWidget::handleImageGraphic(const Expression& exp) {
+	Expression posExp = exp.getProperty("position");
+	Expression widthExp = exp.getProperty("width");
+	Expression heightExp = exp.getProperty("height");
+	if (getObjectName(posExp) == "point" && widthExp.isHeadNumber() && heightExp.isHeadNumber() &&
+		widthExp.head().asNumber() >= 0 && heightExp.head().asNumber() >= 0) {
+		QRectF posRect = handlePointGraphic(posExp, false);
+
+		// Get the optional shading property
+		bool logarithmic = exp.getProperty("shading").head().asSymbol(true) == "logarithmic";
+
+		// The image is a list of rows of the same length, each a list of numbers
+		if (exp.isHeadListRoot() && exp.tailConstBegin() != exp.tailConstEnd()) {
+			std::size_t rows = exp.tailConstEnd() - exp.tailConstBegin();
+			std::size_t columns = exp.tailConstBegin()->tailConstEnd() -
+				exp.tailConstBegin()->tailConstBegin();
+			std::vector<double> values;
+			values.reserve(rows * columns);
+			for (auto row = exp.tailConstBegin(); row != exp.tailConstEnd(); row++) {
+				std::size_t length = row->tailConstEnd() - row->tailConstBegin();
+				if (!row->isHeadListRoot() || length != columns) {
+					throw SemanticError("Error: invalid rows of image object");
+				}
+
+				for (auto value = row->tailConstBegin(); value != row->tailConstEnd(); value++) {
+					if (!value->isHeadNumber()) {
+						throw SemanticError("Error: invalid values of image object");
+					}
+
+					values.push_back(value->head().asNumber());
+				}
+			}
+
+			placeImage(values, columns, rows, posRect.left(), posRect.top(),
+				widthExp.head().asNumber(), heightExp.head().asNumber(), logarithmic);
+			return;
+		}
+
+		throw SemanticError("Error: invalid rows of image object");
+	}
+
+	throw SemanticError("Error: invalid image object");
+}
+
+void OutputWidget::placeImage(const std::vector<double>& values, std::size_t columns,
+	std::size_t rows, qreal x, qreal y, qreal width, qreal height, bool logarithmic) {
+	if (columns == 0 || rows == 0) {
+		return;
+	}
+
+	// Cells at the lowest value are clear, the others black and more opaque the higher their
+	// value
+	std::vector<double> opacity = imageOpacity(values, logarithmic);
+	QImage image(static_cast<int>(columns), static_cast<int>(rows), QImage::Format_ARGB32);
+	image.fill(Qt::transparent);
+	for (std::size_t r = 0; r < rows; r++) {
+		for (std::size_t c = 0; c < columns; c++) {
+			int alpha = static_cast<int>(255 * opacity[r * columns + c]);
+			image.setPixel(static_cast<int>(c), static_cast<int>(r), qRgba(0, 0, 0, alpha));
+		}
+	}
+
+	// One pixel per cell, stretched over the rectangle without smoothing between the cells
+	QGraphicsPixmapItem* item = scene->addPixmap(QPixmap::fromImage(image));
+	item->setTransformationMode(Qt::FastTransformation);
+	item->setTransform(QTransform::fromScale(width / columns, height / rows));
+	item->setPos(x, y);
+}
+
 std::string OutputWidget::getObjectName(const Expression& exp) const {
 	return exp.getProperty("object-name").head().asSymbol(true);
 }
@@ -153,13 +230,54 @@ void OutputWidget::handleObject(const Expression& exp, const std::string& object
 		handleLineGraphic(exp);
 	} else if (objectName == "text") {
 		handleTextGraphic(exp);
+	} else if (objectName == "image") {
+		handleImageGraphic(exp);
 	} else {
 		throw SemanticError("Error: unknown object name");
 	}
 }
 
+// The primitives are added in the order of the plot, like the items of its property form
+void OutputWidget::processPlot(const PlotData& plot) {
+	const PlotData::Points& points = plot.points();
+	const PlotData::Lines& lines = plot.lines();
+	const PlotData::Texts& texts = plot.texts();
+	const PlotData::Images& images = plot.images();
+	std::size_t point = 0, line = 0, text = 0, image = 0;
+	for (unsigned char kind : plot.order()) {
+		if (kind == PlotData::PointKind) {
+
+			// the point is centered at its coordinates, with a pen as wide as the point
+			qreal size = points.size[point];
+			scene->addEllipse(points.x[point] - (size / 2), points.y[point] - (size / 2), size, size,
+				QPen(QBrush(Qt::black), size), QBrush(Qt::black));
+			point++;
+		} else if (kind == PlotData::LineKind) {
+			scene->addLine(lines.x1[line], lines.y1[line], lines.x2[line], lines.y2[line],
+				QPen(QBrush(Qt::black), lines.thickness[line]));
+			line++;
+		} else if (kind == PlotData::TextKind) {
+			placeText(QString::fromStdString(texts.text[text]), texts.x[text], texts.y[text],
+				texts.scale[text], texts.rotation[text]);
+			text++;
+		} else {
+			placeImage(images.values[image], images.columns[image], images.rows[image],
+				images.x[image], images.y[image], images.width[image], images.height[image],
+				images.logarithmic[image]);
+			image++;
+		}
+	}
+}
+
 void OutputWidget::processExpression(const Expression& exp) {
 
+	// a plot still in its typed form is drawn from it
+	std::shared_ptr<const PlotData> plot = plotData(exp);
+	if (plot) {
+		processPlot(*plot);
+		return;
+	}
+
 	// lambda functions don't get printed out
 	if (!exp.isHeadLambdaRoot()) {
 		if (exp.head().isNone()) {
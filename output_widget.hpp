@@ -7,7 +7,10 @@
 #include <QGraphicsItem>
 #include <QLayout>
 
+#include <vector>
+
 #include "expression.hpp"
+#include "plot_data.hpp"
 #include "semantic_error.hpp"
 
 class OutputWidget: public QWidget {
@@ -17,6 +20,9 @@ public:
 
 	void processExpression(const Expression& exp);
 
+	// draw the typed primitives of a plot, which need no validation
+	void processPlot(const PlotData& plot);
+
 	void error(const QString& str);
 
 	// re-scale the output to make all items inside it visible
@@ -38,6 +44,15 @@ private:
 	QRectF handlePointGraphic(const Expression& exp, bool addToScene = true);
 	void handleLineGraphic(const Expression& exp);
 	void handleTextGraphic(const Expression& exp);
+	void handleImageGraphic(const Expression& exp);
+
+	// add text centered at (x, y), scaled (at least 1) and rotated by rotation radians
+	void placeText(const QString& str, qreal x, qreal y, double scale, double rotation);
+
+	// add a single pixmap of columns by rows values, row by row from the top, stretched over the
+	// rectangle of the given size whose top left corner is (x, y)
+	void placeImage(const std::vector<double>& values, std::size_t columns, std::size_t rows,
+		qreal x, qreal y, qreal width, qreal height, bool logarithmic);
 
 protected:
 	void resizeEvent(QResizeEvent* event) override;
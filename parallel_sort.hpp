@@ -0,0 +1,24 @@
+#ifndef PARALLEL_SORT_HPP
+#define PARALLEL_SORT_HPP
+// Stable merge sort that sorts the halves of long ranges on the shared thread pool
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+// Ranges shorter than this are sorted on the calling thread
+const std::size_t PARALLEL_SORT_MIN = 4096;
+
+// Sort items with comp like std::stable_sort. Above PARALLEL_SORT_MIN items, the two halves are
+// sorted concurrently, recursively, and then merged. comp must not throw
+template<typename T, typename Compare>
+void parallelStableSort(std::vector<T>& items, Compare comp);
+
+// Ascending order of numbers with NaN after all of them. Unlike <, this is a strict weak ordering
+// when NaN is present, as sorting requires
+inline bool numberBefore(double a, double b) {
+	return a < b || (std::isnan(b) && !std::isnan(a));
+}
+
+#include "parallel_sort.tpp"
+#endif
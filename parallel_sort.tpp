@@ -0,0 +1,40 @@
+#include "parallel_sort.hpp"
+
+#include <algorithm>
+#include <iterator>
+
+#include "thread_pool.hpp"
+
+// Sort [data, data + count) using buffer, which has room for count items, as merge space
+template<typename T, typename Compare>
+void parallelStableSortRange(T* data, T* buffer, std::size_t count, Compare& comp) {
+	if (count < PARALLEL_SORT_MIN) {
+		std::stable_sort(data, data + count, comp);
+		return;
+	}
+
+	std::size_t half = count / 2;
+	ThreadPool::shared().parallelFor(2, 1, [=, &comp](std::size_t begin, std::size_t) {
+		if (begin == 0) {
+			parallelStableSortRange(data, buffer, half, comp);
+		} else {
+			parallelStableSortRange(data + half, buffer + half, count - half, comp);
+		}
+	});
+
+	// std::merge takes equal items from the first half first, which keeps the sort stable
+	std::merge(std::make_move_iterator(data), std::make_move_iterator(data + half),
+		std::make_move_iterator(data + half), std::make_move_iterator(data + count), buffer, comp);
+	std::move(buffer, buffer + count, data);
+}
+
+template<typename T, typename Compare>
+void parallelStableSort(std::vector<T>& items, Compare comp) {
+	if (items.size() < PARALLEL_SORT_MIN) {
+		std::stable_sort(items.begin(), items.end(), comp);
+		return;
+	}
+
+	std::vector<T> buffer(items.size());
+	parallelStableSortRange(items.data(), buffer.data(), items.size(), comp);
+}
@@ -0,0 +1,46 @@
+#include "catch.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+#include "parallel_sort.hpp"
+
+TEST_CASE("Test parallel stable sort", "[parallel_sort]") {
+
+	// short and long ranges, the long ones are split across the pool
+	std::vector<std::size_t> counts = {0, 1, 100, PARALLEL_SORT_MIN, 10 * PARALLEL_SORT_MIN + 7};
+	for (std::size_t count : counts) {
+		INFO(count);
+		std::vector<std::pair<int, std::size_t>> items;
+		for (std::size_t i = 0; i < count; i++) {
+			items.push_back({static_cast<int>((i * 7919) % 101), i});
+		}
+
+		std::vector<std::pair<int, std::size_t>> expected = items;
+		auto byKey = [](const std::pair<int, std::size_t>& a, const std::pair<int, std::size_t>& b) {
+			return a.first < b.first;
+		};
+
+		std::stable_sort(expected.begin(), expected.end(), byKey);
+		parallelStableSort(items, byKey);
+
+		// equal keys keep their original order
+		REQUIRE(items == expected);
+	}
+}
+
+TEST_CASE("Test sorting numbers with NaN", "[parallel_sort]") {
+	std::vector<double> numbers;
+	for (std::size_t i = 0; i < 4 * PARALLEL_SORT_MIN; i++) {
+		numbers.push_back((i % 3 == 0) ? NAN : static_cast<double>((i * 7919) % 101));
+	}
+
+	parallelStableSort(numbers, numberBefore);
+	std::size_t count = numbers.size() - numbers.size() / 3 - 1;
+	REQUIRE(std::is_sorted(numbers.begin(), numbers.begin() + count));
+	REQUIRE(std::all_of(numbers.begin() + count, numbers.end(), [](double x) {
+		return std::isnan(x);
+	}));
+}
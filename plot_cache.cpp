@@ -0,0 +1,210 @@
+#include "plot_cache.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <string>
+
+#include "environment.hpp"
+
+// The curves the shared cache keeps
+const std::size_t SHARED_CAPACITY = 32;
+
+PlotCache::PlotCache(std::size_t capacity): m_capacity(capacity), m_hits(0), m_misses(0) {}
+
+PlotCache& PlotCache::shared() {
+	static PlotCache cache(SHARED_CAPACITY);
+	return cache;
+}
+
+// Helper function to hash the bits of a number, 0 and -0 differ like they do for the sampler
+std::size_t hashNumber(double x) {
+	std::uint64_t bits;
+	std::memcpy(&bits, &x, sizeof(bits));
+	return std::hash<std::uint64_t>()(bits);
+}
+
+std::size_t combineHash(std::size_t seed, std::size_t hash) {
+	return seed ^ (hash + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+}
+
+std::size_t hashKey(const CurveKey& key) {
+	std::size_t hash = hashExpression(key.lambda);
+	hash = combineHash(hash, hashNumber(key.begin));
+	hash = combineHash(hash, hashNumber(key.end));
+	hash = combineHash(hash, hashNumber(key.minAngle));
+	return combineHash(hash, std::hash<std::size_t>()(key.sampleBudget));
+}
+
+// Helper function to compare two numbers bit for bit
+bool sameNumber(double a, double b) {
+	return std::memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+bool sameKey(const CurveKey& a, const CurveKey& b) {
+	return sameNumber(a.begin, b.begin) && sameNumber(a.end, b.end) &&
+		a.minAngle == b.minAngle && a.sampleBudget == b.sampleBudget &&
+		sameExpression(a.lambda, b.lambda);
+}
+
+bool PlotCache::find(const CurveKey& key, SampledCurve& curve) {
+	std::size_t hash = hashKey(key);
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (auto it = m_entries.begin(); it != m_entries.end(); it++) {
+		if (it->hash == hash && sameKey(it->key, key)) {
+			curve = it->curve;
+			m_entries.splice(m_entries.begin(), m_entries, it);
+			m_hits++;
+			return true;
+		}
+	}
+
+	m_misses++;
+	return false;
+}
+
+void PlotCache::insert(const CurveKey& key, const SampledCurve& curve) {
+	if (m_capacity == 0) {
+		return;
+	}
+
+	std::size_t hash = hashKey(key);
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	// two threads may have sampled the same curve
+	for (auto it = m_entries.begin(); it != m_entries.end(); it++) {
+		if (it->hash == hash && sameKey(it->key, key)) {
+			m_entries.splice(m_entries.begin(), m_entries, it);
+			return;
+		}
+	}
+
+	m_entries.push_front(Entry{hash, key, curve});
+	if (m_entries.size() > m_capacity) {
+		m_entries.pop_back();
+	}
+}
+
+std::size_t PlotCache::size() const {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_entries.size();
+}
+
+std::size_t PlotCache::hits() const {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_hits;
+}
+
+std::size_t PlotCache::misses() const {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_misses;
+}
+
+void PlotCache::clear() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_entries.clear();
+	m_hits = 0;
+	m_misses = 0;
+}
+
+// Helper function to tell whether exp, part of the body of a lambda with the given parameters,
+// only depends on them. Special forms that define a symbol, make a lambda or delay are left out
+bool dependsOnlyOn(const Expression& exp, const std::vector<Atom>& params,
+	const Environment& builtins) {
+	const Atom& head = exp.head();
+	if (exp.isHeadSequence() || exp.isHeadPromise()) {
+		return false;
+	} else if (!head.isSymbol()) {
+		return true;
+	}
+
+	bool call = exp.tailConstBegin() != exp.tailConstEnd() || exp.isHeadListRoot();
+	if (!call) {
+		return std::find(params.begin(), params.end(), head) != params.end() ||
+			builtins.is_exp(head) || builtins.is_proc(head);
+	}
+
+	std::string op = head.asSymbol();
+	if (!exp.isHeadListRoot() && !builtins.is_proc(head) && op != "begin" && op != "apply" &&
+		op != "map" && op != "reduce" && op != "fold" && op != "filter" && op != "sort-by" &&
+		op != "get-property" && op != "set-property") {
+		return false;
+	}
+
+	for (auto it = exp.tailConstBegin(); it != exp.tailConstEnd(); it++) {
+		if (!dependsOnlyOn(*it, params, builtins)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool isCacheableLambda(const Expression& lambda) {
+	if (!lambda.isHeadLambdaRoot()) {
+		return false;
+	}
+
+	// definitions cannot shadow built-in procedures, so they mean the same in every interpreter
+	static const Environment builtins;
+
+	const Expression& lambdaArgs = *lambda.tailConstBegin();
+	std::vector<Atom> params;
+	for (auto it = lambdaArgs.tailConstBegin(); it != lambdaArgs.tailConstEnd(); it++) {
+		params.push_back(it->head());
+	}
+
+	return dependsOnlyOn(*std::prev(lambda.tailConstEnd()), params, builtins);
+}
+
+std::size_t hashExpression(const Expression& exp) {
+	const Atom& head = exp.head();
+	std::size_t hash;
+	if (head.isNumber()) {
+		hash = hashNumber(head.asNumber());
+	} else if (head.isComplex()) {
+		hash = combineHash(hashNumber(head.asComplex().real()),
+			hashNumber(head.asComplex().imag()));
+	} else {
+		hash = std::hash<std::string>()(head.asSymbol());
+	}
+
+	for (auto it = exp.tailConstBegin(); it != exp.tailConstEnd(); it++) {
+		hash = combineHash(hash, hashExpression(*it));
+	}
+
+	return hash;
+}
+
+bool sameExpression(const Expression& a, const Expression& b) {
+
+	// lambdas holding a promise or a sequence are not cached
+	if (a.isHeadPromise() || a.isHeadSequence() || b.isHeadPromise() || b.isHeadSequence()) {
+		return false;
+	}
+
+	const Atom& x = a.head();
+	const Atom& y = b.head();
+	if (x.isNumber() || y.isNumber()) {
+		if (!x.isNumber() || !y.isNumber() || !sameNumber(x.asNumber(), y.asNumber())) {
+			return false;
+		}
+	} else if (x.isComplex() || y.isComplex()) {
+		if (!x.isComplex() || !y.isComplex() ||
+			!sameNumber(x.asComplex().real(), y.asComplex().real()) ||
+			!sameNumber(x.asComplex().imag(), y.asComplex().imag())) {
+			return false;
+		}
+	} else if (!(x == y)) {
+		return false;
+	}
+
+	if (std::distance(a.tailConstBegin(), a.tailConstEnd()) !=
+		std::distance(b.tailConstBegin(), b.tailConstEnd())) {
+		return false;
+	}
+
+	return std::equal(a.tailConstBegin(), a.tailConstEnd(), b.tailConstBegin(), sameExpression);
+}
@@ -0,0 +1,99 @@
+/*! \file plot_cache.hpp
+Cache of the curves sampled by continuous-plot.
+
+Nearly all the time of a continuous plot is spent evaluating its lambda. The
+curve it samples only depends on the lambda, the abscissa bounds and the
+smoothing options, not on the title, the labels or the text scale, so a cell
+run again after changing only those finds its curve here and the plot is only
+laid out again.
+
+A lambda can only be cached if its body uses nothing but its parameters,
+numbers, strings, built-in procedures and constants, and the special forms
+that do not define anything: any other symbol could be bound to something
+else in another interpreter, or the next time the notebook kernel starts.
+ */
+#ifndef PLOT_CACHE_HPP
+#define PLOT_CACHE_HPP
+
+#include <cstddef>
+#include <list>
+#include <mutex>
+#include <vector>
+
+#include "expression.hpp"
+
+/// What a continuous plot samples depends on
+struct CurveKey {
+
+	/// the lambda plotted
+	Expression lambda;
+
+	/// the abscissa bounds
+	double begin, end;
+
+	/// the smoothing options
+	double minAngle;
+	std::size_t sampleBudget;
+};
+
+/// The curve sampled by a continuous plot, the points joined by its lines in order, with the
+/// lowest and highest ordinate it reached
+struct SampledCurve {
+	std::vector<double> x, y;
+	double lowest, highest;
+};
+
+/*! \class PlotCache
+\brief The most recently sampled curves, shared by the threads evaluating plots.
+ */
+class PlotCache {
+public:
+
+	/// a cache of at most capacity curves, the least recently used is dropped first
+	explicit PlotCache(std::size_t capacity);
+
+	/// the cache shared by the interpreters of the process
+	static PlotCache& shared();
+
+	/// return true and set curve to the curve cached for key, if there is one
+	bool find(const CurveKey& key, SampledCurve& curve);
+
+	/// cache the curve sampled for key, its lambda must be cacheable (see isCacheableLambda)
+	void insert(const CurveKey& key, const SampledCurve& curve);
+
+	/// return the number of curves cached
+	std::size_t size() const;
+
+	/// return the number of finds that found a curve, and that did not
+	std::size_t hits() const;
+	std::size_t misses() const;
+
+	/// drop every curve and reset the counts
+	void clear();
+
+private:
+	struct Entry {
+		std::size_t hash;
+		CurveKey key;
+		SampledCurve curve;
+	};
+
+	mutable std::mutex m_mutex;
+	std::size_t m_capacity;
+
+	// the most recently used first
+	std::list<Entry> m_entries;
+
+	std::size_t m_hits, m_misses;
+};
+
+/// return true if what the body of lambda computes only depends on its arguments
+bool isCacheableLambda(const Expression& lambda);
+
+/// return a hash of the heads of exp and its subexpressions, equal for sameExpression ones
+std::size_t hashExpression(const Expression& exp);
+
+/// return true if a and b are the same, numbers compared bit for bit unlike with operator==
+bool sameExpression(const Expression& a, const Expression& b);
+
+#endif
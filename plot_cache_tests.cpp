@@ -0,0 +1,101 @@
+#include "catch.hpp"
+
+#include <sstream>
+#include <string>
+
+#include "interpreter.hpp"
+#include "plot_cache.hpp"
+
+Expression runCacheProgram(const std::string& program) {
+	std::istringstream iss(program);
+	Interpreter interp;
+	REQUIRE(interp.parseStream(iss));
+	return interp.evaluate();
+}
+
+TEST_CASE("Test which lambdas can be cached", "[plot_cache]") {
+	REQUIRE(isCacheableLambda(runCacheProgram("(lambda (x) (sin x))")));
+	REQUIRE(isCacheableLambda(runCacheProgram("(lambda (x) (+ x pi 1 \"a\"))")));
+	REQUIRE(isCacheableLambda(runCacheProgram("(lambda (x) (apply max (map sin (list x e))))")));
+	REQUIRE(isCacheableLambda(runCacheProgram("(lambda (e) (* e 2))")));
+
+	// anything else may be bound differently elsewhere
+	REQUIRE_FALSE(isCacheableLambda(runCacheProgram("(lambda (x) (* a x))")));
+	REQUIRE_FALSE(isCacheableLambda(runCacheProgram("(lambda (x) (f x))")));
+	REQUIRE_FALSE(isCacheableLambda(runCacheProgram("(lambda (x) (begin (define y x) y))")));
+	REQUIRE_FALSE(isCacheableLambda(runCacheProgram("(lambda (x) (map (lambda (y) y) (list x)))")));
+	REQUIRE_FALSE(isCacheableLambda(Expression(1.)));
+}
+
+TEST_CASE("Test the plot cache keeps the most recent curves", "[plot_cache]") {
+	Expression sine = runCacheProgram("(lambda (x) (sin x))");
+	Expression cosine = runCacheProgram("(lambda (x) (cos x))");
+	REQUIRE(hashExpression(sine) == hashExpression(runCacheProgram("(lambda (x) (sin x))")));
+
+	// lambdas are compared like they are hashed, numbers bit for bit
+	Expression small = runCacheProgram("(lambda (x) (* x 1e-15))");
+	Expression nearby = runCacheProgram("(lambda (x) (* x 1.2e-15))");
+	REQUIRE(small == nearby);
+	REQUIRE(sameExpression(small, runCacheProgram("(lambda (x) (* x 1e-15))")));
+	REQUIRE_FALSE(sameExpression(small, nearby));
+	REQUIRE_FALSE(sameExpression(sine, runCacheProgram("(lambda (x) (sin \"x\"))")));
+
+	PlotCache cache(2);
+	SampledCurve curve{{0, 1}, {2, 3}, 2, 3};
+	SampledCurve found;
+	cache.insert(CurveKey{sine, 0, 1, 175, 100}, curve);
+	cache.insert(CurveKey{cosine, 0, 1, 175, 100}, curve);
+	REQUIRE(cache.size() == 2);
+
+	// every part of the key must match
+	REQUIRE(cache.find(CurveKey{sine, 0, 1, 175, 100}, found));
+	REQUIRE(found.y == curve.y);
+	REQUIRE(found.highest == 3);
+	REQUIRE_FALSE(cache.find(CurveKey{sine, 0, 2, 175, 100}, found));
+	REQUIRE_FALSE(cache.find(CurveKey{sine, 0, 1, 170, 100}, found));
+	REQUIRE_FALSE(cache.find(CurveKey{sine, 0, 1, 175, 50}, found));
+	REQUIRE(cache.hits() == 1);
+	REQUIRE(cache.misses() == 3);
+
+	// the least recently used curve is dropped
+	cache.insert(CurveKey{sine, 0, 2, 175, 100}, curve);
+	REQUIRE(cache.size() == 2);
+	REQUIRE(cache.find(CurveKey{sine, 0, 1, 175, 100}, found));
+	REQUIRE_FALSE(cache.find(CurveKey{cosine, 0, 1, 175, 100}, found));
+
+	// a curve sampled twice is cached once
+	cache.insert(CurveKey{sine, 0, 1, 175, 100}, curve);
+	REQUIRE(cache.size() == 2);
+	REQUIRE(cache.find(CurveKey{sine, 0, 2, 175, 100}, found));
+
+	cache.clear();
+	REQUIRE(cache.size() == 0);
+	REQUIRE(cache.hits() == 0);
+}
+
+TEST_CASE("Test continuous plots reuse cached curves", "[plot_cache]") {
+	const std::string plot = "(continuous-plot (lambda (x) (sin (* 3 x))) (list -2 2)";
+	PlotCache::shared().clear();
+	Expression plain = runCacheProgram(plot + ")");
+	REQUIRE(PlotCache::shared().size() == 1);
+	REQUIRE(PlotCache::shared().misses() == 1);
+
+	// changing only the title lays the same curve out again
+	Expression titled = runCacheProgram(plot + " (list (list \"title\" \"sine\")))");
+	REQUIRE(PlotCache::shared().hits() == 1);
+	REQUIRE(std::distance(titled.tailConstBegin(), titled.tailConstEnd()) ==
+		std::distance(plain.tailConstBegin(), plain.tailConstEnd()) + 1);
+	REQUIRE(std::equal(plain.tailConstBegin(), plain.tailConstEnd() - 4, titled.tailConstBegin()));
+
+	// smoothing options change the curve
+	runCacheProgram(plot + " (list (list \"angle-tolerance\" 10)))");
+	REQUIRE(PlotCache::shared().size() == 2);
+
+	INFO("a lambda using a definition is sampled every time");
+	const std::string scaled = "(begin (define a 2) (continuous-plot (lambda (x) (* a x)) "
+		"(list 0 1)))";
+	REQUIRE(runCacheProgram(scaled) == runCacheProgram(scaled));
+	REQUIRE(PlotCache::shared().size() == 2);
+	REQUIRE(PlotCache::shared().hits() == 1);
+	REQUIRE(PlotCache::shared().misses() == 2);
+}
@@ -0,0 +1,227 @@
+#include "plot_data.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "sequence.hpp"
+
+void PlotData::addPoint(double x, double y, double size) {
+	m_order.push_back(PointKind);
+	m_points.x.push_back(x);
+	m_points.y.push_back(y);
+	m_points.size.push_back(size);
+}
+
+void PlotData::addLine(double x1, double y1, double x2, double y2, double thickness) {
+	m_order.push_back(LineKind);
+	m_lines.x1.push_back(x1);
+	m_lines.y1.push_back(y1);
+	m_lines.x2.push_back(x2);
+	m_lines.y2.push_back(y2);
+	m_lines.thickness.push_back(thickness);
+}
+
+void PlotData::addText(const std::string& text, double x, double y, double scale,
+	double rotation) {
+	m_order.push_back(TextKind);
+	m_texts.text.push_back(text);
+	m_texts.x.push_back(x);
+	m_texts.y.push_back(y);
+	m_texts.scale.push_back(scale);
+	m_texts.rotation.push_back(rotation);
+}
+
+void PlotData::addImage(double x, double y, double width, double height, std::size_t columns,
+	std::size_t rows, std::vector<double> values, bool logarithmic) {
+	m_order.push_back(ImageKind);
+	m_images.x.push_back(x);
+	m_images.y.push_back(y);
+	m_images.width.push_back(width);
+	m_images.height.push_back(height);
+	m_images.columns.push_back(columns);
+	m_images.rows.push_back(rows);
+	m_images.values.push_back(std::move(values));
+	m_images.logarithmic.push_back(logarithmic);
+}
+
+std::size_t PlotData::size() const noexcept {
+	return m_order.size();
+}
+
+const std::vector<unsigned char>& PlotData::order() const noexcept {
+	return m_order;
+}
+
+const PlotData::Points& PlotData::points() const noexcept {
+	return m_points;
+}
+
+const PlotData::Lines& PlotData::lines() const noexcept {
+	return m_lines;
+}
+
+const PlotData::Texts& PlotData::texts() const noexcept {
+	return m_texts;
+}
+
+const PlotData::Images& PlotData::images() const noexcept {
+	return m_images;
+}
+
+// A point object of the property form
+Expression makePointObject(double x, double y, double size) {
+	Expression point({Expression(x), Expression(y)});
+	point.setProperty("object-name", Expression(Atom("\"point\"")));
+	point.setProperty("size", Expression(size));
+	return point;
+}
+
+Expression PlotData::pointExpression(std::size_t i) const {
+	return makePointObject(m_points.x[i], m_points.y[i], m_points.size[i]);
+}
+
+Expression PlotData::lineExpression(std::size_t i) const {
+	Expression line({makePointObject(m_lines.x1[i], m_lines.y1[i], 0),
+		makePointObject(m_lines.x2[i], m_lines.y2[i], 0)});
+	line.setProperty("object-name", Expression(Atom("\"line\"")));
+	line.setProperty("thickness", Expression(m_lines.thickness[i]));
+	return line;
+}
+
+Expression PlotData::textExpression(std::size_t i) const {
+	Expression text(Atom('"' + m_texts.text[i] + '"'));
+	text.setProperty("object-name", Expression(Atom("\"text\"")));
+	text.setProperty("position", makePointObject(m_texts.x[i], m_texts.y[i], 0));
+	text.setProperty("text-scale", Expression(m_texts.scale[i]));
+	text.setProperty("text-rotation", Expression(m_texts.rotation[i]));
+	return text;
+}
+
+Expression PlotData::imageExpression(std::size_t i) const {
+	const std::vector<double>& values = m_images.values[i];
+	std::size_t columns = m_images.columns[i];
+	std::vector<Expression> rows;
+	rows.reserve(m_images.rows[i]);
+	for (std::size_t r = 0; r < m_images.rows[i]; r++) {
+		std::vector<Expression> row;
+		row.reserve(columns);
+		for (std::size_t c = 0; c < columns; c++) {
+			row.push_back(Expression(values[r * columns + c]));
+		}
+
+		rows.push_back(Expression(row));
+	}
+
+	Expression image(rows);
+	image.setProperty("object-name", Expression(Atom("\"image\"")));
+	image.setProperty("position", makePointObject(m_images.x[i], m_images.y[i], 0));
+	image.setProperty("width", Expression(m_images.width[i]));
+	image.setProperty("height", Expression(m_images.height[i]));
+	image.setProperty("shading",
+		Expression(Atom(m_images.logarithmic[i] ? "\"logarithmic\"" : "\"linear\"")));
+	return image;
+}
+
+std::vector<double> imageOpacity(const std::vector<double>& values, bool logarithmic) {
+	std::vector<double> opacity(values.size(), 0);
+	if (values.empty()) {
+		return opacity;
+	}
+
+	// the range is that of the finite values, infinities are drawn at its ends and NaN is clear
+	double lowest = HUGE_VAL, highest = -HUGE_VAL;
+	for (double value : values) {
+		if (std::isfinite(value)) {
+			lowest = std::min(lowest, value);
+			highest = std::max(highest, value);
+		}
+	}
+
+	double span = highest - lowest;
+	for (std::size_t i = 0; i < values.size(); i++) {
+		double offset = values[i] - lowest;
+		if (values[i] == HUGE_VAL) {
+			opacity[i] = 1;
+		} else if (std::isfinite(values[i]) && offset > 0) {
+			double shade = logarithmic ? std::log1p(offset) / std::log1p(span) : offset / span;
+
+			// written so a NaN from a span too wide for a double is clear
+			opacity[i] = (shade >= 1) ? 1 : ((shade > 0) ? shade : 0);
+		}
+	}
+
+	return opacity;
+}
+
+// A plot as a sequence. The cursor counts the primitives of each kind it has read to find the
+// next one in its array
+class PlotSequence: public Sequence {
+public:
+	explicit PlotSequence(std::shared_ptr<const PlotData> plot): m_plot(plot) {}
+
+	std::unique_ptr<SequenceCursor> cursor() const {
+		return std::unique_ptr<SequenceCursor>(new Cursor(m_plot));
+	}
+
+	Expression toList() const {
+		std::vector<Expression> elements;
+		elements.reserve(m_plot->size());
+		Cursor cursor(m_plot);
+		Expression value;
+		while (cursor.next(value)) {
+			elements.push_back(value);
+		}
+
+		return Expression(elements);
+	}
+
+	std::shared_ptr<const PlotData> plot() const {
+		return m_plot;
+	}
+
+private:
+	std::shared_ptr<const PlotData> m_plot;
+
+	class Cursor: public SequenceCursor {
+	public:
+		explicit Cursor(std::shared_ptr<const PlotData> plot):
+			m_plot(plot), m_index(0), m_points(0), m_lines(0), m_texts(0), m_images(0) {}
+
+	protected:
+		bool advance(Expression& value) {
+			if (m_index == m_plot->size()) {
+				return false;
+			}
+
+			switch (m_plot->order()[m_index++]) {
+			case PlotData::PointKind:
+				value = m_plot->pointExpression(m_points++);
+				break;
+			case PlotData::LineKind:
+				value = m_plot->lineExpression(m_lines++);
+				break;
+			case PlotData::TextKind:
+				value = m_plot->textExpression(m_texts++);
+				break;
+			default:
+				value = m_plot->imageExpression(m_images++);
+				break;
+			}
+
+			return true;
+		}
+
+	private:
+		std::shared_ptr<const PlotData> m_plot;
+		std::size_t m_index, m_points, m_lines, m_texts, m_images;
+	};
+};
+
+Expression makePlot(std::shared_ptr<const PlotData> plot) {
+	return Expression::fromSequence(std::make_shared<PlotSequence>(plot));
+}
+
+std::shared_ptr<const PlotData> plotData(const Expression& exp) {
+	const PlotSequence* plot = dynamic_cast<const PlotSequence*>(exp.sequence());
+	return (plot != nullptr) ? plot->plot() : nullptr;
+}
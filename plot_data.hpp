@@ -0,0 +1,130 @@
+/*! \file plot_data.hpp
+Typed plot primitives.
+
+discrete-plot and continuous-plot build their points, lines, text and images
+into a PlotData, which keeps the coordinates and style of each kind of
+primitive in arrays of their own. The plot is returned as a lazy sequence (see sequence.hpp)
+of the primitives in their property form, a list or string tagged with
+"object-name", "size", "thickness" and so on, which is only made when a script
+reads the elements. The interpreter hands the typed data on to the notebook,
+which draws it without going through the property form.
+ */
+#ifndef PLOT_DATA_HPP
+#define PLOT_DATA_HPP
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "expression.hpp"
+
+/*! \class PlotData
+\brief The points, lines, text and images of a plot, in the order they were added.
+
+Coordinates are those of the scene the plot is drawn in, where ordinates grow downwards like in
+the property form.
+ */
+class PlotData {
+public:
+	/// The kinds of primitives
+	enum Kind {PointKind, LineKind, TextKind, ImageKind};
+
+	/// The points, each drawn as a filled circle of diameter size centered at (x, y)
+	struct Points {
+		std::vector<double> x, y, size;
+	};
+
+	/// The lines from (x1, y1) to (x2, y2), with a pen of width thickness
+	struct Lines {
+		std::vector<double> x1, y1, x2, y2, thickness;
+	};
+
+	/// The strings centered at (x, y), scaled by scale and rotated by rotation radians
+	struct Texts {
+		std::vector<std::string> text;
+		std::vector<double> x, y, scale, rotation;
+	};
+
+	/// The images, each a grid of columns by rows values drawn over the rectangle of the given
+	/// width and height whose top left corner is (x, y). The values are stored row by row from the
+	/// top. A cell is drawn the darker the higher its value, from clear at the lowest value of the
+	/// image to black at the highest, on a log scale if logarithmic is set
+	struct Images {
+		std::vector<double> x, y, width, height;
+		std::vector<std::size_t> columns, rows;
+		std::vector<std::vector<double>> values;
+		std::vector<unsigned char> logarithmic;
+	};
+
+	/// add a point
+	void addPoint(double x, double y, double size);
+
+	/// add a line
+	void addLine(double x1, double y1, double x2, double y2, double thickness);
+
+	/// add a string
+	void addText(const std::string& text, double x, double y, double scale, double rotation);
+
+	/// add an image of columns by rows values
+	void addImage(double x, double y, double width, double height, std::size_t columns,
+		std::size_t rows, std::vector<double> values, bool logarithmic);
+
+	/// return the number of primitives
+	std::size_t size() const noexcept;
+
+	/// return the kind of every primitive, in order. The primitives of each kind are in the same
+	/// order in their arrays
+	const std::vector<unsigned char>& order() const noexcept;
+
+	/// return the points
+	const Points& points() const noexcept;
+
+	/// return the lines
+	const Lines& lines() const noexcept;
+
+	/// return the strings
+	const Texts& texts() const noexcept;
+
+	/// return the images
+	const Images& images() const noexcept;
+
+	/// return the property form of the point at index i of the points
+	Expression pointExpression(std::size_t i) const;
+
+	/// return the property form of the line at index i of the lines
+	Expression lineExpression(std::size_t i) const;
+
+	/// return the property form of the string at index i of the strings
+	Expression textExpression(std::size_t i) const;
+
+	/// return the property form of the image at index i of the images, a list of its rows
+	Expression imageExpression(std::size_t i) const;
+
+private:
+	std::vector<unsigned char> m_order;
+	Points m_points;
+	Lines m_lines;
+	Texts m_texts;
+	Images m_images;
+};
+
+/*! Return how opaque each cell of an image is drawn, black over the plot.
+	\param values the values of the cells
+	\param logarithmic true to shade the values on a log scale
+	\return for each cell 0 at the lowest finite value of the image up to 1 at the highest, 0 if
+		every value is the same. Infinite values are 0 or 1 and NaN is 0
+ */
+std::vector<double> imageOpacity(const std::vector<double>& values, bool logarithmic);
+
+/// return a plot as a lazy sequence of its primitives in their property form
+Expression makePlot(std::shared_ptr<const PlotData> plot);
+
+/*! Return the typed data of a plot.
+	\param exp any expression
+	\return the data if exp is a plot made by makePlot and not yet forced into a list, otherwise
+		nullptr
+ */
+std::shared_ptr<const PlotData> plotData(const Expression& exp);
+
+#endif
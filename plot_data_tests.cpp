@@ -0,0 +1,175 @@
+#include "catch.hpp"
+
+#include <cmath>
+#include <numeric>
+#include <sstream>
+#include <string>
+
+#include "interpreter.hpp"
+#include "plot_data.hpp"
+#include "sequence.hpp"
+#include "threaded_interpreter.hpp"
+
+TEST_CASE("Test the property form of plot primitives", "[plot_data]") {
+	std::shared_ptr<PlotData> plot = std::make_shared<PlotData>();
+	plot->addLine(0, 1, 2, 3, 0);
+	plot->addPoint(4, 5, 0.25);
+	plot->addText("label", 6, 7, 2, 0.5);
+	plot->addPoint(8, 9, 0);
+
+	REQUIRE(plot->size() == 4);
+	REQUIRE(plot->points().x.size() == 2);
+	REQUIRE(plot->lines().thickness.size() == 1);
+	REQUIRE(plot->texts().text[0] == "label");
+
+	Expression exp = makePlot(plot);
+	REQUIRE(exp.isHeadSequence());
+	REQUIRE(plotData(exp) == plot);
+
+	// the primitives are made in the order they were added
+	Expression list = forceSequence(exp);
+	REQUIRE(plotData(list) == nullptr);
+	REQUIRE(std::distance(list.tailConstBegin(), list.tailConstEnd()) == 4);
+
+	auto it = list.tailConstBegin();
+	REQUIRE(it->getProperty("object-name") == Expression(Atom("\"line\"")));
+	REQUIRE(it->getProperty("thickness") == Expression(0.));
+	REQUIRE(*it->tailConstBegin()->tailConstBegin() == Expression(0.));
+	REQUIRE(*std::prev(it->tailConstEnd())->tailConstBegin() == Expression(2.));
+
+	it++;
+	REQUIRE(*it == plot->pointExpression(0));
+	REQUIRE(it->getProperty("object-name") == Expression(Atom("\"point\"")));
+	REQUIRE(it->getProperty("size") == Expression(0.25));
+	REQUIRE(*std::prev(it->tailConstEnd()) == Expression(5.));
+
+	it++;
+	REQUIRE(it->head().asSymbol(true) == "label");
+	REQUIRE(it->getProperty("text-scale") == Expression(2.));
+	REQUIRE(it->getProperty("text-rotation") == Expression(0.5));
+	REQUIRE(it->getProperty("position").getProperty("object-name") ==
+		Expression(Atom("\"point\"")));
+
+	it++;
+	REQUIRE(*it == plot->pointExpression(1));
+}
+
+TEST_CASE("Test plots keep their typed form until read", "[plot_data]") {
+	const std::string program = "(discrete-plot (list (list -1 -1) (list 1 1)))";
+
+	std::istringstream iss(program);
+	Interpreter interp;
+	REQUIRE(interp.parseStream(iss));
+	Expression shown = interp.evaluateForDisplay();
+	std::shared_ptr<const PlotData> plot = plotData(shown);
+	REQUIRE(plot);
+
+	// two stems with their points, the axes, the edges and the tick labels
+	REQUIRE(plot->points().x.size() == 2);
+	REQUIRE(plot->lines().x1.size() == 8);
+	REQUIRE(plot->texts().text.size() == 4);
+
+	// scripts and evaluate see the property form, with the same primitives
+	Expression list = interp.evaluate();
+	REQUIRE(list.isHeadListRoot());
+	REQUIRE(list == shown);
+	REQUIRE(list.tailConstBegin()->getProperty("object-name") == Expression(Atom("\"line\"")));
+
+	std::istringstream first("(get-property \"object-name\" (first " + program + "))");
+	REQUIRE(interp.parseStream(first));
+	REQUIRE(interp.evaluate() == Expression(Atom("\"line\"")));
+
+	INFO("the output message carries the typed data");
+	std::istringstream stream(program);
+	OutputQueue oq;
+	ThreadedInterpreter threaded(&oq, stream);
+	OutputMessage msg;
+	oq.wait_pop(msg);
+	REQUIRE(msg.type == ExpressionType);
+	REQUIRE(msg.plot);
+	REQUIRE(msg.plot->size() == plot->size());
+	REQUIRE(msg.exp == list);
+
+	OutputMessage number(ExpressionType, Expression(1.));
+	REQUIRE_FALSE(number.plot);
+}
+
+TEST_CASE("Test the shading of images", "[plot_data]") {
+	REQUIRE(imageOpacity({1, 3, 2}, false) == std::vector<double>({0, 1, 0.5}));
+	REQUIRE(imageOpacity({4, 4}, true) == std::vector<double>({0, 0}));
+	std::vector<double> shades = imageOpacity({0, 7, 3}, true);
+	REQUIRE(shades[1] == 1);
+	REQUIRE(shades[2] == Approx(std::log(4) / std::log(8)));
+
+	// the range is that of the finite values
+	REQUIRE(imageOpacity({0, HUGE_VAL, 1, -HUGE_VAL, NAN, 2}, false) ==
+		std::vector<double>({0, 1, 0.5, 0, 0, 1}));
+	REQUIRE(imageOpacity({NAN, HUGE_VAL}, true) == std::vector<double>({0, 1}));
+	for (double shade : imageOpacity({-1e308, 1e308, 0}, false)) {
+		REQUIRE(shade >= 0);
+		REQUIRE(shade <= 1);
+	}
+}
+
+TEST_CASE("Test density images of discrete plots", "[plot_data]") {
+	const std::string data = "(map (lambda (x) (list x (sin x))) (range 0 9999 1))";
+
+	std::istringstream iss("(discrete-plot " + data + " (list (list \"decimation\" \"density\") "
+		"(list \"resolution\" 10)))");
+	Interpreter interp;
+	REQUIRE(interp.parseStream(iss));
+	std::shared_ptr<const PlotData> plot = plotData(interp.evaluateForDisplay());
+	REQUIRE(plot);
+
+	// a single image in place of the points and stems, with the axis, the edges and the labels
+	REQUIRE(plot->points().x.empty());
+	REQUIRE(plot->images().values.size() == 1);
+	REQUIRE(plot->size() == 5 + 1 + 4);
+
+	// every point is counted once, the abscissas spread evenly over the columns
+	const std::vector<double>& counts = plot->images().values[0];
+	REQUIRE(plot->images().logarithmic[0]);
+	REQUIRE(plot->images().columns[0] == 10);
+	REQUIRE(plot->images().rows[0] == 10);
+	REQUIRE(std::accumulate(counts.begin(), counts.end(), 0.) == 10000);
+	for (std::size_t c = 0; c < 10; c++) {
+		double column = 0;
+		for (std::size_t r = 0; r < 10; r++) {
+			column += counts[r * 10 + c];
+		}
+
+		REQUIRE(column == 1000);
+	}
+
+	// the image covers the area of the data, within the edges of the plot
+	REQUIRE(plot->images().x[0] == 0);
+	REQUIRE(plot->images().y[0] == Approx(-10));
+	REQUIRE(plot->images().width[0] == 20);
+	REQUIRE(plot->images().height[0] == Approx(20));
+
+	// its property form is the list of its rows
+	Expression image = plot->imageExpression(0);
+	REQUIRE(image.getProperty("object-name") == Expression(Atom("\"image\"")));
+	REQUIRE(image.getProperty("width") == Expression(20.));
+	REQUIRE(image.getProperty("shading") == Expression(Atom("\"logarithmic\"")));
+	REQUIRE(std::distance(image.tailConstBegin(), image.tailConstEnd()) == 10);
+	REQUIRE(*image.tailConstBegin()->tailConstBegin() == Expression(counts[0]));
+
+	INFO("the resolution defaults to 200 cells a side");
+	std::istringstream defaults("(discrete-plot " + data +
+		" (list (list \"decimation\" \"density\")))");
+	REQUIRE(interp.parseStream(defaults));
+	plot = plotData(interp.evaluateForDisplay());
+	REQUIRE(plot);
+	REQUIRE(plot->images().columns[0] == 200);
+	REQUIRE(plot->images().values[0].size() == 200 * 200);
+
+	INFO("and is at most 1000 cells a side");
+	std::istringstream large("(discrete-plot (list (list 0 0) (list 1 1) (list 2 3)) "
+		"(list (list \"decimation\" \"density\") (list \"resolution\" 100000)))");
+	REQUIRE(interp.parseStream(large));
+	plot = plotData(interp.evaluateForDisplay());
+	REQUIRE(plot);
+	REQUIRE(plot->images().columns[0] == 1000);
+	REQUIRE(plot->images().rows[0] == 1000);
+}
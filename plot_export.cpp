@@ -0,0 +1,555 @@
+#include "plot_export.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <vector>
+
+#include "semantic_error.hpp"
+#include "sequence.hpp"
+
+const double PI = std::atan2(0, -1);
+
+// Space left around the primitives, in scene units
+const double EXPORT_MARGIN = 1;
+
+// **************** Property form ****************
+
+// Helper function to read the coordinates of a point object
+void readPoint(const Expression& exp, double& x, double& y) {
+	if (exp.getProperty("object-name").head().asSymbol(true) == "point" && exp.isHeadListRoot() &&
+		std::distance(exp.tailConstBegin(), exp.tailConstEnd()) == 2 &&
+		exp.tailConstBegin()->isHeadNumber() && std::prev(exp.tailConstEnd())->isHeadNumber()) {
+		x = exp.tailConstBegin()->head().asNumber();
+		y = std::prev(exp.tailConstEnd())->head().asNumber();
+		return;
+	}
+
+	throw SemanticError("Error: invalid coordinates of point object");
+}
+
+// Helper function to read a number property that must not be negative
+double readSize(const Expression& exp, const std::string& property, const std::string& object) {
+	Expression value = exp.getProperty(property);
+	if (value.isHeadNumber() && value.head().asNumber() >= 0) {
+		return value.head().asNumber();
+	}
+
+	throw SemanticError("Error: invalid " + property + " of " + object + " object");
+}
+
+// Helper function to add a graphic object, or the objects of a list in order, to a plot. The
+// objects are checked like the notebook checks them
+void addObjects(PlotData& plot, const Expression& exp) {
+	Expression objectName = exp.getProperty("object-name");
+	std::string name = objectName.head().asSymbol(true);
+	double x, y;
+	if (name == "point") {
+		readPoint(exp, x, y);
+		plot.addPoint(x, y, readSize(exp, "size", "point"));
+	} else if (name == "line") {
+		double x2, y2;
+		if (!exp.isHeadListRoot() || std::distance(exp.tailConstBegin(), exp.tailConstEnd()) != 2) {
+			throw SemanticError("Error: invalid line object");
+		}
+
+		readPoint(*exp.tailConstBegin(), x, y);
+		readPoint(*std::prev(exp.tailConstEnd()), x2, y2);
+		plot.addLine(x, y, x2, y2, readSize(exp, "thickness", "line"));
+	} else if (name == "text") {
+		if (!exp.isHeadStringLiteral()) {
+			throw SemanticError("Error: invalid text object");
+		}
+
+		// the scale and rotation are optional
+		readPoint(exp.getProperty("position"), x, y);
+		Expression scale = exp.getProperty("text-scale");
+		Expression rotation = exp.getProperty("text-rotation");
+		plot.addText(exp.head().asSymbol(true), x, y,
+			scale.isHeadNumber() ? scale.head().asNumber() : 1,
+			rotation.isHeadNumber() ? rotation.head().asNumber() : 0);
+	} else if (name == "image") {
+		readPoint(exp.getProperty("position"), x, y);
+		double width = readSize(exp, "width", "image");
+		double height = readSize(exp, "height", "image");
+		if (!exp.isHeadListRoot() || exp.tailConstBegin() == exp.tailConstEnd()) {
+			throw SemanticError("Error: invalid rows of image object");
+		}
+
+		std::size_t rows = std::distance(exp.tailConstBegin(), exp.tailConstEnd());
+		std::size_t columns = std::distance(exp.tailConstBegin()->tailConstBegin(),
+			exp.tailConstBegin()->tailConstEnd());
+		std::vector<double> values;
+		values.reserve(rows * columns);
+		for (auto row = exp.tailConstBegin(); row != exp.tailConstEnd(); row++) {
+			std::size_t length = std::distance(row->tailConstBegin(), row->tailConstEnd());
+			if (!row->isHeadListRoot() || length != columns) {
+				throw SemanticError("Error: invalid rows of image object");
+			}
+
+			for (auto value = row->tailConstBegin(); value != row->tailConstEnd(); value++) {
+				if (!value->isHeadNumber()) {
+					throw SemanticError("Error: invalid values of image object");
+				}
+
+				values.push_back(value->head().asNumber());
+			}
+		}
+
+		bool logarithmic = exp.getProperty("shading").head().asSymbol(true) == "logarithmic";
+		plot.addImage(x, y, width, height, columns, rows, std::move(values), logarithmic);
+	} else if (!objectName.head().isNone()) {
+		throw SemanticError("Error: unknown object name");
+	} else if (exp.isHeadListRoot()) {
+		for (auto it = exp.tailConstBegin(); it != exp.tailConstEnd(); it++) {
+			addObjects(plot, *it);
+		}
+	} else {
+		throw SemanticError("Error: save-plot takes a plot or a list of graphic objects");
+	}
+}
+
+std::shared_ptr<const PlotData> toPlotData(const Expression& exp) {
+	std::shared_ptr<const PlotData> typed = plotData(exp);
+	if (typed) {
+		return typed;
+	}
+
+	std::shared_ptr<PlotData> plot = std::make_shared<PlotData>();
+	addObjects(*plot, forceSequence(exp));
+	return plot;
+}
+
+// **************** Layout ****************
+
+// The rectangle of the scene a file shows, and how many pixels a scene unit takes
+typedef struct _Frame {
+	double left, top, width, height, scale;
+} Frame;
+
+// Helper function to find the rectangle holding every primitive, with a margin. Text is measured
+// as if its characters were about half as wide as they are high, like Courier
+Frame plotFrame(const PlotData& plot) {
+	double left = std::numeric_limits<double>::infinity();
+	double top = left, right = -left, bottom = -left;
+	auto add = [&](double x, double y, double radius) {
+		left = std::min(left, x - radius);
+		right = std::max(right, x + radius);
+		top = std::min(top, y - radius);
+		bottom = std::max(bottom, y + radius);
+	};
+
+	const PlotData::Points& points = plot.points();
+	for (std::size_t i = 0; i < points.x.size(); i++) {
+		add(points.x[i], points.y[i], points.size[i]);
+	}
+
+	const PlotData::Lines& lines = plot.lines();
+	for (std::size_t i = 0; i < lines.x1.size(); i++) {
+		add(lines.x1[i], lines.y1[i], lines.thickness[i] / 2);
+		add(lines.x2[i], lines.y2[i], lines.thickness[i] / 2);
+	}
+
+	const PlotData::Texts& texts = plot.texts();
+	for (std::size_t i = 0; i < texts.x.size(); i++) {
+		double scale = std::max(texts.scale[i], 1.);
+		add(texts.x[i], texts.y[i], std::max(0.3 * texts.text[i].size(), 0.5) * scale);
+	}
+
+	const PlotData::Images& images = plot.images();
+	for (std::size_t i = 0; i < images.x.size(); i++) {
+		add(images.x[i], images.y[i], 0);
+		add(images.x[i] + images.width[i], images.y[i] + images.height[i], 0);
+	}
+
+	// an empty plot shows a blank square
+	if (!(left <= right && top <= bottom)) {
+		left = top = 0;
+		right = bottom = 1;
+	}
+
+	Frame frame;
+	frame.left = left - EXPORT_MARGIN;
+	frame.top = top - EXPORT_MARGIN;
+	frame.width = right - left + 2 * EXPORT_MARGIN;
+	frame.height = bottom - top + 2 * EXPORT_MARGIN;
+	frame.scale = PLOT_EXPORT_PIXELS / std::max(frame.width, frame.height);
+	return frame;
+}
+
+// **************** SVG ****************
+
+// Helper function to write text with the characters XML reserves escaped
+void writeEscaped(std::ostream& out, const std::string& text) {
+	for (char c : text) {
+		switch (c) {
+		case '&':
+			out << "&amp;";
+			break;
+		case '<':
+			out << "&lt;";
+			break;
+		case '>':
+			out << "&gt;";
+			break;
+		case '"':
+			out << "&quot;";
+			break;
+		default:
+			out << c;
+		}
+	}
+}
+
+// Helper function to write -0 as 0, like the property form holds it
+double svgNumber(double x) {
+	return x + 0.0;
+}
+
+// Each primitive is one element, written as it is read. Points and lines are drawn like the
+// notebook draws them: a point is filled and outlined with a pen as wide as the point, and a line
+// of thickness 0 is one pixel wide however the document is scaled
+void writeSvg(const PlotData& plot, std::ostream& out) {
+	Frame frame = plotFrame(plot);
+	out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+		<< "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"" << frame.width * frame.scale
+		<< "\" height=\"" << frame.height * frame.scale << "\" viewBox=\"" << frame.left << ' '
+		<< frame.top << ' ' << frame.width << ' ' << frame.height << "\">\n"
+		<< "<rect x=\"" << frame.left << "\" y=\"" << frame.top << "\" width=\"" << frame.width
+		<< "\" height=\"" << frame.height << "\" fill=\"white\"/>\n";
+
+	const PlotData::Points& points = plot.points();
+	const PlotData::Lines& lines = plot.lines();
+	const PlotData::Texts& texts = plot.texts();
+	const PlotData::Images& images = plot.images();
+	std::size_t point = 0, line = 0, text = 0, image = 0;
+	for (unsigned char kind : plot.order()) {
+		if (kind == PlotData::PointKind) {
+			out << "<circle cx=\"" << svgNumber(points.x[point]) << "\" cy=\""
+				<< svgNumber(points.y[point]) << "\" r=\""
+				<< std::max(points.size[point], 0.5 / frame.scale) << "\"/>\n";
+			point++;
+		} else if (kind == PlotData::LineKind) {
+			out << "<line x1=\"" << svgNumber(lines.x1[line]) << "\" y1=\""
+				<< svgNumber(lines.y1[line]) << "\" x2=\"" << svgNumber(lines.x2[line]) << "\" y2=\""
+				<< svgNumber(lines.y2[line]) << "\" stroke=\"black\" ";
+			if (lines.thickness[line] > 0) {
+				out << "stroke-width=\"" << lines.thickness[line] << "\"/>\n";
+			} else {
+				out << "stroke-width=\"1\" vector-effect=\"non-scaling-stroke\"/>\n";
+			}
+
+			line++;
+		} else if (kind == PlotData::TextKind) {
+			out << "<text transform=\"translate(" << svgNumber(texts.x[text]) << ' '
+				<< svgNumber(texts.y[text]) << ") rotate(" << texts.rotation[text] * (180 / PI)
+				<< ") scale(" << std::max(texts.scale[text], 1.) << ")\" "
+				<< "font-family=\"Courier\" font-size=\"1\" text-anchor=\"middle\" "
+				<< "dominant-baseline=\"central\">";
+			writeEscaped(out, texts.text[text]);
+			out << "</text>\n";
+			text++;
+		} else {
+
+			// a cell is a unit square of a group scaled to the image
+			std::size_t columns = images.columns[image];
+			std::size_t rows = images.rows[image];
+			out << "<g transform=\"translate(" << svgNumber(images.x[image]) << ' '
+				<< svgNumber(images.y[image]) << ") scale(" << images.width[image] / columns << ' '
+				<< images.height[image] / rows << ")\" shape-rendering=\"crispEdges\">\n";
+
+			std::vector<double> opacity = imageOpacity(images.values[image],
+				images.logarithmic[image]);
+			for (std::size_t r = 0; r < rows; r++) {
+				for (std::size_t c = 0; c < columns; c++) {
+					if (opacity[r * columns + c] > 0) {
+						out << "<rect x=\"" << c << "\" y=\"" << r << "\" width=\"1\" height=\"1\" "
+							<< "fill-opacity=\"" << opacity[r * columns + c] << "\"/>\n";
+					}
+				}
+			}
+
+			out << "</g>\n";
+			image++;
+		}
+	}
+
+	out << "</svg>\n";
+}
+
+// **************** PNG ****************
+
+// A white RGB raster of the frame of a plot, drawn on in black
+class Canvas {
+public:
+	explicit Canvas(const Frame& frame): m_frame(frame),
+		m_width(static_cast<std::size_t>(std::max(1., std::round(frame.width * frame.scale)))),
+		m_height(static_cast<std::size_t>(std::max(1., std::round(frame.height * frame.scale)))),
+		m_pixels(m_width * m_height * 3, 255) {}
+
+	std::size_t width() const {
+		return m_width;
+	}
+
+	std::size_t height() const {
+		return m_height;
+	}
+
+	// the red, green and blue bytes of row y
+	const unsigned char* row(std::size_t y) const {
+		return &m_pixels[y * m_width * 3];
+	}
+
+	// Fill a disc, its edge smoothed over a pixel
+	void disc(double x, double y, double radius) {
+		double cx = toX(x), cy = toY(y);
+		double r = std::max(radius * m_frame.scale, 0.5);
+		forPixels(cx - r, cy - r, cx + r, cy + r, [&](double px, double py) {
+			return r + 0.5 - std::hypot(px - cx, py - cy);
+		});
+	}
+
+	// Draw a line with a pen of the given width, at least a pixel wide
+	void line(double x1, double y1, double x2, double y2, double thickness) {
+		double ax = toX(x1), ay = toY(y1), bx = toX(x2), by = toY(y2);
+		double half = std::max(thickness * m_frame.scale, 1.) / 2;
+		double dx = bx - ax, dy = by - ay;
+		double length2 = dx * dx + dy * dy;
+		forPixels(std::min(ax, bx) - half, std::min(ay, by) - half, std::max(ax, bx) + half,
+			std::max(ay, by) + half, [&](double px, double py) {
+
+			// the distance from the pixel to the nearest point of the segment
+			double t = (length2 > 0) ? ((px - ax) * dx + (py - ay) * dy) / length2 : 0;
+			t = std::min(std::max(t, 0.), 1.);
+			return half + 0.5 - std::hypot(px - (ax + t * dx), py - (ay + t * dy));
+		});
+	}
+
+	// Shade the cells of an image
+	void image(double x, double y, double width, double height, std::size_t columns,
+		std::size_t rows, const std::vector<double>& opacity) {
+		double left = toX(x), top = toY(y);
+		double cellWidth = width * m_frame.scale / columns;
+		double cellHeight = height * m_frame.scale / rows;
+		forPixels(left, top, left + width * m_frame.scale, top + height * m_frame.scale,
+			[&](double px, double py) {
+			std::size_t c = std::min(static_cast<std::size_t>((px - left) / cellWidth), columns - 1);
+			std::size_t r = std::min(static_cast<std::size_t>((py - top) / cellHeight), rows - 1);
+			return opacity[r * columns + c];
+		});
+	}
+
+private:
+	Frame m_frame;
+	std::size_t m_width, m_height;
+	std::vector<unsigned char> m_pixels;
+
+	double toX(double x) const {
+		return (x - m_frame.left) * m_frame.scale;
+	}
+
+	double toY(double y) const {
+		return (y - m_frame.top) * m_frame.scale;
+	}
+
+	// Darken the pixels of a rectangle by the coverage f returns for the center of each, clamped
+	// to [0, 1]
+	template<typename F>
+	void forPixels(double left, double top, double right, double bottom, F f) {
+		std::size_t x0 = static_cast<std::size_t>(std::max(std::floor(left), 0.));
+		std::size_t y0 = static_cast<std::size_t>(std::max(std::floor(top), 0.));
+		std::size_t x1 = static_cast<std::size_t>(std::max(std::min(std::ceil(right),
+			static_cast<double>(m_width)), 0.));
+		std::size_t y1 = static_cast<std::size_t>(std::max(std::min(std::ceil(bottom),
+			static_cast<double>(m_height)), 0.));
+		for (std::size_t py = y0; py < y1; py++) {
+			for (std::size_t px = x0; px < x1; px++) {
+				double coverage = std::min(std::max(f(px + 0.5, py + 0.5), 0.), 1.);
+				unsigned char* pixel = &m_pixels[(py * m_width + px) * 3];
+				for (std::size_t i = 0; i < 3; i++) {
+					pixel[i] = static_cast<unsigned char>(std::lround(pixel[i] * (1 - coverage)));
+				}
+			}
+		}
+	}
+};
+
+std::uint32_t crc32(const unsigned char* data, std::size_t size, std::uint32_t crc) {
+	static const std::vector<std::uint32_t> table = [] {
+		std::vector<std::uint32_t> t(256);
+		for (std::uint32_t n = 0; n < 256; n++) {
+			std::uint32_t c = n;
+			for (int k = 0; k < 8; k++) {
+				c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+			}
+
+			t[n] = c;
+		}
+
+		return t;
+	}();
+
+	crc = ~crc;
+	for (std::size_t i = 0; i < size; i++) {
+		crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	}
+
+	return ~crc;
+}
+
+void putUint32(std::vector<unsigned char>& bytes, std::uint32_t value) {
+	for (int shift = 24; shift >= 0; shift -= 8) {
+		bytes.push_back(static_cast<unsigned char>(value >> shift));
+	}
+}
+
+// Write a PNG chunk: its length, type, data and the CRC of the type and data
+void writeChunk(std::ostream& out, const char* type, const std::vector<unsigned char>& data) {
+	std::vector<unsigned char> chunk;
+	chunk.reserve(data.size() + 12);
+	putUint32(chunk, static_cast<std::uint32_t>(data.size()));
+	chunk.insert(chunk.end(), type, type + 4);
+	chunk.insert(chunk.end(), data.begin(), data.end());
+	putUint32(chunk, crc32(&chunk[4], data.size() + 4, 0));
+	out.write(reinterpret_cast<const char*>(chunk.data()), chunk.size());
+}
+
+// The image data of a PNG as a zlib stream of stored deflate blocks, each written in an IDAT
+// chunk of its own as soon as it is full. Rasters of plots are mostly blank, but a compressor is
+// not worth a dependency for files that are written and not kept
+class IdatWriter {
+public:
+	explicit IdatWriter(std::ostream& out): m_out(out), m_started(false), m_a(1), m_b(0) {}
+
+	void write(const unsigned char* data, std::size_t size) {
+		for (std::size_t i = 0; i < size; i++) {
+			m_block.push_back(data[i]);
+			m_a = (m_a + data[i]) % 65521;
+			m_b = (m_b + m_a) % 65521;
+			if (m_block.size() == BLOCK_SIZE) {
+				flush(false);
+			}
+		}
+	}
+
+	// write the last block and the Adler-32 checksum of the data
+	void finish() {
+		flush(true);
+	}
+
+private:
+	static const std::size_t BLOCK_SIZE = 65535;
+
+	std::ostream& m_out;
+	std::vector<unsigned char> m_block;
+	bool m_started;
+	std::uint32_t m_a, m_b;
+
+	void flush(bool last) {
+		std::vector<unsigned char> data;
+		data.reserve(m_block.size() + 11);
+		if (!m_started) {
+
+			// deflate with a 32K window and no preset dictionary
+			data.push_back(0x78);
+			data.push_back(0x01);
+			m_started = true;
+		}
+
+		std::uint16_t size = static_cast<std::uint16_t>(m_block.size());
+		data.push_back(last ? 1 : 0);
+		data.push_back(static_cast<unsigned char>(size & 0xff));
+		data.push_back(static_cast<unsigned char>(size >> 8));
+		data.push_back(static_cast<unsigned char>(~size & 0xff));
+		data.push_back(static_cast<unsigned char>((~size >> 8) & 0xff));
+		data.insert(data.end(), m_block.begin(), m_block.end());
+		if (last) {
+			putUint32(data, (m_b << 16) | m_a);
+		}
+
+		writeChunk(m_out, "IDAT", data);
+		m_block.clear();
+	}
+};
+
+void writePng(const PlotData& plot, std::ostream& out) {
+	Canvas canvas(plotFrame(plot));
+
+	const PlotData::Points& points = plot.points();
+	const PlotData::Lines& lines = plot.lines();
+	const PlotData::Images& images = plot.images();
+	std::size_t point = 0, line = 0, image = 0;
+	for (unsigned char kind : plot.order()) {
+		if (kind == PlotData::PointKind) {
+			canvas.disc(points.x[point], points.y[point], points.size[point]);
+			point++;
+		} else if (kind == PlotData::LineKind) {
+			canvas.line(lines.x1[line], lines.y1[line], lines.x2[line], lines.y2[line],
+				lines.thickness[line]);
+			line++;
+		} else if (kind == PlotData::ImageKind) {
+			canvas.image(images.x[image], images.y[image], images.width[image],
+				images.height[image], images.columns[image], images.rows[image],
+				imageOpacity(images.values[image], images.logarithmic[image]));
+			image++;
+		}
+	}
+
+	static const unsigned char signature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+	out.write(reinterpret_cast<const char*>(signature), sizeof(signature));
+
+	// 8 bit RGB, not interlaced
+	std::vector<unsigned char> header;
+	putUint32(header, static_cast<std::uint32_t>(canvas.width()));
+	putUint32(header, static_cast<std::uint32_t>(canvas.height()));
+	header.insert(header.end(), {8, 2, 0, 0, 0});
+	writeChunk(out, "IHDR", header);
+
+	// each row starts with filter type 0, none
+	IdatWriter idat(out);
+	const unsigned char filter = 0;
+	for (std::size_t y = 0; y < canvas.height(); y++) {
+		idat.write(&filter, 1);
+		idat.write(canvas.row(y), canvas.width() * 3);
+	}
+
+	idat.finish();
+	writeChunk(out, "IEND", std::vector<unsigned char>());
+}
+
+// Helper function to tell whether a path ends with an extension, ignoring case
+bool hasExtension(const std::string& path, const std::string& extension) {
+	if (path.size() < extension.size()) {
+		return false;
+	}
+
+	return std::equal(extension.begin(), extension.end(), path.end() - extension.size(),
+		[](char a, char b) { return a == std::tolower(static_cast<unsigned char>(b)); });
+}
+
+void savePlot(const Expression& plot, const std::string& path) {
+	bool svg = hasExtension(path, ".svg");
+	if (!svg && !hasExtension(path, ".png")) {
+		throw SemanticError("Error: save-plot writes .svg or .png files");
+	}
+
+	std::shared_ptr<const PlotData> data = toPlotData(plot);
+	std::ofstream out(path, std::ios::binary);
+	if (!out) {
+		throw SemanticError("Error: could not open " + path + " for writing");
+	}
+
+	if (svg) {
+		writeSvg(*data, out);
+	} else {
+		writePng(*data, out);
+	}
+
+	out.close();
+	if (!out) {
+		throw SemanticError("Error: could not write " + path);
+	}
+}
@@ -0,0 +1,48 @@
+/*! \file plot_export.hpp
+Writing plots to image files without the notebook.
+
+(save-plot plot "out.svg") writes a plot, or a list of graphic objects in their
+property form, to an SVG or PNG file chosen by the extension. The primitives
+are walked once and written to the file as they are read, SVG as one element
+each and PNG through a small rasteriser, so plots can be exported in batch jobs
+built without Qt.
+
+The files are drawn like the notebook draws the plot, with the bounds of the
+primitives and a margin. PNG files have no font to draw with, text is left out
+of them.
+ */
+#ifndef PLOT_EXPORT_HPP
+#define PLOT_EXPORT_HPP
+
+#include <cstddef>
+#include <memory>
+#include <ostream>
+#include <string>
+
+#include "expression.hpp"
+#include "plot_data.hpp"
+
+/// Size in pixels of the longer side of an exported plot
+const std::size_t PLOT_EXPORT_PIXELS = 800;
+
+/*! Return the typed form of a plot.
+	\param exp a plot, or a list of graphic objects and lists of them
+	\return the primitives of exp in order
+	\throws SemanticError if exp holds anything but graphic objects, or one is invalid
+ */
+std::shared_ptr<const PlotData> toPlotData(const Expression& exp);
+
+/// write a plot as an SVG document
+void writeSvg(const PlotData& plot, std::ostream& out);
+
+/// write a plot as a PNG image, PLOT_EXPORT_PIXELS wide or high
+void writePng(const PlotData& plot, std::ostream& out);
+
+/*! Write a plot to a file.
+	\param plot a plot or a list of graphic objects
+	\param path the file, ending in .svg or .png
+	\throws SemanticError if the plot is invalid, the extension unknown or the file not written
+ */
+void savePlot(const Expression& plot, const std::string& path);
+
+#endif
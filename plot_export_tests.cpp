@@ -0,0 +1,217 @@
+#include "catch.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "interpreter.hpp"
+#include "plot_export.hpp"
+#include "semantic_error.hpp"
+#include "sequence.hpp"
+
+Expression runExportProgram(const std::string& program) {
+	std::istringstream iss(program);
+	Interpreter interp;
+	REQUIRE(interp.parseStream(iss));
+	return interp.evaluate();
+}
+
+std::size_t countOf(const std::string& text, const std::string& part) {
+	std::size_t count = 0;
+	for (std::size_t at = text.find(part); at != std::string::npos; at = text.find(part, at + 1)) {
+		count++;
+	}
+
+	return count;
+}
+
+std::uint32_t readUint32(const std::string& bytes, std::size_t at) {
+	std::uint32_t value = 0;
+	for (std::size_t i = 0; i < 4; i++) {
+		value = (value << 8) | static_cast<unsigned char>(bytes[at + i]);
+	}
+
+	return value;
+}
+
+// Read back the rows of a PNG written with stored deflate blocks, checking its structure
+std::string readPngData(const std::string& png, std::uint32_t& width, std::uint32_t& height) {
+	REQUIRE(png.compare(0, 8, "\x89PNG\r\n\x1a\n") == 0);
+	REQUIRE(png.compare(12, 4, "IHDR") == 0);
+	width = readUint32(png, 16);
+	height = readUint32(png, 20);
+
+	std::string zlib;
+	std::size_t at = 8;
+	std::string type;
+	while (type != "IEND") {
+		REQUIRE(at + 12 <= png.size());
+		std::uint32_t length = readUint32(png, at);
+		type = png.substr(at + 4, 4);
+		if (type == "IDAT") {
+			zlib += png.substr(at + 8, length);
+		}
+
+		at += length + 12;
+	}
+
+	REQUIRE(at == png.size());
+
+	// the zlib header, stored blocks up to the last one, and the checksum
+	std::string data;
+	std::size_t block = 2;
+	bool last = false;
+	while (!last) {
+		last = zlib[block] & 1;
+		std::size_t size = static_cast<unsigned char>(zlib[block + 1]) |
+			(static_cast<unsigned char>(zlib[block + 2]) << 8);
+		data += zlib.substr(block + 5, size);
+		block += size + 5;
+	}
+
+	std::uint32_t a = 1, b = 0;
+	for (char c : data) {
+		a = (a + static_cast<unsigned char>(c)) % 65521;
+		b = (b + a) % 65521;
+	}
+
+	REQUIRE(readUint32(zlib, block) == ((b << 16) | a));
+	return data;
+}
+
+TEST_CASE("Test plots written as SVG", "[plot_export]") {
+	PlotData plot;
+	plot.addLine(0, 0, 10, 0, 0);
+	plot.addPoint(5, 5, 0.5);
+	plot.addText("a<b", 5, -5, 2, 0);
+	plot.addImage(0, 0, 2, 1, 2, 1, {0, 3}, false);
+
+	std::ostringstream out;
+	writeSvg(plot, out);
+	std::string svg = out.str();
+	REQUIRE(svg.compare(0, 5, "<?xml") == 0);
+	REQUIRE(countOf(svg, "<line") == 1);
+	REQUIRE(countOf(svg, "vector-effect=\"non-scaling-stroke\"") == 1);
+	REQUIRE(countOf(svg, "<circle") == 1);
+	REQUIRE(countOf(svg, ">a&lt;b</text>") == 1);
+
+	// the cell at the lowest value is clear
+	REQUIRE(countOf(svg, "fill-opacity=") == 1);
+	REQUIRE(countOf(svg, "fill-opacity=\"1\"") == 1);
+	REQUIRE(svg.substr(svg.size() - 7) == "</svg>\n");
+
+	// values that are not finite are shaded within the range of the others
+	std::istringstream infinite("(surface-plot (lambda (x y) (/ x (- y 0.5))) (list -1 1) "
+		"(list -1 1) (list (list \"resolution\" 2)))");
+	Interpreter surface;
+	REQUIRE(surface.parseStream(infinite));
+	std::ostringstream shaded;
+	writeSvg(*toPlotData(surface.evaluateForDisplay()), shaded);
+	std::string shades = shaded.str();
+	REQUIRE(countOf(shades, "fill-opacity=") == 2);
+	for (std::size_t at = shades.find("fill-opacity=\""); at != std::string::npos;
+		at = shades.find("fill-opacity=\"", at + 1)) {
+		double opacity = std::stod(shades.substr(at + 14));
+		REQUIRE(opacity > 0);
+		REQUIRE(opacity <= 1);
+	}
+
+	INFO("the property form is written like the typed form");
+	std::istringstream program("(discrete-plot (list (list -1 -1) (list 1 1)) "
+		"(list (list \"title\" \"stems\")))");
+	Interpreter interp;
+	REQUIRE(interp.parseStream(program));
+	Expression typed = interp.evaluateForDisplay();
+	std::shared_ptr<const PlotData> data = toPlotData(typed);
+	REQUIRE(data == plotData(typed));
+	std::ostringstream fromTyped, fromList;
+	writeSvg(*data, fromTyped);
+	writeSvg(*toPlotData(forceSequence(typed)), fromList);
+	REQUIRE(fromTyped.str() == fromList.str());
+	REQUIRE(countOf(fromList.str(), "<line") == 8);
+	REQUIRE(countOf(fromList.str(), "<text") == 5);
+
+	REQUIRE_THROWS_AS(toPlotData(Expression(1.)), SemanticError);
+	REQUIRE_THROWS_AS(toPlotData(runExportProgram("(list (set-property \"object-name\" "
+		"\"circle\" (list 0 0)))")), SemanticError);
+	REQUIRE_THROWS_AS(toPlotData(runExportProgram("(list (set-property \"size\" -1 "
+		"(make-point 0 0)))")), SemanticError);
+}
+
+TEST_CASE("Test plots written as PNG", "[plot_export]") {
+	PlotData plot;
+	plot.addLine(-10, 0, 10, 0, 0);
+	plot.addPoint(0, -5, 1);
+	plot.addText("no font", 0, 5, 1, 0);
+
+	std::ostringstream out;
+	writePng(plot, out);
+	std::uint32_t width, height;
+	std::string data = readPngData(out.str(), width, height);
+
+	// the longer side of the frame, the line and a margin on each side, is PLOT_EXPORT_PIXELS
+	REQUIRE(width == PLOT_EXPORT_PIXELS);
+	REQUIRE(height < width);
+	REQUIRE(data.size() == height * (1 + 3 * width));
+
+	// a white background with the line across the middle and the point above it
+	auto pixel = [&](std::size_t x, std::size_t y) {
+		return static_cast<unsigned char>(data[y * (1 + 3 * width) + 1 + 3 * x]);
+	};
+
+	REQUIRE(pixel(0, 0) == 255);
+	REQUIRE(pixel(width / 2, height - 1) == 255);
+	std::size_t lineRow = 0;
+	for (std::size_t y = 0; y < height; y++) {
+		if (pixel(width / 2 + width / 4, y) < pixel(width / 2 + width / 4, lineRow)) {
+			lineRow = y;
+		}
+	}
+
+	// edges are antialiased, so the darkest pixels are not quite black
+	REQUIRE(pixel(width / 2 + width / 4, lineRow) < 64);
+	std::size_t pointRow = 0;
+	for (std::size_t y = 0; y + 2 < lineRow; y++) {
+		if (pixel(width / 2, y) < pixel(width / 2, pointRow)) {
+			pointRow = y;
+		}
+	}
+
+	REQUIRE(pixel(width / 2, pointRow) < 64);
+	REQUIRE(pointRow < lineRow / 2);
+}
+
+TEST_CASE("Test save-plot", "[plot_export]") {
+	const std::string path = "save_plot_test.svg";
+	Expression result = runExportProgram("(save-plot (continuous-plot (lambda (x) (* x x)) "
+		"(list -1 1)) \"" + path + "\")");
+	REQUIRE(result == Expression());
+
+	std::ifstream in(path);
+	std::stringstream svg;
+	svg << in.rdbuf();
+	REQUIRE(countOf(svg.str(), "<svg") == 1);
+	REQUIRE(countOf(svg.str(), "<text") == 4);
+	in.close();
+	std::remove(path.c_str());
+
+	std::vector<std::string> programs = {
+		"(save-plot (discrete-plot (list (list 0 0) (list 1 1))) \"plot.bmp\")",
+		"(save-plot (discrete-plot (list (list 0 0) (list 1 1))) \"/no/such/dir/plot.svg\")",
+		"(save-plot (list 1 2) \"plot.svg\")",
+		"(save-plot (discrete-plot (list (list 0 0) (list 1 1))) plot)",
+		"(save-plot (list))",
+		"(define save-plot 1)"
+	};
+
+	for (auto program : programs) {
+		INFO(program);
+		std::istringstream iss(program);
+		Interpreter interp;
+		REQUIRE(interp.parseStream(iss));
+		REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+	}
+}
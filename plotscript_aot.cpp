@@ -0,0 +1,338 @@
+// Build tool that translates the lambdas defined in a plotscript library into C++ functions,
+// which are added to an Environment as native procedures (see add_plotscript_library in
+// CMakeLists.txt)
+//
+// usage: plotscript_aot <library.pls> <name> <output directory>
+//
+// The library is evaluated like a startup file. Every lambda it defines becomes a function and
+// every number it defines becomes a constant. Lambda bodies may use their arguments, literals,
+// the library's constants and lambdas, built-in constants, built-in procedures and the list
+// special form. Free symbols are bound when the library is translated, not when it is called.
+// Anything else is reported as an error so the library is never silently interpreted
+
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "startup_image.hpp"
+#include "cpp_codegen.hpp"
+
+// Thrown when a library uses a construct the translator does not support
+class TranslationError {
+public:
+	explicit TranslationError(const std::string& message): m_message(message) {}
+
+	const std::string& what() const {
+		return m_message;
+	}
+
+private:
+	std::string m_message;
+};
+
+class Translator {
+public:
+	explicit Translator(const Environment& library): m_library(library) {
+		for (auto& sym : library.get_symbols()) {
+			const Expression& exp = library.get_exp_ref(Atom(sym));
+			if (exp.isHeadLambdaRoot()) {
+				std::string name = "pls_" + std::to_string(m_functions.size()) + "_" + cppIdentifier(sym);
+				m_functions[sym] = name;
+			} else if ((exp.isHeadNumber() || exp.isHeadComplex()) &&
+				exp.tailConstBegin() == exp.tailConstEnd()) {
+				m_constants[sym] = exp.head();
+			} else {
+				throw TranslationError("definition of " + sym + " is not a lambda or a number");
+			}
+		}
+	}
+
+	// Write the translated library, the generated functions use helpers named after the built-in
+	// procedures they call, so the bodies are translated before the helpers are written
+	void write(std::ostream& out, const std::string& header, const std::string& registerName) {
+		std::ostringstream bodies;
+		for (auto& sym : m_library.get_symbols()) {
+			auto fn = m_functions.find(sym);
+			if (fn != m_functions.end()) {
+				writeFunction(bodies, sym, fn->second);
+			}
+		}
+
+		out << "#include \"" << header << "\"\n\n";
+		out << "#include <initializer_list>\n";
+		out << "#include <limits>\n\n";
+		out << "#include \"semantic_error.hpp\"\n\n";
+		writeHelpers(out);
+
+		for (auto& fn : m_functions) {
+			out << "static Expression " << fn.second << "(Arguments args);\n";
+		}
+
+		out << bodies.str();
+		out << "\nvoid " << registerName << "(Environment& env) {\n";
+		for (auto& sym : m_library.get_symbols()) {
+			auto fn = m_functions.find(sym);
+			if (fn != m_functions.end()) {
+				out << "\tenv.add_proc(" << cppAtom(Atom(sym)) << ", " << fn->second << ");\n";
+			} else {
+				out << "\tenv.add_exp(" << cppAtom(Atom(sym)) << ", Expression(" <<
+					cppAtom(m_constants[sym]) << "));\n";
+			}
+		}
+		out << "}\n";
+	}
+
+private:
+	const Environment& m_library;
+	Environment m_builtins;
+
+	// generated function names for the library's lambdas and the values of its constants
+	std::map<std::string, std::string> m_functions;
+	std::map<std::string, Atom> m_constants;
+
+	// built-in procedures called by the generated functions, and if any procedure is called
+	std::set<std::string> m_usedBuiltins;
+	bool m_callsProcedures = false;
+
+	// the lambda being translated and its parameters
+	std::string m_current;
+	std::vector<std::string> m_params;
+
+	// the statements of the function being written, each binding the result of one call to a
+	// local, and the number of locals
+	std::ostringstream m_statements;
+	std::size_t m_locals = 0;
+
+	void writeFunction(std::ostream& out, const std::string& sym, const std::string& name) {
+		const Expression& lambda = m_library.get_exp_ref(Atom(sym));
+		const Expression& params = *lambda.tailConstBegin();
+		const Expression& body = *std::prev(lambda.tailConstEnd());
+
+		m_current = sym;
+		m_params.clear();
+		for (auto it = params.tailConstBegin(); it != params.tailConstEnd(); it++) {
+			m_params.push_back(it->head().asSymbol());
+		}
+
+		out << "\n// " << sym << "\n";
+		out << "static Expression " << name << "(Arguments args) {\n";
+		out << "\tif (args.size() != " << m_params.size() << ") {\n";
+		out << "\t\tthrow SemanticError(\"Error during evaluation: incorrect number of arguments to \"\n";
+		out << "\t\t\t\"lambda function\");\n";
+		out << "\t}\n\n";
+
+		// a built-in procedure may force a lazy map, calling a lambda that grows the argument stack
+		// args points into, so the parameters are copied out of it first
+		for (std::size_t i = 0; i < m_params.size(); i++) {
+			out << "\tExpression p" << i << " = args[" << i << "];\n";
+		}
+
+		m_statements.str(std::string());
+		m_locals = 0;
+		std::string result = translate(body);
+		out << m_statements.str();
+		out << "\treturn " << result << ";\n";
+		out << "}\n";
+	}
+
+	// Bind value to a new local of the function being written and return its name. C++ leaves the
+	// order in which function arguments are evaluated unspecified, so every call is made in a
+	// statement of its own, in the order the interpreter evaluates them
+	std::string bind(const std::string& value) {
+		std::string name = "v" + std::to_string(m_locals++);
+		m_statements << "\tExpression " << name << " = " << value << ";\n";
+		return name;
+	}
+
+	// Return a C++ expression evaluating exp to an Expression. The calls exp makes are written to
+	// m_statements
+	std::string translate(const Expression& exp) {
+		const Atom& head = exp.head();
+		if (exp.tailConstBegin() == exp.tailConstEnd() && !exp.isHeadListRoot()) {
+			return translateTerminal(head);
+		}
+
+		std::vector<std::string> args;
+		for (auto it = exp.tailConstBegin(); it != exp.tailConstEnd(); it++) {
+			args.push_back(translate(*it));
+		}
+
+		if (exp.isHeadListRoot()) {
+			return bind("Expression(std::vector<Expression>{" + join(args) + "})");
+		}
+
+		std::string op = head.asSymbol();
+		m_callsProcedures = true;
+		auto fn = m_functions.find(op);
+		if (fn != m_functions.end() && !isParam(op)) {
+			return bind("call(" + fn->second + ", {" + join(args) + "})");
+		} else if (!isParam(op) && m_builtins.is_proc(head)) {
+			m_usedBuiltins.insert(op);
+			if ((op == "+" || op == "*") && args.size() == 2) {
+				return bind((op == "+" ? "add2(" : "mul2(") + join(args) + ")");
+			} else if (op == "-" && args.size() == 2) {
+				return bind("sub2(" + join(args) + ")");
+			}
+
+			return bind("call(" + builtinName(op) + "(), {" + join(args) + "})");
+		}
+
+		throw TranslationError("unsupported call to " + op + " in " + m_current);
+	}
+
+	std::string translateTerminal(const Atom& head) {
+		if (head.isNumber() || head.isComplex() || head.isStringLiteral()) {
+			return "Expression(" + cppAtom(head) + ")";
+		}
+
+		std::string sym = head.asSymbol();
+		for (std::size_t i = 0; i < m_params.size(); i++) {
+			if (m_params[i] == sym) {
+				return "p" + std::to_string(i);
+			}
+		}
+
+		auto constant = m_constants.find(sym);
+		if (constant != m_constants.end()) {
+			return "Expression(" + cppAtom(constant->second) + ")";
+		}
+
+		const Expression* builtin = m_builtins.find_exp(head);
+		if (builtin != nullptr) {
+			return "Expression(" + cppAtom(builtin->head()) + ")";
+		}
+
+		throw TranslationError("unsupported use of symbol " + sym + " in " + m_current);
+	}
+
+	bool isParam(const std::string& sym) const {
+		for (auto& param : m_params) {
+			if (param == sym) {
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	std::string builtinName(const std::string& op) const {
+		static const std::map<std::string, std::string> operators = {
+			{"+", "add"}, {"-", "subneg"}, {"*", "mul"}, {"/", "div"}, {"^", "pow"}
+		};
+
+		auto it = operators.find(op);
+		return "builtin_" + (it != operators.end() ? it->second : cppIdentifier(op));
+	}
+
+	static std::string join(const std::vector<std::string>& items) {
+		std::string result;
+		for (auto& item : items) {
+			result += (result.empty() ? "" : ", ") + item;
+		}
+
+		return result;
+	}
+
+	// Built-in procedures are looked up once, on first use. Binary +, - and * on real numbers are
+	// computed inline and fall back to the built-in procedure for anything else
+	void writeHelpers(std::ostream& out) {
+		if (!m_callsProcedures) {
+			return;
+		}
+
+		out << "static Expression call(Procedure proc, std::initializer_list<Expression> args) {\n";
+		out << "\treturn proc(Arguments(args.begin(), args.size()));\n";
+		out << "}\n";
+
+		for (auto& op : m_usedBuiltins) {
+			out << "\nstatic Procedure " << builtinName(op) << "() {\n";
+			out << "\tstatic const Procedure proc = Environment().get_proc(" << cppAtom(Atom(op)) <<
+				");\n";
+			out << "\treturn proc;\n";
+			out << "}\n";
+		}
+
+		static const std::map<std::string, std::pair<std::string, std::string>> inlined = {
+			{"+", {"add2", "+"}}, {"-", {"sub2", "-"}}, {"*", {"mul2", "*"}}
+		};
+
+		for (auto& op : inlined) {
+			if (m_usedBuiltins.count(op.first) == 0) {
+				continue;
+			}
+
+			out << "\nstatic Expression " << op.second.first <<
+				"(const Expression& a, const Expression& b) {\n";
+			out << "\tif (a.isHeadNumber() && b.isHeadNumber()) {\n";
+			out << "\t\treturn Expression(a.head().asNumber() " << op.second.second <<
+				" b.head().asNumber());\n";
+			out << "\t}\n\n";
+			out << "\treturn call(" << builtinName(op.first) << "(), {a, b});\n";
+			out << "}\n";
+		}
+
+		out << "\n";
+	}
+};
+
+int main(int argc, char* argv[]) {
+	if (argc != 4) {
+		std::cerr << "usage: plotscript_aot <library.pls> <name> <output directory>" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::string source = argv[1];
+	std::string name = cppIdentifier(argv[2]);
+	std::string header = name + ".hpp";
+	std::string registerName = "register_" + name;
+
+	Environment library;
+	std::string error;
+	evaluateStartupFile(library, source, error);
+	if (!error.empty()) {
+		std::cerr << source << ": " << error << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::ostringstream cpp;
+	cpp << "// Generated by plotscript_aot from " << source << ". Do not edit.\n\n";
+	try {
+		Translator(library).write(cpp, header, registerName);
+	} catch (const TranslationError& ex) {
+		std::cerr << source << ": " << ex.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::string guard = name + "_HPP";
+	for (auto& c : guard) {
+		c = std::toupper(static_cast<unsigned char>(c));
+	}
+
+	std::ostringstream hpp;
+	hpp << "// Generated by plotscript_aot from " << source << ". Do not edit.\n";
+	hpp << "#ifndef " << guard << "\n";
+	hpp << "#define " << guard << "\n\n";
+	hpp << "#include \"environment.hpp\"\n\n";
+	hpp << "// Add the procedures and constants defined in " << source << " to env\n";
+	hpp << "void " << registerName << "(Environment& env);\n\n";
+	hpp << "#endif\n";
+
+	std::string directory = argv[3];
+	std::ofstream cppFile(directory + "/" + name + ".cpp");
+	std::ofstream hppFile(directory + "/" + header);
+	cppFile << cpp.str();
+	hppFile << hpp.str();
+	if (!cppFile || !hppFile) {
+		std::cerr << "Error: could not write to " << directory << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,79 @@
+#include "promise.hpp"
+
+#include <chrono>
+
+#include "environment.hpp"
+#include "interrupt_flag.hpp"
+#include "semantic_error.hpp"
+#include "thread_pool.hpp"
+
+Promise::Promise(const Expression& exp, std::shared_ptr<const Environment> env):
+	m_state(Delayed), m_exp(exp), m_env(env) {}
+
+Expression Promise::force() const {
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		if (m_state == Forcing && m_forcer == std::this_thread::get_id()) {
+
+			// waiting would never end, the value is computed by this very thread
+			throw SemanticError("Error during evaluation: promise forced recursively");
+		}
+
+		while (m_state == Forcing) {
+
+			// another thread is computing the value, wait for it but stay interruptible
+			m_done.wait_for(lock, std::chrono::milliseconds(1));
+			if (interrupt_flag.load() || ThreadPool::isCancelled()) {
+				if (interrupt_flag.exchange(false)) {
+					ThreadPool::cancelCurrent();
+				}
+				throw SemanticError("Error: interpreter kernel interrupted");
+			}
+		}
+
+		if (m_state == Forced) {
+			return m_value;
+		}
+
+		m_state = Forcing;
+		m_forcer = std::this_thread::get_id();
+	}
+
+	// only this thread touches the expression while Forcing. The environment was copied before
+	// the promise existed, so evaluating cannot force the promise itself
+	Expression value;
+	try {
+		Environment scope = Environment::makeScope(*m_env);
+		value = forcePromise(m_exp.eval(scope));
+	} catch (...) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_state = Delayed;
+		m_done.notify_all();
+		throw;
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_value = value;
+	m_state = Forced;
+	m_exp = Expression();
+	m_env.reset();
+	m_done.notify_all();
+	return value;
+}
+
+bool Promise::isForced() const {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_state == Forced;
+}
+
+Expression makePromise(const Expression& exp, const Environment& env) {
+	return Expression::fromPromise(std::make_shared<Promise>(exp, env.freeze()));
+}
+
+Expression forcePromise(const Expression& exp) {
+	if (exp.isHeadPromise()) {
+		return exp.promise()->force();
+	}
+
+	return exp;
+}
@@ -0,0 +1,73 @@
+/*! \file promise.hpp
+Memoised thunks.
+
+(delay exp) returns a promise holding exp unevaluated, with a copy of the
+environment as it is when delayed. (force p) evaluates exp the first time and
+returns the stored value from then on, so the work is done at most once and
+only if the value is needed. get-property and the plot options force the
+promises they read, so a property or option may be given a delayed value that
+is only computed if it is used.
+ */
+#ifndef PROMISE_HPP
+#define PROMISE_HPP
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "expression.hpp"
+
+/*! \class Promise
+\brief A delayed expression and, once forced, its value. Shared by the Expressions holding it.
+
+A promise may be forced from several threads, the expression is evaluated by the first one and
+the others wait for its value.
+ */
+class Promise {
+public:
+	/*! Construct a promise of the value of an expression.
+		\param exp the expression to evaluate when forced
+		\param env the environment to evaluate it in
+	 */
+	Promise(const Expression& exp, std::shared_ptr<const Environment> env);
+
+	/*! Return the value of the expression, evaluating it on the first call. A value that is
+		itself a promise is forced too. If evaluating throws the promise stays unforced, so the
+		next call evaluates the expression again.
+		\return the value
+		\throws SemanticError when evaluating fails, on an interrupt or if the thread evaluating
+		the expression forces the promise again
+	 */
+	Expression force() const;
+
+	/// return true if the value has been computed
+	bool isForced() const;
+
+private:
+	enum State {Delayed, Forcing, Forced};
+
+	mutable std::mutex m_mutex;
+	mutable std::condition_variable m_done;
+	mutable State m_state;
+
+	// the thread evaluating the expression while Forcing
+	mutable std::thread::id m_forcer;
+
+	// the expression and its environment, released once forced
+	mutable Expression m_exp;
+	mutable std::shared_ptr<const Environment> m_env;
+
+	mutable Expression m_value;
+};
+
+/// return a promise of the value of exp in a copy of env
+Expression makePromise(const Expression& exp, const Environment& env);
+
+/*! Force a promise.
+	\param exp any expression
+	\return the value of exp if it is a promise, otherwise exp
+ */
+Expression forcePromise(const Expression& exp);
+
+#endif
@@ -0,0 +1,121 @@
+#include "catch.hpp"
+
+#include <atomic>
+#include <sstream>
+#include <string>
+
+#include "environment.hpp"
+#include "interpreter.hpp"
+#include "parse.hpp"
+#include "promise.hpp"
+#include "semantic_error.hpp"
+#include "thread_pool.hpp"
+
+Expression runPromiseProgram(const std::string& program) {
+	std::istringstream iss(program);
+	Interpreter interp;
+	REQUIRE(interp.parseStream(iss));
+	return interp.evaluate();
+}
+
+std::atomic<int> promiseCalls(0);
+
+Expression countedSquare(Arguments args) {
+	promiseCalls.fetch_add(1);
+	return Expression(args[0].head().asNumber() * args[0].head().asNumber());
+}
+
+TEST_CASE("Test delay and force", "[promise]") {
+	REQUIRE(runPromiseProgram("(force (delay (+ 1 2)))") == Expression(3.));
+
+	// the delayed expression is not evaluated unless forced
+	REQUIRE(runPromiseProgram("(begin (define p (delay (undefined 1))) 1)") == Expression(1.));
+
+	// forcing anything else returns it
+	REQUIRE(runPromiseProgram("(force 5)") == Expression(5.));
+
+	// the environment is the one the promise was made in
+	REQUIRE(runPromiseProgram("(begin (define f (lambda (a) (delay a))) (define a 2) "
+		"(force (f 1)))") == Expression(1.));
+
+	// a promise of a promise forces both
+	REQUIRE(runPromiseProgram("(force (delay (delay 7)))") == Expression(7.));
+
+	REQUIRE_THROWS_AS(runPromiseProgram("(delay)"), SemanticError);
+	REQUIRE_THROWS_AS(runPromiseProgram("(force 1 2)"), SemanticError);
+	REQUIRE_THROWS_AS(runPromiseProgram("(define force 1)"), SemanticError);
+	REQUIRE_THROWS_AS(runPromiseProgram("(force (delay (undefined 1)))"), SemanticError);
+}
+
+TEST_CASE("Test promises are memoised", "[promise]") {
+	Environment env;
+	env.add_proc(Atom("counted-square"), countedSquare);
+
+	std::istringstream iss("(counted-square 3)");
+	Expression exp = parse(tokenize(iss));
+
+	promiseCalls.store(0);
+	Expression promise = makePromise(exp, env);
+	REQUIRE(promise.isHeadPromise());
+	REQUIRE(!promise.promise()->isForced());
+	REQUIRE(promiseCalls.load() == 0);
+
+	// copies share the value, and forcing from many threads computes it once
+	Expression copy = promise;
+	std::atomic<int> correct(0);
+	ThreadPool::shared().parallelFor(64, 1, [&copy, &correct](std::size_t, std::size_t) {
+		if (forcePromise(copy) == Expression(9.)) {
+			correct.fetch_add(1);
+		}
+	});
+
+	REQUIRE(correct.load() == 64);
+	REQUIRE(forcePromise(promise) == Expression(9.));
+	REQUIRE(promise.promise()->isForced());
+	REQUIRE(promiseCalls.load() == 1);
+
+	REQUIRE(promise == copy);
+	REQUIRE(promise != makePromise(exp, env));
+}
+
+Expression selfPromise;
+
+Expression forceSelf(Arguments) {
+	return forcePromise(selfPromise);
+}
+
+TEST_CASE("Test forcing a promise from parallel work", "[promise]") {
+
+	// the thread forcing p waits for its own parallel map, never for a task of the outer one,
+	// which would force p again
+	REQUIRE(runPromiseProgram("(begin (define xs (sort (range 0 3000 1))) "
+		"(define p (delay (map (lambda (x) (list x x)) xs))) "
+		"(define r (map (lambda (i) (first (first (force p)))) xs)) (length r))") ==
+		Expression(3001.));
+
+	INFO("a promise forced by its own expression is an error, not a deadlock");
+	Environment env;
+	env.add_proc(Atom("force-self"), forceSelf);
+	std::istringstream iss("(force-self 1)");
+	selfPromise = makePromise(parse(tokenize(iss)), env);
+	REQUIRE_THROWS_WITH(forcePromise(selfPromise),
+		"Error during evaluation: promise forced recursively");
+	selfPromise = Expression();
+}
+
+TEST_CASE("Test delayed property values", "[promise]") {
+	Expression result = runPromiseProgram(
+		"(get-property \"label\" (set-property \"label\" (delay (+ 1 2)) (list)))");
+	REQUIRE(result == Expression(3.));
+
+	// only the options a plot uses are forced
+	result = runPromiseProgram("(discrete-plot (list (list 0 0) (list 1 1)) "
+		"(list (list \"title\" (delay \"Title\")) (list \"unused\" (delay (undefined 1)))))");
+	REQUIRE(result.isHeadListRoot());
+
+	bool titled = false;
+	for (auto it = result.tailConstBegin(); it != result.tailConstEnd(); it++) {
+		titled = titled || *it == Expression(Atom("\"Title\""));
+	}
+	REQUIRE(titled);
+}
@@ -0,0 +1,282 @@
+#include "sequence.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <vector>
+
+#include "interrupt_flag.hpp"
+#include "semantic_error.hpp"
+#include "thread_pool.hpp"
+
+// Elements produced between two checks for an interrupt
+const std::size_t INTERRUPT_INTERVAL = 4096;
+
+bool SequenceCursor::next(Expression& value) {
+	if (++m_count % INTERRUPT_INTERVAL == 0 &&
+		(interrupt_flag.load() || ThreadPool::isCancelled())) {
+		if (interrupt_flag.exchange(false)) {
+			ThreadPool::cancelCurrent();
+		}
+		throw SemanticError("Error: interpreter kernel interrupted");
+	}
+
+	return advance(value);
+}
+
+Expression Sequence::toList() const {
+	std::vector<Expression> elements;
+	std::unique_ptr<SequenceCursor> elementsCursor = cursor();
+	Expression value;
+	while (elementsCursor->next(value)) {
+		elements.push_back(value);
+	}
+
+	return Expression(elements);
+}
+
+std::size_t Sequence::length() const {
+	std::unique_ptr<SequenceCursor> elementsCursor = cursor();
+	Expression value;
+	std::size_t count = 0;
+	while (elementsCursor->next(value)) {
+		count++;
+	}
+
+	return count;
+}
+
+class ListCursor: public SequenceCursor {
+public:
+	explicit ListCursor(const Expression& list): m_list(list), m_it(m_list.tailConstBegin()) {}
+
+protected:
+	bool advance(Expression& value) {
+		if (m_it == m_list.tailConstEnd()) {
+			return false;
+		}
+
+		value = *m_it++;
+		return true;
+	}
+
+private:
+
+	// the copy shares the tail of the list, which keeps the iterator valid
+	Expression m_list;
+	Expression::ConstIteratorType m_it;
+};
+
+// The numbers are accumulated like range always did, so the elements are the same as those of
+// the list it used to return
+class RangeSequence: public Sequence {
+public:
+	RangeSequence(double begin, double end, double step): m_begin(begin), m_end(end), m_step(step) {}
+
+	std::unique_ptr<SequenceCursor> cursor() const {
+		return std::unique_ptr<SequenceCursor>(new Cursor(*this));
+	}
+
+private:
+	double m_begin, m_end, m_step;
+
+	class Cursor: public SequenceCursor {
+	public:
+		explicit Cursor(const RangeSequence& range):
+			m_next(range.m_begin), m_end(range.m_end), m_step(range.m_step) {}
+
+	protected:
+		bool advance(Expression& value) {
+			if (m_next > m_end) {
+				return false;
+			}
+
+			value = Expression(m_next);
+			m_next = m_next + m_step;
+			return true;
+		}
+
+	private:
+		double m_next, m_end, m_step;
+	};
+};
+
+class TakeSequence: public Sequence {
+public:
+	TakeSequence(const Expression& source, std::size_t count): m_source(source), m_count(count) {}
+
+	std::unique_ptr<SequenceCursor> cursor() const {
+		return std::unique_ptr<SequenceCursor>(new Cursor(*this));
+	}
+
+	const Expression& source() const {
+		return m_source;
+	}
+
+	std::size_t count() const {
+		return m_count;
+	}
+
+	std::size_t length() const {
+		return std::min(m_count, elementCount(m_source));
+	}
+
+private:
+	Expression m_source;
+	std::size_t m_count;
+
+	class Cursor: public SequenceCursor {
+	public:
+		explicit Cursor(const TakeSequence& take):
+			m_source(elementCursor(take.m_source)), m_remaining(take.m_count) {}
+
+	protected:
+		bool advance(Expression& value) {
+			if (m_remaining == 0 || !m_source->next(value)) {
+				return false;
+			}
+
+			m_remaining--;
+			return true;
+		}
+
+	private:
+		std::unique_ptr<SequenceCursor> m_source;
+		std::size_t m_remaining;
+	};
+};
+
+class DropSequence: public Sequence {
+public:
+	DropSequence(const Expression& source, std::size_t count): m_source(source), m_count(count) {}
+
+	std::unique_ptr<SequenceCursor> cursor() const {
+		return std::unique_ptr<SequenceCursor>(new Cursor(*this));
+	}
+
+	const Expression& source() const {
+		return m_source;
+	}
+
+	std::size_t count() const {
+		return m_count;
+	}
+
+	std::size_t length() const {
+		std::size_t sourceLength = elementCount(m_source);
+		return sourceLength > m_count ? sourceLength - m_count : 0;
+	}
+
+private:
+	Expression m_source;
+	std::size_t m_count;
+
+	class Cursor: public SequenceCursor {
+	public:
+		explicit Cursor(const DropSequence& drop):
+			m_source(elementCursor(drop.m_source)), m_skip(drop.m_count) {}
+
+	protected:
+		bool advance(Expression& value) {
+			for (; m_skip > 0; m_skip--) {
+				if (!m_source->next(value)) {
+					return false;
+				}
+			}
+
+			return m_source->next(value);
+		}
+
+	private:
+		std::unique_ptr<SequenceCursor> m_source;
+		std::size_t m_skip;
+	};
+};
+
+class JoinSequence: public Sequence {
+public:
+	JoinSequence(const Expression& first, const Expression& second):
+		m_first(first), m_second(second) {}
+
+	std::unique_ptr<SequenceCursor> cursor() const {
+		return std::unique_ptr<SequenceCursor>(new Cursor(*this));
+	}
+
+	std::size_t length() const {
+		return elementCount(m_first) + elementCount(m_second);
+	}
+
+private:
+	Expression m_first, m_second;
+
+	class Cursor: public SequenceCursor {
+	public:
+		explicit Cursor(const JoinSequence& join):
+			m_second(join.m_second), m_current(elementCursor(join.m_first)), m_inSecond(false) {}
+
+	protected:
+		bool advance(Expression& value) {
+			if (m_current->next(value)) {
+				return true;
+			} else if (m_inSecond) {
+				return false;
+			}
+
+			m_inSecond = true;
+			m_current = elementCursor(m_second);
+			return m_current->next(value);
+		}
+
+	private:
+		Expression m_second;
+		std::unique_ptr<SequenceCursor> m_current;
+		bool m_inSecond;
+	};
+};
+
+Expression forceSequence(const Expression& exp) {
+	return exp.isHeadSequence() ? exp.sequence()->toList() : exp;
+}
+
+std::unique_ptr<SequenceCursor> elementCursor(const Expression& exp) {
+	if (exp.isHeadSequence()) {
+		return exp.sequence()->cursor();
+	}
+
+	return std::unique_ptr<SequenceCursor>(new ListCursor(exp));
+}
+
+std::size_t elementCount(const Expression& exp) {
+	if (exp.isHeadSequence()) {
+		return exp.sequence()->length();
+	}
+
+	return std::distance(exp.tailConstBegin(), exp.tailConstEnd());
+}
+
+Expression makeRange(double begin, double end, double step) {
+	return Expression::fromSequence(std::make_shared<RangeSequence>(begin, end, step));
+}
+
+// Takes of takes and drops of drops are merged, so e.g. a loop calling rest does not build a
+// chain of sequences that grows with every call
+Expression makeTake(const Expression& exp, std::size_t count) {
+	const TakeSequence* take = dynamic_cast<const TakeSequence*>(exp.sequence());
+	if (take != nullptr) {
+		return makeTake(take->source(), std::min(count, take->count()));
+	}
+
+	return Expression::fromSequence(std::make_shared<TakeSequence>(exp, count));
+}
+
+Expression makeDrop(const Expression& exp, std::size_t count) {
+	const DropSequence* drop = dynamic_cast<const DropSequence*>(exp.sequence());
+	if (drop != nullptr) {
+		return makeDrop(drop->source(), drop->count() + count);
+	}
+
+	return Expression::fromSequence(std::make_shared<DropSequence>(exp, count));
+}
+
+Expression makeJoin(const Expression& first, const Expression& second) {
+	return Expression::fromSequence(std::make_shared<JoinSequence>(first, second));
+}
@@ -0,0 +1,93 @@
+/*! \file sequence.hpp
+Lazy sequences.
+
+range returns a lazy sequence instead of a list, and rest, join, take, drop,
+map and filter return one when given one. The elements of a sequence are produced one at a
+time by a cursor when a consumer reads them, so first, length and pipelines
+ending in take run in constant memory however long the sequence is.
+
+A sequence is forced into a list when something needs the elements stored:
+lists and properties never hold sequences, the result of a program is forced
+before it is shown (except a plot the notebook draws, see plot_data.hpp), and
+procedures that only take lists (append, apply, the plots, sort) force their
+arguments. Definitions and lambda arguments keep the sequence lazy, and a map
+remembers the first elements it produced, so reading a defined map again does
+not call its procedure again.
+ */
+#ifndef SEQUENCE_HPP
+#define SEQUENCE_HPP
+
+#include <cstddef>
+#include <memory>
+
+#include "expression.hpp"
+
+/*! \class SequenceCursor
+\brief Produces the elements of a sequence in order.
+
+A cursor keeps what it reads alive, it may outlive the Expression it was made from.
+ */
+class SequenceCursor {
+public:
+	SequenceCursor(): m_count(0) {}
+	virtual ~SequenceCursor() {}
+
+	/*! Produce the next element. Checks for an interrupt every so often, so a
+		consumer reading a long sequence can be stopped.
+		\param value set to the element
+		\return false if there are no more elements
+		\throws SemanticError when producing the element fails or on an interrupt
+	 */
+	bool next(Expression& value);
+
+protected:
+
+	// produce the next element, return false at the end
+	virtual bool advance(Expression& value) = 0;
+
+private:
+	std::size_t m_count;
+};
+
+/*! \class Sequence
+\brief An immutable lazy sequence of Expressions, shared by the Expressions holding it.
+ */
+class Sequence {
+public:
+	virtual ~Sequence() {}
+
+	/// return a cursor at the first element
+	virtual std::unique_ptr<SequenceCursor> cursor() const = 0;
+
+	/// return the elements as a list, by default read through a cursor
+	virtual Expression toList() const;
+
+	/// return the number of elements, by default counted through a cursor
+	virtual std::size_t length() const;
+};
+
+/*! Force a sequence into a list.
+	\param exp any expression
+	\return the elements of exp as a list if it is a sequence, otherwise exp
+ */
+Expression forceSequence(const Expression& exp);
+
+/// return a cursor over the elements of a list or a sequence
+std::unique_ptr<SequenceCursor> elementCursor(const Expression& exp);
+
+/// return the number of elements of a list or a sequence
+std::size_t elementCount(const Expression& exp);
+
+/// return the sequence of numbers from begin to end (inclusive) in steps of step
+Expression makeRange(double begin, double end, double step);
+
+/// return the sequence of the first count elements of a list or sequence
+Expression makeTake(const Expression& exp, std::size_t count);
+
+/// return the sequence of the elements of a list or sequence after the first count
+Expression makeDrop(const Expression& exp, std::size_t count);
+
+/// return the sequence of the elements of first followed by those of second, lists or sequences
+Expression makeJoin(const Expression& first, const Expression& second);
+
+#endif
@@ -0,0 +1,213 @@
+#include "catch.hpp"
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "environment.hpp"
+#include "interpreter.hpp"
+#include "interrupt_flag.hpp"
+#include "parse.hpp"
+#include "semantic_error.hpp"
+#include "sequence.hpp"
+
+Expression runSequenceProgram(Interpreter& interp, const std::string& program) {
+	std::istringstream iss(program);
+	REQUIRE(interp.parseStream(iss));
+	return interp.evaluate();
+}
+
+Expression runSequenceProgram(const std::string& program) {
+	Interpreter interp;
+	return runSequenceProgram(interp, program);
+}
+
+TEST_CASE("Test lazy ranges", "[sequence]") {
+	Expression result = runSequenceProgram("(first (range 0 1e12 1))");
+	REQUIRE(result == Expression(0.));
+
+	result = runSequenceProgram("(length (range 0 1e6 1))");
+	REQUIRE(result == Expression(1000001.));
+
+	// the elements are accumulated like the eager range did
+	std::vector<Expression> expected;
+	for (double i = -1; i <= 1; i = i + 0.1) {
+		expected.push_back(Expression(i));
+	}
+
+	result = runSequenceProgram("(range -1 1 0.1)");
+	REQUIRE(result.isHeadListRoot());
+	REQUIRE(result == Expression(expected));
+}
+
+TEST_CASE("Test sequence pipelines", "[sequence]") {
+	Expression result = runSequenceProgram(
+		"(take (map (lambda (x) (* x x)) (drop (range 0 1e12 1) 10)) 3)");
+	REQUIRE(result == runSequenceProgram("(list 100 121 144)"));
+
+	result = runSequenceProgram("(rest (rest (range 0 3 1)))");
+	REQUIRE(result == runSequenceProgram("(list 2 3)"));
+
+	result = runSequenceProgram("(join (take (range 0 10 1) 2) (list 7))");
+	REQUIRE(result == runSequenceProgram("(list 0 1 7)"));
+
+	result = runSequenceProgram("(first (join (take (range 0 1 1) 0) (map sqrt (range 4 1e12 1))))");
+	REQUIRE(result == Expression(2.));
+
+	result = runSequenceProgram("(map - (range 0 2 1))");
+	REQUIRE(result == runSequenceProgram("(list 0 -1 -2)"));
+
+	REQUIRE_THROWS_AS(runSequenceProgram("(rest (take (range 0 3 1) 0))"), SemanticError);
+	REQUIRE_THROWS_AS(runSequenceProgram("(first (drop (range 0 3 1) 4))"), SemanticError);
+}
+
+TEST_CASE("Test take and drop", "[sequence]") {
+	REQUIRE(runSequenceProgram("(take (list 1 2 3) 2)") == runSequenceProgram("(list 1 2)"));
+	REQUIRE(runSequenceProgram("(take (list 1 2 3) 5)") == runSequenceProgram("(list 1 2 3)"));
+	REQUIRE(runSequenceProgram("(drop (list 1 2 3) 2)") == runSequenceProgram("(list 3)"));
+	REQUIRE(runSequenceProgram("(drop (list 1 2 3) 5)") == runSequenceProgram("(list)"));
+
+	std::vector<std::string> errors = {
+		"(take (list 1 2) -1)",
+		"(take (list 1 2) 1.5)",
+		"(take 1 (list 1 2))",
+		"(drop (list 1 2))",
+		"(drop (range 0 2 1) I)"
+	};
+
+	for (auto& program : errors) {
+		INFO(program);
+		REQUIRE_THROWS_AS(runSequenceProgram(program), SemanticError);
+	}
+}
+
+TEST_CASE("Test forcing sequences", "[sequence]") {
+
+	// lists and properties never hold sequences
+	Expression result = runSequenceProgram("(list (range 0 2 1))");
+	REQUIRE(result == runSequenceProgram("(list (list 0 1 2))"));
+	REQUIRE((*result.tailConstBegin()).isHeadListRoot());
+
+	result = runSequenceProgram("(get-property \"key\" (set-property \"key\" (range 0 1 1) 1))");
+	REQUIRE(result.isHeadListRoot());
+
+	result = runSequenceProgram("(map (lambda (x) (range 0 x 1)) (list 1 2))");
+	REQUIRE(result == runSequenceProgram("(list (list 0 1) (list 0 1 2))"));
+
+	// procedures that need a list get one
+	REQUIRE(runSequenceProgram("(apply + (range 1 4 1))") == Expression(10.));
+	REQUIRE(runSequenceProgram("(append (range 0 1 1) 5)") == runSequenceProgram("(list 0 1 5)"));
+
+	// a forced map is evaluated like a map over a list
+	Expression lazy = runSequenceProgram("(map (lambda (x) (* 2 x)) (range 0 100 1))");
+	Expression eager = runSequenceProgram(
+		"(map (lambda (x) (* 2 x)) (first (list (range 0 100 1))))");
+	REQUIRE(lazy == eager);
+}
+
+TEST_CASE("Test evaluation of lazy maps", "[sequence]") {
+	Interpreter interp;
+
+	// the lambda sees the environment as it was when map was evaluated
+	runSequenceProgram(interp, "(define k 2)");
+	runSequenceProgram(interp, "(define s (map (lambda (x) (* k x)) (range 0 2 1)))");
+	runSequenceProgram(interp, "(define f (lambda (x) (- \"a\")))");
+	REQUIRE(runSequenceProgram(interp, "(s)") == runSequenceProgram("(list 0 2 4)"));
+
+	// errors are raised when the failing element is read, the result of a program is read to
+	// show it
+	REQUIRE(runSequenceProgram(interp, "(begin (define t (map f (range 0 2 1))) 1)") ==
+		Expression(1.));
+	REQUIRE(runSequenceProgram(interp, "(length (rest (range 0 2 1)))") == Expression(2.));
+	REQUIRE_THROWS_AS(runSequenceProgram(interp, "(first t)"), SemanticError);
+	REQUIRE_THROWS_AS(runSequenceProgram(interp, "(t)"), SemanticError);
+}
+
+// The calls of a procedure counting them, mapped by the tests of lazy maps
+std::size_t countedCalls = 0;
+
+Expression counted(Arguments args) {
+	countedCalls++;
+	return args[0];
+}
+
+TEST_CASE("Test lazy maps call their procedure once per element", "[sequence]") {
+	Environment env;
+	env.add_proc(Atom("counted"), counted);
+	auto run = [&env](const std::string& program) {
+		std::istringstream iss(program);
+		Expression exp = parse(tokenize(iss));
+		REQUIRE(exp != Expression());
+		return exp.eval(env);
+	};
+
+	countedCalls = 0;
+	run("(define s (map counted (range 0 999 1)))");
+	REQUIRE(run("(length s)") == Expression(1000.));
+	REQUIRE(run("(length (take s 10))") == Expression(10.));
+	REQUIRE(countedCalls == 0);
+
+	// walking the map with first and rest reads each element once
+	for (std::size_t i = 0; i < 100; i++) {
+		REQUIRE(run("(first s)") == Expression(static_cast<double>(i)));
+		env.add_exp(Atom("s"), run("(rest s)"), true);
+	}
+
+	REQUIRE(countedCalls == 100);
+	REQUIRE(forceSequence(run("(map counted (range 0 9 1))")) == run("(range 0 9 1)"));
+	REQUIRE(countedCalls == 110);
+
+	// forcing the map reuses the elements already read
+	run("(define m (map counted (range 0 99 1)))");
+	REQUIRE(forceSequence(run("(take m 10)")) == run("(range 0 9 1)"));
+	REQUIRE(countedCalls == 120);
+	REQUIRE(forceSequence(env.get_exp(Atom("m"))) == run("(range 0 99 1)"));
+	REQUIRE(countedCalls == 210);
+
+	INFO("a failing element is not remembered, reading it fails again");
+	Interpreter interp;
+	runSequenceProgram(interp, "(define bad (lambda (x) (+ x \"a\")))");
+	REQUIRE(runSequenceProgram(interp, "(begin (define x (map bad (range 0 3 1))) 1)") ==
+		Expression(1.));
+	REQUIRE(runSequenceProgram(interp, "(length x)") == Expression(4.));
+	REQUIRE_THROWS_AS(runSequenceProgram(interp, "(first x)"), SemanticError);
+	REQUIRE_THROWS_AS(runSequenceProgram(interp, "(first x)"), SemanticError);
+}
+
+TEST_CASE("Test sequence cursors", "[sequence]") {
+	Expression range = makeRange(0, 9, 1);
+	REQUIRE(range.isHeadSequence());
+	REQUIRE(!forceSequence(range).isHeadSequence());
+	REQUIRE(forceSequence(Expression(Atom(1))) == Expression(Atom(1)));
+
+	// nested drops read the source once
+	Expression dropped = makeDrop(makeDrop(range, 2), 3);
+	std::unique_ptr<SequenceCursor> cursor = elementCursor(makeTake(dropped, 2));
+	Expression element;
+	REQUIRE(cursor->next(element));
+	REQUIRE(element == Expression(5.));
+	REQUIRE(cursor->next(element));
+	REQUIRE(element == Expression(6.));
+	REQUIRE(!cursor->next(element));
+
+	INFO("reading a long sequence can be interrupted");
+	Procedure length = Environment().get_proc(Atom("length"));
+	Expression longRange = makeRange(0, 1e12, 1);
+	interrupt_flag.store(true);
+	REQUIRE_THROWS_AS(length(Arguments(&longRange, 1)), SemanticError);
+	REQUIRE(!interrupt_flag.load());
+}
+
+TEST_CASE("Test lazy filters", "[sequence]") {
+
+	// only the elements read are tested
+	Expression result = runSequenceProgram("(take (filter (lambda (x) (> x 10)) (range 0 1e12 1)) 3)");
+	REQUIRE(result == runSequenceProgram("(list 11 12 13)"));
+
+	result = runSequenceProgram("(first (filter (lambda (x) (= x 5)) (range 0 1e12 1)))");
+	REQUIRE(result == Expression(5.));
+
+	// forcing a filtered sequence is the same as filtering the list
+	REQUIRE(runSequenceProgram("(filter (lambda (x) (< x 500)) (range 0 999 1))") ==
+		runSequenceProgram("(range 0 499 1)"));
+}
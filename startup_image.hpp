@@ -0,0 +1,30 @@
+/*! \file startup_image.hpp
+Access to the startup definitions compiled into the interpreter library.
+
+The build evaluates startup.pls with startup_image_gen and compiles the resulting
+definitions into C++ (startup_image.cpp in the build directory), so starting an
+interpreter session does not have to read, parse or evaluate the startup file.
+ */
+#ifndef STARTUP_IMAGE_HPP
+#define STARTUP_IMAGE_HPP
+
+#include <string>
+
+#include "environment.hpp"
+
+/*! Add the compiled startup definitions to an environment.
+	\param env the environment to add the definitions to
+	\param error set to the error evaluating the startup file produced at build time, if any.
+	The definitions made before the error are still added, like when evaluating the file
+	\return false if no startup image is available
+ */
+bool loadStartupImage(Environment& env, std::string& error);
+
+/*! Evaluate a startup file into an environment, the way the startup image is produced.
+	\param env the environment to evaluate the file in
+	\param path the startup file
+	\param error set to the error opening, parsing or evaluating the file, if any
+ */
+void evaluateStartupFile(Environment& env, const std::string& path, std::string& error);
+
+#endif
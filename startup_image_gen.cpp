@@ -0,0 +1,120 @@
+// Build tool that evaluates a startup file and writes the resulting definitions as C++ source
+// implementing loadStartupImage (see startup_image.hpp)
+//
+// usage: startup_image_gen <startup.pls> <startup_image.cpp>
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "startup_image.hpp"
+#include "promise.hpp"
+#include "sequence.hpp"
+#include "semantic_error.hpp"
+#include "cpp_codegen.hpp"
+
+// The image holds values, so promises are forced when it is generated and sequences forced into
+// lists
+Expression forceValue(const Expression& exp) {
+	return forceSequence(forcePromise(exp));
+}
+
+// Emit statements that build the tail and properties of exp into the Expression named target,
+// whose head is already set. Children are built in place through Expression::tail, depth first
+class ImageWriter {
+public:
+	explicit ImageWriter(std::ostream& out): m_out(out) {}
+
+	void writeBody(const Expression& exp, const std::string& target, int depth) {
+		std::string indent(depth, '\t');
+
+		for (auto it = exp.tailConstBegin(); it != exp.tailConstEnd(); it++) {
+			Expression item = forceValue(*it);
+			m_out << indent << target << ".append(" << cppAtom(item.head()) << ");\n";
+			if (item.tailConstBegin() != item.tailConstEnd() || !item.getPropertyKeys().empty()) {
+				std::string child = "c" + std::to_string(m_next++);
+				m_out << indent << "{\n";
+				m_out << indent << "\tExpression& " << child << " = *" << target << ".tail();\n";
+				writeBody(item, child, depth + 1);
+				m_out << indent << "}\n";
+			}
+		}
+
+		for (auto& key : exp.getPropertyKeys()) {
+			Expression value = forceValue(exp.getProperty(key));
+			std::string prop = "p" + std::to_string(m_next++);
+			m_out << indent << "{\n";
+			m_out << indent << "\tExpression " << prop << "(" << cppAtom(value.head()) << ");\n";
+			writeBody(value, prop, depth + 1);
+			m_out << indent << "\t" << target << ".setProperty(" << cppString(key) << ", " << prop <<
+				");\n";
+			m_out << indent << "}\n";
+		}
+	}
+
+private:
+	std::ostream& m_out;
+	int m_next = 0;
+};
+
+int main(int argc, char* argv[]) {
+	if (argc != 3) {
+		std::cerr << "usage: startup_image_gen <startup.pls> <startup_image.cpp>" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::ifstream ifs(argv[1]);
+	if (!ifs) {
+		std::cerr << "Error: could not open " << argv[1] << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// Errors evaluating the file are not fatal here, they are compiled into the image and reported
+	// by each session
+	Environment env;
+	std::string error;
+	evaluateStartupFile(env, argv[1], error);
+
+	std::ostringstream out;
+	out << "// Generated by startup_image_gen from " << argv[1] << ". Do not edit.\n\n";
+	out << "#include <limits>\n\n";
+	out << "#include \"startup_image.hpp\"\n\n";
+	out << "bool loadStartupImage(Environment& env, std::string& error) {\n";
+
+	for (auto& sym : env.get_symbols()) {
+		std::ostringstream definition;
+		try {
+			Expression exp = forceValue(env.get_exp_ref(Atom(sym)));
+			definition << "\t{\n";
+			definition << "\t\tExpression exp(" << cppAtom(exp.head()) << ");\n";
+			ImageWriter(definition).writeBody(exp, "exp", 2);
+			definition << "\t\tenv.add_exp(" << cppAtom(Atom(sym)) << ", exp, true);\n";
+			definition << "\t}\n";
+		} catch (const SemanticError& ex) {
+
+			// a definition whose value cannot be computed is left out, like a failed define
+			if (error.empty()) {
+				error = ex.what();
+			}
+
+			continue;
+		}
+
+		out << definition.str();
+	}
+
+	out << "\n\terror = " << cppString(error) << ";\n";
+	out << "\treturn true;\n";
+	out << "}\n";
+
+	std::ofstream ofs(argv[2]);
+	ofs << out.str();
+	if (!ofs) {
+		std::cerr << "Error: could not write " << argv[2] << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,6 @@
+#include "startup_image.hpp"
+
+// Used when building startup_image_gen itself, before there is an image to load
+bool loadStartupImage(Environment&, std::string&) {
+	return false;
+}
@@ -0,0 +1,40 @@
+#include "symbol_map.hpp"
+
+#include <mutex>
+#include <unordered_set>
+#include <unordered_map>
+
+// The intern table is shared by every interpreter thread. Interned strings are never removed, so
+// each thread also keeps a cache of the symbols it has already seen and only takes the lock the
+// first time it meets a name
+std::unordered_set<std::string> internTable;
+std::mutex internMutex;
+thread_local std::unordered_map<std::string, Symbol> internCache;
+
+Symbol internSymbol(const std::string& name) {
+	auto cached = internCache.find(name);
+	if (cached != internCache.end()) {
+		return cached->second;
+	}
+
+	std::lock_guard<std::mutex> lock(internMutex);
+	Symbol sym = &*internTable.insert(name).first;
+	internCache.emplace(name, sym);
+	return sym;
+}
+
+Symbol findSymbol(const std::string& name) {
+	auto cached = internCache.find(name);
+	if (cached != internCache.end()) {
+		return cached->second;
+	}
+
+	std::lock_guard<std::mutex> lock(internMutex);
+	auto it = internTable.find(name);
+	if (it == internTable.end()) {
+		return nullptr;
+	}
+
+	internCache.emplace(name, &*it);
+	return &*it;
+}
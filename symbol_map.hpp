@@ -0,0 +1,60 @@
+#ifndef SYMBOL_MAP_HPP
+#define SYMBOL_MAP_HPP
+// Interned symbols and an open-addressing hash map keyed on them
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <cstdint>
+
+// An interned symbol. Every distinct symbol name has exactly one Symbol for the lifetime of the
+// process, so symbols can be compared and hashed by address instead of by their characters
+typedef const std::string* Symbol;
+
+// Return the Symbol for name, interning it on first use
+Symbol internSymbol(const std::string& name);
+
+// Return the Symbol for name, or nullptr if it has never been interned. Lookups use this so that
+// unknown names do not grow the intern table
+Symbol findSymbol(const std::string& name);
+
+// Hash map from Symbols to values using open addressing with linear probing. Values are stored
+// separately from the probe table so pointers to them stay valid while the map grows
+template<typename T>
+class SymbolMap {
+public:
+	SymbolMap();
+
+	std::size_t size() const;
+	bool empty() const;
+
+	// Return a pointer to the value mapped to sym, or nullptr if there is none
+	const T* find(Symbol sym) const;
+	T* find(Symbol sym);
+
+	// Map sym to value, replacing any existing value. Returns a reference to the stored value
+	T& assign(Symbol sym, const T& value);
+
+	// Remove every mapping. The probe table is released so an empty map costs nothing
+	void clear();
+
+	// Call f(sym, value) for every mapping in insertion order
+	template<typename F>
+	void forEach(F f) const;
+private:
+	struct Slot {
+		Symbol key;
+		std::uint32_t index;
+	};
+
+	// probe table (size is zero or a power of two) and the values it indexes
+	std::vector<Slot> m_slots;
+	std::deque<T> m_values;
+	std::vector<Symbol> m_keys;
+
+	std::size_t slotFor(Symbol sym) const;
+	void grow();
+};
+
+#include "symbol_map.tpp"
+#endif
@@ -0,0 +1,92 @@
+#include "symbol_map.hpp"
+
+template<typename T>
+SymbolMap<T>::SymbolMap() {}
+
+template<typename T>
+std::size_t SymbolMap<T>::size() const {
+	return m_values.size();
+}
+
+template<typename T>
+bool SymbolMap<T>::empty() const {
+	return m_values.empty();
+}
+
+// Find the slot holding sym, or the empty slot where it would be inserted. The table is never
+// more than half full, so the probe always terminates
+template<typename T>
+std::size_t SymbolMap<T>::slotFor(Symbol sym) const {
+	std::size_t mask = m_slots.size() - 1;
+
+	// Fibonacci hashing on the address, the low bits of a heap pointer carry no information
+	std::uint64_t h = reinterpret_cast<std::uintptr_t>(sym) * 0x9E3779B97F4A7C15ull;
+	std::size_t i = static_cast<std::size_t>(h >> 32) & mask;
+	while (m_slots[i].key != nullptr && m_slots[i].key != sym) {
+		i = (i + 1) & mask;
+	}
+
+	return i;
+}
+
+template<typename T>
+const T* SymbolMap<T>::find(Symbol sym) const {
+	if (sym == nullptr || m_slots.empty()) {
+		return nullptr;
+	}
+
+	const Slot& slot = m_slots[slotFor(sym)];
+	return (slot.key == nullptr) ? nullptr : &m_values[slot.index];
+}
+
+template<typename T>
+T* SymbolMap<T>::find(Symbol sym) {
+	return const_cast<T*>(static_cast<const SymbolMap<T>&>(*this).find(sym));
+}
+
+template<typename T>
+T& SymbolMap<T>::assign(Symbol sym, const T& value) {
+	if ((m_values.size() + 1) * 2 > m_slots.size()) {
+		grow();
+	}
+
+	Slot& slot = m_slots[slotFor(sym)];
+	if (slot.key != nullptr) {
+		m_values[slot.index] = value;
+	} else {
+		slot.key = sym;
+		slot.index = static_cast<std::uint32_t>(m_values.size());
+		m_values.push_back(value);
+		m_keys.push_back(sym);
+	}
+
+	return m_values[slot.index];
+}
+
+template<typename T>
+void SymbolMap<T>::clear() {
+	std::vector<Slot>().swap(m_slots);
+	m_values.clear();
+	m_keys.clear();
+}
+
+template<typename T>
+template<typename F>
+void SymbolMap<T>::forEach(F f) const {
+	for (std::size_t i = 0; i < m_keys.size(); i++) {
+		f(m_keys[i], m_values[i]);
+	}
+}
+
+// Double the probe table and re-insert every key. Values do not move
+template<typename T>
+void SymbolMap<T>::grow() {
+	std::size_t capacity = m_slots.empty() ? 16 : m_slots.size() * 2;
+	m_slots.assign(capacity, Slot{nullptr, 0});
+
+	for (std::size_t i = 0; i < m_keys.size(); i++) {
+		Slot& slot = m_slots[slotFor(m_keys[i])];
+		slot.key = m_keys[i];
+		slot.index = static_cast<std::uint32_t>(i);
+	}
+}
@@ -0,0 +1,75 @@
+#include "catch.hpp"
+
+#include "symbol_map.hpp"
+#include <thread>
+#include <string>
+
+TEST_CASE("Interned symbols are unique", "[SymbolMap]") {
+	Symbol a = internSymbol("alpha");
+	Symbol b = internSymbol("beta");
+
+	REQUIRE(a != b);
+	REQUIRE(*a == "alpha");
+	REQUIRE(internSymbol("alpha") == a);
+	REQUIRE(findSymbol("alpha") == a);
+
+	// finding a name must not intern it
+	REQUIRE(findSymbol("never-interned-symbol") == nullptr);
+	REQUIRE(findSymbol("never-interned-symbol") == nullptr);
+}
+
+TEST_CASE("Interning from several threads", "[SymbolMap]") {
+	Symbol fromThread = nullptr;
+	std::thread th([&fromThread]() {
+		fromThread = internSymbol("shared-between-threads");
+	});
+	th.join();
+
+	REQUIRE(internSymbol("shared-between-threads") == fromThread);
+}
+
+TEST_CASE("Assign and find", "[SymbolMap]") {
+	SymbolMap<int> map;
+	REQUIRE(map.empty());
+	REQUIRE(map.find(internSymbol("a")) == nullptr);
+	REQUIRE(map.find(nullptr) == nullptr);
+
+	map.assign(internSymbol("a"), 1);
+	map.assign(internSymbol("b"), 2);
+	REQUIRE(map.size() == 2);
+	REQUIRE(*map.find(internSymbol("a")) == 1);
+	REQUIRE(*map.find(internSymbol("b")) == 2);
+
+	// assigning again replaces the value
+	map.assign(internSymbol("a"), 3);
+	REQUIRE(map.size() == 2);
+	REQUIRE(*map.find(internSymbol("a")) == 3);
+
+	map.clear();
+	REQUIRE(map.empty());
+	REQUIRE(map.find(internSymbol("a")) == nullptr);
+}
+
+TEST_CASE("Values stay in place while the map grows", "[SymbolMap]") {
+	SymbolMap<int> map;
+	int* first = &map.assign(internSymbol("sym0"), 0);
+
+	for (int i = 1; i < 1000; i++) {
+		map.assign(internSymbol("sym" + std::to_string(i)), i);
+	}
+
+	REQUIRE(map.size() == 1000);
+	REQUIRE(map.find(internSymbol("sym0")) == first);
+	for (int i = 0; i < 1000; i++) {
+		REQUIRE(*map.find(internSymbol("sym" + std::to_string(i))) == i);
+	}
+
+	// iteration is in insertion order
+	int expected = 0;
+	map.forEach([&expected](Symbol sym, int value) {
+		REQUIRE(*sym == "sym" + std::to_string(expected));
+		REQUIRE(value == expected);
+		expected++;
+	});
+	REQUIRE(expected == 1000);
+}
@@ -0,0 +1,256 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+
+// The pool and queue index of the worker running on this thread, if any
+thread_local ThreadPool* currentPool = nullptr;
+thread_local std::size_t currentQueue = 0;
+
+// The computation the task running on this thread is part of
+thread_local std::shared_ptr<Cancellation> currentComputation;
+
+Cancellation::Cancellation(std::shared_ptr<Cancellation> parent):
+	m_cancelled(false), m_parent(parent) {}
+
+void Cancellation::cancel() {
+	m_cancelled.store(true);
+}
+
+bool Cancellation::isCancelled() const {
+	for (const Cancellation* c = this; c != nullptr; c = c->m_parent.get()) {
+		if (c->m_cancelled.load(std::memory_order_relaxed)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+Cancellation& Cancellation::root() {
+	Cancellation* c = this;
+	while (c->m_parent.get() != nullptr) {
+		c = c->m_parent.get();
+	}
+
+	return *c;
+}
+
+bool ThreadPool::isCancelled() {
+	return currentComputation.get() != nullptr && currentComputation->isCancelled();
+}
+
+void ThreadPool::cancelCurrent() {
+	if (currentComputation.get() != nullptr) {
+		currentComputation->root().cancel();
+	}
+}
+
+std::shared_ptr<Cancellation> ThreadPool::currentCancellation() {
+	return currentComputation;
+}
+
+ThreadPool::CancellationScope::CancellationScope(): m_saved(currentComputation) {
+	if (currentComputation.get() == nullptr) {
+		currentComputation = std::make_shared<Cancellation>(nullptr);
+	}
+}
+
+ThreadPool::CancellationScope::CancellationScope(std::shared_ptr<Cancellation> computation):
+	m_saved(currentComputation) {
+	currentComputation = computation;
+}
+
+ThreadPool::CancellationScope::~CancellationScope() {
+	currentComputation = m_saved;
+}
+
+ThreadPool::ThreadPool(std::size_t workers): m_pending(0), m_stop(false), m_nextQueue(0) {
+	if (workers == 0) {
+		workers = 1;
+	}
+
+	for (std::size_t i = 0; i < workers; i++) {
+		m_queues.emplace_back(new Queue);
+	}
+
+	for (std::size_t i = 0; i < workers; i++) {
+		m_threads.emplace_back(&ThreadPool::workerLoop, this, i);
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+		m_stop = true;
+	}
+
+	m_wake.notify_all();
+	for (auto& thread : m_threads) {
+		thread.join();
+	}
+}
+
+ThreadPool& ThreadPool::shared() {
+	static ThreadPool pool(std::thread::hardware_concurrency());
+	return pool;
+}
+
+std::size_t ThreadPool::size() const {
+	return m_threads.size();
+}
+
+void ThreadPool::push(Task task) {
+	Entry entry;
+	entry.task = std::move(task);
+	entry.cancellation = currentComputation;
+	pushEntry(std::move(entry));
+}
+
+void ThreadPool::pushEntry(Entry entry) {
+	std::size_t index = (currentPool == this) ? currentQueue :
+		m_nextQueue.fetch_add(1, std::memory_order_relaxed) % m_queues.size();
+
+	{
+		std::lock_guard<std::mutex> lock(m_queues[index]->mutex);
+		m_queues[index]->tasks.push_back(std::move(entry));
+	}
+
+	// the pending count is updated under the sleep mutex so a worker deciding to sleep cannot miss it
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+		m_pending.fetch_add(1);
+	}
+
+	m_wake.notify_one();
+}
+
+// Take the newest task of queue first, or steal the oldest task of another queue
+bool ThreadPool::popTask(std::size_t first, Entry& entry) {
+	for (std::size_t i = 0; i < m_queues.size(); i++) {
+		Queue& queue = *m_queues[(first + i) % m_queues.size()];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.tasks.empty()) {
+			if (i == 0) {
+				entry = std::move(queue.tasks.back());
+				queue.tasks.pop_back();
+			} else {
+				entry = std::move(queue.tasks.front());
+				queue.tasks.pop_front();
+			}
+
+			m_pending.fetch_sub(1);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool ThreadPool::runPendingTask() {
+	if (m_pending.load() == 0) {
+		return false;
+	}
+
+	Entry entry;
+	std::size_t first = (currentPool == this) ? currentQueue : 0;
+	if (!popTask(first, entry)) {
+		return false;
+	}
+
+	runEntry(entry);
+	return true;
+}
+
+// Run a task as part of the computation that queued it
+void ThreadPool::runEntry(Entry& entry) {
+	runAs(entry.cancellation, entry.task);
+}
+
+void ThreadPool::runAs(const std::shared_ptr<Cancellation>& computation, const Task& task) {
+	std::shared_ptr<Cancellation> saved = std::move(currentComputation);
+	currentComputation = computation;
+	task();
+	currentComputation = std::move(saved);
+}
+
+void ThreadPool::workerLoop(std::size_t index) {
+	currentPool = this;
+	currentQueue = index;
+
+	while (true) {
+		Entry entry;
+		if (popTask(index, entry)) {
+			runEntry(entry);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(m_sleepMutex);
+		m_wake.wait(lock, [this]() {
+			return m_stop || m_pending.load() > 0;
+		});
+
+		if (m_stop && m_pending.load() == 0) {
+			return;
+		}
+	}
+}
+
+// The ranges are claimed from a shared counter by the calling thread and by helper tasks, one
+// per worker, so uneven ranges balance themselves. The state is shared with the helpers because
+// a helper may only start after the calling thread has returned
+void ThreadPool::parallelFor(std::size_t count, std::size_t grain,
+	const std::function<void(std::size_t, std::size_t)>& body) {
+	if (grain == 0) {
+		grain = 1;
+	}
+
+	std::size_t ranges = (count + grain - 1) / grain;
+	if (ranges <= 1) {
+		if (count > 0) {
+			body(0, count);
+		}
+
+		return;
+	}
+
+	// the helpers are part of the computation running the loop
+	CancellationScope scope;
+
+	struct State {
+		std::atomic<std::size_t> next;
+		std::atomic<std::size_t> done;
+		std::mutex mutex;
+		std::condition_variable finished;
+	};
+
+	std::shared_ptr<State> state = std::make_shared<State>();
+	state->next = 0;
+	state->done = 0;
+
+	// the body is only referenced while ranges are left, which keeps the caller waiting
+	const std::function<void(std::size_t, std::size_t)>* fn = &body;
+	auto claim = [state, fn, count, grain, ranges]() {
+		std::size_t range;
+		while ((range = state->next.fetch_add(1)) < ranges) {
+			std::size_t begin = range * grain;
+			(*fn)(begin, std::min(begin + grain, count));
+			if (state->done.fetch_add(1) + 1 == ranges) {
+				std::lock_guard<std::mutex> lock(state->mutex);
+				state->finished.notify_all();
+			}
+		}
+	};
+
+	std::size_t helpers = std::min(m_threads.size(), ranges - 1);
+	for (std::size_t i = 0; i < helpers; i++) {
+		push(claim);
+	}
+
+	claim();
+
+	// every range has been claimed, wait for the helpers still running theirs
+	std::unique_lock<std::mutex> lock(state->mutex);
+	state->finished.wait(lock, [&state, ranges]() {
+		return state->done.load() == ranges;
+	});
+}
@@ -0,0 +1,227 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+// Work-stealing thread pool shared by the parallel parts of the interpreter
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Thrown by Future::get when the task was cancelled before it started
+class TaskCancelled: public std::runtime_error {
+public:
+	TaskCancelled(): std::runtime_error("Error: task cancelled") {}
+};
+
+// The cancellation flag of a computation. A computation started by another one, e.g. a task
+// submitted by a task, is cancelled with it
+class Cancellation {
+public:
+	explicit Cancellation(std::shared_ptr<Cancellation> parent);
+
+	// Cancel this computation and the ones it started
+	void cancel();
+
+	// Return true if this computation or one it is part of was cancelled
+	bool isCancelled() const;
+
+	// The outermost computation this one is part of
+	Cancellation& root();
+
+private:
+	std::atomic<bool> m_cancelled;
+	std::shared_ptr<Cancellation> m_parent;
+};
+
+template<typename T>
+class Future;
+
+// Each worker has its own deque of tasks. A worker pops its newest task and, when its deque is
+// empty, steals the oldest task of another worker. A thread waiting for parallel work to finish
+// does the part of it that has not started itself and then blocks, so parallel work may be
+// started from inside a task. It never runs unrelated tasks while waiting, one of them could wait
+// for something the thread holds, e.g. a promise it is forcing.
+//
+// Cancellation is cooperative. Every task runs as part of the computation that queued it, and
+// long running code checks isCancelled, e.g. Expression::eval does with the interrupt flag. An
+// interrupt seen by one task cancels the computation, so the other tasks stop at their next check
+class ThreadPool {
+public:
+	typedef std::function<void()> Task;
+
+	// Start a pool with the given number of worker threads (at least one)
+	explicit ThreadPool(std::size_t workers);
+
+	// Finish the queued tasks and join the workers
+	~ThreadPool();
+
+	// Not copyable
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// The pool shared by the interpreter, sized to the hardware concurrency
+	static ThreadPool& shared();
+
+	// Number of worker threads
+	std::size_t size() const;
+
+	// Queue a task, as part of the computation the calling thread works for. From a worker it goes
+	// on that worker's deque, otherwise the deques are used in turn
+	void push(Task task);
+
+	// Run one queued task on the calling thread. Returns false if there was none
+	bool runPendingTask();
+
+	// Call body(begin, end) for consecutive ranges of at most grain indices covering [0, count),
+	// on the pool and the calling thread, and return once every range is done. body must not throw
+	void parallelFor(std::size_t count, std::size_t grain,
+		const std::function<void(std::size_t, std::size_t)>& body);
+
+	// Queue f() as a task and return a future for its result. The task is a computation of its own,
+	// part of the computation calling submit
+	template<typename F>
+	Future<typename std::result_of<F()>::type> submit(F f);
+
+	// Return true if the computation the calling thread works for was cancelled
+	static bool isCancelled();
+
+	// Cancel the outermost computation the calling thread works for, with every task it started.
+	// Does nothing outside of a computation. Called by the thread that takes the interrupt flag, a
+	// thread that only sees its computation cancelled leaves the cancelling to whoever cancelled it
+	static void cancelCurrent();
+
+	// The computation the calling thread works for, or nullptr
+	static std::shared_ptr<Cancellation> currentCancellation();
+
+	// Makes the calling thread start a computation, unless it already works for one, until the
+	// scope ends. Tasks queued meanwhile are part of it
+	class CancellationScope {
+	public:
+		CancellationScope();
+
+		// Makes the calling thread work for the given computation until the scope ends
+		explicit CancellationScope(std::shared_ptr<Cancellation> computation);
+
+		~CancellationScope();
+
+	private:
+		std::shared_ptr<Cancellation> m_saved;
+	};
+
+private:
+	template<typename T>
+	friend class Future;
+
+	struct Entry {
+		Task task;
+		std::shared_ptr<Cancellation> cancellation;
+	};
+
+	struct Queue {
+		std::mutex mutex;
+		std::deque<Entry> tasks;
+	};
+
+	std::vector<std::unique_ptr<Queue>> m_queues;
+	std::vector<std::thread> m_threads;
+
+	// queued task count and the sleeping workers waiting for it to be non-zero
+	std::atomic<std::size_t> m_pending;
+	std::mutex m_sleepMutex;
+	std::condition_variable m_wake;
+	bool m_stop;
+
+	std::atomic<std::size_t> m_nextQueue;
+
+	void pushEntry(Entry entry);
+	bool popTask(std::size_t first, Entry& entry);
+	void runEntry(Entry& entry);
+	static void runAs(const std::shared_ptr<Cancellation>& computation, const Task& task);
+	void workerLoop(std::size_t index);
+};
+
+// The value computed by a task, tasks returning void have none
+template<typename T>
+struct TaskResult {
+	T value;
+
+	template<typename F>
+	void run(F& f) {
+		value = f();
+	}
+
+	T take() {
+		return std::move(value);
+	}
+};
+
+template<>
+struct TaskResult<void> {
+	template<typename F>
+	void run(F& f) {
+		f();
+	}
+
+	void take() {}
+};
+
+// The state shared by a Future and the task computing its value. The task is run by whichever of
+// the pool and a thread waiting for the future starts it first
+template<typename T>
+struct FutureState {
+	std::shared_ptr<Cancellation> cancellation;
+	std::function<void()> task;
+	std::atomic<bool> started;
+	TaskResult<T> result;
+	std::exception_ptr error;
+	std::atomic<bool> done;
+	std::mutex mutex;
+	std::condition_variable finished;
+
+	// Run the task unless it was started already
+	void run() {
+		if (!started.exchange(true)) {
+			task();
+			task = nullptr;
+		}
+	}
+};
+
+// The result of a task submitted to a ThreadPool. Results other than void must be default
+// constructible
+template<typename T>
+class Future {
+public:
+	// Return true once the task has finished
+	bool ready() const;
+
+	// Wait for the task to finish, running it on the calling thread if it has not started
+	void wait() const;
+
+	// Wait for the task and return its result, or rethrow what it threw. Throws TaskCancelled if
+	// the task was cancelled before it started. May only be called once
+	T get();
+
+	// Cancel the task and the tasks it started. A task already running stops at its next check
+	// of ThreadPool::isCancelled
+	void cancel();
+
+private:
+	friend class ThreadPool;
+	Future(ThreadPool& pool, std::shared_ptr<FutureState<T>> state);
+
+	ThreadPool* m_pool;
+	std::shared_ptr<FutureState<T>> m_state;
+};
+
+#include "thread_pool.tpp"
+#endif
@@ -0,0 +1,82 @@
+#include "thread_pool.hpp"
+
+template<typename F>
+Future<typename std::result_of<F()>::type> ThreadPool::submit(F f) {
+	typedef typename std::result_of<F()>::type T;
+
+	std::shared_ptr<FutureState<T>> state = std::make_shared<FutureState<T>>();
+	state->cancellation = std::make_shared<Cancellation>(currentCancellation());
+	state->started = false;
+	state->done = false;
+
+	// the task only points to the state, which owns it
+	FutureState<T>* raw = state.get();
+	state->task = [raw, f]() mutable {
+		if (raw->cancellation->isCancelled()) {
+			raw->error = std::make_exception_ptr(TaskCancelled());
+		} else {
+			try {
+				raw->result.run(f);
+			} catch (...) {
+				raw->error = std::current_exception();
+			}
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(raw->mutex);
+			raw->done = true;
+		}
+
+		raw->finished.notify_all();
+	};
+
+	Entry entry;
+	entry.cancellation = state->cancellation;
+	entry.task = [state]() {
+		state->run();
+	};
+
+	pushEntry(std::move(entry));
+	return Future<T>(*this, state);
+}
+
+template<typename T>
+Future<T>::Future(ThreadPool& pool, std::shared_ptr<FutureState<T>> state):
+	m_pool(&pool), m_state(state) {}
+
+template<typename T>
+bool Future<T>::ready() const {
+	return m_state->done.load();
+}
+
+// A task still queued is run by the waiting thread, as part of its own computation. The entry
+// left in the queue then does nothing
+template<typename T>
+void Future<T>::wait() const {
+	FutureState<T>* state = m_state.get();
+	if (!state->started.load()) {
+		ThreadPool::runAs(state->cancellation, [state]() {
+			state->run();
+		});
+	}
+
+	std::unique_lock<std::mutex> lock(state->mutex);
+	state->finished.wait(lock, [state]() {
+		return state->done.load();
+	});
+}
+
+template<typename T>
+T Future<T>::get() {
+	wait();
+	if (m_state->error) {
+		std::rethrow_exception(m_state->error);
+	}
+
+	return m_state->result.take();
+}
+
+template<typename T>
+void Future<T>::cancel() {
+	m_state->cancellation->cancel();
+}
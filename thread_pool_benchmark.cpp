@@ -0,0 +1,134 @@
+// Scaling benchmark of the thread pool. A plotscript lambda is evaluated for every element of a
+// range on pools of 1 to N workers, split once with parallelFor and once into submitted tasks, and
+// the time and speedup over one worker are printed for each pool size
+//
+// usage: thread_pool_benchmark [max workers] [elements]
+//
+// N defaults to the hardware concurrency
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+#include "interpreter.hpp"
+#include "semantic_error.hpp"
+#include "thread_pool.hpp"
+
+// The body is evaluated by the tree walker until the lambda is promoted, which happens within the
+// first few elements
+const char* WORKLOAD = "(lambda (x) (+ (* x x) (/ 1 (+ 1 x)) (sqrt (+ x 2)) (^ (sin x) 2) "
+	"(^ (cos x) 2) (ln (+ x 1))))";
+
+typedef std::chrono::steady_clock Clock;
+
+double seconds(Clock::time_point start) {
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+double runParallelFor(ThreadPool& pool, const Expression& lambda, const Environment& env,
+	std::vector<Expression>& results) {
+	std::exception_ptr error;
+	std::mutex errorMutex;
+
+	Clock::time_point start = Clock::now();
+	pool.parallelFor(results.size(), 256, [&](std::size_t begin, std::size_t end) {
+		try {
+			for (std::size_t i = begin; i < end; i++) {
+				Expression x(Atom(static_cast<double>(i)));
+				results[i] = lambda.evalLambda(Arguments(&x, 1), env);
+			}
+		} catch (...) {
+			std::lock_guard<std::mutex> lock(errorMutex);
+			error = std::current_exception();
+		}
+	});
+
+	double time = seconds(start);
+	if (error) {
+		std::rethrow_exception(error);
+	}
+
+	return time;
+}
+
+double runSubmit(ThreadPool& pool, const Expression& lambda, const Environment& env,
+	std::vector<Expression>& results) {
+	const std::size_t chunk = 4096;
+
+	Clock::time_point start = Clock::now();
+	std::vector<Future<void>> chunks;
+	for (std::size_t begin = 0; begin < results.size(); begin += chunk) {
+		chunks.push_back(pool.submit([&, begin]() {
+			for (std::size_t i = begin; i < results.size() && i < begin + chunk; i++) {
+				Expression x(Atom(static_cast<double>(i)));
+				results[i] = lambda.evalLambda(Arguments(&x, 1), env);
+			}
+		}));
+	}
+
+	for (auto& f : chunks) {
+		f.get();
+	}
+
+	return seconds(start);
+}
+
+int main(int argc, char* argv[]) {
+	std::size_t maxWorkers = (argc > 1) ? std::strtoul(argv[1], nullptr, 10) :
+		std::thread::hardware_concurrency();
+	std::size_t elements = (argc > 2) ? std::strtoul(argv[2], nullptr, 10) : 200000;
+	if (maxWorkers == 0) {
+		maxWorkers = 1;
+	}
+
+	Interpreter interp;
+	std::istringstream program(WORKLOAD);
+	if (!interp.parseStream(program)) {
+		std::cerr << "Error: could not parse the workload" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	Environment env;
+	Expression lambda;
+	try {
+		lambda = interp.evaluate();
+	} catch (const SemanticError& ex) {
+		std::cerr << ex.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::vector<Expression> results(elements);
+	std::cout << "workers  parallelFor (s)  speedup  submit (s)  speedup" << std::endl;
+
+	double baseFor = 0;
+	double baseSubmit = 0;
+	for (std::size_t workers = 1; workers <= maxWorkers; workers++) {
+
+		// the calling thread mostly waits, it only helps with queued work
+		ThreadPool pool(workers);
+		double timeFor = 0;
+		double timeSubmit = 0;
+		try {
+			timeFor = runParallelFor(pool, lambda, env, results);
+			timeSubmit = runSubmit(pool, lambda, env, results);
+		} catch (const SemanticError& ex) {
+			std::cerr << ex.what() << std::endl;
+			return EXIT_FAILURE;
+		}
+
+		if (workers == 1) {
+			baseFor = timeFor;
+			baseSubmit = timeSubmit;
+		}
+
+		std::cout << std::setw(7) << workers << std::fixed << std::setprecision(3) <<
+			std::setw(17) << timeFor << std::setw(9) << baseFor / timeFor <<
+			std::setw(12) << timeSubmit << std::setw(9) << baseSubmit / timeSubmit << std::endl;
+	}
+
+	return EXIT_SUCCESS;
+}
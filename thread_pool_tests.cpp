@@ -0,0 +1,213 @@
+#include "catch.hpp"
+
+#include "thread_pool.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "environment.hpp"
+#include "interrupt_flag.hpp"
+#include "semantic_error.hpp"
+
+TEST_CASE("Parallel loops cover every index once", "[ThreadPool]") {
+	ThreadPool pool(4);
+	REQUIRE(pool.size() == 4);
+
+	std::vector<std::atomic<int>> visits(1000);
+	for (auto& v : visits) {
+		v = 0;
+	}
+
+	// Catch is not thread safe, the ranges are checked after the loop
+	std::atomic<bool> tooLong(false);
+	pool.parallelFor(visits.size(), 7, [&visits, &tooLong](std::size_t begin, std::size_t end) {
+		if (end - begin > 7) {
+			tooLong = true;
+		}
+
+		for (std::size_t i = begin; i < end; i++) {
+			visits[i]++;
+		}
+	});
+
+	REQUIRE(!tooLong);
+	for (auto& v : visits) {
+		REQUIRE(v == 1);
+	}
+
+	INFO("empty and single range loops run inline");
+	int calls = 0;
+	pool.parallelFor(0, 4, [&calls](std::size_t, std::size_t) { calls++; });
+	REQUIRE(calls == 0);
+	pool.parallelFor(3, 4, [&calls](std::size_t begin, std::size_t end) {
+		REQUIRE(begin == 0);
+		REQUIRE(end == 3);
+		calls++;
+	});
+	REQUIRE(calls == 1);
+}
+
+TEST_CASE("Parallel loops can be nested", "[ThreadPool]") {
+	ThreadPool pool(2);
+	std::atomic<int> total(0);
+
+	pool.parallelFor(16, 1, [&pool, &total](std::size_t, std::size_t) {
+		pool.parallelFor(100, 10, [&total](std::size_t begin, std::size_t end) {
+			total += static_cast<int>(end - begin);
+		});
+	});
+
+	REQUIRE(total == 1600);
+}
+
+TEST_CASE("Waiting for a parallel loop runs no unrelated task", "[ThreadPool]") {
+	ThreadPool pool(1);
+
+	// keep the only worker busy until the loop has started, so the unrelated task stays queued
+	std::atomic<bool> release(false);
+	pool.push([&release]() {
+		while (!release) {
+			std::this_thread::yield();
+		}
+	});
+
+	std::atomic<bool> unrelatedRan(false);
+	std::thread::id unrelatedThread;
+	pool.push([&unrelatedRan, &unrelatedThread]() {
+		unrelatedThread = std::this_thread::get_id();
+		unrelatedRan = true;
+	});
+
+	// the calling thread finishes its range while the worker is still busy with the other one
+	std::atomic<bool> workerStarted(false);
+	pool.parallelFor(2, 1, [&release, &workerStarted](std::size_t begin, std::size_t) {
+		if (begin == 0) {
+			release = true;
+			while (!workerStarted) {
+				std::this_thread::yield();
+			}
+		} else {
+			workerStarted = true;
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		}
+	});
+
+	while (!unrelatedRan) {
+		std::this_thread::yield();
+	}
+
+	REQUIRE(unrelatedThread != std::this_thread::get_id());
+}
+
+TEST_CASE("Queued tasks run on the pool", "[ThreadPool]") {
+	std::atomic<int> ran(0);
+	{
+		ThreadPool pool(2);
+		for (int i = 0; i < 100; i++) {
+			pool.push([&ran]() { ran++; });
+		}
+	}
+
+	// the destructor finishes the queued tasks
+	REQUIRE(ran == 100);
+}
+
+TEST_CASE("Submitted tasks return futures", "[ThreadPool]") {
+	ThreadPool pool(2);
+
+	Future<int> answer = pool.submit([]() { return 6 * 7; });
+	REQUIRE(answer.get() == 42);
+
+	std::atomic<int> ran(0);
+	Future<void> done = pool.submit([&ran]() { ran++; });
+	done.wait();
+	REQUIRE(done.ready());
+	REQUIRE(ran == 1);
+
+	INFO("exceptions are rethrown by get");
+	Future<int> failed = pool.submit([]() -> int { throw std::runtime_error("failed"); });
+	REQUIRE_THROWS_AS(failed.get(), std::runtime_error);
+
+	INFO("tasks may wait for the tasks they submit, even on a single worker");
+	ThreadPool single(1);
+	Future<int> outer = single.submit([&single]() {
+		Future<int> inner = single.submit([]() { return 1; });
+		return inner.get() + 1;
+	});
+	REQUIRE(outer.get() == 2);
+}
+
+TEST_CASE("Cancelled tasks", "[ThreadPool]") {
+	ThreadPool pool(1);
+
+	// keep the only worker busy so the next task stays queued
+	std::atomic<bool> release(false);
+	Future<void> blocker = pool.submit([&release]() {
+		while (!release) {
+			std::this_thread::yield();
+		}
+	});
+
+	Future<int> queued = pool.submit([]() { return 1; });
+	queued.cancel();
+	release = true;
+	blocker.get();
+	REQUIRE_THROWS_AS(queued.get(), TaskCancelled);
+
+	INFO("running tasks see the cancellation of the task that submitted them");
+	std::atomic<bool> started(false);
+	std::atomic<bool> sawCancel(false);
+	Future<void> parent = pool.submit([&pool, &started, &sawCancel]() {
+		Future<void> child = pool.submit([&started, &sawCancel]() {
+			started = true;
+			auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+			while (!ThreadPool::isCancelled() && std::chrono::steady_clock::now() < deadline) {
+				std::this_thread::yield();
+			}
+
+			sawCancel = ThreadPool::isCancelled();
+		});
+
+		child.get();
+	});
+
+	while (!started) {
+		std::this_thread::yield();
+	}
+
+	parent.cancel();
+	parent.get();
+	REQUIRE(sawCancel);
+	REQUIRE(!ThreadPool::isCancelled());
+}
+
+TEST_CASE("Interrupts cancel the whole parallel loop", "[ThreadPool]") {
+	ThreadPool pool(4);
+	std::vector<int> interrupted(8, 0);
+
+	// range 0 raises the interrupt, the others evaluate until they are cancelled
+	pool.parallelFor(interrupted.size(), 1, [&interrupted](std::size_t begin, std::size_t) {
+		if (begin == 0) {
+			interrupt_flag.store(true);
+		}
+
+		Environment env;
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+		while (std::chrono::steady_clock::now() < deadline) {
+			try {
+				Expression(Atom(1)).eval(env);
+			} catch (const SemanticError& ex) {
+				interrupted[begin] = std::string(ex.what()) == "Error: interpreter kernel interrupted";
+				break;
+			}
+		}
+	});
+
+	REQUIRE(!interrupt_flag.load());
+	for (int i : interrupted) {
+		REQUIRE(i == 1);
+	}
+}
@@ -1,5 +1,58 @@
 #include "threaded_interpreter.hpp"
 
+#include <cstdlib>
+#include <mutex>
+
+#include "parse.hpp"
+#include "analysis.hpp"
+#include "startup_image.hpp"
+
+// The environment built from the startup definitions, and the error (if any) from building it.
+// Sessions are layered over this base, so the startup definitions are loaded once per process
+std::shared_ptr<const Environment> startupBase;
+std::string startupError;
+std::once_flag startupOnce;
+
+void evaluateStartupFile(Environment& env, const std::string& path, std::string& error) {
+	std::ifstream ifs(path);
+
+	if (!ifs) {
+		error = "Could not open startup file for reading.";
+	} else {
+
+		// Just load the expressions from the startup file into the environment. We don't need to do
+		// anything with them
+		TokenSequenceType tokens = tokenize(ifs);
+		Expression program = parse(tokens);
+		markParallelEvaluation(program);
+		if (program == Expression()) {
+			error = "Invalid Program in startup file. Could not parse.";
+		} else {
+			try {
+				program.eval(env);
+			} catch (const SemanticError& ex) {
+				error = std::string(ex.what()) + " [startup]";
+			}
+		}
+	}
+}
+
+// The startup definitions are normally compiled into the library (see startup_image.hpp). During
+// development PLOTSCRIPT_STARTUP can name a startup file to evaluate instead, if it is set but
+// empty the startup file the build was configured with is used
+void buildStartupBase() {
+	Environment env;
+	const char* path = std::getenv("PLOTSCRIPT_STARTUP");
+
+	if (path != nullptr) {
+		evaluateStartupFile(env, (*path == '\0') ? STARTUP_FILE : std::string(path), startupError);
+	} else if (!loadStartupImage(env, startupError)) {
+		evaluateStartupFile(env, STARTUP_FILE, startupError);
+	}
+
+	startupBase = env.freeze();
+}
+
 ThreadedInterpreter::ThreadedInterpreter(InputQueue* iq, OutputQueue* oq): m_iq(iq), m_oq(oq) {
 	start();
 }
@@ -8,8 +61,7 @@ ThreadedInterpreter::ThreadedInterpreter(InputQueue* iq, OutputQueue* oq): m_iq(
 ThreadedInterpreter::ThreadedInterpreter(OutputQueue* oq, std::istream& stream): m_oq(oq) {
 	if (!m_thread.joinable()) {
 		m_thread = std::thread([this, &stream](){
-			Interpreter interp;
-			loadStartupFile(interp);
+			Interpreter interp(loadStartupFile());
 
 			// pop in case there was an error with the startup file
 			OutputMessage msg;
@@ -60,7 +112,7 @@ void ThreadedInterpreter::evalStream(Interpreter& interp, std::istream& stream)
 
 		// try to evaluate the expression, push the result to the output queue
 		try {
-			Expression exp = interp.evaluate();
+			Expression exp = interp.evaluateForDisplay();
 			m_oq->push(OutputMessage(ExpressionType, exp));
 		} catch(const SemanticError& ex) {
 			error(std::string(ex.what()));
@@ -69,8 +121,7 @@ void ThreadedInterpreter::evalStream(Interpreter& interp, std::istream& stream)
 }
 
 void ThreadedInterpreter::run() {
-	Interpreter interp;
-	loadStartupFile(interp);
+	Interpreter interp(loadStartupFile());
 	while (active) {
 
 		// Grab input messages as they populate the queue. If not message is returned, then continue
@@ -85,27 +136,16 @@ void ThreadedInterpreter::run() {
 	}
 }
 
-void ThreadedInterpreter::loadStartupFile(Interpreter& interp) {
-	std::ifstream ifs(STARTUP_FILE);
-
-	if (!ifs) {
-		error("Could not open startup file for reading.");
-	} else {
+std::shared_ptr<const Environment> ThreadedInterpreter::loadStartupFile() {
+	std::call_once(startupOnce, buildStartupBase);
 
-		// Just load the expressions from the startup file into the interpreter. We don't need to do
-		// anything with them
-		if (!interp.parseStream(ifs)) {
-			error("Invalid Program in startup file. Could not parse.");
-		} else {
-			try {
-				interp.evaluate();
-			} catch (const SemanticError& ex) {
-				error(std::string(ex.what()) + " [startup]");
-			}
-		}
+	// Every session reports the startup error, as if it had loaded the file itself
+	if (!startupError.empty()) {
+		error(startupError);
 	}
 
 	startupLoaded = true;
+	return startupBase;
 }
 
 bool ThreadedInterpreter::isStartupLoaded() const {
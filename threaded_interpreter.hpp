@@ -7,6 +7,7 @@
 #include "interpreter.hpp"
 #include "semantic_error.hpp"
 #include "message_queue.hpp"
+#include "plot_data.hpp"
 
 #include "startup_config.hpp"
 
@@ -19,9 +20,12 @@ typedef struct _OutputMessage {
 	Expression exp;
 	std::string err;
 
+	// the typed data of exp if it is a plot, which a renderer draws instead of the primitives
+	std::shared_ptr<const PlotData> plot;
+
 	// constructors for use in container emplace
 	_OutputMessage() {};
-	_OutputMessage(OutputMessageType t, Expression e): type(t), exp(e) {};
+	_OutputMessage(OutputMessageType t, Expression e): type(t), exp(e), plot(plotData(e)) {};
 	_OutputMessage(OutputMessageType t, std::string e): type(t), err(e) {};
 } OutputMessage;
 
@@ -64,9 +68,10 @@ private:
 	bool active = true;
 	void run();
 
-	// Load the startup plotscript file. Errors are sent to the output queue
+	// Load the startup plotscript file. It is only evaluated once per process into a frozen base
+	// environment shared by every session, errors are sent to the output queue of each session
 	bool startupLoaded = false;
-	void loadStartupFile(Interpreter& interp);
+	std::shared_ptr<const Environment> loadStartupFile();
 
 	void error(const std::string& e);
 };
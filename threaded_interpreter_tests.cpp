@@ -1,6 +1,7 @@
 #include "catch.hpp"
 
 #include "threaded_interpreter.hpp"
+#include "startup_image.hpp"
 #include <thread>
 
 void waitForStartup(ThreadedInterpreter& interp, OutputQueue& oq) {
@@ -179,3 +180,60 @@ TEST_CASE("Make sure the startup file loads", "[ThreadedInterpreter]") {
 		REQUIRE(msg.exp == Expression(0));
 	}
 }
+
+TEST_CASE("Sessions share the startup definitions", "[ThreadedInterpreter]") {
+	InputQueue iq1, iq2;
+	OutputQueue oq1, oq2;
+
+	ThreadedInterpreter interp1(&iq1, &oq1);
+	ThreadedInterpreter interp2(&iq2, &oq2);
+	waitForStartup(interp1, oq1);
+	waitForStartup(interp2, oq2);
+
+	// definitions in one session are not visible in the other
+	iq1.push("(define a (make-point 1 2))");
+	OutputMessage msg;
+	oq1.wait_pop(msg);
+	REQUIRE(msg.type == ExpressionType);
+
+	iq2.push("(define a 1)");
+	oq2.wait_pop(msg);
+	REQUIRE(msg.exp == Expression(1));
+	iq2.push("(get-property \"object-name\" (make-point 1 2))");
+	oq2.wait_pop(msg);
+	REQUIRE(msg.exp == Expression(Atom("\"point\"")));
+
+	// restarting a session drops its definitions and keeps the startup ones
+	interp1.reset();
+	waitForStartup(interp1, oq1);
+	iq1.push("(get-property \"object-name\" (make-point 1 2))");
+	oq1.wait_pop(msg);
+	REQUIRE(msg.exp == Expression(Atom("\"point\"")));
+}
+
+TEST_CASE("The startup image matches evaluating the startup file", "[ThreadedInterpreter]") {
+	Environment image;
+	std::string imageError = "unset";
+	REQUIRE(loadStartupImage(image, imageError));
+	REQUIRE(imageError == "");
+
+	Environment evaluated;
+	std::string evaluatedError;
+	evaluateStartupFile(evaluated, STARTUP_FILE, evaluatedError);
+	REQUIRE(evaluatedError == "");
+
+	REQUIRE(image.get_symbols() == evaluated.get_symbols());
+	for (auto& sym : evaluated.get_symbols()) {
+		INFO(sym);
+		REQUIRE(image.get_exp(Atom(sym)) == evaluated.get_exp(Atom(sym)));
+		if (image.get_exp(Atom(sym)).isHeadLambdaRoot()) {
+			REQUIRE(image.get_exp(Atom(sym)).profile() != nullptr);
+		}
+	}
+
+	INFO("a missing startup file is reported")
+	Environment missing;
+	std::string missingError;
+	evaluateStartupFile(missing, "/does/not/exist.pls", missingError);
+	REQUIRE(missingError == "Could not open startup file for reading.");
+}